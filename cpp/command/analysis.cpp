@@ -1,26 +1,98 @@
 #include "../core/global.h"
 #include "../core/config_parser.h"
+#include "../core/cooperativescheduler.h"
 #include "../core/timer.h"
 #include "../core/datetime.h"
 #include "../core/makedir.h"
+#include "../core/os.h"
+#include "../dataio/binaryjson.h"
 #include "../search/asyncbot.h"
 #include "../search/patternbonustable.h"
+#include "../search/searchthreadpool.h"
 #include "../program/setup.h"
 #include "../program/playutils.h"
 #include "../program/play.h"
 #include "../command/commandline.h"
+#include "../distributed/httplib_wrapper.h"
 #include "../main.h"
 
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+
 #include "../external/nlohmann_json/json.hpp"
 
+#ifdef OS_IS_WINDOWS
+  #include <fcntl.h>
+  #include <io.h>
+#endif
+#ifdef OS_IS_UNIX_OR_APPLE
+  #include <fcntl.h>
+  #include <poll.h>
+  #include <sys/socket.h>
+  #include <sys/stat.h>
+  #include <sys/un.h>
+  #include <unistd.h>
+#endif
+
 using namespace std;
 using json = nlohmann::json;
 
+//Where the responses to a stream of requests go. That's stdout when reading requests from stdin,
+//else each connection in -listen mode is a client with its own output.
+struct AnalysisClient {
+  const bool binaryProtocol;
+  //Terminate actions only apply to requests from clients in the same scope, so that clients can't interfere with each other
+  const int64_t terminateScope;
+  //Encoded messages to write. Made read-only once all input from this client has been handled
+  //and every request from it is done, so the writer knows when it's finished.
+  ThreadSafeQueue<string*> toWriteQueue;
+
+  AnalysisClient(bool binary, int64_t scope)
+    :binaryProtocol(binary),terminateScope(scope),toWriteQueue(),mutex(),numOpenRequests(0),inputFinished(false)
+  {}
+  ~AnalysisClient() {
+    toWriteQueue.setReadOnly();
+    string* message;
+    while(toWriteQueue.tryPop(message))
+      delete message;
+  }
+
+  void addOpenRequest() {
+    std::lock_guard<std::mutex> lock(mutex);
+    numOpenRequests++;
+  }
+  void removeOpenRequest() {
+    std::lock_guard<std::mutex> lock(mutex);
+    numOpenRequests--;
+    if(inputFinished && numOpenRequests <= 0)
+      toWriteQueue.setReadOnly();
+  }
+  void finishInput() {
+    std::lock_guard<std::mutex> lock(mutex);
+    inputFinished = true;
+    if(numOpenRequests <= 0)
+      toWriteQueue.setReadOnly();
+  }
+
+ private:
+  std::mutex mutex;
+  int64_t numOpenRequests;
+  bool inputFinished;
+};
+
 struct AnalyzeRequest {
+  //Responses for this request go here
+  std::shared_ptr<AnalysisClient> client;
   int64_t internalId;
   string id;
   int turnNumber;
   int64_t priority;
+  //Requests made from the same input line share this, and are successive positions of the same game
+  int64_t batchId;
+  //Requests may only continue each other's search trees if this is equal, since it covers all the ways
+  //that a request can change search parameters other than maxVisits
+  string searchSettingsKey;
 
   Board board;
   BoardHistory hist;
@@ -38,10 +110,26 @@ struct AnalyzeRequest {
 
   bool reportDuringSearch;
   double reportDuringSearchEvery;
+  //Reports during search after the first one only contain what changed, see makeDeltaReport
+  bool reportDuringSearchDeltas;
+  double deltaMinVisitsChange;
+  double deltaOwnershipQuantum;
 
   vector<int> avoidMoveUntilByLocBlack;
   vector<int> avoidMoveUntilByLocWhite;
 
+  //Visits already at the root when the search for this request started, carried over from an earlier request
+  int64_t reusedVisits;
+
+  //Evaluate the position with the neural net alone instead of searching it, see rawEvalLoop
+  bool rawEval;
+  //Symmetry to evaluate with if rawEval, or -1 to use the evaluator's default
+  int rawEvalSymmetry;
+
+  //The queue holds one reference. An analysis thread that claims the request directly out of openRequests
+  //to continue its own tree holds another, since the request is still in the queue.
+  std::atomic<int> numRefs;
+
   //Starts with STATUS_IN_QUEUE.
   //Thread that grabs it from queue it changes it to STATUS_POPPED
   //Once search is fully started thread sticks in its own thread index
@@ -53,6 +141,244 @@ struct AnalyzeRequest {
   std::atomic<int> status;
 };
 
+static void releaseRequest(AnalyzeRequest* request) {
+  if(request->numRefs.fetch_sub(1,std::memory_order_acq_rel) == 1) {
+    //Everything for it has been written by now
+    request->client->removeOpenRequest();
+    delete request;
+  }
+}
+
+//If hist is the same game as rootHist with zero or more moves played after it, appends those moves to moves and returns true.
+static bool getMovesFromRoot(const BoardHistory& rootHist, const BoardHistory& hist, vector<Move>& moves) {
+  if(!(rootHist.rules == hist.rules) ||
+     rootHist.initialPla != hist.initialPla ||
+     rootHist.initialBoard.pos_hash != hist.initialBoard.pos_hash ||
+     rootHist.moveHistory.size() > hist.moveHistory.size())
+    return false;
+  for(size_t i = 0; i<rootHist.moveHistory.size(); i++) {
+    if(rootHist.moveHistory[i].loc != hist.moveHistory[i].loc || rootHist.moveHistory[i].pla != hist.moveHistory[i].pla)
+      return false;
+  }
+  moves.insert(moves.end(), hist.moveHistory.begin() + rootHist.moveHistory.size(), hist.moveHistory.end());
+  return true;
+}
+
+//For reports during search in reportDuringSearchDeltas mode. clientView is what the client has from the reports so far, with deltas
+//applied to the first complete one, or null before the first. Replaces report with only what differs enough from clientView,
+//and updates clientView to match what the client will have after it:
+//- moveOrder lists every reported move in order, and moveInfos only has the moves that are new or whose visits changed by at least
+//  deltaMinVisitsChange times the root visits. The client's other moveInfos stay as they were, other than their order.
+//- Ownership maps are replaced by the indices of entries that changed by at least deltaOwnershipQuantum, and their new values rounded to
+//  multiples of it, as ownershipChangedIndices and ownershipChangedValues, and likewise for ownershipStdev.
+//- policy is left out if unchanged.
+//- isDelta is true.
+static void makeDeltaReport(json& report, json& clientView, double deltaMinVisitsChange, double deltaOwnershipQuantum) {
+  if(clientView.is_null()) {
+    clientView = report;
+    return;
+  }
+  json delta;
+  for(auto it = report.begin(); it != report.end(); ++it) {
+    if(it.key() != "moveInfos" && it.key() != "ownership" && it.key() != "ownershipStdev" && it.key() != "policy") {
+      delta[it.key()] = it.value();
+      clientView[it.key()] = it.value();
+    }
+  }
+  delta["isDelta"] = true;
+
+  if(report.find("moveInfos") != report.end()) {
+    int64_t rootVisits = report["rootInfo"]["visits"].get<int64_t>();
+    double minVisitsChange = std::max(1.0, deltaMinVisitsChange * (double)rootVisits);
+    std::map<string,json*> viewByMove;
+    json& viewMoveInfos = clientView["moveInfos"];
+    for(json& moveInfo: viewMoveInfos)
+      viewByMove[moveInfo["move"].get<string>()] = &moveInfo;
+    json moveOrder = json::array();
+    json changedMoveInfos = json::array();
+    json newViewMoveInfos = json::array();
+    for(json& moveInfo: report["moveInfos"]) {
+      moveOrder.push_back(moveInfo["move"]);
+      auto found = viewByMove.find(moveInfo["move"].get<string>());
+      if(found != viewByMove.end()) {
+        json& prev = *(found->second);
+        int64_t visitsChange = moveInfo["visits"].get<int64_t>() - prev["visits"].get<int64_t>();
+        if(std::abs((double)visitsChange) < minVisitsChange) {
+          prev["order"] = moveInfo["order"];
+          newViewMoveInfos.push_back(std::move(prev));
+          continue;
+        }
+      }
+      changedMoveInfos.push_back(moveInfo);
+      newViewMoveInfos.push_back(std::move(moveInfo));
+    }
+    delta["moveOrder"] = std::move(moveOrder);
+    delta["moveInfos"] = std::move(changedMoveInfos);
+    clientView["moveInfos"] = std::move(newViewMoveInfos);
+  }
+
+  for(const string& field: {string("ownership"), string("ownershipStdev")}) {
+    if(report.find(field) == report.end())
+      continue;
+    const json& values = report[field];
+    if(clientView.find(field) == clientView.end() || clientView[field].size() != values.size()) {
+      delta[field] = values;
+      clientView[field] = values;
+      continue;
+    }
+    json& viewValues = clientView[field];
+    json changedIndices = json::array();
+    json changedValues = json::array();
+    for(size_t i = 0; i<values.size(); i++) {
+      double value = values[i].get<double>();
+      if(std::fabs(value - viewValues[i].get<double>()) >= deltaOwnershipQuantum) {
+        double quantized = std::round(value / deltaOwnershipQuantum) * deltaOwnershipQuantum;
+        changedIndices.push_back(i);
+        changedValues.push_back(quantized);
+        viewValues[i] = quantized;
+      }
+    }
+    delta[field + "ChangedIndices"] = std::move(changedIndices);
+    delta[field + "ChangedValues"] = std::move(changedValues);
+  }
+
+  if(report.find("policy") != report.end() && clientView["policy"] != report["policy"]) {
+    delta["policy"] = report["policy"];
+    clientView["policy"] = report["policy"];
+  }
+  report = std::move(delta);
+}
+
+//Response for a rawEval request, from the raw neural net output for its position.
+//Values and ownership are from the perspective given in the same way as for searches, the policy is for nextPla.
+static json getRawEvalJson(const NNOutput& nnOutput, const Board& board, Player nextPla, Player perspective, bool includeOwnership) {
+  auto roundOutput = [](double x) { return std::round(x * 1000000.0) / 1000000.0; };
+  bool flip = perspective == P_BLACK || (perspective != P_WHITE && nextPla == P_BLACK);
+
+  double winrate = 0.5 * (1.0 + nnOutput.whiteWinProb - nnOutput.whiteLossProb);
+  double scoreMean = nnOutput.whiteScoreMean;
+  double lead = nnOutput.whiteLead;
+  double scoreStdev = sqrt(std::max(0.0, (double)nnOutput.whiteScoreMeanSq - scoreMean * scoreMean));
+  if(flip) {
+    winrate = 1.0 - winrate;
+    scoreMean = -scoreMean;
+    lead = -lead;
+  }
+
+  json ret;
+  json rawInfo;
+  rawInfo["winrate"] = roundOutput(winrate);
+  rawInfo["noResultProb"] = roundOutput(nnOutput.whiteNoResultProb);
+  rawInfo["scoreSelfplay"] = roundOutput(scoreMean);
+  rawInfo["scoreLead"] = roundOutput(lead);
+  rawInfo["scoreStdev"] = roundOutput(scoreStdev);
+  rawInfo["varTimeLeft"] = roundOutput(nnOutput.varTimeLeft);
+  rawInfo["shorttermWinlossError"] = roundOutput(nnOutput.shorttermWinlossError);
+  rawInfo["shorttermScoreError"] = roundOutput(nnOutput.shorttermScoreError);
+  rawInfo["currentPlayer"] = PlayerIO::playerToStringShort(nextPla);
+  ret["rawInfo"] = rawInfo;
+
+  //Same layout as includePolicy for searches, row by row then pass, negative for illegal moves
+  json policy = json::array();
+  for(int y = 0; y < board.y_size; y++) {
+    for(int x = 0; x < board.x_size; x++) {
+      int pos = NNPos::xyToPos(x, y, nnOutput.nnXLen);
+      policy.push_back(roundOutput(nnOutput.policyProbs[pos]));
+    }
+  }
+  int passPos = NNPos::locToPos(Board::PASS_LOC, board.x_size, nnOutput.nnXLen, nnOutput.nnYLen);
+  policy.push_back(roundOutput(nnOutput.policyProbs[passPos]));
+  ret["policy"] = policy;
+
+  if(includeOwnership && nnOutput.whiteOwnerMap != NULL) {
+    json ownership = json::array();
+    for(int y = 0; y < board.y_size; y++) {
+      for(int x = 0; x < board.x_size; x++) {
+        int pos = NNPos::xyToPos(x, y, nnOutput.nnXLen);
+        double o = nnOutput.whiteOwnerMap[pos];
+        ownership.push_back(roundOutput(flip ? -o : o));
+      }
+    }
+    ret["ownership"] = ownership;
+  }
+  return ret;
+}
+
+static std::atomic<bool> sigReceived(false);
+static void signalHandler(int signal)
+{
+  if(signal == SIGINT || signal == SIGTERM)
+    sigReceived.store(true);
+}
+
+#ifdef OS_IS_UNIX_OR_APPLE
+//Streams from a socket, so that requests can be read from a connection the same way as from stdin
+struct FdInputBuf final : public std::streambuf {
+  FdInputBuf(int f): fd(f) {}
+ protected:
+  int_type underflow() override {
+    if(gptr() < egptr())
+      return traits_type::to_int_type(*gptr());
+    ssize_t n;
+    do {
+      n = read(fd, buf, sizeof(buf));
+    } while(n < 0 && errno == EINTR);
+    if(n <= 0)
+      return traits_type::eof();
+    setg(buf, buf, buf + n);
+    return traits_type::to_int_type(*gptr());
+  }
+ private:
+  int fd;
+  char buf[65536];
+};
+
+static bool writeAllToFd(int fd, const string& data) {
+  size_t written = 0;
+  while(written < data.size()) {
+    ssize_t n = write(fd, data.data() + written, data.size() - written);
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n <= 0)
+      return false;
+    written += (size_t)n;
+  }
+  return true;
+}
+
+//Replaces a socket left over from an earlier run at path, but nothing else
+static int listenOnUnixSocket(const string& path) {
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if(path.size() >= sizeof(addr.sun_path))
+    throw StringError("Unix socket path is too long: " + path);
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+  struct stat st;
+  if(lstat(path.c_str(), &st) == 0) {
+    if(!S_ISSOCK(st.st_mode))
+      throw StringError("Cannot listen on " + path + ", it already exists and is not a socket");
+    unlink(path.c_str());
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd < 0)
+    throw StringError("Could not create unix socket for " + path + ": " + strerror(errno));
+  if(bind(fd, (const sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+    string error = strerror(errno);
+    close(fd);
+    throw StringError("Could not listen on unix socket " + path + ": " + error);
+  }
+  //Nonblocking, so that a connection dropped between poll and accept can't leave accept stuck past stopping
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+#endif
+
+//Whether host only accepts connections from this machine, since http serving has no authentication
+static bool isLoopbackHost(const string& host) {
+  return host == "localhost" || host == "::1" || Global::isPrefix(host,"127.");
+}
 
 int MainCmds::analysis(const vector<string>& args) {
   Board::initHash();
@@ -64,6 +390,9 @@ int MainCmds::analysis(const vector<string>& args) {
   bool numAnalysisThreadsCmdlineSpecified;
   int numAnalysisThreadsCmdline;
   bool quitWithoutWaiting;
+  bool binaryProtocol;
+  vector<string> listenUnixPaths;
+  vector<std::pair<string,int>> listenHttpAddresses;
 
   KataHexCommandLine cmd("Run KataHex parallel JSON-based analysis engine.");
   try {
@@ -74,14 +403,73 @@ int MainCmds::analysis(const vector<string>& args) {
 
     TCLAP::ValueArg<int> numAnalysisThreadsArg("","analysis-threads","Analyze up to this many positions in parallel. Equivalent to numAnalysisThreads in the config.",false,0,"THREADS");
     TCLAP::SwitchArg quitWithoutWaitingArg("","quit-without-waiting","When stdin is closed, quit quickly without waiting for queued tasks");
+    TCLAP::ValueArg<string> protocolArg(
+      "","protocol",
+      "json (default) for one json object per line, or msgpack for each request and response as a 4-byte little-endian length "
+      "followed by that many bytes of MessagePack, with the same fields as json. Arrays of floats in responses, "
+      "such as policy and ownership, are sent as MessagePack ext type 1 holding little-endian float32s, and may be sent that way in requests too.",
+      false,"json","PROTOCOL"
+    );
     cmd.add(numAnalysisThreadsArg);
     cmd.add(quitWithoutWaitingArg);
+    TCLAP::MultiArg<string> listenArg(
+      "","listen",
+      "Instead of stdin and stdout, serve any number of clients at once until interrupted, sharing the same neural net and request queue. "
+      "unix:PATH listens on a unix domain socket, where each connection speaks the same protocol as stdin and stdout, "
+      "with terminate actions applying to requests of the same connection. "
+      "HOST:PORT or just PORT listens for http, where the body of each POST to /analyze holds requests in the same protocol, and the response "
+      "streams back everything for those requests as a chunked body, ending once they are all done. HOST defaults to 127.0.0.1. "
+      "There is no authentication, so other hosts also need -listen-allow-remote. May be specified multiple times.",
+      false,"ADDRESS"
+    );
+    TCLAP::SwitchArg listenAllowRemoteArg(
+      "","listen-allow-remote",
+      "Allow -listen HOST:PORT on hosts other than loopback, letting anyone who can reach it use the engine"
+    );
+    cmd.add(protocolArg);
+    cmd.add(listenArg);
+    cmd.add(listenAllowRemoteArg);
     cmd.parseArgs(args);
 
     modelFile = cmd.getModelFile();
     numAnalysisThreadsCmdlineSpecified = numAnalysisThreadsArg.isSet();
     numAnalysisThreadsCmdline = numAnalysisThreadsArg.getValue();
     quitWithoutWaiting = quitWithoutWaitingArg.getValue();
+    string protocol = protocolArg.getValue();
+    if(protocol == "json")
+      binaryProtocol = false;
+    else if(protocol == "msgpack")
+      binaryProtocol = true;
+    else
+      throw StringError("-protocol must be json or msgpack");
+    for(const string& address: listenArg.getValue()) {
+      if(Global::isPrefix(address,"unix:")) {
+#ifdef OS_IS_UNIX_OR_APPLE
+        string path = Global::chopPrefix(address,"unix:");
+        if(path.size() <= 0)
+          throw StringError("-listen: empty unix socket path");
+        listenUnixPaths.push_back(path);
+#else
+        throw StringError("-listen: unix sockets are not supported on this platform");
+#endif
+      }
+      else {
+        size_t colon = address.rfind(':');
+        string host = colon == string::npos ? "" : address.substr(0,colon);
+        string portStr = colon == string::npos ? address : address.substr(colon+1);
+        int port;
+        if(!Global::tryStringToInt(portStr,port) || port <= 0 || port > 65535)
+          throw StringError("-listen: could not parse as unix:PATH, HOST:PORT, or PORT: " + address);
+        //IPv6 hosts are written in brackets so that the port can be told apart, but bound without them
+        if(host.size() >= 2 && host[0] == '[' && host[host.size()-1] == ']')
+          host = host.substr(1,host.size()-2);
+        if(host.size() <= 0)
+          host = "127.0.0.1";
+        if(!isLoopbackHost(host) && !listenAllowRemoteArg.getValue())
+          throw StringError("-listen: " + host + " is not a loopback address, and there is no authentication, specify -listen-allow-remote to allow this anyways");
+        listenHttpAddresses.push_back(std::make_pair(host,port));
+      }
+    }
 
     cmd.getConfig(cfg);
   }
@@ -129,6 +517,24 @@ int MainCmds::analysis(const vector<string>& args) {
   const bool logAllRequests = cfg.contains("logAllRequests") ? cfg.getBool("logAllRequests") : false;
   const bool logAllResponses = cfg.contains("logAllResponses") ? cfg.getBool("logAllResponses") : false;
   const bool logSearchInfo = cfg.contains("logSearchInfo") ? cfg.getBool("logSearchInfo") : false;
+  //Keep each analysis thread's search tree between requests, continue it for requests that are later positions of the same game,
+  //and prefer to hand such requests to the thread whose tree they continue. Off by default, since results then depend on
+  //what was searched before rather than only on the request.
+  const bool reuseTreeAcrossRequests = cfg.contains("reuseTreeAcrossRequests") ? cfg.getBool("reuseTreeAcrossRequests") : false;
+  //Rather than each analysis thread having its own search threads, all of them share numAnalysisThreads * numSearchThreadsPerAnalysisThread
+  //search threads, lent out to the highest priority requests being searched first. So one request alone can use all of them.
+  const bool shareSearchThreadsByPriority = cfg.contains("shareSearchThreadsByPriority") ? cfg.getBool("shareSearchThreadsByPriority") : false;
+  //Requests with rawEval are evaluated by these threads, separately from the analysis threads. Each one keeps up to
+  //numRawEvalsPerThread of them waiting on the neural net at once, so that a burst of them fills whole batches.
+  const int numRawEvalThreads = cfg.contains("numRawEvalThreads") ? cfg.getInt("numRawEvalThreads",1,1024) : 1;
+  const int numRawEvalsPerThread =
+    cfg.contains("numRawEvalsPerThread") ? cfg.getInt("numRawEvalsPerThread",1,4096) :
+    CooperativeScheduler::isSupported() ? 64 : 1;
+  //Each http response streams for as long as its requests are being analyzed and holds one http server thread meanwhile,
+  //so this bounds how many http clients can be served at once per -listen address. Past it, new ones get 503.
+  const int maxHttpClients = cfg.contains("maxHttpClients") ? cfg.getInt("maxHttpClients",1,4096) : 16;
+  if(numRawEvalsPerThread > 1 && !CooperativeScheduler::isSupported())
+    throw StringError("numRawEvalsPerThread > 1 is not supported on this platform");
 
   auto loadParams = [](ConfigParser& config, SearchParams& params, Player& perspective, Player defaultPerspective) {
     params = Setup::loadSingleParams(config,Setup::SETUP_FOR_ANALYSIS);
@@ -151,7 +557,8 @@ int MainCmds::analysis(const vector<string>& args) {
   NNEvaluator* nnEval;
   {
     Setup::initializeSession(cfg);
-    const int maxConcurrentEvals = numAnalysisThreads * defaultParams.numThreads * 2 + 16; // * 2 + 16 just to give plenty of headroom
+    const int maxConcurrentEvals =
+      numAnalysisThreads * defaultParams.numThreads * 2 + numRawEvalThreads * numRawEvalsPerThread + 16; // * 2 + 16 just to give plenty of headroom
     const int expectedConcurrentEvals = numAnalysisThreads * defaultParams.numThreads;
     const bool defaultRequireExactNNLen = false;
     const int defaultMaxBatchSize = -1;
@@ -180,6 +587,14 @@ int MainCmds::analysis(const vector<string>& args) {
   }
 #endif
 
+  std::unique_ptr<SearchThreadPool> searchThreadPool = nullptr;
+  if(shareSearchThreadsByPriority) {
+    searchThreadPool = std::make_unique<SearchThreadPool>(defaultParams.numThreads * numAnalysisThreads);
+    //Now the most that any one request may use
+    defaultParams.numThreads = searchThreadPool->getMaxTotalThreads();
+    logger.write("Sharing " + Global::intToString(searchThreadPool->getMaxTotalThreads()) + " search threads between requests by priority");
+  }
+
   //Check for unused config keys
   cfg.warnUnusedKeys(cerr,&logger);
 
@@ -187,52 +602,83 @@ int MainCmds::analysis(const vector<string>& args) {
   logger.write("Loaded model "+ modelFile);
   cmd.logOverrides(logger);
 
-  ThreadSafeQueue<string*> toWriteQueue;
-  auto writeLoop = [&toWriteQueue,&logAllResponses,&logger]() {
+#ifdef OS_IS_WINDOWS
+  if(binaryProtocol) {
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+  }
+#endif
+
+  //Requests from stdin are one client, as is each connection in -listen mode
+  std::shared_ptr<AnalysisClient> stdioClient = std::make_shared<AnalysisClient>(binaryProtocol, 0);
+  //Http is stateless, so all http requests share a scope, to be able to terminate each other
+  const int64_t httpTerminateScope = 1;
+  int64_t terminateScopeCounter = 2;
+
+  //Messages are already encoded for the protocol, including the newline for json, so the write thread only has to output them
+  auto writeLoop = [&stdioClient]() {
     while(true) {
       string* message;
-      bool suc = toWriteQueue.waitPop(message);
+      bool suc = stdioClient->toWriteQueue.waitPop(message);
       if(!suc)
         break;
-      cout << *message << endl;
-      if(logAllResponses)
-        logger.write("Response: " + *message);
+      cout.write(message->data(), message->size());
+      cout.flush();
       delete message;
     }
   };
 
-  auto pushToWrite = [&toWriteQueue](string* s) {
-    bool suc = toWriteQueue.forcePush(s);
+  //May modify ret
+  auto pushToWrite = [&logAllResponses,&logger](const std::shared_ptr<AnalysisClient>& client, json& ret) {
+    string* s;
+    if(client->binaryProtocol) {
+      if(logAllResponses)
+        logger.write("Response: " + ret.dump());
+      s = new string();
+      BinaryJson::encode(ret,*s);
+    }
+    else {
+      s = new string(ret.dump());
+      if(logAllResponses)
+        logger.write("Response: " + *s);
+      s->push_back('\n');
+    }
+    bool suc = client->toWriteQueue.forcePush(s);
     if(!suc)
       delete s;
   };
 
   ThreadSafePriorityQueue<std::pair<int64_t,int64_t>, AnalyzeRequest*> toAnalyzeQueue;
+  ThreadSafePriorityQueue<std::pair<int64_t,int64_t>, AnalyzeRequest*> toRawEvalQueue;
   int64_t numRequestsSoFar = 0; // Used as tie breaker for requests with same priority
   int64_t internalIdCounter = 0; // Counter for internalId on requests.
+  int64_t batchIdCounter = 0; // Counter for batchId on requests.
 
   //Open requests, keyed by internalId, mutexed by the mutex
   std::mutex openRequestsMutex;
   std::map<int64_t, AnalyzeRequest*> openRequests;
+  //(priority, internalId) of the open requests for search that may still be in the queue, also mutexed by openRequestsMutex.
+  //Entries for requests popped from the queue are pruned lazily by maxQueuedPriority, or when the request closes.
+  std::set<std::pair<int64_t,int64_t>> queuedPriorities;
 
-  auto reportError = [&pushToWrite](const string& s) {
+  auto reportError = [&pushToWrite](const std::shared_ptr<AnalysisClient>& client, const string& s) {
     json ret;
     ret["error"] = s;
-    pushToWrite(new string(ret.dump()));
+    pushToWrite(client, ret);
   };
-  auto reportErrorForId = [&pushToWrite](const string& id, const string& field, const string& s) {
+  auto reportErrorForId = [&pushToWrite](const std::shared_ptr<AnalysisClient>& client, const string& id, const string& field, const string& s) {
     json ret;
     ret["id"] = id;
     ret["field"] = field;
     ret["error"] = s;
-    pushToWrite(new string(ret.dump()));
+    pushToWrite(client, ret);
   };
-  auto reportWarningForId = [&pushToWrite](const string& id, const string& field, const string& s) {
+  auto reportWarningForId = [&pushToWrite](const std::shared_ptr<AnalysisClient>& client, const string& id, const string& field, const string& s) {
     json ret;
     ret["id"] = id;
     ret["field"] = field;
     ret["warning"] = s;
-    pushToWrite(new string(ret.dump()));
+    pushToWrite(client, ret);
   };
 
   //Report analysis for which we don't actually have results. This is used when something is user-terminated before being actually
@@ -243,16 +689,18 @@ int MainCmds::analysis(const vector<string>& args) {
     ret["turnNumber"] = request->turnNumber;
     ret["isDuringSearch"] = false;
     ret["noResults"] = true;
-    pushToWrite(new string(ret.dump()));
+    pushToWrite(request->client, ret);
   };
 
   //Returns false if no analysis was reportable due to there being no root node or search results.
-  auto reportAnalysis = [&pushToWrite](const AnalyzeRequest* request, const Search* search, bool isDuringSearch) {
+  //If deltaClientView is not NULL, reports only what changed from it, see makeDeltaReport
+  auto reportAnalysis = [&pushToWrite](const AnalyzeRequest* request, const Search* search, bool isDuringSearch, json* deltaClientView) {
     static constexpr int ownershipMinVisits = 3;
     json ret;
     ret["id"] = request->id;
     ret["turnNumber"] = request->turnNumber;
     ret["isDuringSearch"] = isDuringSearch;
+    ret["reusedVisits"] = request->reusedVisits;
 
     bool success = search->getAnalysisJson(
       request->perspective,
@@ -263,31 +711,189 @@ int MainCmds::analysis(const vector<string>& args) {
       ret
     );
 
-    if(success)
-      pushToWrite(new string(ret.dump()));
+    if(success) {
+      if(deltaClientView != NULL)
+        makeDeltaReport(ret, *deltaClientView, request->deltaMinVisitsChange, request->deltaOwnershipQuantum);
+      pushToWrite(request->client, ret);
+    }
     return success;
   };
 
+  std::atomic<int64_t> numRequestsReusingTree(0);
+  std::atomic<int64_t> numReusedVisitsTotal(0);
+
+  //Requests of one input line are consecutive in openRequests, in turn order, since internalIds are assigned in that order.
+  //The helpers below use this to route successive positions of a game to the thread already holding the tree for them.
+  //All must be called with openRequestsMutex held.
+
+  //Highest priority among requests that are still in the queue
+  auto maxQueuedPriority = [&openRequests,&queuedPriorities]() {
+    while(queuedPriorities.size() > 0) {
+      auto top = std::prev(queuedPriorities.end());
+      auto it = openRequests.find(top->second);
+      if(it != openRequests.end() && it->second->status.load(std::memory_order_acquire) == AnalyzeRequest::STATUS_IN_QUEUE)
+        return top->first;
+      queuedPriorities.erase(top);
+    }
+    return std::numeric_limits<int64_t>::min();
+  };
+  //Remove a request from openRequests, once it has been answered or dropped
+  auto closeOpenRequest = [&openRequests,&queuedPriorities](const AnalyzeRequest* request) {
+    openRequests.erase(request->internalId);
+    queuedPriorities.erase(std::make_pair(request->priority, request->internalId));
+  };
+  //Take a request directly out of openRequests, while it is still in the queue. Returns false if it was taken already.
+  auto claimOpenRequest = [](AnalyzeRequest* request) {
+    //Take our reference before claiming, so that the queue's reference being released cannot free it under us
+    request->numRefs.fetch_add(1,std::memory_order_acq_rel);
+    int expected = AnalyzeRequest::STATUS_IN_QUEUE;
+    if(!request->status.compare_exchange_strong(expected, AnalyzeRequest::STATUS_POPPED, std::memory_order_acq_rel)) {
+      releaseRequest(request);
+      return false;
+    }
+    return true;
+  };
+
+  //Claim the request for the next turn after the one this bot just searched, if it is still queued and nothing queued
+  //has a higher priority. Returns NULL if there is nothing to claim.
+  auto claimContinuation = [&openRequests,&maxQueuedPriority,&claimOpenRequest](AsyncBot* bot, int64_t lastInternalId, int64_t lastBatchId) -> AnalyzeRequest* {
+    auto it = openRequests.upper_bound(lastInternalId);
+    if(it == openRequests.end())
+      return NULL;
+    AnalyzeRequest* next = it->second;
+    if(next->batchId != lastBatchId || next->status.load(std::memory_order_acquire) != AnalyzeRequest::STATUS_IN_QUEUE)
+      return NULL;
+    if(next->priority < maxQueuedPriority())
+      return NULL;
+    vector<Move> moves;
+    if(!getMovesFromRoot(bot->getRootHist(), next->hist, moves))
+      return NULL;
+    if(!claimOpenRequest(next))
+      return NULL;
+    return next;
+  };
+
+  //request was just popped from the queue, but the thread searching the turn before it will want to continue on to it.
+  //So instead claim the middle of the run of queued turns starting at request, leaving the first half of the run to that thread.
+  //Returns the claimed request, or NULL if request should just be searched here.
+  auto claimSplitPoint = [&openRequests,&queuedPriorities,&claimOpenRequest](AnalyzeRequest* request) -> AnalyzeRequest* {
+    auto it = openRequests.find(request->internalId);
+    if(it == openRequests.end() || it == openRequests.begin())
+      return NULL;
+    AnalyzeRequest* prev = std::prev(it)->second;
+    int prevStatus = prev->status.load(std::memory_order_acquire);
+    if(prev->batchId != request->batchId || !(prevStatus == AnalyzeRequest::STATUS_POPPED || prevStatus >= 0))
+      return NULL;
+    vector<AnalyzeRequest*> run;
+    for(++it; it != openRequests.end(); ++it) {
+      AnalyzeRequest* r = it->second;
+      if(r->batchId != request->batchId || r->priority != request->priority ||
+         r->status.load(std::memory_order_acquire) != AnalyzeRequest::STATUS_IN_QUEUE)
+        break;
+      run.push_back(r);
+    }
+    //run excludes request itself, which is at the start of the full run
+    if(run.size() < 2)
+      return NULL;
+    AnalyzeRequest* mid = run[(run.size()-1)/2];
+    if(!claimOpenRequest(mid))
+      return NULL;
+    //request goes back to waiting in the queue in place of mid
+    queuedPriorities.insert(std::make_pair(request->priority, request->internalId));
+    return mid;
+  };
+
   auto analysisLoop = [
-    &logger,&toAnalyzeQueue,&reportAnalysis,&reportNoAnalysis,&logSearchInfo,&nnEval,&openRequestsMutex,&openRequests
+    &logger,&toAnalyzeQueue,&reportAnalysis,&reportNoAnalysis,&logSearchInfo,&nnEval,&openRequestsMutex,&closeOpenRequest,
+    &reuseTreeAcrossRequests,&claimContinuation,&claimSplitPoint,&numRequestsReusingTree,&numReusedVisitsTotal,&searchThreadPool
   ](AsyncBot* bot, int threadIdx) {
+    //The last request this bot searched, if its tree is still there
+    bool hasLastTree = false;
+    int64_t lastInternalId = -1;
+    int64_t lastBatchId = -1;
+    string lastSearchSettingsKey;
+    //A request we popped from the queue but gave up to another thread's tree, holding the queue's reference to it.
+    //It stays claimable out of openRequests, and if nobody has claimed it by the time we come back to it, we search it.
+    AnalyzeRequest* deferredRequest = NULL;
     while(true) {
-      std::pair<std::pair<int64_t,int64_t>,AnalyzeRequest*> analysisItem;
-      bool suc = toAnalyzeQueue.waitPop(analysisItem);
-      if(!suc)
-        break;
-      AnalyzeRequest* request = analysisItem.second;
-      int expected = AnalyzeRequest::STATUS_IN_QUEUE;
-      //If it's already terminated, then there's nothing for us to do
-      if(!request->status.compare_exchange_strong(expected, AnalyzeRequest::STATUS_POPPED, std::memory_order_acq_rel)) {
-        assert(expected == AnalyzeRequest::STATUS_TERMINATED);
+      AnalyzeRequest* request = NULL;
+      bool isFromQueue = false;
+      if(deferredRequest != NULL) {
+        request = deferredRequest;
+        deferredRequest = NULL;
+        isFromQueue = true;
       }
-      //Else, the request is live and we marked it as popped
-      else {
-        bot->setPosition(request->nextPla,request->board,request->hist);
+      else if(hasLastTree) {
+        std::lock_guard<std::mutex> lock(openRequestsMutex);
+        request = claimContinuation(bot, lastInternalId, lastBatchId);
+      }
+      bool canSplit = false;
+      if(request == NULL) {
+        std::pair<std::pair<int64_t,int64_t>,AnalyzeRequest*> analysisItem;
+        bool suc = toAnalyzeQueue.waitPop(analysisItem);
+        if(!suc)
+          break;
+        request = analysisItem.second;
+        isFromQueue = true;
+        canSplit = reuseTreeAcrossRequests;
+      }
+
+      if(isFromQueue) {
+        int expected = AnalyzeRequest::STATUS_IN_QUEUE;
+        //If it's already terminated, or another thread claimed it out of openRequests, then there's nothing for us to do
+        if(!request->status.compare_exchange_strong(expected, AnalyzeRequest::STATUS_POPPED, std::memory_order_acq_rel)) {
+          assert(expected == AnalyzeRequest::STATUS_TERMINATED || expected == AnalyzeRequest::STATUS_POPPED || expected >= 0);
+          if(expected == AnalyzeRequest::STATUS_TERMINATED) {
+            std::lock_guard<std::mutex> lock(openRequestsMutex);
+            closeOpenRequest(request);
+          }
+          releaseRequest(request);
+          continue;
+        }
+      }
+      if(canSplit) {
+        std::lock_guard<std::mutex> lock(openRequestsMutex);
+        //Terminating also happens under this mutex, so if it hasn't happened yet, it won't until we're done here
+        AnalyzeRequest* splitRequest = NULL;
+        if(request->status.load(std::memory_order_acquire) == AnalyzeRequest::STATUS_POPPED)
+          splitRequest = claimSplitPoint(request);
+        if(splitRequest != NULL) {
+          request->status.store(AnalyzeRequest::STATUS_IN_QUEUE, std::memory_order_release);
+          deferredRequest = request;
+          request = splitRequest;
+        }
+      }
+
+      //The request is live and we marked it as popped
+      {
+        bool reusingTree = false;
+        if(hasLastTree && lastSearchSettingsKey == request->searchSettingsKey) {
+          vector<Move> moves;
+          if(getMovesFromRoot(bot->getRootHist(), request->hist, moves)) {
+            reusingTree = true;
+            for(size_t i = 0; i<moves.size() && reusingTree; i++)
+              reusingTree = bot->makeMove(moves[i].loc, moves[i].pla);
+            if(reusingTree && bot->getSearch()->rootPla != request->nextPla)
+              reusingTree = false;
+          }
+        }
+        if(reusingTree) {
+          bot->setParamsNoClearing(request->params);
+        }
+        else {
+          bot->setPosition(request->nextPla,request->board,request->hist);
+          bot->setParams(request->params);
+        }
         bot->setAlwaysIncludeOwnerMap(request->includeOwnership || request->includeOwnershipStdev || request->includeMovesOwnership || request->includeMovesOwnershipStdev);
-        bot->setParams(request->params);
         bot->setAvoidMoveUntilByLoc(request->avoidMoveUntilByLocBlack,request->avoidMoveUntilByLocWhite);
+        if(searchThreadPool != nullptr)
+          bot->setSharedThreadPool(searchThreadPool.get(),request->priority);
+
+        request->reusedVisits = bot->getSearch()->getRootVisits();
+        if(request->reusedVisits > 0) {
+          numRequestsReusingTree.fetch_add(1,std::memory_order_relaxed);
+          numReusedVisitsTotal.fetch_add(request->reusedVisits,std::memory_order_relaxed);
+        }
 
         Player pla = request->nextPla;
         double searchFactor = 1.0;
@@ -304,9 +910,10 @@ int MainCmds::analysis(const vector<string>& args) {
         };
 
         if(request->reportDuringSearch) {
-          std::function<void(const Search* search)> callback = [&request,&reportAnalysis](const Search* search) {
+          json deltaClientView;
+          std::function<void(const Search* search)> callback = [&request,&reportAnalysis,&deltaClientView](const Search* search) {
             const bool isDuringSearch = true;
-            reportAnalysis(request,search,isDuringSearch);
+            reportAnalysis(request,search,isDuringSearch,request->reportDuringSearchDeltas ? &deltaClientView : NULL);
           };
           bot->genMoveSynchronousAnalyze(pla, TimeControls(), searchFactor, request->reportDuringSearchEvery, callback, onSearchBegun);
         }
@@ -323,7 +930,8 @@ int MainCmds::analysis(const vector<string>& args) {
         {
           const bool isDuringSearch = false;
           const Search* search = bot->getSearch();
-          bool analysisWritten = reportAnalysis(request,search,isDuringSearch);
+          //The final report is always complete
+          bool analysisWritten = reportAnalysis(request,search,isDuringSearch,NULL);
           //If the search didn't have any root or root neural net output, it must have been interrupted and we must be quitting imminently
           if(!analysisWritten) {
             //If the reason we stopped was because we noticed a terminate, then we will write out a dummy response even if we didn't have
@@ -337,15 +945,24 @@ int MainCmds::analysis(const vector<string>& args) {
         }
       }
 
-      //Free up bot resources in case it's a while before we do more search
-      bot->clearSearch();
+      //Keep the tree for a later request to continue, else free up bot resources in case it's a while before we do more search
+      if(reuseTreeAcrossRequests && request->status.load(std::memory_order_acquire) != AnalyzeRequest::STATUS_TERMINATED) {
+        hasLastTree = true;
+        lastInternalId = request->internalId;
+        lastBatchId = request->batchId;
+        lastSearchSettingsKey = request->searchSettingsKey;
+      }
+      else {
+        bot->clearSearch();
+        hasLastTree = false;
+      }
 
       //This request is no longer open
       {
         std::lock_guard<std::mutex> lock(openRequestsMutex);
-        openRequests.erase(request->internalId);
+        closeOpenRequest(request);
       }
-      delete request;
+      releaseRequest(request);
     }
   };
   auto analysisLoopProtected = [&logger,&analysisLoop](AsyncBot* bot, int threadIdx) {
@@ -363,717 +980,1140 @@ int MainCmds::analysis(const vector<string>& args) {
     bots.push_back(bot);
   }
 
+  //Wakers of the cooperative schedulers running raw evals, for when requests arrive while all their tasks are waiting for one
+  std::mutex rawEvalWakersMutex;
+  vector<CooperativeScheduler::Waker*> rawEvalWakers;
+  auto wakeRawEvalThreads = [&rawEvalWakersMutex,&rawEvalWakers]() {
+    std::lock_guard<std::mutex> lock(rawEvalWakersMutex);
+    for(CooperativeScheduler::Waker* waker: rawEvalWakers)
+      waker->wake();
+  };
+
+  //Returns false once the queue is read-only and empty
+  auto popRawEvalRequest = [&toRawEvalQueue](std::pair<std::pair<int64_t,int64_t>,AnalyzeRequest*>& item) {
+    while(true) {
+      //Let the other tasks on this thread keep evaluating meanwhile, if it's running them cooperatively
+      bool waitedCooperatively = CooperativeScheduler::waitIfCooperative([&toRawEvalQueue]() {
+        return toRawEvalQueue.size() > 0 || toRawEvalQueue.isReadOnly();
+      });
+      if(!waitedCooperatively)
+        return toRawEvalQueue.waitPop(item);
+      if(toRawEvalQueue.tryPop(item))
+        return true;
+      if(toRawEvalQueue.isReadOnly())
+        return false;
+    }
+  };
+
+  //Evaluate rawEval requests without a search. Many of these wait on the neural net at once, each with one row in
+  //the evaluator's batches, so that rows from across all pending requests are evaluated together.
+  auto rawEvalLoop = [&popRawEvalRequest,&nnEval,&pushToWrite,&openRequestsMutex,&closeOpenRequest]() {
+    NNResultBuf buf;
+    std::pair<std::pair<int64_t,int64_t>,AnalyzeRequest*> analysisItem;
+    while(popRawEvalRequest(analysisItem)) {
+      AnalyzeRequest* request = analysisItem.second;
+      int expected = AnalyzeRequest::STATUS_IN_QUEUE;
+      //If it was terminated while queued, that already reported it. Once popped, it's quick enough to just finish.
+      if(request->status.compare_exchange_strong(expected, AnalyzeRequest::STATUS_POPPED, std::memory_order_acq_rel)) {
+        const SearchParams& params = request->params;
+        MiscNNInputParams nnInputParams;
+        nnInputParams.drawEquivalentWinsForWhite = params.drawEquivalentWinsForWhite;
+        nnInputParams.nnPolicyTemperature = params.nnPolicyTemperature;
+        nnInputParams.playoutDoublingAdvantage =
+          (params.playoutDoublingAdvantagePla == C_EMPTY || params.playoutDoublingAdvantagePla == request->nextPla) ?
+          params.playoutDoublingAdvantage : -params.playoutDoublingAdvantage;
+        //A specific symmetry was asked for, so a cached result from any other one won't do
+        bool skipCache = false;
+        if(request->rawEvalSymmetry >= 0) {
+          nnInputParams.symmetry = request->rawEvalSymmetry;
+          skipCache = true;
+        }
+        Board board = request->board;
+        nnEval->evaluate(board,request->hist,request->nextPla,nnInputParams,buf,skipCache,request->includeOwnership);
+
+        json ret = getRawEvalJson(*(buf.result), request->board, request->nextPla, request->perspective, request->includeOwnership);
+        buf.result = nullptr;
+        ret["id"] = request->id;
+        ret["turnNumber"] = request->turnNumber;
+        ret["isDuringSearch"] = false;
+        pushToWrite(request->client, ret);
+      }
+      {
+        std::lock_guard<std::mutex> lock(openRequestsMutex);
+        closeOpenRequest(request);
+      }
+      releaseRequest(request);
+    }
+  };
+  auto rawEvalThreadLoop = [&logger,&rawEvalLoop,&rawEvalWakersMutex,&rawEvalWakers,numRawEvalsPerThread]() {
+    Logger::logThreadUncaught("raw eval", &logger, [&]() {
+      if(numRawEvalsPerThread <= 1) {
+        rawEvalLoop();
+        return;
+      }
+      vector<std::function<void()>> tasks;
+      for(int i = 0; i<numRawEvalsPerThread; i++) {
+        tasks.push_back([&,i]() {
+          if(i == 0) {
+            std::lock_guard<std::mutex> lock(rawEvalWakersMutex);
+            rawEvalWakers.push_back(CooperativeScheduler::getCurrentWaker());
+          }
+          rawEvalLoop();
+        });
+      }
+      //Raw evals need far less stack than a search, and only the pages actually used get committed anyways
+      const size_t stackBytesPerTask = 1024 * 1024;
+      CooperativeScheduler::run(tasks, stackBytesPerTask);
+    });
+  };
+  vector<std::thread> rawEvalThreads;
+  for(int i = 0; i<numRawEvalThreads; i++)
+    rawEvalThreads.push_back(std::thread(rawEvalThreadLoop));
+
+#ifndef USE_EIGEN_BACKEND
+  if(numRawEvalThreads * numRawEvalsPerThread < nnEval->getNumGpus() * nnEval->getMaxBatchSize())
+    logger.write(
+      Global::strprintf(
+        "Note: numRawEvalThreads * numRawEvalsPerThread (%d) is smaller than nnMaxBatchSize * number of GPUs (%d), so rawEval requests can't fill whole batches",
+        numRawEvalThreads * numRawEvalsPerThread, nnEval->getNumGpus() * nnEval->getMaxBatchSize()
+      )
+    );
+#endif
+
   logger.write("Analyzing up to " + Global::intToString(numAnalysisThreads) + " positions at at time in parallel");
   logger.write("Started, ready to begin handling requests");
   if(!logToStderr) {
     cerr << "Started, ready to begin handling requests" << endl;
   }
 
-  auto requestLoop = [&]() {
-    string line;
-    json input;
-    while(getline(cin,line)) {
-      line = Global::trim(line);
-      if(line.length() == 0)
-        continue;
+  //Must be called with openRequestsMutex held
+  auto terminateRequest = [&bots,&reportNoAnalysis](AnalyzeRequest* request) {
+    //Firstly, flag the request as terminated
+    int prevStatus = request->status.exchange(AnalyzeRequest::STATUS_TERMINATED,std::memory_order_acq_rel);
+    //Already terminated? Nothing to do.
+    if(prevStatus == AnalyzeRequest::STATUS_TERMINATED)
+    {}
+    //No thread claimed it, so it's up to us to write the result
+    else if(prevStatus == AnalyzeRequest::STATUS_IN_QUEUE) {
+      reportNoAnalysis(request);
+    }
+    //A thread popped it. That thread will notice that it's terminated once it tries to put its thread idx in, so we need not do anything.
+    else if(prevStatus == AnalyzeRequest::STATUS_POPPED)
+    {}
+    //A thread started searching it and put its thread idx in
+    else {
+      assert(prevStatus >= 0);
+      //We've already set the above status to terminated so when the thread terminates due to our killing it below, it will see this.
+      //Or else the thread has already done so, in which case it's already properly written a result, also fine.
+      int threadIdx = prevStatus;
+      //Terminate it by thread index
+      bots[threadIdx]->stopWithoutWait();
+    }
+  };
 
-      if(logAllRequests)
-        logger.write("Request: " + line);
+  //For a client that has gone away, so nobody will read the results. Must be called with openRequestsMutex held
+  auto terminateAllRequestsForClient = [&openRequests,&terminateRequest](const AnalysisClient* client) {
+    for(auto it = openRequests.begin(); it != openRequests.end(); ++it) {
+      if(it->second->client.get() == client)
+        terminateRequest(it->second);
+    }
+  };
 
-      try {
-        input = json::parse(line);
-      }
-      catch(nlohmann::detail::exception& e) {
-        reportError(e.what() + string(" - could not parse input line as json request: ") + line);
-        continue;
-      }
+  //Serializes handling input from all clients, which assigns ids and priorities in order
+  std::mutex requestInputMutex;
+  bool acceptingInput = true;
 
-      if(!input.is_object()) {
-        reportError("Request line was valid json but was not an object, ignoring: " + input.dump());
-        continue;
-      }
+  //Parse one request and queue up analysis for it, or perform its action
+  auto handleInput = [&](const std::shared_ptr<AnalysisClient>& client, json& input) {
+    std::lock_guard<std::mutex> inputLock(requestInputMutex);
+    if(!acceptingInput) {
+      reportError(client, "Shutting down, no longer accepting requests");
+      return;
+    }
 
-      if(input.find("id") == input.end() || !input["id"].is_string()) {
-        reportError("Request must have a string \"id\" field");
-        continue;
-      }
+    if(!input.is_object()) {
+      reportError(client, "Request line was valid json but was not an object, ignoring: " + input.dump());
+      return;
+    }
+
+    if(input.find("id") == input.end() || !input["id"].is_string()) {
+      reportError(client, "Request must have a string \"id\" field");
+      return;
+    }
+
+    AnalyzeRequest rbase;
+    rbase.id = input["id"].get<string>();
 
-      AnalyzeRequest rbase;
-      rbase.id = input["id"].get<string>();
+    //Special actions
+    if(input.find("action") != input.end() && input["action"].is_string()) {
+      string action = input["action"].get<string>();
+      if(action == "query_version") {
+        input["version"] = Version::getKataHexVersion();
+        input["git_hash"] = Version::getGitRevision();
+        pushToWrite(client, input);
+      }
+      else if(action == "clear_cache") {
+        //This should be thread-safe.
+        nnEval->clearCache();
+        pushToWrite(client, input);
+      }
+      else if(action == "terminate") {
 
-      //Special actions
-      if(input.find("action") != input.end() && input["action"].is_string()) {
-        string action = input["action"].get<string>();
-        if(action == "query_version") {
-          input["version"] = Version::getKataHexVersion();
-          input["git_hash"] = Version::getGitRevision();
-          pushToWrite(new string(input.dump()));
+        bool terminateIdFound = false;
+        string terminateId;
+        if(input.find("terminateId") != input.end() && input["terminateId"].is_string()) {
+          terminateId = input["terminateId"].get<string>();
+          terminateIdFound = true;
         }
-        else if(action == "clear_cache") {
-          //This should be thread-safe.
-          nnEval->clearCache();
-          pushToWrite(new string(input.dump()));
+        if(!terminateIdFound) {
+          reportErrorForId(client, rbase.id, "terminateId", "Requests for a terminate action must have a string \"terminateId\" field");
+          return;
         }
-        else if(action == "terminate") {
 
-          bool terminateIdFound = false;
-          string terminateId;
-          if(input.find("terminateId") != input.end() && input["terminateId"].is_string()) {
-            terminateId = input["terminateId"].get<string>();
-            terminateIdFound = true;
+        bool hasTurnNumbers = false;
+        vector<int> turnNumbers;
+        if(input.find("turnNumbers") != input.end()) {
+          try {
+            turnNumbers = input["turnNumbers"].get<vector<int> >();
+            hasTurnNumbers = true;
           }
-          if(!terminateIdFound) {
-            reportErrorForId(rbase.id, "terminateId", "Requests for a terminate action must have a string \"terminateId\" field");
-            continue;
+          catch(nlohmann::detail::exception&) {
+            reportErrorForId(client, rbase.id, "turnNumbers", "If provided, must be an array of integers indicating turns to terminate");
+            return;
           }
+        }
 
-          bool hasTurnNumbers = false;
-          vector<int> turnNumbers;
-          if(input.find("turnNumbers") != input.end()) {
-            try {
-              turnNumbers = input["turnNumbers"].get<vector<int> >();
-              hasTurnNumbers = true;
-            }
-            catch(nlohmann::detail::exception&) {
-              reportErrorForId(rbase.id, "turnNumbers", "If provided, must be an array of integers indicating turns to terminate");
-              continue;
-            }
+        {
+          std::lock_guard<std::mutex> lock(openRequestsMutex);
+          std::set<int> turnNumbersSet(turnNumbers.begin(),turnNumbers.end());
+          for(auto it = openRequests.begin(); it != openRequests.end(); ++it) {
+            AnalyzeRequest* request = it->second;
+            if(request->client->terminateScope == client->terminateScope && request->id == terminateId &&
+               (!hasTurnNumbers || (turnNumbersSet.find(request->turnNumber) != turnNumbersSet.end())))
+              terminateRequest(request);
           }
+        }
+        pushToWrite(client, input);
+      }
+      else {
+        reportError(client, "'action' field must be 'query_version' or 'terminate'");
+      }
 
-          auto terminateRequest = [&bots,&reportNoAnalysis](AnalyzeRequest* request) {
-            //Firstly, flag the request as terminated
-            int prevStatus = request->status.exchange(AnalyzeRequest::STATUS_TERMINATED,std::memory_order_acq_rel);
-            //Already terminated? Nothing to do.
-            if(prevStatus == AnalyzeRequest::STATUS_TERMINATED)
-            {}
-            //No thread claimed it, so it's up to us to write the result
-            else if(prevStatus == AnalyzeRequest::STATUS_IN_QUEUE) {
-              reportNoAnalysis(request);
-            }
-            //A thread popped it. That thread will notice that it's terminated once it tries to put its thread idx in, so we need not do anything.
-            else if(prevStatus == AnalyzeRequest::STATUS_POPPED)
-            {}
-            //A thread started searching it and put its thread idx in
-            else {
-              assert(prevStatus >= 0);
-              //We've already set the above status to terminated so when the thread terminates due to our killing it below, it will see this.
-              //Or else the thread has already done so, in which case it's already properly written a result, also fine.
-              int threadIdx = prevStatus;
-              //Terminate it by thread index
-              bots[threadIdx]->stopWithoutWait();
-            }
-          };
+      return;
+    }
 
-          {
-            std::lock_guard<std::mutex> lock(openRequestsMutex);
-            std::set<int> turnNumbersSet(turnNumbers.begin(),turnNumbers.end());
-            for(auto it = openRequests.begin(); it != openRequests.end(); ++it) {
-              AnalyzeRequest* request = it->second;
-              if(request->id == terminateId && (!hasTurnNumbers || (turnNumbersSet.find(request->turnNumber) != turnNumbersSet.end())))
-                terminateRequest(request);
-            }
-          }
-          pushToWrite(new string(input.dump()));
+    //Defaults
+    rbase.params = defaultParams;
+    rbase.perspective = defaultPerspective;
+    rbase.analysisPVLen = analysisPVLen;
+    rbase.includeOwnership = false;
+    rbase.includeOwnershipStdev = false;
+    rbase.includeMovesOwnership = false;
+    rbase.includeMovesOwnershipStdev = false;
+    rbase.includePolicy = false;
+    rbase.includePVVisits = false;
+    rbase.reportDuringSearch = false;
+    rbase.reportDuringSearchEvery = 1.0;
+    rbase.reportDuringSearchDeltas = false;
+    rbase.deltaMinVisitsChange = 0.01;
+    rbase.deltaOwnershipQuantum = 0.01;
+    rbase.priority = 0;
+    rbase.batchId = batchIdCounter++;
+    rbase.reusedVisits = 0;
+    rbase.rawEval = false;
+    rbase.rawEvalSymmetry = -1;
+    rbase.avoidMoveUntilByLocBlack.clear();
+    rbase.avoidMoveUntilByLocWhite.clear();
+
+    auto parseInteger = [&client,&rbase,&reportErrorForId](const json& dict, const char* field, int64_t& buf, int64_t min, int64_t max, const char* errorMessage) {
+      try {
+        if(!dict[field].is_number_integer()) {
+          reportErrorForId(client, rbase.id, field, errorMessage);
+          return false;
         }
-        else {
-          reportError("'action' field must be 'query_version' or 'terminate'");
+        int64_t x = dict[field].get<int64_t>();
+        if(x < min || x > max) {
+          reportErrorForId(client, rbase.id, field, errorMessage);
+          return false;
         }
+        buf = x;
+        return true;
+      }
+      catch(nlohmann::detail::exception& e) {
+        (void)e;
+        reportErrorForId(client, rbase.id, field, errorMessage);
+        return false;
+      }
+    };
 
-        continue;
+    auto parseDouble = [&client,&rbase,&reportErrorForId](const json& dict, const char* field, double& buf, double min, double max, const char* errorMessage) {
+      try {
+        if(!dict[field].is_number()) {
+          reportErrorForId(client, rbase.id, field, errorMessage);
+          return false;
+        }
+        double x = dict[field].get<double>();
+        if(!isfinite(x) || x < min || x > max) {
+          reportErrorForId(client, rbase.id, field, errorMessage);
+          return false;
+        }
+        buf = x;
+        return true;
+      }
+      catch(nlohmann::detail::exception& e) {
+        (void)e;
+        reportErrorForId(client, rbase.id, field, errorMessage);
+        return false;
+      }
+    };
+
+    auto parseBoolean = [&client,&rbase,&reportErrorForId](const json& dict, const char* field, bool& buf, const char* errorMessage) {
+      try {
+        if(!dict[field].is_boolean()) {
+          reportErrorForId(client, rbase.id, field, errorMessage);
+          return false;
+        }
+        buf = dict[field].get<bool>();
+        return true;
+      }
+      catch(nlohmann::detail::exception& e) {
+        (void)e;
+        reportErrorForId(client, rbase.id, field, errorMessage);
+        return false;
+      }
+    };
+
+    auto parsePlayer = [&client,&rbase,&reportErrorForId](const json& dict, const char* field, Player& buf) {
+      buf = C_EMPTY;
+      try {
+        string s = dict[field].get<string>();
+        PlayerIO::tryParsePlayer(s,buf);
+      }
+      catch(nlohmann::detail::exception&) {}
+      if(buf != P_BLACK && buf != P_WHITE) {
+        reportErrorForId(client, rbase.id, field, "Must be \"b\" or \"w\"");
+        return false;
+      }
+      return true;
+    };
+
+    int boardXSize;
+    int boardYSize;
+    {
+      int64_t xBuf;
+      int64_t yBuf;
+      static const string boardSizeError = string("Must provide an integer from 2 to ") + Global::intToString(Board::MAX_LEN);
+      if(input.find("boardXSize") == input.end()) {
+        reportErrorForId(client, rbase.id, "boardXSize", boardSizeError.c_str());
+        return;
+      }
+      if(input.find("boardYSize") == input.end()) {
+        reportErrorForId(client, rbase.id, "boardYSize", boardSizeError.c_str());
+        return;
+      }
+      if(!parseInteger(input, "boardXSize", xBuf, 2, Board::MAX_LEN, boardSizeError.c_str())) {
+        reportErrorForId(client, rbase.id, "boardXSize", boardSizeError.c_str());
+        return;
+      }
+      if(!parseInteger(input, "boardYSize", yBuf, 2, Board::MAX_LEN, boardSizeError.c_str())) {
+        reportErrorForId(client, rbase.id, "boardYSize", boardSizeError.c_str());
+        return;
       }
+      boardXSize = (int)xBuf;
+      boardYSize = (int)yBuf;
+    }
 
-      //Defaults
-      rbase.params = defaultParams;
-      rbase.perspective = defaultPerspective;
-      rbase.analysisPVLen = analysisPVLen;
-      rbase.includeOwnership = false;
-      rbase.includeOwnershipStdev = false;
-      rbase.includeMovesOwnership = false;
-      rbase.includeMovesOwnershipStdev = false;
-      rbase.includePolicy = false;
-      rbase.includePVVisits = false;
-      rbase.reportDuringSearch = false;
-      rbase.reportDuringSearchEvery = 1.0;
-      rbase.priority = 0;
-      rbase.avoidMoveUntilByLocBlack.clear();
-      rbase.avoidMoveUntilByLocWhite.clear();
-
-      auto parseInteger = [&rbase,&reportErrorForId](const json& dict, const char* field, int64_t& buf, int64_t min, int64_t max, const char* errorMessage) {
+    auto parseBoardLocs = [boardXSize,boardYSize,&client,&rbase,&reportErrorForId](const json& dict, const char* field, vector<Loc>& buf, bool allowPass) {
+      buf.clear();
+      if(!dict[field].is_array()) {
+        reportErrorForId(client, rbase.id, field, "Must be an array of GTP board vertices");
+        return false;
+      }
+      for(auto& elt : dict[field]) {
+        string s;
         try {
-          if(!dict[field].is_number_integer()) {
-            reportErrorForId(rbase.id, field, errorMessage);
-            return false;
-          }
-          int64_t x = dict[field].get<int64_t>();
-          if(x < min || x > max) {
-            reportErrorForId(rbase.id, field, errorMessage);
-            return false;
-          }
-          buf = x;
-          return true;
+          s = elt.get<string>();
         }
         catch(nlohmann::detail::exception& e) {
           (void)e;
-          reportErrorForId(rbase.id, field, errorMessage);
+          reportErrorForId(client, rbase.id, field, "Must be an array of GTP board vertices");
           return false;
         }
-      };
 
-      auto parseDouble = [&rbase,&reportErrorForId](const json& dict, const char* field, double& buf, double min, double max, const char* errorMessage) {
-        try {
-          if(!dict[field].is_number()) {
-            reportErrorForId(rbase.id, field, errorMessage);
-            return false;
-          }
-          double x = dict[field].get<double>();
-          if(!isfinite(x) || x < min || x > max) {
-            reportErrorForId(rbase.id, field, errorMessage);
-            return false;
-          }
-          buf = x;
-          return true;
+        Loc loc;
+        if(!Location::tryOfString(s, boardXSize, boardYSize, loc) ||
+           (!allowPass && loc == Board::PASS_LOC) ||
+           (loc == Board::NULL_LOC)) {
+          reportErrorForId(client, rbase.id, field, "Could not parse board location: " + s);
+          return false;
         }
-        catch(nlohmann::detail::exception& e) {
-          (void)e;
-          reportErrorForId(rbase.id, field, errorMessage);
+        buf.push_back(loc);
+      }
+      return true;
+    };
+
+    auto parseBoardMoves = [boardXSize,boardYSize,&client,&rbase,&reportErrorForId](const json& dict, const char* field, vector<Move>& buf, bool allowPass) {
+      buf.clear();
+      if(!dict[field].is_array()) {
+        reportErrorForId(client, rbase.id, field, "Must be an array of pairs of the form: [\"b\" or \"w\", GTP board vertex]");
+        return false;
+      }
+      for(auto& elt : dict[field]) {
+        if(!elt.is_array() || elt.size() != 2) {
+          reportErrorForId(client, rbase.id, field, "Must be an array of pairs of the form: [\"b\" or \"w\", GTP board vertex]");
           return false;
         }
-      };
 
-      auto parseBoolean = [&rbase,&reportErrorForId](const json& dict, const char* field, bool& buf, const char* errorMessage) {
+        string s0;
+        string s1;
         try {
-          if(!dict[field].is_boolean()) {
-            reportErrorForId(rbase.id, field, errorMessage);
-            return false;
-          }
-          buf = dict[field].get<bool>();
-          return true;
+          s0 = elt[0].get<string>();
+          s1 = elt[1].get<string>();
         }
         catch(nlohmann::detail::exception& e) {
           (void)e;
-          reportErrorForId(rbase.id, field, errorMessage);
+          reportErrorForId(client, rbase.id, field, "Must be an array of pairs of the form: [\"b\" or \"w\", GTP board vertex]");
           return false;
         }
-      };
 
-      auto parsePlayer = [&rbase,&reportErrorForId](const json& dict, const char* field, Player& buf) {
-        buf = C_EMPTY;
-        try {
-          string s = dict[field].get<string>();
-          PlayerIO::tryParsePlayer(s,buf);
-        }
-        catch(nlohmann::detail::exception&) {}
-        if(buf != P_BLACK && buf != P_WHITE) {
-          reportErrorForId(rbase.id, field, "Must be \"b\" or \"w\"");
+        Player pla;
+        if(!PlayerIO::tryParsePlayer(s0,pla)) {
+          reportErrorForId(client, rbase.id, field, "Could not parse player: " + s0);
           return false;
         }
-        return true;
-      };
 
-      int boardXSize;
-      int boardYSize;
-      {
-        int64_t xBuf;
-        int64_t yBuf;
-        static const string boardSizeError = string("Must provide an integer from 2 to ") + Global::intToString(Board::MAX_LEN);
-        if(input.find("boardXSize") == input.end()) {
-          reportErrorForId(rbase.id, "boardXSize", boardSizeError.c_str());
-          continue;
-        }
-        if(input.find("boardYSize") == input.end()) {
-          reportErrorForId(rbase.id, "boardYSize", boardSizeError.c_str());
-          continue;
-        }
-        if(!parseInteger(input, "boardXSize", xBuf, 2, Board::MAX_LEN, boardSizeError.c_str())) {
-          reportErrorForId(rbase.id, "boardXSize", boardSizeError.c_str());
-          continue;
-        }
-        if(!parseInteger(input, "boardYSize", yBuf, 2, Board::MAX_LEN, boardSizeError.c_str())) {
-          reportErrorForId(rbase.id, "boardYSize", boardSizeError.c_str());
-          continue;
+        Loc loc;
+        if(!Location::tryOfString(s1, boardXSize, boardYSize, loc) ||
+           (!allowPass && loc == Board::PASS_LOC) ||
+           (loc == Board::NULL_LOC)) {
+          reportErrorForId(client, rbase.id, field, "Could not parse board location: " + s1);
+          return false;
         }
-        boardXSize = (int)xBuf;
-        boardYSize = (int)yBuf;
+        buf.push_back(Move(loc,pla));
       }
+      return true;
+    };
 
-      auto parseBoardLocs = [boardXSize,boardYSize,&rbase,&reportErrorForId](const json& dict, const char* field, vector<Loc>& buf, bool allowPass) {
-        buf.clear();
-        if(!dict[field].is_array()) {
-          reportErrorForId(rbase.id, field, "Must be an array of GTP board vertices");
-          return false;
-        }
-        for(auto& elt : dict[field]) {
-          string s;
-          try {
-            s = elt.get<string>();
-          }
-          catch(nlohmann::detail::exception& e) {
-            (void)e;
-            reportErrorForId(rbase.id, field, "Must be an array of GTP board vertices");
-            return false;
-          }
-
-          Loc loc;
-          if(!Location::tryOfString(s, boardXSize, boardYSize, loc) ||
-             (!allowPass && loc == Board::PASS_LOC) ||
-             (loc == Board::NULL_LOC)) {
-            reportErrorForId(rbase.id, field, "Could not parse board location: " + s);
-            return false;
-          }
-          buf.push_back(loc);
-        }
-        return true;
-      };
-
-      auto parseBoardMoves = [boardXSize,boardYSize,&rbase,&reportErrorForId](const json& dict, const char* field, vector<Move>& buf, bool allowPass) {
-        buf.clear();
-        if(!dict[field].is_array()) {
-          reportErrorForId(rbase.id, field, "Must be an array of pairs of the form: [\"b\" or \"w\", GTP board vertex]");
-          return false;
-        }
-        for(auto& elt : dict[field]) {
-          if(!elt.is_array() || elt.size() != 2) {
-            reportErrorForId(rbase.id, field, "Must be an array of pairs of the form: [\"b\" or \"w\", GTP board vertex]");
-            return false;
-          }
-
-          string s0;
-          string s1;
-          try {
-            s0 = elt[0].get<string>();
-            s1 = elt[1].get<string>();
-          }
-          catch(nlohmann::detail::exception& e) {
-            (void)e;
-            reportErrorForId(rbase.id, field, "Must be an array of pairs of the form: [\"b\" or \"w\", GTP board vertex]");
-            return false;
-          }
+    vector<Move> placements;
+    if(input.find("initialStones") != input.end()) {
+      if(!parseBoardMoves(input, "initialStones", placements, false))
+        return;
+    }
+    vector<Move> moveHistory;
+    if(input.find("moves") != input.end()) {
+      if(!parseBoardMoves(input, "moves", moveHistory, true))
+        return;
+    }
+    else {
+      reportErrorForId(client, rbase.id, "moves", "Must specify an array of [player,location] pairs");
+      return;
+    }
+    Player initialPlayer = C_EMPTY;
+    if(input.find("initialPlayer") != input.end()) {
+      bool suc = parsePlayer(input, "initialPlayer", initialPlayer);
+      if(!suc)
+        return;
+    }
 
-          Player pla;
-          if(!PlayerIO::tryParsePlayer(s0,pla)) {
-            reportErrorForId(rbase.id, field, "Could not parse player: " + s0);
-            return false;
-          }
+    vector<bool> shouldAnalyze(moveHistory.size()+1,false);
+    if(input.find("analyzeTurns") != input.end()) {
+      vector<int> analyzeTurns;
+      try {
+        analyzeTurns = input["analyzeTurns"].get<vector<int> >();
+      }
+      catch(nlohmann::detail::exception&) {
+        reportErrorForId(client, rbase.id, "analyzeTurns", "Must specify an array of integers indicating turns to analyze");
+        return;
+      }
 
-          Loc loc;
-          if(!Location::tryOfString(s1, boardXSize, boardYSize, loc) ||
-             (!allowPass && loc == Board::PASS_LOC) ||
-             (loc == Board::NULL_LOC)) {
-            reportErrorForId(rbase.id, field, "Could not parse board location: " + s1);
-            return false;
-          }
-          buf.push_back(Move(loc,pla));
+      bool failed = false;
+      for(int i = 0; i<analyzeTurns.size(); i++) {
+        int turnNumber = analyzeTurns[i];
+        if(turnNumber < 0 || turnNumber >= shouldAnalyze.size()) {
+          reportErrorForId(client, rbase.id, "analyzeTurns", "Invalid turn number: " + Global::intToString(turnNumber));
+          failed = true;
+          break;
         }
-        return true;
-      };
+        shouldAnalyze[turnNumber] = true;
+      }
+      if(failed)
+        return;
+    }
+    else {
+      shouldAnalyze[shouldAnalyze.size()-1] = true;
+    }
 
-      vector<Move> placements;
-      if(input.find("initialStones") != input.end()) {
-        if(!parseBoardMoves(input, "initialStones", placements, false))
-          continue;
+    std::map<int,int64_t> priorities;
+    if(input.find("priorities") != input.end()) {
+      vector<int64_t> prioritiesVec;
+      try {
+        prioritiesVec = input["priorities"].get<vector<int64_t> >();
       }
-      vector<Move> moveHistory;
-      if(input.find("moves") != input.end()) {
-        if(!parseBoardMoves(input, "moves", moveHistory, true))
-          continue;
+      catch(nlohmann::detail::exception&) {
+        reportErrorForId(client, rbase.id, "priorities", "Must specify an array of integers indicating priorities");
+        return;
       }
-      else {
-        reportErrorForId(rbase.id, "moves", "Must specify an array of [player,location] pairs");
-        continue;
+      if(input.find("analyzeTurns") == input.end()) {
+        reportErrorForId(client, rbase.id, "priorities", "Can only specify when also specifying analyzeTurns");
+        return;
       }
-      Player initialPlayer = C_EMPTY;
-      if(input.find("initialPlayer") != input.end()) {
-        bool suc = parsePlayer(input, "initialPlayer", initialPlayer);
-        if(!suc)
-          continue;
+      vector<int> analyzeTurns = input["analyzeTurns"].get<vector<int> >();
+      if(prioritiesVec.size() != analyzeTurns.size()) {
+        reportErrorForId(client, rbase.id, "priorities", "Must be of matching length to analyzeTurns");
+        return;
       }
 
-      vector<bool> shouldAnalyze(moveHistory.size()+1,false);
-      if(input.find("analyzeTurns") != input.end()) {
-        vector<int> analyzeTurns;
-        try {
-          analyzeTurns = input["analyzeTurns"].get<vector<int> >();
-        }
-        catch(nlohmann::detail::exception&) {
-          reportErrorForId(rbase.id, "analyzeTurns", "Must specify an array of integers indicating turns to analyze");
-          continue;
+      bool failed = false;
+      for(int i = 0; i<prioritiesVec.size(); i++) {
+        int64_t priority = prioritiesVec[i];
+        if(priority < -0x3FFFffffFFFFffffLL || priority > 0x3FFFffffFFFFffffLL) {
+          reportErrorForId(client, rbase.id, "priorities", "Invalid priority: " + Global::int64ToString(priority));
+          failed = true;
+          break;
         }
+        priorities[analyzeTurns[i]] = priority;
+      }
+      if(failed) {
+        priorities.clear();
+        return;
+      }
+    }
 
-        bool failed = false;
-        for(int i = 0; i<analyzeTurns.size(); i++) {
-          int turnNumber = analyzeTurns[i];
-          if(turnNumber < 0 || turnNumber >= shouldAnalyze.size()) {
-            reportErrorForId(rbase.id, "analyzeTurns", "Invalid turn number: " + Global::intToString(turnNumber));
-            failed = true;
-            break;
-          }
-          shouldAnalyze[turnNumber] = true;
+
+    Rules rules;
+    if(input.find("rules") != input.end()) {
+      if(input["rules"].is_string()) {
+        string s = input["rules"].get<string>();
+        if(!Rules::tryParseRules(s,rules)) {
+          reportErrorForId(client, rbase.id, "rules", "Could not parse rules: " + s);
+          return;
+        }
+      }
+      else if(input["rules"].is_object()) {
+        string s = input["rules"].dump();
+        if(!Rules::tryParseRules(s,rules)) {
+          reportErrorForId(client, rbase.id, "rules", "Could not parse rules: " + s);
+          return;
         }
-        if(failed)
-          continue;
       }
       else {
-        shouldAnalyze[shouldAnalyze.size()-1] = true;
+        reportErrorForId(client, rbase.id, "rules", "Must specify rules string, such as \"chinese\" or \"tromp-taylor\", or a JSON object with detailed rules parameters.");
+        return;
       }
+    }
+    else {
+      reportErrorForId(client, rbase.id, "rules", "Must specify rules string, such as \"chinese\" or \"tromp-taylor\", or a JSON object with detailed rules parameters.");
+      return;
+    }
 
-      std::map<int,int64_t> priorities;
-      if(input.find("priorities") != input.end()) {
-        vector<int64_t> prioritiesVec;
-        try {
-          prioritiesVec = input["priorities"].get<vector<int64_t> >();
-        }
-        catch(nlohmann::detail::exception&) {
-          reportErrorForId(rbase.id, "priorities", "Must specify an array of integers indicating priorities");
-          continue;
-        }
-        if(input.find("analyzeTurns") == input.end()) {
-          reportErrorForId(rbase.id, "priorities", "Can only specify when also specifying analyzeTurns");
-          continue;
-        }
-        vector<int> analyzeTurns = input["analyzeTurns"].get<vector<int> >();
-        if(prioritiesVec.size() != analyzeTurns.size()) {
-          reportErrorForId(rbase.id, "priorities", "Must be of matching length to analyzeTurns");
-          continue;
-        }
+    if(input.find("komi") != input.end()) {
+      double komi;
+      static_assert(Rules::MIN_USER_KOMI == -150.0f, "");
+      static_assert(Rules::MAX_USER_KOMI == 150.0f, "");
+      const char* msg = "Must be a integer or half-integer from -150.0 to 150.0";
+      bool suc = parseDouble(input, "komi", komi, Rules::MIN_USER_KOMI, Rules::MAX_USER_KOMI, msg);
+      if(!suc)
+        return;
+      rules.komi = (float)komi;
+      if(!Rules::komiIsIntOrHalfInt(rules.komi)) {
+        reportErrorForId(client, rbase.id, "rules", msg);
+        return;
+      }
+    }
 
-        bool failed = false;
-        for(int i = 0; i<prioritiesVec.size(); i++) {
-          int64_t priority = prioritiesVec[i];
-          if(priority < -0x3FFFffffFFFFffffLL || priority > 0x3FFFffffFFFFffffLL) {
-            reportErrorForId(rbase.id, "priorities", "Invalid priority: " + Global::int64ToString(priority));
-            failed = true;
-            break;
+    if(input.find("overrideSettings") != input.end()) {
+      json settings = input["overrideSettings"];
+      if(!settings.is_object()) {
+        reportErrorForId(client, rbase.id, "overrideSettings", "Must be an object");
+        return;
+      }
+      std::map<string,string> overrideSettings;
+      for(auto it = settings.begin(); it != settings.end(); ++it) {
+        overrideSettings[it.key()] = it.value().is_string() ? it.value().get<string>(): it.value().dump(); // always convert to string
+      }
+
+      // Reload settings to allow overrides
+      if(!overrideSettings.empty()) {
+        try {
+          ConfigParser localCfg(cfg);
+          //Ignore any unused keys in the ORIGINAL config
+          localCfg.markAllKeysUsedWithPrefix("");
+          localCfg.overrideKeys(overrideSettings);
+          loadParams(localCfg, rbase.params, rbase.perspective, defaultPerspective);
+          //The config's numSearchThreads is per analysis thread, sharing lets requests use all of them unless they say otherwise
+          if(searchThreadPool != nullptr &&
+             overrideSettings.find("numSearchThreads") == overrideSettings.end() &&
+             overrideSettings.find("numSearchThreadsPerAnalysisThread") == overrideSettings.end())
+            rbase.params.numThreads = defaultParams.numThreads;
+          SearchParams::failIfParamsDifferOnUnchangeableParameter(defaultParams,rbase.params);
+          //Soft failure on unused override keys newly present in the config
+          vector<string> unusedKeys = localCfg.unusedKeys();
+          if(unusedKeys.size() > 0) {
+            reportWarningForId(client, rbase.id, "overrideSettings", string("Unknown config params: ") + Global::concat(unusedKeys,","));
           }
-          priorities[analyzeTurns[i]] = priority;
         }
-        if(failed) {
-          priorities.clear();
-          continue;
+        catch(const StringError& exception) {
+          reportErrorForId(client, rbase.id, "overrideSettings", string("Could not set settings: ") + exception.what());
+          return;
         }
       }
+    }
 
+    if(input.find("maxVisits") != input.end()) {
+      bool suc = parseInteger(input, "maxVisits", rbase.params.maxVisits, 1, (int64_t)1 << 50, "Must be an integer from 1 to 2^50");
+      if(!suc)
+        return;
+    }
 
-      Rules rules;
-      if(input.find("rules") != input.end()) {
-        if(input["rules"].is_string()) {
-          string s = input["rules"].get<string>();
-          if(!Rules::tryParseRules(s,rules)) {
-            reportErrorForId(rbase.id, "rules", "Could not parse rules: " + s);
-            continue;
-          }
-        }
-        else if(input["rules"].is_object()) {
-          string s = input["rules"].dump();
-          if(!Rules::tryParseRules(s,rules)) {
-            reportErrorForId(rbase.id, "rules", "Could not parse rules: " + s);
-            continue;
-          }
-        }
-        else {
-          reportErrorForId(rbase.id, "rules", "Must specify rules string, such as \"chinese\" or \"tromp-taylor\", or a JSON object with detailed rules parameters.");
-          continue;
-        }
+    if(input.find("analysisPVLen") != input.end()) {
+      int64_t buf;
+      bool suc = parseInteger(input, "analysisPVLen", buf, 1, 1000, "Must be an integer from 1 to 1000");
+      if(!suc)
+        return;
+      rbase.analysisPVLen = (int)buf;
+    }
+
+    if(input.find("rootFpuReductionMax") != input.end()) {
+      bool suc = parseDouble(input, "rootFpuReductionMax", rbase.params.rootFpuReductionMax, 0.0, 2.0, "Must be a number from 0.0 to 2.0");
+      if(!suc)
+        return;
+    }
+    if(input.find("rootPolicyTemperature") != input.end()) {
+      bool suc = parseDouble(input, "rootPolicyTemperature", rbase.params.rootPolicyTemperature, 0.01, 100.0, "Must be a number from 0.01 to 100.0");
+      if(!suc)
+        return;
+      rbase.params.rootPolicyTemperatureEarly = rbase.params.rootPolicyTemperature;
+    }
+    {
+      json settingsKey = json::object();
+      for(const char* field: {"overrideSettings","rootFpuReductionMax","rootPolicyTemperature"}) {
+        if(input.find(field) != input.end())
+          settingsKey[field] = input[field];
       }
-      else {
-        reportErrorForId(rbase.id, "rules", "Must specify rules string, such as \"chinese\" or \"tromp-taylor\", or a JSON object with detailed rules parameters.");
-        continue;
+      rbase.searchSettingsKey = settingsKey.dump();
+    }
+
+    if(input.find("includeMovesOwnership") != input.end()) {
+      bool suc = parseBoolean(input, "includeMovesOwnership", rbase.includeMovesOwnership, "Must be a boolean");
+      if(!suc)
+        return;
+    }
+    if(input.find("includeMovesOwnershipStdev") != input.end()) {
+      bool suc = parseBoolean(input, "includeMovesOwnershipStdev", rbase.includeMovesOwnershipStdev, "Must be a boolean");
+      if(!suc)
+        return;
+    }
+    if(input.find("includeOwnership") != input.end()) {
+      bool suc = parseBoolean(input, "includeOwnership", rbase.includeOwnership, "Must be a boolean");
+      if(!suc)
+        return;
+    }
+    if(input.find("includeOwnershipStdev") != input.end()) {
+      bool suc = parseBoolean(input, "includeOwnershipStdev", rbase.includeOwnershipStdev, "Must be a boolean");
+      if(!suc)
+        return;
+    }
+    if(input.find("includePolicy") != input.end()) {
+      bool suc = parseBoolean(input, "includePolicy", rbase.includePolicy, "Must be a boolean");
+      if(!suc)
+        return;
+    }
+    if(input.find("includePVVisits") != input.end()) {
+      bool suc = parseBoolean(input, "includePVVisits", rbase.includePVVisits, "Must be a boolean");
+      if(!suc)
+        return;
+    }
+    if(input.find("reportDuringSearchEvery") != input.end()) {
+      bool suc = parseDouble(input, "reportDuringSearchEvery", rbase.reportDuringSearchEvery, 0.001, 1000000.0, "Must be number of seconds from 0.001 to 1000000.0");
+      if(!suc)
+        return;
+      rbase.reportDuringSearch = true;
+    }
+    if(input.find("reportDuringSearchDeltas") != input.end()) {
+      bool suc = parseBoolean(input, "reportDuringSearchDeltas", rbase.reportDuringSearchDeltas, "Must be a boolean");
+      if(!suc)
+        return;
+    }
+    if(input.find("deltaMinVisitsChange") != input.end()) {
+      bool suc = parseDouble(input, "deltaMinVisitsChange", rbase.deltaMinVisitsChange, 0.0, 1.0, "Must be a number from 0.0 to 1.0");
+      if(!suc)
+        return;
+    }
+    if(input.find("deltaOwnershipQuantum") != input.end()) {
+      bool suc = parseDouble(input, "deltaOwnershipQuantum", rbase.deltaOwnershipQuantum, 0.0001, 2.0, "Must be a number from 0.0001 to 2.0");
+      if(!suc)
+        return;
+    }
+    if(input.find("rawEval") != input.end()) {
+      bool suc = parseBoolean(input, "rawEval", rbase.rawEval, "Must be a boolean");
+      if(!suc)
+        return;
+    }
+    if(input.find("rawEvalSymmetry") != input.end()) {
+      int64_t buf;
+      bool suc = parseInteger(input, "rawEvalSymmetry", buf, 0, SymmetryHelpers::NUM_SYMMETRIES-1, "Must be an integer from 0 to 7");
+      if(!suc)
+        return;
+      rbase.rawEvalSymmetry = (int)buf;
+    }
+    if(input.find("priority") != input.end()) {
+      if(input.find("priorities") != input.end()) {
+        reportErrorForId(client, rbase.id, "priority", "Cannot specify both priority and priorities");
+        return;
       }
+      int64_t buf;
+      bool suc = parseInteger(input, "priority", buf, -0x3FFFffffFFFFffffLL,0x3FFFffffFFFFffffLL, "Must be a number between -2^62 and 2^62");
+      if(!suc)
+        return;
+      rbase.priority = buf;
+    }
 
-      if(input.find("komi") != input.end()) {
-        double komi;
-        static_assert(Rules::MIN_USER_KOMI == -150.0f, "");
-        static_assert(Rules::MAX_USER_KOMI == 150.0f, "");
-        const char* msg = "Must be a integer or half-integer from -150.0 to 150.0";
-        bool suc = parseDouble(input, "komi", komi, Rules::MIN_USER_KOMI, Rules::MAX_USER_KOMI, msg);
-        if(!suc)
-          continue;
-        rules.komi = (float)komi;
-        if(!Rules::komiIsIntOrHalfInt(rules.komi)) {
-          reportErrorForId(rbase.id, "rules", msg);
-          continue;
-        }
+    bool hasAllowMoves = input.find("allowMoves") != input.end();
+    bool hasAvoidMoves = input.find("avoidMoves") != input.end();
+    if(hasAllowMoves || hasAvoidMoves) {
+      if(hasAllowMoves && hasAvoidMoves) {
+        reportErrorForId(client, rbase.id, "allowMoves", string("Cannot specify both allowMoves and avoidMoves"));
+        return;
+      }
+      string field = hasAllowMoves ? "allowMoves" : "avoidMoves";
+      json& avoidParamsList = input[field];
+      if(!avoidParamsList.is_array()) {
+        reportErrorForId(client, rbase.id, field, string("Must be a list of dicts with subfields 'player', 'moves', 'untilDepth'"));
+        return;
+      }
+      if(hasAllowMoves && avoidParamsList.size() > 1) {
+        reportErrorForId(client, rbase.id, field, string("Currently allowMoves only allows one entry"));
+        return;
       }
 
-      if(input.find("overrideSettings") != input.end()) {
-        json settings = input["overrideSettings"];
-        if(!settings.is_object()) {
-          reportErrorForId(rbase.id, "overrideSettings", "Must be an object");
-          continue;
-        }
-        std::map<string,string> overrideSettings;
-        for(auto it = settings.begin(); it != settings.end(); ++it) {
-          overrideSettings[it.key()] = it.value().is_string() ? it.value().get<string>(): it.value().dump(); // always convert to string
+      bool failed = false;
+      for(size_t i = 0; i<avoidParamsList.size(); i++) {
+        json& avoidParams = avoidParamsList[i];
+        if(avoidParams.find("moves") == avoidParams.end() ||
+           avoidParams.find("untilDepth") == avoidParams.end() ||
+           avoidParams.find("player") == avoidParams.end()) {
+          reportErrorForId(client, rbase.id, field, string("Must be a list of dicts with subfields 'player', 'moves', 'untilDepth'"));
+          failed = true;
+          break;
         }
 
-        // Reload settings to allow overrides
-        if(!overrideSettings.empty()) {
-          try {
-            ConfigParser localCfg(cfg);
-            //Ignore any unused keys in the ORIGINAL config
-            localCfg.markAllKeysUsedWithPrefix("");
-            localCfg.overrideKeys(overrideSettings);
-            loadParams(localCfg, rbase.params, rbase.perspective, defaultPerspective);
-            SearchParams::failIfParamsDifferOnUnchangeableParameter(defaultParams,rbase.params);
-            //Soft failure on unused override keys newly present in the config
-            vector<string> unusedKeys = localCfg.unusedKeys();
-            if(unusedKeys.size() > 0) {
-              reportWarningForId(rbase.id, "overrideSettings", string("Unknown config params: ") + Global::concat(unusedKeys,","));
-            }
+        Player avoidPla;
+        vector<Loc> parsedLocs;
+        int64_t untilDepth;
+        bool suc;
+        suc = parsePlayer(avoidParams, "player", avoidPla);
+        if(!suc) { failed = true; break; }
+        suc = parseBoardLocs(avoidParams, "moves", parsedLocs, true);
+        if(!suc) { failed = true; break; }
+        suc = parseInteger(avoidParams, "untilDepth", untilDepth, 1, 1000000000, "Must be a positive integer");
+        if(!suc) { failed = true; break; }
+
+        vector<int>& avoidMoveUntilByLoc = avoidPla == P_BLACK ? rbase.avoidMoveUntilByLocBlack : rbase.avoidMoveUntilByLocWhite;
+        avoidMoveUntilByLoc.resize(Board::MAX_ARR_SIZE);
+        if(hasAllowMoves) {
+          std::fill(avoidMoveUntilByLoc.begin(),avoidMoveUntilByLoc.end(),(int)untilDepth);
+          for(Loc loc: parsedLocs) {
+            avoidMoveUntilByLoc[loc] = 0;
           }
-          catch(const StringError& exception) {
-            reportErrorForId(rbase.id, "overrideSettings", string("Could not set settings: ") + exception.what());
-            continue;
+        }
+        else {
+          for(Loc loc: parsedLocs) {
+            avoidMoveUntilByLoc[loc] = (int)untilDepth;
           }
         }
       }
+      if(failed)
+        return;
+    }
 
-      if(input.find("maxVisits") != input.end()) {
-        bool suc = parseInteger(input, "maxVisits", rbase.params.maxVisits, 1, (int64_t)1 << 50, "Must be an integer from 1 to 2^50");
-        if(!suc)
-          continue;
-      }
 
-      if(input.find("analysisPVLen") != input.end()) {
-        int64_t buf;
-        bool suc = parseInteger(input, "analysisPVLen", buf, 1, 1000, "Must be an integer from 1 to 1000");
-        if(!suc)
-          continue;
-        rbase.analysisPVLen = (int)buf;
-      }
+    Board board(boardXSize,boardYSize);
+    for(int i = 0; i<placements.size(); i++) {
+      board.setStone(placements[i].loc,placements[i].pla);
+    }
 
-      if(input.find("rootFpuReductionMax") != input.end()) {
-        bool suc = parseDouble(input, "rootFpuReductionMax", rbase.params.rootFpuReductionMax, 0.0, 2.0, "Must be a number from 0.0 to 2.0");
-        if(!suc)
-          continue;
-      }
-      if(input.find("rootPolicyTemperature") != input.end()) {
-        bool suc = parseDouble(input, "rootPolicyTemperature", rbase.params.rootPolicyTemperature, 0.01, 100.0, "Must be a number from 0.01 to 100.0");
-        if(!suc)
-          continue;
-        rbase.params.rootPolicyTemperatureEarly = rbase.params.rootPolicyTemperature;
-      }
-      if(input.find("includeMovesOwnership") != input.end()) {
-        bool suc = parseBoolean(input, "includeMovesOwnership", rbase.includeMovesOwnership, "Must be a boolean");
-        if(!suc)
-          continue;
-      }
-      if(input.find("includeMovesOwnershipStdev") != input.end()) {
-        bool suc = parseBoolean(input, "includeMovesOwnershipStdev", rbase.includeMovesOwnershipStdev, "Must be a boolean");
-        if(!suc)
-          continue;
-      }
-      if(input.find("includeOwnership") != input.end()) {
-        bool suc = parseBoolean(input, "includeOwnership", rbase.includeOwnership, "Must be a boolean");
-        if(!suc)
-          continue;
-      }
-      if(input.find("includeOwnershipStdev") != input.end()) {
-        bool suc = parseBoolean(input, "includeOwnershipStdev", rbase.includeOwnershipStdev, "Must be a boolean");
-        if(!suc)
-          continue;
-      }
-      if(input.find("includePolicy") != input.end()) {
-        bool suc = parseBoolean(input, "includePolicy", rbase.includePolicy, "Must be a boolean");
-        if(!suc)
-          continue;
+    if(initialPlayer == C_EMPTY) {
+      if(moveHistory.size() > 0)
+        initialPlayer = moveHistory[0].pla;
+      else
+        initialPlayer = P_BLACK;
+    }
+
+    bool rulesWereSupported;
+    Rules supportedRules = nnEval->getSupportedRules(rules,rulesWereSupported);
+    if(!rulesWereSupported) {
+      ostringstream out;
+      out << "Rules " << rules << " not supported by neural net, using " << supportedRules << " instead";
+      reportWarningForId(client, rbase.id, "rules", out.str());
+      rules = supportedRules;
+    }
+
+    Player nextPla = initialPlayer;
+    BoardHistory hist(board,nextPla,rules);
+
+    //Build and enqueue requests
+    vector<AnalyzeRequest*> newRequests;
+    bool foundIllegalMove =  false;
+    for(int turnNumber = 0; turnNumber <= moveHistory.size(); turnNumber++) {
+      if(shouldAnalyze[turnNumber]) {
+        int64_t priority = rbase.priority;
+        if(priorities.size() > 0) {
+          assert(priorities.size() > newRequests.size());
+          assert(priorities.find(turnNumber) != priorities.end());
+          priority = priorities[turnNumber];
+        }
+
+        AnalyzeRequest* newRequest = new AnalyzeRequest();
+        newRequest->client = client;
+        newRequest->internalId = internalIdCounter++;
+        newRequest->id = rbase.id;
+        newRequest->turnNumber = turnNumber;
+        newRequest->board = board;
+        newRequest->hist = hist;
+        newRequest->nextPla = nextPla;
+        newRequest->params = rbase.params;
+        newRequest->perspective = rbase.perspective;
+        newRequest->analysisPVLen = rbase.analysisPVLen;
+        newRequest->includeOwnership = rbase.includeOwnership;
+        newRequest->includeOwnershipStdev = rbase.includeOwnershipStdev;
+        newRequest->includeMovesOwnership = rbase.includeMovesOwnership;
+        newRequest->includeMovesOwnershipStdev = rbase.includeMovesOwnershipStdev;
+        newRequest->includePolicy = rbase.includePolicy;
+        newRequest->includePVVisits = rbase.includePVVisits;
+        newRequest->reportDuringSearch = rbase.reportDuringSearch;
+        newRequest->reportDuringSearchEvery = rbase.reportDuringSearchEvery;
+        newRequest->reportDuringSearchDeltas = rbase.reportDuringSearchDeltas;
+        newRequest->deltaMinVisitsChange = rbase.deltaMinVisitsChange;
+        newRequest->deltaOwnershipQuantum = rbase.deltaOwnershipQuantum;
+        newRequest->priority = priority;
+        newRequest->batchId = rbase.batchId;
+        newRequest->searchSettingsKey = rbase.searchSettingsKey;
+        newRequest->reusedVisits = 0;
+        newRequest->rawEval = rbase.rawEval;
+        newRequest->rawEvalSymmetry = rbase.rawEvalSymmetry;
+        newRequest->numRefs.store(1,std::memory_order_release);
+        newRequest->avoidMoveUntilByLocBlack = rbase.avoidMoveUntilByLocBlack;
+        newRequest->avoidMoveUntilByLocWhite = rbase.avoidMoveUntilByLocWhite;
+        newRequest->status.store(AnalyzeRequest::STATUS_IN_QUEUE,std::memory_order_release);
+        newRequests.push_back(newRequest);
       }
-      if(input.find("includePVVisits") != input.end()) {
-        bool suc = parseBoolean(input, "includePVVisits", rbase.includePVVisits, "Must be a boolean");
-        if(!suc)
-          continue;
+      if(turnNumber >= moveHistory.size())
+        break;
+
+      Player movePla = moveHistory[turnNumber].pla;
+      Loc moveLoc = moveHistory[turnNumber].loc;
+      if(movePla != nextPla) {
+        hist.clear(board,movePla,rules);
       }
-      if(input.find("reportDuringSearchEvery") != input.end()) {
-        bool suc = parseDouble(input, "reportDuringSearchEvery", rbase.reportDuringSearchEvery, 0.001, 1000000.0, "Must be number of seconds from 0.001 to 1000000.0");
-        if(!suc)
-          continue;
-        rbase.reportDuringSearch = true;
+
+      bool suc = hist.makeBoardMoveTolerant(board,moveLoc,movePla);
+      if(!suc) {
+        reportErrorForId(client, rbase.id, "moves", "Illegal move " + Global::intToString(turnNumber) + ": " + Location::toString(moveLoc,board));
+        foundIllegalMove = true;
+        break;
       }
-      if(input.find("priority") != input.end()) {
-        if(input.find("priorities") != input.end()) {
-          reportErrorForId(rbase.id, "priority", "Cannot specify both priority and priorities");
-          continue;
-        }
-        int64_t buf;
-        bool suc = parseInteger(input, "priority", buf, -0x3FFFffffFFFFffffLL,0x3FFFffffFFFFffffLL, "Must be a number between -2^62 and 2^62");
-        if(!suc)
-          continue;
-        rbase.priority = buf;
+      nextPla = getOpp(movePla);
+    }
+
+    if(foundIllegalMove) {
+      for(int i = 0; i<newRequests.size(); i++)
+        delete newRequests[i];
+      newRequests.clear();
+      return;
+    }
+
+    //Add all requests to open requests
+    {
+      std::lock_guard<std::mutex> lock(openRequestsMutex);
+      for(int i = 0; i<newRequests.size(); i++) {
+        openRequests[newRequests[i]->internalId] = newRequests[i];
+        if(!newRequests[i]->rawEval)
+          queuedPriorities.insert(std::make_pair(newRequests[i]->priority, newRequests[i]->internalId));
+        client->addOpenRequest();
       }
+    }
+    //Push into queue for processing
+    for(int i = 0; i<newRequests.size(); i++) {
+      //Compare first by user-provided priority, and next breaks ties by preferring earlier requests.
+      std::pair<int64_t,int64_t> priorityKey = std::make_pair(newRequests[i]->priority, -numRequestsSoFar);
+      ThreadSafePriorityQueue<std::pair<int64_t,int64_t>, AnalyzeRequest*>& queue = newRequests[i]->rawEval ? toRawEvalQueue : toAnalyzeQueue;
+      bool suc = queue.forcePush( std::make_pair(priorityKey, newRequests[i]) );
+      assert(suc);
+      (void)suc;
+      numRequestsSoFar++;
+    }
+    if(rbase.rawEval)
+      wakeRawEvalThreads();
+    newRequests.clear();
+  };
 
-      bool hasAllowMoves = input.find("allowMoves") != input.end();
-      bool hasAvoidMoves = input.find("avoidMoves") != input.end();
-      if(hasAllowMoves || hasAvoidMoves) {
-        if(hasAllowMoves && hasAvoidMoves) {
-          reportErrorForId(rbase.id, "allowMoves", string("Cannot specify both allowMoves and avoidMoves"));
-          continue;
+  //Read requests until the end of in, in the protocol of the client
+  auto readRequests = [&](std::istream& in, const std::shared_ptr<AnalysisClient>& client) {
+    string line;
+    json input;
+    while(true) {
+      if(client->binaryProtocol) {
+        try {
+          if(!BinaryJson::readFrame(in,line))
+            break;
+        }
+        //Can't find where the next message starts, so nothing more can be read
+        catch(const IOError& e) {
+          reportError(client, e.what());
+          break;
         }
-        string field = hasAllowMoves ? "allowMoves" : "avoidMoves";
-        json& avoidParamsList = input[field];
-        if(!avoidParamsList.is_array()) {
-          reportErrorForId(rbase.id, field, string("Must be a list of dicts with subfields 'player', 'moves', 'untilDepth'"));
+        try {
+          input = BinaryJson::decode(line);
+        }
+        catch(const StringError& e) {
+          reportError(client, e.what() + string(" - could not decode input message"));
           continue;
         }
-        if(hasAllowMoves && avoidParamsList.size() > 1) {
-          reportErrorForId(rbase.id, field, string("Currently allowMoves only allows one entry"));
+        catch(nlohmann::detail::exception& e) {
+          reportError(client, e.what() + string(" - could not decode input message as msgpack request"));
           continue;
         }
+        if(logAllRequests)
+          logger.write("Request: " + input.dump());
+      }
+      else {
+        if(!getline(in,line))
+          break;
+        line = Global::trim(line);
+        if(line.length() == 0)
+          continue;
 
-        bool failed = false;
-        for(size_t i = 0; i<avoidParamsList.size(); i++) {
-          json& avoidParams = avoidParamsList[i];
-          if(avoidParams.find("moves") == avoidParams.end() ||
-             avoidParams.find("untilDepth") == avoidParams.end() ||
-             avoidParams.find("player") == avoidParams.end()) {
-            reportErrorForId(rbase.id, field, string("Must be a list of dicts with subfields 'player', 'moves', 'untilDepth'"));
-            failed = true;
-            break;
-          }
+        if(logAllRequests)
+          logger.write("Request: " + line);
 
-          Player avoidPla;
-          vector<Loc> parsedLocs;
-          int64_t untilDepth;
-          bool suc;
-          suc = parsePlayer(avoidParams, "player", avoidPla);
-          if(!suc) { failed = true; break; }
-          suc = parseBoardLocs(avoidParams, "moves", parsedLocs, true);
-          if(!suc) { failed = true; break; }
-          suc = parseInteger(avoidParams, "untilDepth", untilDepth, 1, 1000000000, "Must be a positive integer");
-          if(!suc) { failed = true; break; }
-
-          vector<int>& avoidMoveUntilByLoc = avoidPla == P_BLACK ? rbase.avoidMoveUntilByLocBlack : rbase.avoidMoveUntilByLocWhite;
-          avoidMoveUntilByLoc.resize(Board::MAX_ARR_SIZE);
-          if(hasAllowMoves) {
-            std::fill(avoidMoveUntilByLoc.begin(),avoidMoveUntilByLoc.end(),(int)untilDepth);
-            for(Loc loc: parsedLocs) {
-              avoidMoveUntilByLoc[loc] = 0;
-            }
-          }
-          else {
-            for(Loc loc: parsedLocs) {
-              avoidMoveUntilByLoc[loc] = (int)untilDepth;
-            }
-          }
+        try {
+          input = json::parse(line);
         }
-        if(failed)
+        catch(nlohmann::detail::exception& e) {
+          reportError(client, e.what() + string(" - could not parse input line as json request: ") + line);
           continue;
+        }
       }
+      handleInput(client, input);
+    }
+    client->finishInput();
+  };
 
-
-      Board board(boardXSize,boardYSize);
-      for(int i = 0; i<placements.size(); i++) {
-        board.setStone(placements[i].loc,placements[i].pla);
+#ifdef OS_IS_UNIX_OR_APPLE
+  //Each connection has a thread reading its requests and one writing its responses
+  struct UnixConnection {
+    int fd;
+    std::shared_ptr<AnalysisClient> client;
+    std::thread readThread;
+    std::thread writeThread;
+    std::atomic<int> numThreadsFinished;
+  };
+  std::mutex connectionsMutex;
+  vector<std::unique_ptr<UnixConnection>> connections;
+  vector<int> unixListenFds;
+  vector<std::thread> acceptThreads;
+  //Written to once when stopping, to wake every accept loop. Shutting down a listening socket doesn't wake accept on all platforms.
+  int acceptStopPipe[2] = {-1,-1};
+  if(listenUnixPaths.size() > 0 && pipe(acceptStopPipe) != 0)
+    throw StringError(string("Could not create pipe: ") + strerror(errno));
+
+  auto runConnectionWriteLoop = [&](UnixConnection* conn) {
+    bool connected = true;
+    string* message;
+    while(conn->client->toWriteQueue.waitPop(message)) {
+      if(connected && !writeAllToFd(conn->fd, *message)) {
+        connected = false;
+        //Nobody is reading anymore, so stop what's left for this connection
+        conn->client->toWriteQueue.setReadOnly();
+        std::lock_guard<std::mutex> lock(openRequestsMutex);
+        terminateAllRequestsForClient(conn->client.get());
       }
+      delete message;
+    }
+    //Everything for this connection is written, let the other end know
+    shutdown(conn->fd, SHUT_RDWR);
+  };
 
-      if(initialPlayer == C_EMPTY) {
-        if(moveHistory.size() > 0)
-          initialPlayer = moveHistory[0].pla;
-        else
-          initialPlayer = P_BLACK;
-      }
-
-      bool rulesWereSupported;
-      Rules supportedRules = nnEval->getSupportedRules(rules,rulesWereSupported);
-      if(!rulesWereSupported) {
-        ostringstream out;
-        out << "Rules " << rules << " not supported by neural net, using " << supportedRules << " instead";
-        reportWarningForId(rbase.id, "rules", out.str());
-        rules = supportedRules;
-      }
-
-      Player nextPla = initialPlayer;
-      BoardHistory hist(board,nextPla,rules);
-
-      //Build and enqueue requests
-      vector<AnalyzeRequest*> newRequests;
-      bool foundIllegalMove =  false;
-      for(int turnNumber = 0; turnNumber <= moveHistory.size(); turnNumber++) {
-        if(shouldAnalyze[turnNumber]) {
-          int64_t priority = rbase.priority;
-          if(priorities.size() > 0) {
-            assert(priorities.size() > newRequests.size());
-            assert(priorities.find(turnNumber) != priorities.end());
-            priority = priorities[turnNumber];
-          }
-
-          AnalyzeRequest* newRequest = new AnalyzeRequest();
-          newRequest->internalId = internalIdCounter++;
-          newRequest->id = rbase.id;
-          newRequest->turnNumber = turnNumber;
-          newRequest->board = board;
-          newRequest->hist = hist;
-          newRequest->nextPla = nextPla;
-          newRequest->params = rbase.params;
-          newRequest->perspective = rbase.perspective;
-          newRequest->analysisPVLen = rbase.analysisPVLen;
-          newRequest->includeOwnership = rbase.includeOwnership;
-          newRequest->includeOwnershipStdev = rbase.includeOwnershipStdev;
-          newRequest->includeMovesOwnership = rbase.includeMovesOwnership;
-          newRequest->includeMovesOwnershipStdev = rbase.includeMovesOwnershipStdev;
-          newRequest->includePolicy = rbase.includePolicy;
-          newRequest->includePVVisits = rbase.includePVVisits;
-          newRequest->reportDuringSearch = rbase.reportDuringSearch;
-          newRequest->reportDuringSearchEvery = rbase.reportDuringSearchEvery;
-          newRequest->priority = priority;
-          newRequest->avoidMoveUntilByLocBlack = rbase.avoidMoveUntilByLocBlack;
-          newRequest->avoidMoveUntilByLocWhite = rbase.avoidMoveUntilByLocWhite;
-          newRequest->status.store(AnalyzeRequest::STATUS_IN_QUEUE,std::memory_order_release);
-          newRequests.push_back(newRequest);
+  auto runAcceptLoop = [&](int listenFd) {
+    while(true) {
+      pollfd pollFds[2];
+      pollFds[0].fd = listenFd;
+      pollFds[0].events = POLLIN;
+      pollFds[1].fd = acceptStopPipe[0];
+      pollFds[1].events = POLLIN;
+      if(poll(pollFds, 2, -1) < 0) {
+        if(errno == EINTR)
+          continue;
+        break;
+      }
+      if(pollFds[1].revents != 0)
+        break;
+      if(pollFds[0].revents == 0)
+        continue;
+      int fd = accept(listenFd, NULL, NULL);
+      if(fd < 0) {
+        if(errno == EINTR || errno == ECONNABORTED || errno == EAGAIN || errno == EWOULDBLOCK)
+          continue;
+        break;
+      }
+      //Some platforms carry nonblocking over from the listening socket, but connections are read and written blocking
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+      std::lock_guard<std::mutex> lock(connectionsMutex);
+      //Clean up after connections that are done
+      for(size_t i = 0; i<connections.size(); ) {
+        if(connections[i]->numThreadsFinished.load() >= 2) {
+          connections[i]->readThread.join();
+          connections[i]->writeThread.join();
+          close(connections[i]->fd);
+          connections.erase(connections.begin()+i);
         }
-        if(turnNumber >= moveHistory.size())
-          break;
+        else
+          i++;
+      }
+      UnixConnection* conn = new UnixConnection();
+      conn->fd = fd;
+      conn->client = std::make_shared<AnalysisClient>(binaryProtocol, terminateScopeCounter++);
+      conn->numThreadsFinished.store(0);
+      connections.push_back(std::unique_ptr<UnixConnection>(conn));
+      conn->readThread = std::thread([&logger,&readRequests,conn]() {
+        FdInputBuf buf(conn->fd);
+        std::istream in(&buf);
+        Logger::logThreadUncaught("connection read", &logger, [&](){ readRequests(in, conn->client); });
+        conn->numThreadsFinished.fetch_add(1);
+      });
+      conn->writeThread = std::thread([&logger,&runConnectionWriteLoop,conn]() {
+        Logger::logThreadUncaught("connection write", &logger, [&](){ runConnectionWriteLoop(conn); });
+        conn->numThreadsFinished.fetch_add(1);
+      });
+    }
+  };
 
-        Player movePla = moveHistory[turnNumber].pla;
-        Loc moveLoc = moveHistory[turnNumber].loc;
-        if(movePla != nextPla) {
-          hist.clear(board,movePla,rules);
-        }
+  for(const string& path: listenUnixPaths) {
+    int fd = listenOnUnixSocket(path);
+    unixListenFds.push_back(fd);
+    acceptThreads.push_back(std::thread(runAcceptLoop, fd));
+    logger.write("Listening on unix socket " + path);
+  }
+#endif
 
-        bool suc = hist.makeBoardMoveTolerant(board,moveLoc,movePla);
-        if(!suc) {
-          reportErrorForId(rbase.id, "moves", "Illegal move " + Global::intToString(turnNumber) + ": " + Location::toString(moveLoc,board));
-          foundIllegalMove = true;
-          break;
-        }
-        nextPla = getOpp(movePla);
+  vector<std::unique_ptr<httplib::Server>> httpServers;
+  vector<std::thread> httpThreads;
+  for(const std::pair<string,int>& address: listenHttpAddresses) {
+    httplib::Server* server = new httplib::Server();
+    httpServers.push_back(std::unique_ptr<httplib::Server>(server));
+    //A few threads beyond maxHttpClients so that clients past the limit still promptly get their 503 rather than
+    //queueing behind the streaming ones, and one request per connection so that a finished stream frees its thread.
+    server->new_task_queue = [maxHttpClients]() { return new httplib::ThreadPool(maxHttpClients + 4); };
+    server->set_keep_alive_max_count(1);
+    std::shared_ptr<std::atomic<int>> numStreaming = std::make_shared<std::atomic<int>>(0);
+    server->Post("/analyze", [&,numStreaming](const httplib::Request& req, httplib::Response& res) {
+      if(numStreaming->fetch_add(1) >= maxHttpClients) {
+        numStreaming->fetch_sub(1);
+        res.status = 503;
+        res.set_content("Too many clients, maxHttpClients is " + Global::intToString(maxHttpClients) + "\n", "text/plain");
+        return;
       }
+      std::shared_ptr<AnalysisClient> client = std::make_shared<AnalysisClient>(binaryProtocol, httpTerminateScope);
+      std::istringstream in(req.body);
+      readRequests(in, client);
+      res.set_chunked_content_provider(
+        binaryProtocol ? "application/x-msgpack" : "application/x-ndjson",
+        [client](size_t offset, httplib::DataSink& sink) {
+          (void)offset;
+          string* message;
+          if(!client->toWriteQueue.waitPop(message)) {
+            sink.done();
+            return true;
+          }
+          sink.write(message->data(), message->size());
+          delete message;
+          return true;
+        },
+        //Called once the response is over, whether or not everything was written
+        [client,numStreaming,&openRequestsMutex,&terminateAllRequestsForClient]() {
+          client->toWriteQueue.setReadOnly();
+          {
+            std::lock_guard<std::mutex> lock(openRequestsMutex);
+            terminateAllRequestsForClient(client.get());
+          }
+          numStreaming->fetch_sub(1);
+        }
+      );
+    });
+    if(!server->bind_to_port(address.first.c_str(), address.second))
+      throw StringError("Could not listen for http on " + address.first + ":" + Global::intToString(address.second));
+    httpThreads.push_back(std::thread([server]() { server->listen_after_bind(); }));
+    logger.write("Listening for http on " + address.first + ":" + Global::intToString(address.second));
+  }
 
-      if(foundIllegalMove) {
-        for(int i = 0; i<newRequests.size(); i++)
-          delete newRequests[i];
-        newRequests.clear();
-        continue;
-      }
+  if(listenUnixPaths.size() <= 0 && listenHttpAddresses.size() <= 0) {
+    //If request loop raises an exception, we need to log here BEFORE destructing main context, because in some cases
+    //gameThreads[i].join() will abort without useful exception due to thread not being joinable,
+    //hiding the real exception.
+    Logger::logThreadUncaught("request loop", &logger, [&]() { readRequests(cin, stdioClient); });
+  }
+  else {
+#ifdef SIGPIPE
+    //Clients disconnecting are handled by failed writes
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+    if(!std::atomic_is_lock_free(&sigReceived))
+      throw StringError("sigReceived is not lock free, signal-quitting mechanism for terminating the server will NOT work!");
+    std::signal(SIGINT, signalHandler);
+    std::signal(SIGTERM, signalHandler);
+    while(!sigReceived.load())
+      std::this_thread::sleep_for(std::chrono::duration<double>(0.1));
+    logger.write("Signal to stop received, no longer accepting requests");
+
+    {
+      std::lock_guard<std::mutex> lock(requestInputMutex);
+      acceptingInput = false;
+    }
+#ifdef OS_IS_UNIX_OR_APPLE
+    if(acceptStopPipe[1] >= 0) {
+      char c = 0;
+      while(write(acceptStopPipe[1], &c, 1) < 0 && errno == EINTR) {}
+    }
+    for(size_t i = 0; i<acceptThreads.size(); i++)
+      acceptThreads[i].join();
+    for(int fd: unixListenFds)
+      close(fd);
+    if(acceptStopPipe[0] >= 0) {
+      close(acceptStopPipe[0]);
+      close(acceptStopPipe[1]);
+    }
+    for(const string& path: listenUnixPaths)
+      unlink(path.c_str());
+    //Connections see the end of their input, and finish once everything for their requests so far is written
+    {
+      std::lock_guard<std::mutex> lock(connectionsMutex);
+      for(size_t i = 0; i<connections.size(); i++)
+        shutdown(connections[i]->fd, SHUT_RD);
+    }
+#endif
+  }
 
-      //Add all requests to open requests
+  //Requests never popped when quitting without waiting are done too, so that every client's output finishes
+  auto releaseUnpoppedRequests = [&openRequestsMutex,&closeOpenRequest](ThreadSafePriorityQueue<std::pair<int64_t,int64_t>, AnalyzeRequest*>& queue) {
+    std::pair<std::pair<int64_t,int64_t>,AnalyzeRequest*> analysisItem;
+    while(queue.tryPop(analysisItem)) {
       {
         std::lock_guard<std::mutex> lock(openRequestsMutex);
-        for(int i = 0; i<newRequests.size(); i++) {
-          openRequests[newRequests[i]->internalId] = newRequests[i];
-        }
-      }
-      //Push into queue for processing
-      for(int i = 0; i<newRequests.size(); i++) {
-        //Compare first by user-provided priority, and next breaks ties by preferring earlier requests.
-        std::pair<int64_t,int64_t> priorityKey = std::make_pair(newRequests[i]->priority, -numRequestsSoFar);
-        bool suc = toAnalyzeQueue.forcePush( std::make_pair(priorityKey, newRequests[i]) );
-        assert(suc);
-        (void)suc;
-        numRequestsSoFar++;
+        closeOpenRequest(analysisItem.second);
       }
-      newRequests.clear();
+      releaseRequest(analysisItem.second);
     }
   };
 
-  //If request loop raises an exception, we need to log here BEFORE destructing main context, because in some cases
-  //gameThreads[i].join() will abort without useful exception due to thread not being joinable,
-  //hiding the real exception.
-  Logger::logThreadUncaught("request loop", &logger, requestLoop);
-
   if(quitWithoutWaiting) {
     //Making this readOnly will halt futher output that isn't already queued and signal the write loop thread to terminate.
-    toWriteQueue.setReadOnly();
+    stdioClient->toWriteQueue.setReadOnly();
     //Making this readOnly should signal the analysis loop threads to terminate once they have nothing left.
     toAnalyzeQueue.setReadOnly();
+    //Raw evals can't be interrupted like searches, so take away the ones not yet started
+    releaseUnpoppedRequests(toRawEvalQueue);
+    toRawEvalQueue.setReadOnly();
+    wakeRawEvalThreads();
     //Interrupt any searches going on to help the analysis threads realize to terminate faster.
     for(int i = 0; i<bots.size(); i++)
       bots[i]->stopWithoutWait();
@@ -1081,25 +2121,54 @@ int MainCmds::analysis(const vector<string>& args) {
       bots[i]->setKilled();
     for(int i = 0; i<threads.size(); i++)
       threads[i].join();
+    for(int i = 0; i<rawEvalThreads.size(); i++)
+      rawEvalThreads[i].join();
     write_thread.join();
   }
   else {
     //Making this readOnly should signal the analysis loop threads to terminate once they have nothing left.
     toAnalyzeQueue.setReadOnly();
+    toRawEvalQueue.setReadOnly();
+    wakeRawEvalThreads();
     //Wait patiently for everything to finish
     for(int i = 0; i<threads.size(); i++)
       threads[i].join();
+    for(int i = 0; i<rawEvalThreads.size(); i++)
+      rawEvalThreads[i].join();
     //Signal the write loop thread to terminate
-    toWriteQueue.setReadOnly();
+    stdioClient->toWriteQueue.setReadOnly();
     write_thread.join();
   }
 
+  releaseUnpoppedRequests(toAnalyzeQueue);
+  releaseUnpoppedRequests(toRawEvalQueue);
+#ifdef OS_IS_UNIX_OR_APPLE
+  for(size_t i = 0; i<connections.size(); i++) {
+    connections[i]->readThread.join();
+    connections[i]->writeThread.join();
+    close(connections[i]->fd);
+  }
+  connections.clear();
+#endif
+  for(size_t i = 0; i<httpServers.size(); i++)
+    httpServers[i]->stop();
+  for(size_t i = 0; i<httpThreads.size(); i++)
+    httpThreads[i].join();
+
   for(int i = 0; i<bots.size(); i++)
     delete bots[i];
 
   logger.write(nnEval->getModelFileName());
+  if(searchThreadPool != nullptr)
+    logger.write("Search threads taken back for higher priority requests: " + Global::int64ToString(searchThreadPool->getNumThreadsReturned()));
+  if(reuseTreeAcrossRequests)
+    logger.write(
+      "Requests continuing an earlier search tree: " + Global::int64ToString(numRequestsReusingTree.load()) +
+      ", reused visits: " + Global::int64ToString(numReusedVisitsTotal.load())
+    );
   logger.write("NN rows: " + Global::int64ToString(nnEval->numRowsProcessed()));
   logger.write("NN batches: " + Global::int64ToString(nnEval->numBatchesProcessed()));
+  logger.write("NN coalesced evals: " + Global::uint64ToString(nnEval->numCoalescedEvals()));
   logger.write("NN avg batch size: " + Global::doubleToString(nnEval->averageProcessedBatchSize()));
   delete nnEval;
   NeuralNet::globalCleanup();
@@ -0,0 +1,282 @@
+#include "../core/global.h"
+#include "../core/os.h"
+#include "../core/rand.h"
+#include "../core/timer.h"
+#include "../game/boardhistory.h"
+#include "../command/commandline.h"
+#include "../main.h"
+
+#ifdef OS_IS_UNIX_OR_APPLE
+  #include <sys/wait.h>
+  #include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+#include "../external/nlohmann_json/json.hpp"
+
+//------------------------
+#include "../core/using.h"
+//------------------------
+
+using json = nlohmann::json;
+
+//Requests for random positions from random games, with random priorities from the ones given
+static vector<json> makeLoadTestRequests(
+  Rand& rand, int numRequests, const vector<int64_t>& priorities, int64_t maxVisits, int boardSize
+) {
+  vector<json> requests;
+  for(int i = 0; i<numRequests; i++) {
+    Board board(boardSize,boardSize);
+    Player pla = P_BLACK;
+    BoardHistory hist(board,pla,Rules::getTrompTaylorish());
+    json moves = json::array();
+    int numMoves = rand.nextInt(0,boardSize*boardSize/3);
+    for(int m = 0; m<numMoves && !hist.isGameFinished; m++) {
+      Loc loc;
+      do {
+        loc = Location::getLoc(rand.nextInt(0,boardSize-1),rand.nextInt(0,boardSize-1),boardSize);
+      } while(!hist.isLegal(board,loc,pla));
+      moves.push_back(json::array({PlayerIO::playerToStringShort(pla), Location::toString(loc,board)}));
+      hist.makeBoardMoveAssumeLegal(board,loc,pla);
+      pla = getOpp(pla);
+    }
+    json request;
+    request["id"] = Global::intToString(i);
+    request["moves"] = moves;
+    request["rules"] = "chinese";
+    request["boardXSize"] = boardSize;
+    request["boardYSize"] = boardSize;
+    request["maxVisits"] = maxVisits;
+    request["priority"] = priorities[rand.nextUInt((uint32_t)priorities.size())];
+    requests.push_back(request);
+  }
+  return requests;
+}
+
+//Nearest-rank percentile of sorted values
+static double percentile(const vector<double>& sorted, double p) {
+  if(sorted.size() <= 0)
+    return 0.0;
+  size_t rank = (size_t)ceil(p / 100.0 * sorted.size());
+  return sorted[std::min(sorted.size()-1, rank > 0 ? rank-1 : 0)];
+}
+
+int MainCmds::analysisloadtest(const vector<string>& args, const string& firstCommand) {
+  Board::initHash();
+
+  string configFile;
+  string modelFile;
+  vector<string> overrideConfigs;
+  int numRequests;
+  double requestsPerSecond;
+  vector<int64_t> priorities;
+  int64_t maxVisits;
+  int boardSize;
+  string seed;
+  try {
+    KataHexCommandLine cmd(
+      "Run an analysis engine and send it requests of mixed priorities arriving at random, reporting latency percentiles for each priority."
+    );
+    TCLAP::ValueArg<string> configArg("","config","Config file for the analysis engine",true,string(),"FILE");
+    TCLAP::ValueArg<string> modelArg("","model","Neural net model file for the analysis engine",true,string(),"FILE");
+    TCLAP::MultiArg<string> overrideConfigArg("","override-config","Passed on to the analysis engine",false,"KEYVALUEPAIRS");
+    TCLAP::ValueArg<int> numRequestsArg("","requests","Number of requests to send (default 200)",false,200,"N");
+    TCLAP::ValueArg<double> requestsPerSecondArg("","rate","Average requests per second, arriving as a poisson process (default 20)",false,20.0,"RATE");
+    TCLAP::ValueArg<string> prioritiesArg("","priorities","Comma-separated priorities, each request gets one uniformly at random (default 0,10)",false,"0,10","LIST");
+    TCLAP::ValueArg<int64_t> maxVisitsArg("","max-visits","maxVisits of each request (default 200)",false,200,"VISITS");
+    TCLAP::ValueArg<int> boardSizeArg("","board-size","Board size of the positions (default 11)",false,11,"SIZE");
+    TCLAP::ValueArg<string> seedArg("","seed","Seed for the positions, priorities, and arrival times",false,"analysisloadtest","SEED");
+    cmd.add(configArg);
+    cmd.add(modelArg);
+    cmd.add(overrideConfigArg);
+    cmd.add(numRequestsArg);
+    cmd.add(requestsPerSecondArg);
+    cmd.add(prioritiesArg);
+    cmd.add(maxVisitsArg);
+    cmd.add(boardSizeArg);
+    cmd.add(seedArg);
+    cmd.parseArgs(args);
+
+    configFile = configArg.getValue();
+    modelFile = modelArg.getValue();
+    overrideConfigs = overrideConfigArg.getValue();
+    numRequests = numRequestsArg.getValue();
+    requestsPerSecond = requestsPerSecondArg.getValue();
+    maxVisits = maxVisitsArg.getValue();
+    boardSize = boardSizeArg.getValue();
+    seed = seedArg.getValue();
+    for(const string& s: Global::split(prioritiesArg.getValue(),',')) {
+      int64_t priority;
+      if(!Global::tryStringToInt64(Global::trim(s),priority))
+        throw StringError("Could not parse priority: " + s);
+      priorities.push_back(priority);
+    }
+    if(priorities.size() <= 0)
+      throw StringError("Must specify at least one priority");
+    if(numRequests <= 0 || !(requestsPerSecond > 0) || maxVisits <= 0)
+      throw StringError("-requests, -rate, and -max-visits must be positive");
+    if(boardSize < 2 || boardSize > Board::MAX_LEN)
+      throw StringError("Invalid board size");
+  }
+  catch (TCLAP::ArgException &e) {
+    cerr << "Error: " << e.error() << " for argument " << e.argId() << endl;
+    return 1;
+  }
+
+#ifdef OS_IS_UNIX_OR_APPLE
+  Rand rand(seed);
+  vector<json> requests = makeLoadTestRequests(rand, numRequests, priorities, maxVisits, boardSize);
+
+  vector<string> engineArgs = {firstCommand, "analysis", "-config", configFile, "-model", modelFile};
+  for(const string& s: overrideConfigs) {
+    engineArgs.push_back("-override-config");
+    engineArgs.push_back(s);
+  }
+
+  int toEngine[2];
+  int fromEngine[2];
+  if(pipe(toEngine) != 0 || pipe(fromEngine) != 0)
+    throw StringError("analysisloadtest: could not create pipes");
+  pid_t pid = fork();
+  if(pid < 0)
+    throw StringError("analysisloadtest: could not fork");
+  if(pid == 0) {
+    dup2(toEngine[0], STDIN_FILENO);
+    dup2(fromEngine[1], STDOUT_FILENO);
+    close(toEngine[0]);
+    close(toEngine[1]);
+    close(fromEngine[0]);
+    close(fromEngine[1]);
+    vector<char*> argv;
+    for(string& s: engineArgs)
+      argv.push_back(&s[0]);
+    argv.push_back(NULL);
+    execvp(argv[0], argv.data());
+    cerr << "analysisloadtest: could not run " << firstCommand << endl;
+    _exit(1);
+  }
+  close(toEngine[0]);
+  close(fromEngine[1]);
+  //If the engine exits early, writing to it should fail with EPIPE so that we still report, rather than kill us
+  signal(SIGPIPE, SIG_IGN);
+
+  ClockTimer timer;
+  std::mutex sentMutex;
+  std::map<string,double> sentTimeById;
+  std::map<int64_t,vector<double>> latenciesByPriority;
+  int numErrors = 0;
+
+  //Read final responses and match them up to when their request was sent
+  std::thread readThread([&]() {
+    FILE* in = fdopen(fromEngine[0], "r");
+    char* lineBuf = NULL;
+    size_t lineBufLen = 0;
+    while(getline(&lineBuf, &lineBufLen, in) >= 0) {
+      double now = timer.getSeconds();
+      json response;
+      try {
+        response = json::parse(lineBuf);
+      }
+      catch(nlohmann::detail::exception& e) {
+        cerr << "analysisloadtest: could not parse response: " << lineBuf;
+        continue;
+      }
+      if(response.find("error") != response.end()) {
+        cerr << "analysisloadtest: error response: " << response.dump() << endl;
+        std::lock_guard<std::mutex> lock(sentMutex);
+        numErrors++;
+        //An error is the only response to its request, so don't count it again as missing
+        if(response.find("id") != response.end() && response["id"].is_string())
+          sentTimeById.erase(response["id"].get<string>());
+        continue;
+      }
+      if(response.find("id") == response.end() || response.find("turnNumber") == response.end())
+        continue;
+      if(response.find("isDuringSearch") != response.end() && response["isDuringSearch"].get<bool>())
+        continue;
+      string id = response["id"].get<string>();
+      std::lock_guard<std::mutex> lock(sentMutex);
+      auto iter = sentTimeById.find(id);
+      if(iter == sentTimeById.end())
+        continue;
+      int64_t priority = requests[Global::stringToInt(id)]["priority"].get<int64_t>();
+      latenciesByPriority[priority].push_back(now - iter->second);
+      sentTimeById.erase(iter);
+    }
+    free(lineBuf);
+    fclose(in);
+  });
+
+  //Send requests as a poisson process, so there are bursts where they pile up as well as lulls
+  double nextSendTime = 0.0;
+  int numSent = 0;
+  bool engineExitedEarly = false;
+  for(int i = 0; i<numRequests; i++) {
+    double secondsToWait = nextSendTime - timer.getSeconds();
+    if(secondsToWait > 0)
+      std::this_thread::sleep_for(std::chrono::duration<double>(secondsToWait));
+    string line = requests[i].dump() + "\n";
+    {
+      std::lock_guard<std::mutex> lock(sentMutex);
+      sentTimeById[requests[i]["id"].get<string>()] = timer.getSeconds();
+    }
+    size_t written = 0;
+    while(written < line.size()) {
+      ssize_t ret = write(toEngine[1], line.data() + written, line.size() - written);
+      if(ret < 0 && errno == EINTR)
+        continue;
+      if(ret <= 0) {
+        cerr << "analysisloadtest: analysis engine exited early: " << (ret < 0 ? strerror(errno) : "short write") << endl;
+        engineExitedEarly = true;
+        break;
+      }
+      written += (size_t)ret;
+    }
+    if(engineExitedEarly) {
+      std::lock_guard<std::mutex> lock(sentMutex);
+      sentTimeById.erase(requests[i]["id"].get<string>());
+      break;
+    }
+    numSent++;
+    nextSendTime += rand.nextExponential() / requestsPerSecond;
+  }
+  double sendSeconds = timer.getSeconds();
+  //The engine finishes what's queued and exits once its input is closed
+  close(toEngine[1]);
+  readThread.join();
+  int status;
+  waitpid(pid, &status, 0);
+  double totalSeconds = timer.getSeconds();
+
+  cout << "Sent " << numSent << " requests in " << Global::strprintf("%.2f", sendSeconds)
+       << " seconds, all done after " << Global::strprintf("%.2f", totalSeconds) << " seconds" << endl;
+  if(numErrors > 0 || sentTimeById.size() > 0)
+    cout << "Errors: " << numErrors << ", no response: " << sentTimeById.size() << endl;
+  cout << "Latency in milliseconds by priority, highest first" << endl;
+  cout << Global::strprintf("%10s %8s %8s %8s %8s %8s %8s", "priority", "count", "mean", "p50", "p90", "p99", "max") << endl;
+  for(auto iter = latenciesByPriority.rbegin(); iter != latenciesByPriority.rend(); ++iter) {
+    vector<double>& latencies = iter->second;
+    std::sort(latencies.begin(), latencies.end());
+    double sum = 0.0;
+    for(double latency: latencies)
+      sum += latency;
+    cout << Global::strprintf(
+      "%10lld %8d %8.0f %8.0f %8.0f %8.0f %8.0f",
+      (long long)iter->first, (int)latencies.size(),
+      1000.0 * sum / latencies.size(),
+      1000.0 * percentile(latencies, 50), 1000.0 * percentile(latencies, 90),
+      1000.0 * percentile(latencies, 99), 1000.0 * latencies.back()
+    ) << endl;
+  }
+  return (!engineExitedEarly && WIFEXITED(status) && WEXITSTATUS(status) == 0 && numErrors == 0) ? 0 : 1;
+#else
+  (void)firstCommand;
+  throw StringError("analysisloadtest is not supported on this platform");
+#endif
+}
@@ -6,6 +6,7 @@
 #include "../tests/tests.h"
 #include "../dataio/sgf.h"
 #include "../search/asyncbot.h"
+#include "../search/rootparallelsearch.h"
 #include "../program/setup.h"
 #include "../program/playutils.h"
 #include "../program/gtpconfig.h"
@@ -43,6 +44,15 @@ static vector<PlayUtils::BenchmarkResults> doAutoTuneThreads(
   double secondsPerGameMove,
   std::function<void(int)> reallocateNNEvalWithEnoughBatchSize
 );
+static void doRootParallelComparison(
+  const SearchParams& params,
+  const CompactSgf* sgf,
+  int numPositionsPerGame,
+  NNEvaluator* nnEval,
+  Logger& logger,
+  vector<int> numThreadsToTest,
+  int numSubSearches
+);
 
 #ifdef USE_EIGEN_BACKEND
 static const int64_t defaultMaxVisits = 80;
@@ -66,6 +76,7 @@ int MainCmds::benchmark(const vector<string>& args) {
   int numPositionsPerGame;
   bool autoTuneThreads;
   double secondsPerGameMove;
+  int rootParallelSubSearches;
   try {
     KataHexCommandLine cmd("Benchmark with gtp config to test speed with different numbers of threads.");
     cmd.addConfigFileArg(KataHexCommandLine::defaultGtpConfigFileName(),"gtp_example.cfg");
@@ -89,6 +100,13 @@ int MainCmds::benchmark(const vector<string>& args) {
       Global::doubleToString(defaultSecondsPerGameMove) + ")",
       false,defaultSecondsPerGameMove,"SECONDS"
     );
+    TCLAP::ValueArg<int> rootParallelArg(
+      "","rootparallel",
+      "Instead of tuning threads, compare root-parallel search with this many independent sub-searches against "
+      "shared-tree search, reporting playouts/sec and how often they choose the same move. "
+      "For evaluation only, GTP and the analysis engine do not use root-parallel search",
+      false,0,"N"
+    );
     cmd.add(visitsArg);
     cmd.add(threadsArg);
     cmd.add(numPositionsPerGameArg);
@@ -101,6 +119,7 @@ int MainCmds::benchmark(const vector<string>& args) {
     cmd.add(boardSizeArg);
     cmd.add(autoTuneThreadsArg);
     cmd.add(secondsPerGameMoveArg);
+    cmd.add(rootParallelArg);
     cmd.parseArgs(args);
 
     modelFile = cmd.getModelFile();
@@ -111,6 +130,7 @@ int MainCmds::benchmark(const vector<string>& args) {
     numPositionsPerGame = numPositionsPerGameArg.getValue();
     autoTuneThreads = autoTuneThreadsArg.getValue();
     secondsPerGameMove = secondsPerGameMoveArg.getValue();
+    rootParallelSubSearches = rootParallelArg.getValue();
 
     if(boardSize != -1 && sgfFile != "")
       throw StringError("Cannot specify both -sgf and -boardsize at the same time");
@@ -124,6 +144,10 @@ int MainCmds::benchmark(const vector<string>& args) {
       throw StringError("Number of seconds per game move to assume: invalid value " + Global::doubleToString(secondsPerGameMove));
     if(desiredThreadsStr != "" && autoTuneThreads)
       throw StringError("Cannot both automatically tune threads and specify fixed exact numbers of threads to test");
+    if(rootParallelSubSearches < 0 || rootParallelSubSearches > 1024)
+      throw StringError("Number of root-parallel sub-searches: invalid value " + Global::intToString(rootParallelSubSearches));
+    if(rootParallelSubSearches > 0 && autoTuneThreads)
+      throw StringError("-rootparallel requires specifying the numbers of threads to test with -threads");
 
     //Apply default
     if(desiredThreadsStr == "")
@@ -237,6 +261,14 @@ int MainCmds::benchmark(const vector<string>& args) {
   cout << endl;
   cout << "Your GTP config is currently set to use numSearchThreads = " << params.numThreads << endl;
 
+  if(rootParallelSubSearches > 0) {
+    doRootParallelComparison(params,sgf,numPositionsPerGame,nnEval,logger,numThreadsToTest,rootParallelSubSearches);
+    delete nnEval;
+    NeuralNet::globalCleanup();
+    delete sgf;
+    return 0;
+  }
+
   vector<PlayUtils::BenchmarkResults> results;
   if(!autoTuneThreads) {
     results = doFixedTuneThreads(params,sgf,numPositionsPerGame,nnEval,logger,secondsPerGameMove,numThreadsToTest,true);
@@ -954,3 +986,100 @@ int MainCmds::genconfig(const vector<string>& args, const string& firstCommand)
 
   return 0;
 }
+
+//Argmax of play selection values, so that the comparison doesn't depend on move temperature
+static Loc getBestMoveNoTemperature(const Search* search) {
+  vector<Loc> locs;
+  vector<double> playSelectionValues;
+  if(!search->getPlaySelectionValues(locs, playSelectionValues, 0.0))
+    return Board::NULL_LOC;
+  size_t bestIdx = 0;
+  for(size_t i = 1; i<locs.size(); i++) {
+    if(playSelectionValues[i] > playSelectionValues[bestIdx])
+      bestIdx = i;
+  }
+  return locs[bestIdx];
+}
+
+static void doRootParallelComparison(
+  const SearchParams& params,
+  const CompactSgf* sgf,
+  int numPositionsPerGame,
+  NNEvaluator* nnEval,
+  Logger& logger,
+  vector<int> numThreadsToTest,
+  int numSubSearches
+) {
+  //Spread the positions evenly through the game
+  vector<int> positionIdxs;
+  int numMoves = (int)sgf->moves.size();
+  int numPositions = std::min(numPositionsPerGame, numMoves);
+  for(int i = 0; i<numPositions; i++)
+    positionIdxs.push_back((int)((int64_t)i * numMoves / numPositions));
+
+  Rules initialRules = Rules::getTrompTaylorish();
+  initialRules.komi = sgf->komi;
+
+  cout << "Comparing shared-tree search against root-parallel search with " << numSubSearches << " sub-searches"
+       << " (board size " << sgf->xSize << "x" << sgf->ySize << ", " << positionIdxs.size() << " positions): " << endl;
+
+  Rand seedRand;
+  for(int numThreads: numThreadsToTest) {
+    SearchParams thisParams = params;
+    setNumThreads(thisParams,nnEval,logger,numThreads,sgf);
+
+    Search* sharedBot = new Search(thisParams, nnEval, &logger, Global::uint64ToString(seedRand.nextUInt64()));
+    RootParallelSearch* rootParallelBot = new RootParallelSearch(thisParams, numSubSearches, nnEval, &logger, Global::uint64ToString(seedRand.nextUInt64()));
+
+    int64_t sharedPlayouts = 0;
+    double sharedSeconds = 0.0;
+    int64_t rootParallelPlayouts = 0;
+    double rootParallelSeconds = 0.0;
+    int numAgreed = 0;
+
+    Board board;
+    Player nextPla;
+    BoardHistory hist;
+    sgf->setupInitialBoardAndHist(initialRules, board, nextPla, hist);
+    int moveNum = 0;
+    for(int positionIdx: positionIdxs) {
+      while(moveNum < positionIdx) {
+        bool suc = hist.makeBoardMoveTolerant(board,sgf->moves[moveNum].loc,sgf->moves[moveNum].pla);
+        if(!suc)
+          throw StringError("Illegal move in SGF");
+        nextPla = getOpp(sgf->moves[moveNum].pla);
+        moveNum += 1;
+      }
+
+      //Clear the cache before each so that neither gets to reuse the other's evals
+      sharedBot->setPosition(nextPla,board,hist);
+      nnEval->clearCache();
+      ClockTimer timer;
+      sharedBot->runWholeSearch(nextPla);
+      sharedSeconds += timer.getSeconds();
+      sharedPlayouts += sharedBot->lastSearchNumPlayouts;
+      Loc sharedMove = getBestMoveNoTemperature(sharedBot);
+
+      rootParallelBot->setPosition(nextPla,board,hist);
+      nnEval->clearCache();
+      timer.reset();
+      rootParallelBot->runWholeSearch(nextPla);
+      rootParallelSeconds += timer.getSeconds();
+      rootParallelPlayouts += rootParallelBot->getLastSearchNumPlayouts();
+      Loc rootParallelMove = rootParallelBot->getChosenMoveLoc();
+
+      if(sharedMove == rootParallelMove)
+        numAgreed += 1;
+    }
+
+    delete sharedBot;
+    delete rootParallelBot;
+
+    cout << "numSearchThreads = " << Global::strprintf("%3d",numThreads) << ":"
+         << " shared-tree " << Global::strprintf("%8.2f", sharedPlayouts / std::max(sharedSeconds,1e-10)) << " playouts/s,"
+         << " root-parallel " << Global::strprintf("%8.2f", rootParallelPlayouts / std::max(rootParallelSeconds,1e-10)) << " playouts/s,"
+         << " same move " << numAgreed << "/" << positionIdxs.size()
+         << endl;
+  }
+  cout << endl;
+}
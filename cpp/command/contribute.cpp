@@ -290,7 +290,7 @@ static void runAndUploadSingleGame(
       Tests::runCanaryTests(nnEvalBlack, NNInputs::SYMMETRY_NOTSPECIFIED, false);
       gameTask.blackManager->withDataWriters(
         nnEvalBlack,
-        [gameData,&gameTask,gameIdx,&sgfFile,&connection,&logger,&shouldStopFunc](TrainingDataWriter* tdataWriter, TrainingDataWriter* vdataWriter, std::ofstream* sgfOut) {
+        [gameData,&gameTask,gameIdx,&sgfFile,&connection,&logger,&shouldStopFunc](TrainingDataWriter* tdataWriter, TrainingDataWriter* vdataWriter, SgfStreamWriter* sgfOut) {
           (void)vdataWriter;
           (void)sgfOut;
           assert(tdataWriter->isEmpty());
@@ -817,7 +817,7 @@ int MainCmds::contribute(const vector<string>& args) {
     TrainingDataWriter* tdataWriter = new TrainingDataWriter(
       tdataOutputDir, inputsVersion, maxRowsPerTrainFile, firstFileRandMinProp, dataBoardLen, dataBoardLen, Global::uint64ToHexString(rand.nextUInt64()));
     TrainingDataWriter* vdataWriter = NULL;
-    ofstream* sgfOut = NULL;
+    SgfStreamWriter* sgfOut = NULL;
 
     logger.write("Loaded new neural net " + nnEval->getModelName());
     manager->loadModelNoDataWritingLoop(nnEval, tdataWriter, vdataWriter, sgfOut);
@@ -1983,9 +1983,29 @@ int MainCmds::gtp(const vector<string>& args) {
     }
 
     else if(command == "kata-debug-print-tc") {
-      response += "Black "+ engine->bTimeControls.toDebugString(engine->bot->getRootBoard(),engine->bot->getRootHist(),initialParams.lagBuffer);
+      //Stop any ponder first, since it would be updating the root and the measured playout rate as we read them
+      const Search* search = engine->bot->getSearchStopAndWait();
+      const Board& board = engine->bot->getRootBoard();
+      const BoardHistory& hist = engine->bot->getRootHist();
+      double approxGameTurnsLeft = search->estimateGameTurnsLeftForTime();
+      response += "Black "+ engine->bTimeControls.toDebugString(board,hist,initialParams.lagBuffer,approxGameTurnsLeft);
       response += "\n";
-      response += "White "+ engine->wTimeControls.toDebugString(engine->bot->getRootBoard(),engine->bot->getRootHist(),initialParams.lagBuffer);
+      response += "White "+ engine->wTimeControls.toDebugString(board,hist,initialParams.lagBuffer,approxGameTurnsLeft);
+
+      //How many playouts the recommended time comes to for the player to move, at the rate recent searches ran at
+      Player pla = engine->bot->getRootPla();
+      const TimeControls& tc = pla == P_BLACK ? engine->bTimeControls : engine->wTimeControls;
+      double minTime;
+      double recommendedTime;
+      double maxTime;
+      tc.getTime(board,hist,initialParams.lagBuffer,approxGameTurnsLeft,minTime,recommendedTime,maxTime);
+      double playoutsPerSecond = search->getMeasuredPlayoutsPerSecond();
+      response += "\n";
+      response += "Next " + PlayerIO::playerToString(pla);
+      response += " playoutsPerSecond " + Global::strprintf("%.1f",playoutsPerSecond);
+      if(playoutsPerSecond > 0 && !tc.isEffectivelyUnlimitedTime())
+        response += " plannedPlayouts " + Global::strprintf("%.0f",recommendedTime * playoutsPerSecond);
+      maybeStartPondering = engine->bot->getRootHist().moveHistory.size() > 0;
     }
 
     else if(command == "play") {
@@ -5,7 +5,10 @@
 #include "../core/timer.h"
 #include "../core/test.h"
 #include "../dataio/sgf.h"
+#include "../dataio/binaryjson.h"
 #include "../dataio/files.h"
+#include "../dataio/trainingshard.h"
+#include "../dataio/trainingwrite.h"
 #include "../search/asyncbot.h"
 #include "../program/setup.h"
 #include "../program/playutils.h"
@@ -15,6 +18,7 @@
 
 #include <chrono>
 #include <csignal>
+#include <sstream>
 
 using namespace std;
 
@@ -581,6 +585,7 @@ int MainCmds::samplesgfs(const vector<string>& args) {
   int64_t maxNodeCount;
   int64_t maxBranchCount;
   bool flipIfPassOrWFirst;
+  int numThreads;
 
   int minMinRank;
   string requiredPlayerName;
@@ -591,6 +596,7 @@ int MainCmds::samplesgfs(const vector<string>& args) {
 
     TCLAP::MultiArg<string> sgfDirArg("","sgfdir","Directory of sgf files",true,"DIR");
     TCLAP::ValueArg<string> outDirArg("","outdir","Directory to write results",true,string(),"DIR");
+    TCLAP::ValueArg<int> numThreadsArg("","threads","Number of threads loading sgfs and enumerating positions",false,1,"THREADS");
     TCLAP::MultiArg<string> excludeHashesArg("","exclude-hashes","Specify a list of hashes to filter out, one per line in a txt file",false,"FILEOF(HASH,HASH)");
     TCLAP::ValueArg<double> sampleProbArg("","sample-prob","Probability to sample each position",true,0.0,"PROB");
     TCLAP::ValueArg<double> turnWeightLambdaArg("","turn-weight-lambda","Adjust weight for writing down each position",true,0.0,"LAMBDA");
@@ -613,9 +619,11 @@ int MainCmds::samplesgfs(const vector<string>& args) {
     cmd.add(minMinRankArg);
     cmd.add(requiredPlayerNameArg);
     cmd.add(maxKomiArg);
+    cmd.add(numThreadsArg);
     cmd.parseArgs(args);
     sgfDirs = sgfDirArg.getValue();
     outDir = outDirArg.getValue();
+    numThreads = numThreadsArg.getValue();
     excludeHashesFiles = excludeHashesArg.getValue();
     sampleProb = sampleProbArg.getValue();
     turnWeightLambda = turnWeightLambdaArg.getValue();
@@ -626,6 +634,8 @@ int MainCmds::samplesgfs(const vector<string>& args) {
     minMinRank = minMinRankArg.getValue();
     requiredPlayerName = requiredPlayerNameArg.getValue();
     maxKomi = maxKomiArg.getValue();
+    if(numThreads <= 0)
+      throw StringError("-threads must be positive");
   }
   catch (TCLAP::ArgException &e) {
     cerr << "Error: " << e.error() << " for argument " << e.argId() << endl;
@@ -711,23 +721,13 @@ int MainCmds::samplesgfs(const vector<string>& args) {
 
   // ---------------------------------------------------------------------------------------------------
 
-  int64_t numKept = 0;
-  std::set<Hash128> uniqueHashes;
-  std::function<void(Sgf::PositionSample&, const BoardHistory&, const string&)> posHandler =
-    [sampleProb,&toWriteQueue,turnWeightLambda,&numKept,&seedRand](Sgf::PositionSample& posSample, const BoardHistory& hist, const string& comments) {
-    (void)hist;
-    (void)comments;
-    if(seedRand.nextBool(sampleProb)) {
-      Sgf::PositionSample posSampleToWrite = posSample;
-      int64_t startTurn = posSampleToWrite.initialTurnNumber + (int64_t)posSampleToWrite.moves.size();
-      posSampleToWrite.weight = exp(-startTurn * turnWeightLambda) * posSampleToWrite.weight;
-      toWriteQueue.waitPush(new string(Sgf::PositionSample::toJsonLine(posSampleToWrite)));
-      numKept += 1;
-    }
-  };
-  int64_t numExcluded = 0;
-  int64_t numSgfsFilteredTopLevel = 0;
-  auto trySgf = [&](Sgf* sgf) {
+  //Sgfs are loaded, filtered and enumerated on numThreads threads at once, sharing only the set of positions seen so far.
+  //Which of several sgfs reaching the same position gets to sample it therefore depends on timing when numThreads > 1.
+  std::atomic<int64_t> numKept(0);
+  Sgf::ConcurrentHashSet uniqueHashes;
+  std::atomic<int64_t> numExcluded(0);
+  std::atomic<int64_t> numSgfsFilteredTopLevel(0);
+  auto trySgf = [&](Sgf* sgf, Rand& threadRand) {
     if(contains(excludeHashes,sgf->hash)) {
       numExcluded += 1;
       return;
@@ -760,28 +760,54 @@ int MainCmds::samplesgfs(const vector<string>& args) {
       return;
     }
 
+    std::function<void(Sgf::PositionSample&, const BoardHistory&, const string&)> posHandler =
+      [sampleProb,&toWriteQueue,turnWeightLambda,&numKept,&threadRand](Sgf::PositionSample& posSample, const BoardHistory& hist, const string& comments) {
+      (void)hist;
+      (void)comments;
+      if(threadRand.nextBool(sampleProb)) {
+        Sgf::PositionSample posSampleToWrite = posSample;
+        int64_t startTurn = posSampleToWrite.initialTurnNumber + (int64_t)posSampleToWrite.moves.size();
+        posSampleToWrite.weight = exp(-startTurn * turnWeightLambda) * posSampleToWrite.weight;
+        toWriteQueue.waitPush(new string(Sgf::PositionSample::toJsonLine(posSampleToWrite)));
+        numKept += 1;
+      }
+    };
+
     bool hashComments = false;
     bool hashParent = false;
-    Rand iterRand;
-    sgf->iterAllUniquePositions(uniqueHashes, hashComments, hashParent, flipIfPassOrWFirst, &iterRand, posHandler);
+    sgf->iterAllUniquePositions(uniqueHashes, hashComments, hashParent, flipIfPassOrWFirst, &threadRand, posHandler);
   };
 
-  for(size_t i = 0; i<sgfFiles.size(); i++) {
-    Sgf* sgf = NULL;
-    try {
-      sgf = Sgf::loadFile(sgfFiles[i]);
-      trySgf(sgf);
-    }
-    catch(const StringError& e) {
-      logger.write("Invalid SGF " + sgfFiles[i] + ": " + e.what());
-    }
-    if(sgf != NULL) {
-      delete sgf;
+  std::atomic<size_t> nextFileIdx(0);
+  auto processLoop = [&](uint64_t threadSeed) {
+    Rand threadRand(threadSeed);
+    while(true) {
+      size_t i = nextFileIdx.fetch_add(1);
+      if(i >= sgfFiles.size())
+        break;
+      Sgf* sgf = NULL;
+      try {
+        sgf = Sgf::loadFile(sgfFiles[i]);
+        trySgf(sgf,threadRand);
+      }
+      catch(const StringError& e) {
+        logger.write("Invalid SGF " + sgfFiles[i] + ": " + e.what());
+      }
+      if(sgf != NULL) {
+        delete sgf;
+      }
     }
-  }
-  logger.write("Kept " + Global::int64ToString(numKept) + " start positions");
-  logger.write("Excluded " + Global::int64ToString(numExcluded) + "/" + Global::uint64ToString(sgfFiles.size()) + " sgf files");
-  logger.write("Filtered " + Global::int64ToString(numSgfsFilteredTopLevel) + "/" + Global::uint64ToString(sgfFiles.size()) + " sgf files");
+  };
+
+  vector<std::thread> processThreads;
+  for(int i = 0; i<numThreads; i++)
+    processThreads.push_back(std::thread(processLoop, seedRand.nextUInt64()));
+  for(size_t i = 0; i<processThreads.size(); i++)
+    processThreads[i].join();
+
+  logger.write("Kept " + Global::int64ToString(numKept.load()) + " start positions");
+  logger.write("Excluded " + Global::int64ToString(numExcluded.load()) + "/" + Global::uint64ToString(sgfFiles.size()) + " sgf files");
+  logger.write("Filtered " + Global::int64ToString(numSgfsFilteredTopLevel.load()) + "/" + Global::uint64ToString(sgfFiles.size()) + " sgf files");
 
 
   // ---------------------------------------------------------------------------------------------------
@@ -1630,45 +1656,47 @@ int MainCmds::dataminesgfs(const vector<string>& args) {
     );
   };
 
-  for(size_t i = 0; i<sgfFiles.size(); i++) {
+  vector<string> permutedSgfFiles(sgfFiles.size());
+  for(size_t i = 0; i<sgfFiles.size(); i++)
+    permutedSgfFiles[i] = sgfFiles[permutation[i]];
+
+  //Read and parse sgfs in the background, while positions are enumerated here in order
+  const int numLoadThreads = 0;
+  Sgf::loadFilesParallel(permutedSgfFiles, numLoadThreads, [&](size_t i, Sgf* sgf, const StringError* loadError) {
     numSgfsBegun += 1;
     if(numSgfsBegun % std::min((size_t)20, 1 + sgfFiles.size() / 60) == 0)
       logSgfProgress();
 
-    const string& fileName = sgfFiles[permutation[i]];
+    const string& fileName = permutedSgfFiles[i];
 
-    Sgf* sgf = NULL;
-    try {
-      sgf = Sgf::loadFile(fileName);
-    }
-    catch(const StringError& e) {
-      logger.write("Invalid SGF " + fileName + ": " + e.what());
-      continue;
+    if(loadError != NULL) {
+      logger.write("Invalid SGF " + fileName + ": " + loadError->what());
+      return;
     }
     if(contains(excludeHashes,sgf->hash)) {
       logger.write("Filtering due to exclude: " + fileName);
       numSgfsFilteredTopLevel += 1;
       delete sgf;
-      continue;
+      return;
     }
     try {
       if(!isSgfOkay(sgf)) {
         logger.write("Filtering due to not okay: " + fileName);
         numSgfsFilteredTopLevel += 1;
         delete sgf;
-        continue;
+        return;
       }
     }
     catch(const StringError& e) {
       logger.write("Filtering due to error checking okay: " + fileName + ": " + e.what());
       numSgfsFilteredTopLevel += 1;
       delete sgf;
-      continue;
+      return;
     }
     if(sgfSplitCount > 1 && ((int)(sgf->hash.hash0 & 0x7FFFFFFF) % sgfSplitCount) != sgfSplitIdx) {
       numSgfsSkipped += 1;
       delete sgf;
-      continue;
+      return;
     }
 
     logger.write("Starting " + fileName);
@@ -1705,15 +1733,17 @@ int MainCmds::dataminesgfs(const vector<string>& args) {
         );
       }
       catch(const StringError& e) {
-        if(!tolerateIllegalMoves)
+        if(!tolerateIllegalMoves) {
+          delete sgf;
           throw;
+        }
         else
           logger.write(e.what());
       }
       numSgfsDone.fetch_add(1);
       delete sgf;
     }
-  }
+  });
   logSgfProgress();
   logger.write("All sgfs loaded, waiting for finishing analysis");
   logger.write(Global::uint64ToString(sgfQueue.size()) + " sgfs still enqueued");
@@ -2160,3 +2190,844 @@ int MainCmds::sampleinitializations(const vector<string>& args) {
    
   return 0;
 }
+
+
+int MainCmds::npztoshard(const vector<string>& args) {
+  vector<string> inputs;
+  string outputFile;
+  int rowsPerChunk;
+  TrainingShard::Compression compression;
+  try {
+    KataHexCommandLine cmd("Convert .npz training data files into a single chunked training shard file.");
+    TCLAP::MultiArg<string> inputArg("","input",".npz file or directory of them to convert, can be given multiple times",true,"DIR_OR_FILE");
+    TCLAP::ValueArg<string> outputArg("","output","Shard file to write, appended to if it already exists",true,string(),"FILE");
+    TCLAP::ValueArg<int> rowsPerChunkArg("","rows-per-chunk","Rows per independently compressed chunk (default 256)",false,256,"ROWS");
+    TCLAP::ValueArg<string> compressionArg("","compression","Chunk compression, none or deflate (default deflate)",false,"deflate","NAME");
+    cmd.add(inputArg);
+    cmd.add(outputArg);
+    cmd.add(rowsPerChunkArg);
+    cmd.add(compressionArg);
+    cmd.parseArgs(args);
+    inputs = inputArg.getValue();
+    outputFile = outputArg.getValue();
+    rowsPerChunk = rowsPerChunkArg.getValue();
+    compression = TrainingShard::parseCompression(compressionArg.getValue());
+    if(rowsPerChunk <= 0 || rowsPerChunk > 1000000)
+      throw StringError("Invalid -rows-per-chunk: " + Global::intToString(rowsPerChunk));
+  }
+  catch (TCLAP::ArgException &e) {
+    cerr << "Error: " << e.error() << " for argument " << e.argId() << endl;
+    return 1;
+  }
+
+  Logger logger;
+  logger.setLogToStdout(true);
+
+  vector<string> npzFiles;
+  FileHelpers::collectTrainingDataFromDirsOrFiles(inputs,npzFiles);
+  npzFiles.erase(
+    std::remove_if(npzFiles.begin(), npzFiles.end(), [](const string& file) { return !Global::isSuffix(file,".npz"); }),
+    npzFiles.end()
+  );
+  std::sort(npzFiles.begin(),npzFiles.end());
+  logger.write("Found " + Global::uint64ToString(npzFiles.size()) + " npz files");
+  if(npzFiles.size() <= 0)
+    return 1;
+
+  //The fields of the shard are determined by the first file, all others must match it.
+  vector<TrainingShard::Field> fields = TrainingShard::getFieldsOfNpz(npzFiles[0]);
+  TrainingShardWriter writer(outputFile, fields, compression);
+  int64_t numRowsBefore = writer.getNumRows();
+  ClockTimer timer;
+  for(size_t i = 0; i<npzFiles.size(); i++) {
+    int64_t numRows = TrainingShard::appendNpzToShard(npzFiles[i], writer, rowsPerChunk);
+    logger.write("Converted " + npzFiles[i] + " (" + Global::int64ToString(numRows) + " rows)");
+  }
+  logger.write(
+    "Appended " + Global::int64ToString(writer.getNumRows() - numRowsBefore) + " rows to " + outputFile +
+    ", now " + Global::int64ToString(writer.getNumRows()) + " rows in " + Global::int64ToString(writer.getNumChunks()) + " chunks" +
+    ", took " + Global::doubleToString(timer.getSeconds()) + "s"
+  );
+  return 0;
+}
+
+
+int MainCmds::benchmarktrainwrite(const vector<string>& args) {
+  Board::initHash();
+
+  int numPositions;
+  int numRows;
+  try {
+    KataHexCommandLine cmd("Benchmark rows/sec of TrainingWriteBuffers::addRow on random positions, with and without packing the input planes directly from the board.");
+    TCLAP::ValueArg<int> numPositionsArg("","positions","Number of distinct random positions per board size (default 2000)",false,2000,"N");
+    TCLAP::ValueArg<int> numRowsArg("","rows","Number of rows to add per board size and method (default 200000)",false,200000,"N");
+    cmd.add(numPositionsArg);
+    cmd.add(numRowsArg);
+    cmd.parseArgs(args);
+    numPositions = numPositionsArg.getValue();
+    numRows = numRowsArg.getValue();
+    if(numPositions <= 0 || numRows <= 0)
+      throw StringError("-positions and -rows must be positive");
+  }
+  catch (TCLAP::ArgException &e) {
+    cerr << "Error: " << e.error() << " for argument " << e.argId() << endl;
+    return 1;
+  }
+
+  Rand rand("benchmarktrainwrite");
+  const int inputsVersion = 7;
+  const int maxRowsPerBuffer = 4096;
+  const int boardSizes[2] = {11,13};
+  for(int boardSize: boardSizes) {
+    //Random positions from random games, so that both players to move and all stages of the game are covered
+    vector<Board> boards;
+    vector<BoardHistory> hists;
+    vector<Player> plas;
+    Rules rules = Rules::getTrompTaylorish();
+    while((int)boards.size() < numPositions) {
+      Board board(boardSize,boardSize);
+      Player pla = P_BLACK;
+      BoardHistory hist(board,pla,rules);
+      while(!hist.isGameFinished && (int)boards.size() < numPositions) {
+        boards.push_back(board);
+        hists.push_back(hist);
+        plas.push_back(pla);
+        Loc loc;
+        do {
+          loc = Location::getLoc(rand.nextInt(0,boardSize-1),rand.nextInt(0,boardSize-1),boardSize);
+        } while(!hist.isLegal(board,loc,pla));
+        hist.makeBoardMoveAssumeLegal(board,loc,pla);
+        pla = getOpp(pla);
+      }
+    }
+
+    FinishedGameData data;
+    data.hasFullData = true;
+    data.drawEquivalentWinsForWhite = 0.5;
+    data.startHist = hists[0];
+    data.endHist = hists[0];
+    vector<ValueTargets> whiteValueTargets(1);
+    NNRawStats nnRawStats;
+    nnRawStats.whiteWinLoss = 0.0;
+    nnRawStats.whiteScoreMean = 0.0;
+    nnRawStats.policyEntropy = 0.0;
+    vector<PolicyTargetMove> policyTarget;
+    policyTarget.push_back(PolicyTargetMove(Location::getLoc(0,0,boardSize),100));
+
+    TrainingWriteBuffers direct(inputsVersion, maxRowsPerBuffer, NNInputs::NUM_FEATURES_SPATIAL_V7, NNInputs::NUM_FEATURES_GLOBAL_V7, boardSize, boardSize);
+    TrainingWriteBuffers viaFloats(inputsVersion, maxRowsPerBuffer, NNInputs::NUM_FEATURES_SPATIAL_V7, NNInputs::NUM_FEATURES_GLOBAL_V7, boardSize, boardSize);
+    viaFloats.packInputsViaFloats = true;
+
+    auto addRow = [&](TrainingWriteBuffers& buffers, int i) {
+      if(buffers.curRows >= buffers.maxRows)
+        buffers.clear();
+      buffers.addRow(
+        boards[i], hists[i], plas[i], 0, 1.0f, 100, &policyTarget, NULL, whiteValueTargets, 0, nnRawStats,
+        NULL, NULL, NULL, NULL, NULL, false, 0, data, rand
+      );
+    };
+
+    //Both methods must produce exactly the same inputs
+    int64_t packedRowBytes = (int64_t)NNInputs::NUM_FEATURES_SPATIAL_V7 * direct.packedBoardArea;
+    int64_t globalRowFloats = NNInputs::NUM_FEATURES_GLOBAL_V7;
+    for(int i = 0; i<numPositions; i++) {
+      direct.clear();
+      viaFloats.clear();
+      addRow(direct,i);
+      addRow(viaFloats,i);
+      if(memcmp(direct.binaryInputNCHWPacked.data, viaFloats.binaryInputNCHWPacked.data, packedRowBytes) != 0 ||
+         memcmp(direct.globalInputNC.data, viaFloats.globalInputNC.data, globalRowFloats * sizeof(float)) != 0)
+        throw StringError("benchmarktrainwrite: packed inputs differ between methods for board size " + Global::intToString(boardSize));
+    }
+
+    auto timeRows = [&](TrainingWriteBuffers& buffers) {
+      buffers.clear();
+      ClockTimer timer;
+      for(int i = 0; i<numRows; i++)
+        addRow(buffers, i % numPositions);
+      return numRows / std::max(timer.getSeconds(),1e-10);
+    };
+    double viaFloatsRowsPerSec = timeRows(viaFloats);
+    double directRowsPerSec = timeRows(direct);
+    cout << boardSize << "x" << boardSize << ": "
+         << "addRow via floats " << Global::strprintf("%.0f",viaFloatsRowsPerSec) << " rows/s, "
+         << "direct packing " << Global::strprintf("%.0f",directRowsPerSec) << " rows/s, "
+         << "speedup " << Global::strprintf("%.2f",directRowsPerSec / viaFloatsRowsPerSec) << "x"
+         << endl;
+  }
+  return 0;
+}
+
+//Whether a and b are the same json, up to floats having been through float32
+static bool jsonApproxEqual(const nlohmann::json& a, const nlohmann::json& b) {
+  if(a.is_number() && b.is_number()) {
+    if(a.is_number_float() || b.is_number_float())
+      return (float)a.get<double>() == (float)b.get<double>();
+    return a == b;
+  }
+  if(a.type() != b.type() || a.size() != b.size())
+    return false;
+  if(a.is_object()) {
+    for(auto iter = a.begin(); iter != a.end(); ++iter) {
+      if(b.find(iter.key()) == b.end() || !jsonApproxEqual(iter.value(), b[iter.key()]))
+        return false;
+    }
+    return true;
+  }
+  if(a.is_array()) {
+    for(size_t i = 0; i<a.size(); i++) {
+      if(!jsonApproxEqual(a[i], b[i]))
+        return false;
+    }
+    return true;
+  }
+  return a == b;
+}
+
+int MainCmds::benchmarkanalysisprotocol(const vector<string>& args) {
+  Board::initHash();
+  using json = nlohmann::json;
+
+  int numMessages;
+  int boardSize;
+  int numMoveInfos;
+  try {
+    KataHexCommandLine cmd("Benchmark messages/sec of encoding and decoding analysis engine responses in the json and msgpack protocols.");
+    TCLAP::ValueArg<int> numMessagesArg("","messages","Number of responses to encode and decode per protocol and kind (default 2000)",false,2000,"N");
+    TCLAP::ValueArg<int> boardSizeArg("","board-size","Board size of the responses (default 13)",false,13,"SIZE");
+    TCLAP::ValueArg<int> numMoveInfosArg("","move-infos","Number of moveInfos in each response (default 20)",false,20,"N");
+    cmd.add(numMessagesArg);
+    cmd.add(boardSizeArg);
+    cmd.add(numMoveInfosArg);
+    cmd.parseArgs(args);
+    numMessages = numMessagesArg.getValue();
+    boardSize = boardSizeArg.getValue();
+    numMoveInfos = numMoveInfosArg.getValue();
+    if(numMessages <= 0 || numMoveInfos <= 0)
+      throw StringError("-messages and -move-infos must be positive");
+    if(boardSize < 2 || boardSize > Board::MAX_LEN)
+      throw StringError("Invalid board size");
+  }
+  catch (TCLAP::ArgException &e) {
+    cerr << "Error: " << e.error() << " for argument " << e.argId() << endl;
+    return 1;
+  }
+
+  //Responses shaped like the ones the analysis engine writes, with random values of realistic precision
+  Rand rand("benchmarkanalysisprotocol");
+  Board board(boardSize,boardSize);
+  const int area = boardSize * boardSize;
+  auto makeOwnership = [&]() {
+    vector<double> ownership(area);
+    for(int i = 0; i<area; i++)
+      ownership[i] = round((rand.nextDouble() * 2.0 - 1.0) * 1000000.0) / 1000000.0;
+    return json(ownership);
+  };
+  auto makeResponse = [&](bool includeOwnership, bool includeMovesOwnership) {
+    json ret;
+    ret["id"] = "benchmark";
+    ret["turnNumber"] = rand.nextInt(0,area);
+    ret["isDuringSearch"] = false;
+    json moveInfos = json::array();
+    for(int i = 0; i<numMoveInfos; i++) {
+      json moveInfo;
+      moveInfo["move"] = Location::toString(Location::getLoc(rand.nextInt(0,boardSize-1),rand.nextInt(0,boardSize-1),boardSize),board);
+      moveInfo["visits"] = rand.nextInt(1,10000);
+      moveInfo["utility"] = rand.nextGaussian();
+      moveInfo["winrate"] = rand.nextDouble();
+      moveInfo["scoreMean"] = rand.nextGaussian();
+      moveInfo["scoreSelfplay"] = rand.nextGaussian();
+      moveInfo["scoreLead"] = rand.nextGaussian();
+      moveInfo["scoreStdev"] = rand.nextDouble();
+      moveInfo["prior"] = rand.nextDouble();
+      moveInfo["lcb"] = rand.nextDouble();
+      moveInfo["utilityLcb"] = rand.nextGaussian();
+      moveInfo["order"] = i;
+      json pv = json::array();
+      for(int j = 0; j<10; j++)
+        pv.push_back(Location::toString(Location::getLoc(rand.nextInt(0,boardSize-1),rand.nextInt(0,boardSize-1),boardSize),board));
+      moveInfo["pv"] = pv;
+      if(includeMovesOwnership)
+        moveInfo["ownership"] = makeOwnership();
+      moveInfos.push_back(moveInfo);
+    }
+    ret["moveInfos"] = moveInfos;
+    json rootInfo;
+    rootInfo["visits"] = rand.nextInt(1,100000);
+    rootInfo["winrate"] = rand.nextDouble();
+    rootInfo["scoreSelfplay"] = rand.nextGaussian();
+    rootInfo["scoreLead"] = rand.nextGaussian();
+    rootInfo["scoreStdev"] = rand.nextDouble();
+    rootInfo["utility"] = rand.nextGaussian();
+    rootInfo["thisHash"] = Global::uint64ToHexString(rand.nextUInt64()) + Global::uint64ToHexString(rand.nextUInt64());
+    rootInfo["symHash"] = Global::uint64ToHexString(rand.nextUInt64()) + Global::uint64ToHexString(rand.nextUInt64());
+    rootInfo["currentPlayer"] = "B";
+    ret["rootInfo"] = rootInfo;
+    json policy = json::array();
+    for(int i = 0; i<area+1; i++)
+      policy.push_back(rand.nextBool(0.2) ? -1.0 : rand.nextDouble() * 0.1);
+    ret["policy"] = policy;
+    if(includeOwnership)
+      ret["ownership"] = makeOwnership();
+    return ret;
+  };
+
+  struct Kind {
+    string name;
+    bool includeOwnership;
+    bool includeMovesOwnership;
+  };
+  const vector<Kind> kinds = {
+    {"policy only", false, false},
+    {"+ownership", true, false},
+    {"+movesOwnership", true, true},
+  };
+  for(const Kind& kind: kinds) {
+    const int numDistinct = 50;
+    vector<json> responses;
+    for(int i = 0; i<numDistinct; i++)
+      responses.push_back(makeResponse(kind.includeOwnership, kind.includeMovesOwnership));
+
+    //Both protocols must carry the same content
+    for(int i = 0; i<numDistinct; i++) {
+      json copy = responses[i];
+      string frame;
+      BinaryJson::encode(copy,frame);
+      std::istringstream in(frame);
+      string readBack;
+      if(!BinaryJson::readFrame(in,readBack) || !jsonApproxEqual(responses[i], BinaryJson::decode(readBack)) ||
+         !jsonApproxEqual(responses[i], json::parse(responses[i].dump())))
+        throw StringError("benchmarkanalysisprotocol: response did not round trip for " + kind.name);
+    }
+
+    //Each protocol encodes a fresh copy of the response, as the engine does when it builds and writes one
+    int64_t jsonBytes = 0;
+    ClockTimer jsonEncodeTimer;
+    vector<string> jsonMessages;
+    for(int i = 0; i<numMessages; i++) {
+      json copy = responses[i % numDistinct];
+      jsonMessages.push_back(copy.dump());
+      jsonBytes += (int64_t)jsonMessages.back().size() + 1;
+    }
+    double jsonEncodeSeconds = jsonEncodeTimer.getSeconds();
+    ClockTimer jsonDecodeTimer;
+    for(int i = 0; i<numMessages; i++) {
+      json decoded = json::parse(jsonMessages[i]);
+      (void)decoded;
+    }
+    double jsonDecodeSeconds = jsonDecodeTimer.getSeconds();
+
+    int64_t binaryBytes = 0;
+    ClockTimer binaryEncodeTimer;
+    vector<string> binaryMessages;
+    for(int i = 0; i<numMessages; i++) {
+      json copy = responses[i % numDistinct];
+      binaryMessages.push_back(string());
+      BinaryJson::encode(copy,binaryMessages.back());
+      binaryBytes += (int64_t)binaryMessages.back().size();
+    }
+    double binaryEncodeSeconds = binaryEncodeTimer.getSeconds();
+    ClockTimer binaryDecodeTimer;
+    for(int i = 0; i<numMessages; i++) {
+      json decoded = BinaryJson::decode(binaryMessages[i].substr(4));
+      (void)decoded;
+    }
+    double binaryDecodeSeconds = binaryDecodeTimer.getSeconds();
+
+    auto perSec = [&](double seconds) { return Global::strprintf("%.0f", numMessages / std::max(seconds,1e-10)); };
+    cout << boardSize << "x" << boardSize << " " << kind.name << ": "
+         << "json " << jsonBytes / numMessages << " bytes, encode " << perSec(jsonEncodeSeconds) << "/s, decode " << perSec(jsonDecodeSeconds) << "/s; "
+         << "msgpack " << binaryBytes / numMessages << " bytes, encode " << perSec(binaryEncodeSeconds) << "/s, decode " << perSec(binaryDecodeSeconds) << "/s; "
+         << "speedup " << Global::strprintf("%.2f", (jsonEncodeSeconds + jsonDecodeSeconds) / std::max(binaryEncodeSeconds + binaryDecodeSeconds,1e-10)) << "x"
+         << endl;
+  }
+  return 0;
+}
+
+int MainCmds::benchmarktimecontrols(const vector<string>& args) {
+  Board::initHash();
+
+  ConfigParser cfg;
+  string modelFile;
+  vector<string> sgfsFiles;
+  int numGames;
+  int boardSize;
+  double mainTime;
+  double increment;
+  double byoYomiTime;
+  int byoYomiPeriods;
+  double lagBuffer;
+  double meanLag;
+  double meanGameLengthFraction;
+  double nnNoise;
+  string seed;
+  try {
+    KataHexCommandLine cmd(
+      "Play out games on a simulated clock, comparing how well different ways of estimating the turns left in a game spend the time."
+    );
+    cmd.addConfigFileArg("","",false);
+    cmd.addModelFileArg();
+    cmd.addOverrideConfigArg();
+    TCLAP::MultiArg<string> sgfsArg(
+      "","sgfs",
+      "Replay real games from these .sgfs or .sgfs.gz files or directories of them, such as selfplay output, instead of random ones "
+      "of a synthetic length. Only games of -board-size without setup stones are used.",
+      false,"FILE_OR_DIR"
+    );
+    TCLAP::ValueArg<int> numGamesArg("","games","Number of games to simulate, or at most to replay with -sgfs (default 2000)",false,2000,"N");
+    TCLAP::ValueArg<int> boardSizeArg("","board-size","Board size (default 11)",false,11,"SIZE");
+    TCLAP::ValueArg<double> mainTimeArg("","main-time","Main time in seconds for each side (default 120)",false,120.0,"SECONDS");
+    TCLAP::ValueArg<double> incrementArg("","increment","Fischer increment in seconds (default 0)",false,0.0,"SECONDS");
+    TCLAP::ValueArg<double> byoYomiTimeArg("","byo-yomi-time","Byo-yomi period time in seconds, with -byo-yomi-periods (default 0)",false,0.0,"SECONDS");
+    TCLAP::ValueArg<int> byoYomiPeriodsArg("","byo-yomi-periods","Number of byo-yomi periods of one move each (default 0)",false,0,"N");
+    TCLAP::ValueArg<double> lagBufferArg("","lag-buffer","lagBuffer the engine plans with (default 1.0)",false,1.0,"SECONDS");
+    TCLAP::ValueArg<double> meanLagArg("","lag","Mean of the exponentially distributed lag actually added to each move (default 0.2)",false,0.2,"SECONDS");
+    TCLAP::ValueArg<double> meanGameLengthFractionArg("","game-length","Without -sgfs, median fraction of the board filled when games end (default 0.4)",false,0.4,"FRACTION");
+    TCLAP::ValueArg<double> nnNoiseArg(
+      "","nn-noise",
+      "Without -config and -model, the net's varTimeLeft is simulated as the true turns left times the exp of this stdev times a gaussian (default 0.4)",
+      false,0.4,"STDEV"
+    );
+    TCLAP::ValueArg<string> seedArg("","seed","Seed for the simulated games",false,"benchmarktimecontrols","SEED");
+    cmd.add(sgfsArg);
+    cmd.add(numGamesArg);
+    cmd.add(boardSizeArg);
+    cmd.add(mainTimeArg);
+    cmd.add(incrementArg);
+    cmd.add(byoYomiTimeArg);
+    cmd.add(byoYomiPeriodsArg);
+    cmd.add(lagBufferArg);
+    cmd.add(meanLagArg);
+    cmd.add(meanGameLengthFractionArg);
+    cmd.add(nnNoiseArg);
+    cmd.add(seedArg);
+    cmd.parseArgs(args);
+    numGames = numGamesArg.getValue();
+    boardSize = boardSizeArg.getValue();
+    mainTime = mainTimeArg.getValue();
+    increment = incrementArg.getValue();
+    byoYomiTime = byoYomiTimeArg.getValue();
+    byoYomiPeriods = byoYomiPeriodsArg.getValue();
+    lagBuffer = lagBufferArg.getValue();
+    meanLag = meanLagArg.getValue();
+    meanGameLengthFraction = meanGameLengthFractionArg.getValue();
+    nnNoise = nnNoiseArg.getValue();
+    seed = seedArg.getValue();
+    if(numGames <= 0)
+      throw StringError("-games must be positive");
+    if(boardSize < 2 || boardSize > Board::MAX_LEN)
+      throw StringError("Invalid board size");
+    if(!(mainTime >= 0) || !(increment >= 0) || !(byoYomiTime >= 0) || byoYomiPeriods < 0 || !(lagBuffer >= 0) || !(meanLag >= 0) || !(nnNoise >= 0))
+      throw StringError("Times, periods, and noise must be nonnegative");
+    if(!(meanGameLengthFraction > 0 && meanGameLengthFraction <= 1))
+      throw StringError("-game-length must be in (0,1]");
+    if(increment > 0 && byoYomiPeriods > 0)
+      throw StringError("Increment together with byo-yomi is not supported");
+    if(byoYomiPeriods > 0 && !(byoYomiTime > 0))
+      throw StringError("-byo-yomi-periods requires a positive -byo-yomi-time");
+
+    cmd.getConfigAllowEmpty(cfg);
+    if(cfg.getFileName() != "")
+      modelFile = cmd.getModelFile();
+    FileHelpers::collectMultiSgfsFromDirsOrFiles(sgfsArg.getValue(),sgfsFiles);
+    if(sgfsArg.getValue().size() > 0 && sgfsFiles.size() <= 0)
+      throw StringError("-sgfs: no .sgfs or .sgfs.gz files found");
+  }
+  catch (TCLAP::ArgException &e) {
+    cerr << "Error: " << e.error() << " for argument " << e.argId() << endl;
+    return 1;
+  }
+
+  TimeControls originalTC;
+  if(byoYomiPeriods > 0)
+    originalTC = TimeControls::canadianOrByoYomiTime(mainTime,byoYomiTime,byoYomiPeriods,1);
+  else if(increment > 0)
+    originalTC = TimeControls::fischerTime(mainTime,increment);
+  else
+    originalTC = TimeControls::absoluteTime(mainTime);
+
+  //Every policy plays the same games: how long each lasts, which color we are, where the stones go,
+  //and what the net's varTimeLeft is each turn.
+  struct SimGame {
+    int ourParity;
+    vector<Move> moves;
+    //For each of our turns, else unused
+    vector<double> nnVarTimeLefts;
+    vector<double> lags;
+  };
+  const int area = boardSize * boardSize;
+  Rand rand(seed);
+  vector<SimGame> games;
+  if(sgfsFiles.size() > 0) {
+    int64_t numSkipped = 0;
+    for(size_t i = 0; i<sgfsFiles.size() && (int)games.size() < numGames; i++) {
+      vector<Sgf*> sgfs = Sgf::loadSgfsFile(sgfsFiles[i]);
+      for(Sgf* sgf: sgfs) {
+        if((int)games.size() >= numGames) {
+          delete sgf;
+          continue;
+        }
+        //Games with setup stones don't say how long a game from the start lasts, and we can't always parse them anyways
+        std::unique_ptr<CompactSgf> compactSgf;
+        try {
+          compactSgf = std::make_unique<CompactSgf>(sgf);
+        }
+        catch(const IOError&) {
+        }
+        delete sgf;
+        bool usable =
+          compactSgf != nullptr && compactSgf->xSize == boardSize && compactSgf->ySize == boardSize &&
+          compactSgf->placements.size() <= 0 && compactSgf->moves.size() > 0;
+        for(size_t j = 0; usable && j<compactSgf->moves.size(); j++) {
+          if(compactSgf->moves[j].loc == Board::NULL_LOC || compactSgf->moves[j].loc == Board::PASS_LOC)
+            usable = false;
+        }
+        if(!usable) {
+          numSkipped += 1;
+          continue;
+        }
+        SimGame game;
+        game.moves = compactSgf->moves;
+        games.push_back(game);
+      }
+    }
+    if(games.size() <= 0)
+      throw StringError("-sgfs: no games of board size " + Global::intToString(boardSize) + " without setup stones");
+    cout << "Replaying " << games.size() << " games from " << sgfsFiles.size() << " files, skipped " << numSkipped << endl;
+  }
+  else {
+    vector<Loc> locs;
+    for(int y = 0; y<boardSize; y++)
+      for(int x = 0; x<boardSize; x++)
+        locs.push_back(Location::getLoc(x,y,boardSize));
+    for(int g = 0; g<numGames; g++) {
+      SimGame game;
+      double fraction = meanGameLengthFraction * exp(0.25 * rand.nextGaussian());
+      int length = std::max(2 * boardSize - 1, std::min(area, (int)round(fraction * area)));
+      for(int i = 0; i<length; i++) {
+        std::swap(locs[i], locs[rand.nextInt(i,area-1)]);
+        game.moves.push_back(Move(locs[i], i % 2 == 0 ? P_BLACK : P_WHITE));
+      }
+      games.push_back(game);
+    }
+    cout << "Simulating " << games.size() << " random games of synthetic length, use -sgfs to replay real ones instead" << endl;
+  }
+  for(SimGame& game: games) {
+    game.ourParity = rand.nextInt(0,1);
+    for(size_t i = 0; i<game.moves.size(); i++)
+      game.lags.push_back(meanLag * rand.nextExponential());
+  }
+
+  //The net's varTimeLeft, either from the actual net on each position or made up from the true turns left
+  NNEvaluator* nnEval = NULL;
+  Logger logger;
+  logger.setLogToStderr(true);
+  if(cfg.getFileName() != "") {
+    Setup::initializeSession(cfg);
+    const int maxConcurrentEvals = 8;
+    const int expectedConcurrentEvals = 1;
+    const int defaultMaxBatchSize = 1;
+    const bool defaultRequireExactNNLen = false;
+    const string expectedSha256 = "";
+    nnEval = Setup::initializeNNEvaluator(
+      modelFile,modelFile,expectedSha256,cfg,logger,rand,maxConcurrentEvals,expectedConcurrentEvals,
+      boardSize,boardSize,defaultMaxBatchSize,defaultRequireExactNNLen,
+      Setup::SETUP_FOR_BENCHMARK
+    );
+  }
+  const Rules rules = Rules::getTrompTaylorish();
+  for(SimGame& game: games) {
+    Board board(boardSize,boardSize);
+    BoardHistory hist(board,P_BLACK,rules);
+    game.nnVarTimeLefts.assign(game.moves.size(), -1.0);
+    for(size_t turn = 0; turn<game.moves.size(); turn++) {
+      if((int)(turn % 2) == game.ourParity) {
+        if(nnEval != NULL) {
+          MiscNNInputParams nnInputParams;
+          NNResultBuf buf;
+          nnEval->evaluate(board,hist,game.moves[turn].pla,nnInputParams,buf,false,false);
+          game.nnVarTimeLefts[turn] = buf.result->varTimeLeft;
+        }
+        else {
+          game.nnVarTimeLefts[turn] = (game.moves.size() - turn) * exp(nnNoise * rand.nextGaussian());
+        }
+      }
+      hist.makeBoardMoveAssumeLegal(board,game.moves[turn].loc,game.moves[turn].pla);
+    }
+  }
+  delete nnEval;
+  nnEval = NULL;
+
+  //How well the pieces that go into estimateHexTurnsLeft match these games
+  {
+    vector<double> lengthFractions;
+    vector<double> nnRatios;
+    double sumAbsLogErrorPosition = 0.0;
+    double sumAbsLogErrorPositionNN = 0.0;
+    for(const SimGame& game: games) {
+      lengthFractions.push_back((double)game.moves.size() / area);
+      Board board(boardSize,boardSize);
+      for(size_t turn = 0; turn<game.moves.size(); turn++) {
+        if((int)(turn % 2) == game.ourParity) {
+          double trueTurnsLeft = (double)(game.moves.size() - turn);
+          nnRatios.push_back(game.nnVarTimeLefts[turn] / trueTurnsLeft);
+          sumAbsLogErrorPosition += std::fabs(log(TimeControls::estimateHexTurnsLeft(board,-1.0) / trueTurnsLeft));
+          sumAbsLogErrorPositionNN += std::fabs(log(TimeControls::estimateHexTurnsLeft(board,game.nnVarTimeLefts[turn]) / trueTurnsLeft));
+        }
+        board.playMoveAssumeLegal(game.moves[turn].loc,game.moves[turn].pla);
+      }
+    }
+    std::sort(lengthFractions.begin(), lengthFractions.end());
+    std::sort(nnRatios.begin(), nnRatios.end());
+    double numRatios = std::max((double)nnRatios.size(), 1.0);
+    cout << Global::strprintf(
+      "Games end with a median %.3f of the board filled (10%%-90%% %.3f-%.3f), estimateHexTurnsLeft assumes %.3f",
+      lengthFractions[lengthFractions.size() / 2], lengthFractions[lengthFractions.size() / 10], lengthFractions[lengthFractions.size() * 9 / 10],
+      TimeControls::HEX_TYPICAL_GAME_LENGTH_FRACTION
+    ) << endl;
+    cout << Global::strprintf(
+      "%s varTimeLeft / true turns left: median %.3f (10%%-90%% %.3f-%.3f)",
+      cfg.getFileName() != "" ? "Net" : "Simulated",
+      nnRatios.size() > 0 ? nnRatios[nnRatios.size() / 2] : 0.0,
+      nnRatios.size() > 0 ? nnRatios[nnRatios.size() / 10] : 0.0,
+      nnRatios.size() > 0 ? nnRatios[nnRatios.size() * 9 / 10] : 0.0
+    ) << endl;
+    cout << Global::strprintf(
+      "Mean abs log error of estimated turns left: position %.3f, position+nn %.3f",
+      sumAbsLogErrorPosition / numRatios, sumAbsLogErrorPositionNN / numRatios
+    ) << endl;
+  }
+
+  enum class Policy { CRUDE, POSITION, POSITION_NN, ORACLE };
+  vector<std::pair<Policy,string>> policies = {
+    {Policy::CRUDE, "crude"},
+    {Policy::POSITION, "position"},
+    {Policy::POSITION_NN, "position+nn"},
+    {Policy::ORACLE, "oracle"},
+  };
+
+  cout << "Main time " << mainTime;
+  if(increment > 0)
+    cout << " increment " << increment;
+  if(byoYomiPeriods > 0)
+    cout << " byo-yomi " << byoYomiPeriods << "x" << byoYomiTime;
+  cout << " games " << games.size() << " board " << boardSize << "x" << boardSize
+       << " lagBuffer " << lagBuffer << " mean lag " << meanLag << endl;
+  cout << Global::strprintf("%12s %8s %10s %10s %10s %10s", "policy", "timeouts", "meanLog2T", "p10T", "meanT", "unused%") << endl;
+  for(const auto& policyAndName: policies) {
+    const Policy policy = policyAndName.first;
+    int numTimeouts = 0;
+    double sumLog2Time = 0.0;
+    double sumTime = 0.0;
+    double sumUnusedFraction = 0.0;
+    vector<double> moveTimes;
+    for(const SimGame& game: games) {
+      Board board(boardSize,boardSize);
+      BoardHistory hist(board,P_BLACK,Rules::getTrompTaylorish());
+      TimeControls tc = originalTC;
+      bool timedOut = false;
+      const int length = (int)game.moves.size();
+      for(int turn = 0; turn<length && !timedOut; turn++) {
+        if(turn % 2 == game.ourParity) {
+          double trueTurnsLeft = length - turn;
+          double approxGameTurnsLeft = -1.0;
+          if(policy == Policy::POSITION)
+            approxGameTurnsLeft = TimeControls::estimateHexTurnsLeft(board,-1.0);
+          else if(policy == Policy::POSITION_NN)
+            approxGameTurnsLeft = TimeControls::estimateHexTurnsLeft(board,game.nnVarTimeLefts[turn]);
+          else if(policy == Policy::ORACLE)
+            approxGameTurnsLeft = trueTurnsLeft;
+
+          double minTime;
+          double recommendedTime;
+          double maxTime;
+          tc.getTime(board,hist,lagBuffer,approxGameTurnsLeft,minTime,recommendedTime,maxTime);
+          double thinkTime = std::min(tc.roundUpTimeLimitIfNeeded(lagBuffer,0.0,recommendedTime),maxTime);
+          thinkTime = std::max(thinkTime,0.001);
+          double spent = thinkTime + game.lags[turn];
+          moveTimes.push_back(thinkTime);
+          sumLog2Time += log2(thinkTime);
+          sumTime += thinkTime;
+
+          //Run the clock
+          if(!tc.inOvertime) {
+            if(spent <= tc.mainTimeLeft) {
+              tc.mainTimeLeft += tc.increment - spent;
+              spent = 0.0;
+            }
+            else if(tc.originalNumPeriods > 0) {
+              spent -= tc.mainTimeLeft;
+              tc.mainTimeLeft = 0.0;
+              tc.inOvertime = true;
+              tc.numPeriodsLeftIncludingCurrent = tc.originalNumPeriods;
+              tc.numStonesLeftInPeriod = 1;
+              tc.timeLeftInPeriod = tc.perPeriodTime;
+            }
+            else
+              timedOut = true;
+          }
+          if(tc.inOvertime && !timedOut) {
+            while(spent > tc.perPeriodTime && tc.numPeriodsLeftIncludingCurrent > 0) {
+              spent -= tc.perPeriodTime;
+              tc.numPeriodsLeftIncludingCurrent -= 1;
+            }
+            if(tc.numPeriodsLeftIncludingCurrent <= 0)
+              timedOut = true;
+          }
+        }
+        board.playMoveAssumeLegal(game.moves[turn].loc,game.moves[turn].pla);
+      }
+      if(timedOut)
+        numTimeouts++;
+      if(originalTC.originalMainTime > 0)
+        sumUnusedFraction += tc.mainTimeLeft / originalTC.originalMainTime;
+    }
+
+    std::sort(moveTimes.begin(), moveTimes.end());
+    double numMoves = std::max((double)moveTimes.size(), 1.0);
+    double p10Time = moveTimes.size() > 0 ? moveTimes[moveTimes.size() / 10] : 0.0;
+    cout << Global::strprintf(
+      "%12s %8d %10.3f %10.3f %10.3f %10.1f",
+      policyAndName.second.c_str(), numTimeouts,
+      sumLog2Time / numMoves, p10Time, sumTime / numMoves,
+      100.0 * sumUnusedFraction / games.size()
+    ) << endl;
+  }
+  cout << "meanLog2T is the mean log2 seconds of thought per move, a proxy for strength since each doubling is worth about the same." << endl;
+  cout << "oracle knows the true turns left, as a reference for how much better a policy could do." << endl;
+  return 0;
+}
+
+int MainCmds::benchmarkponder(const vector<string>& args) {
+  Board::initHash();
+
+  ConfigParser cfg;
+  string modelFile;
+  int numGames;
+  int boardSize;
+  string seed;
+  try {
+    KataHexCommandLine cmd(
+      "Play games against a non-pondering opponent, pondering on each of its turns, and report how many of the pondered visits "
+      "are kept once it moves, with ponderingReplyFocus off and on."
+    );
+    cmd.addConfigFileArg("","gtp_example.cfg");
+    cmd.addModelFileArg();
+    cmd.addOverrideConfigArg();
+    TCLAP::ValueArg<int> numGamesArg("","games","Number of games per setting (default 10)",false,10,"N");
+    TCLAP::ValueArg<int> boardSizeArg("","board-size","Board size (default 11)",false,11,"SIZE");
+    TCLAP::ValueArg<string> seedArg("","seed","Seed for the searches",false,"benchmarkponder","SEED");
+    cmd.add(numGamesArg);
+    cmd.add(boardSizeArg);
+    cmd.add(seedArg);
+    cmd.parseArgs(args);
+    numGames = numGamesArg.getValue();
+    boardSize = boardSizeArg.getValue();
+    seed = seedArg.getValue();
+    if(numGames <= 0)
+      throw StringError("-games must be positive");
+    if(boardSize < 2 || boardSize > Board::MAX_LEN)
+      throw StringError("Invalid board size");
+    modelFile = cmd.getModelFile();
+    cmd.getConfig(cfg);
+  }
+  catch (TCLAP::ArgException &e) {
+    cerr << "Error: " << e.error() << " for argument " << e.argId() << endl;
+    return 1;
+  }
+
+  Logger logger;
+  logger.setLogToStderr(true);
+  const SearchParams baseParams = Setup::loadSingleParams(cfg,Setup::SETUP_FOR_GTP);
+  if(baseParams.maxVisitsPondering >= ((int64_t)1 << 50) && baseParams.maxPlayoutsPondering >= ((int64_t)1 << 50) && baseParams.maxTimePondering >= 1e19)
+    throw StringError("Set maxVisitsPondering, maxPlayoutsPondering, or maxTimePondering so that pondering ends");
+
+  //Both sides share one evaluator, so with a large enough cache they see the same evals for the same positions,
+  //even with debugSkipNeuralNet.
+  Rand rand(seed);
+  NNEvaluator* nnEval;
+  {
+    Setup::initializeSession(cfg);
+    const int maxConcurrentEvals = baseParams.numThreads * 2 + 16;
+    const int expectedConcurrentEvals = baseParams.numThreads;
+    const int defaultMaxBatchSize = std::max(8,((baseParams.numThreads+3)/4)*4);
+    const bool defaultRequireExactNNLen = false;
+    const string expectedSha256 = "";
+    nnEval = Setup::initializeNNEvaluator(
+      modelFile,modelFile,expectedSha256,cfg,logger,rand,maxConcurrentEvals,expectedConcurrentEvals,
+      boardSize,boardSize,defaultMaxBatchSize,defaultRequireExactNNLen,
+      Setup::SETUP_FOR_BENCHMARK
+    );
+  }
+
+  const double focus = baseParams.ponderingReplyFocus > 0 ? baseParams.ponderingReplyFocus : 0.5;
+  struct Setting {
+    string name;
+    double focus;
+    double exponent;
+  };
+  vector<Setting> settings = {
+    {"off", 0.0, 1.0},
+    {Global::strprintf("focus %.2f exponent 1", focus), focus, 1.0},
+    {Global::strprintf("focus %.2f exponent %.2f", focus, baseParams.ponderingReplyFocusExponent), focus, baseParams.ponderingReplyFocusExponent},
+  };
+
+  const Rules rules = Rules::getTrompTaylorish();
+  cout << Global::strprintf("%32s %10s %12s %12s %10s", "setting", "ponders", "ponderVisits", "carriedOver", "kept%") << endl;
+  for(const Setting& setting: settings) {
+    SearchParams params = baseParams;
+    params.ponderingReplyFocus = setting.focus;
+    params.ponderingReplyFocusExponent = setting.exponent;
+    SearchParams oppParams = baseParams;
+    oppParams.ponderingReplyFocus = 0.0;
+    //Same seeds for every setting, so that they differ only by where the ponder visits went
+    Search* bot = new Search(params, nnEval, &logger, seed + "|bot");
+    Search* opp = new Search(oppParams, nnEval, &logger, seed + "|opp");
+
+    int64_t numPonders = 0;
+    int64_t ponderVisitsSum = 0;
+    int64_t carriedOverSum = 0;
+    for(int gameIdx = 0; gameIdx<numGames; gameIdx++) {
+      Board board(boardSize,boardSize);
+      BoardHistory hist(board,P_BLACK,rules);
+      Player botPla = gameIdx % 2 == 0 ? P_BLACK : P_WHITE;
+      Player pla = P_BLACK;
+      bot->setPosition(pla,board,hist);
+      while(!hist.isGameFinished && hist.moveHistory.size() < (size_t)(boardSize * boardSize)) {
+        Loc loc;
+        if(pla == botPla) {
+          loc = bot->runWholeSearchAndGetMove(pla);
+          bot->makeMove(loc,pla);
+        }
+        else {
+          bot->runWholeSearch(pla,true);
+          int64_t ponderVisits = bot->getRootVisits();
+          opp->setPosition(pla,board,hist);
+          loc = opp->runWholeSearchAndGetMove(pla);
+          bot->makeMove(loc,pla);
+          numPonders += 1;
+          ponderVisitsSum += ponderVisits;
+          carriedOverSum += bot->getRootVisits();
+        }
+        if(loc == Board::NULL_LOC)
+          break;
+        hist.makeBoardMoveAssumeLegal(board,loc,pla);
+        pla = getOpp(pla);
+      }
+    }
+    delete bot;
+    delete opp;
+
+    double n = std::max((double)numPonders, 1.0);
+    cout << Global::strprintf(
+      "%32s %10lld %12.1f %12.1f %10.1f",
+      setting.name.c_str(), (long long)numPonders, ponderVisitsSum / n, carriedOverSum / n,
+      100.0 * carriedOverSum / std::max((double)ponderVisitsSum, 1.0)
+    ) << endl;
+  }
+  cout << "carriedOver is the visits left at the root after the opponent's reply, out of ponderVisits pondered before it." << endl;
+
+  delete nnEval;
+  NeuralNet::globalCleanup();
+  return 0;
+}
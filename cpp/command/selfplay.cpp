@@ -3,19 +3,25 @@
 #include "../core/fileutils.h"
 #include "../core/makedir.h"
 #include "../core/config_parser.h"
+#include "../core/cooperativescheduler.h"
+#include "../core/dirwatcher.h"
+#include "../core/timer.h"
 #include "../dataio/sgf.h"
 #include "../dataio/trainingwrite.h"
+#include "../dataio/trainingshard.h"
 #include "../dataio/loadmodel.h"
 #include "../neuralnet/modelversion.h"
 #include "../search/asyncbot.h"
 #include "../program/setup.h"
 #include "../program/play.h"
+#include "../program/playutils.h"
 #include "../program/selfplaymanager.h"
 #include "../command/commandline.h"
 #include "../main.h"
 
 #include <chrono>
 #include <csignal>
+#include <ctime>
 
 using namespace std;
 
@@ -90,6 +96,11 @@ int MainCmds::selfplay(const vector<string>& args) {
 
   //Load runner settings
   const int numGameThreads = cfg.getInt("numGameThreads",1,16384);
+  //Games run concurrently by each game thread, switching to another game whenever one waits on the neural net,
+  //so that few threads can fill large batches. Best with numSearchThreads = 1.
+  const int numGamesPerThread = cfg.contains("numGamesPerThread") ? cfg.getInt("numGamesPerThread",1,4096) : 1;
+  if(numGamesPerThread > 1 && !CooperativeScheduler::isSupported())
+    throw StringError("numGamesPerThread > 1 is not supported on this platform");
   const string gameSeedBase = Global::uint64ToHexString(seedRand.nextUInt64());
 
   //Width and height of the board to use when writing data, typically 19
@@ -103,6 +114,33 @@ int MainCmds::selfplay(const vector<string>& args) {
   const int maxRowsPerTrainFile = cfg.getInt("maxRowsPerTrainFile",1,100000000);
   const int maxRowsPerValFile = cfg.getInt("maxRowsPerValFile",1,100000000);
   const double firstFileRandMinProp = cfg.getDouble("firstFileRandMinProp",0.0,1.0);
+  //Threads compressing and writing full training data files, so that the data write loop can keep adding rows meanwhile.
+  //0 means compress and write on the data write loop itself.
+  const int numDataWriteThreads = cfg.contains("numDataWriteThreads") ? cfg.getInt("numDataWriteThreads",0,64) : 0;
+  //Number of full files per writer that can wait to be written before the data write loop blocks.
+  //Each one costs another buffer of maxRowsPerTrainFile rows of memory.
+  const int maxPendingDataFiles = cfg.contains("maxPendingDataFiles") ? cfg.getInt("maxPendingDataFiles",1,64) : 1;
+  //"npz" writes a separate .npz file every maxRowsPerTrainFile rows.
+  //"shard" appends chunks of shardRowsPerChunk rows to .khshard files holding up to maxRowsPerTrainFile rows each.
+  const string trainingDataFormat = cfg.contains("trainingDataFormat") ? cfg.getString("trainingDataFormat", {"npz","shard"}) : "npz";
+  const int shardRowsPerChunk = cfg.contains("shardRowsPerChunk") ? cfg.getInt("shardRowsPerChunk",1,1000000) : 256;
+  const TrainingShard::Compression shardCompression =
+    cfg.contains("shardCompression") ? TrainingShard::parseCompression(cfg.getString("shardCompression")) : TrainingShard::Compression::DEFLATE;
+  //Merge rows for identical positions within the same file or shard chunk into one row with the combined weight.
+  //Mostly catches shared openings, and with dedupTrainingRowsSymmetry, also openings that are 180 degree rotations.
+  //With shard output, chunks grow to at least dedupTrainingRowsWindow rows so that there is something to dedup within.
+  const bool dedupTrainingRows = cfg.contains("dedupTrainingRows") ? cfg.getBool("dedupTrainingRows") : false;
+  const bool dedupTrainingRowsSymmetry = cfg.contains("dedupTrainingRowsSymmetry") ? cfg.getBool("dedupTrainingRowsSymmetry") : true;
+  const int dedupTrainingRowsWindow = cfg.contains("dedupTrainingRowsWindow") ? cfg.getInt("dedupTrainingRowsWindow",1,100000000) : 8192;
+  //New models are noticed as soon as they are written where inotify is available, but models-dir is also rescanned
+  //this often in case that is not available or misses something, such as on some network filesystems.
+  const double modelsDirPollSeconds = cfg.contains("modelsDirPollSeconds") ? cfg.getDouble("modelsDirPollSeconds",0.1,86400.0) : 20.0;
+  //Positions per board size evaluated on a newly loaded model before games start using it, 0 to switch right away.
+  const int modelWarmupPositions = cfg.contains("modelWarmupPositions") ? cfg.getInt("modelWarmupPositions",0,10000) : 16;
+  //Sgfs are written as .sgfs.gz if gzipSgfFiles, starting a new file after every maxMegabytesPerSgfFile of sgf text, or
+  //only at each new model if 0.
+  const bool gzipSgfFiles = cfg.contains("gzipSgfFiles") ? cfg.getBool("gzipSgfFiles") : false;
+  const double maxMegabytesPerSgfFile = cfg.contains("maxMegabytesPerSgfFile") ? cfg.getDouble("maxMegabytesPerSgfFile",0.0,1e6) : 0.0;
 
   const double validationProp = cfg.getDouble("validationProp",0.0,0.5);
   const int64_t logGamesEvery = cfg.getInt64("logGamesEvery",1,1000000);
@@ -135,12 +173,27 @@ int MainCmds::selfplay(const vector<string>& args) {
   std::signal(SIGTERM, signalHandler);
 
 
+  //Set up before the first model is loaded, so that nothing written after that is missed
+  DirWatcher modelsDirWatcher(modelsDir);
+  if(modelsDirWatcher.isEventDriven())
+    logger.write("Watching " + modelsDir + " for new models");
+  else
+    logger.write("Could not watch " + modelsDir + " for new models, only rescanning it every " + Global::doubleToString(modelsDirPollSeconds) + " seconds");
+
+  vector<std::pair<int,int>> warmupBoardSizes;
+  warmupBoardSizes.push_back(std::make_pair(maxBoardXSizeUsed,maxBoardYSizeUsed));
+  if(minBoardXSizeUsed != maxBoardXSizeUsed || minBoardYSizeUsed != maxBoardYSizeUsed)
+    warmupBoardSizes.push_back(std::make_pair(minBoardXSizeUsed,minBoardYSizeUsed));
+
   //Returns true if a new net was loaded.
   auto loadLatestNeuralNetIntoManager =
     [inputsVersion,&manager,maxRowsPerTrainFile,maxRowsPerValFile,firstFileRandMinProp,dataBoardLen,
-     &modelsDir,&outputDir,&logger,&cfg,numGameThreads,
+     numDataWriteThreads,maxPendingDataFiles,trainingDataFormat,shardRowsPerChunk,shardCompression,
+     dedupTrainingRows,dedupTrainingRowsSymmetry,dedupTrainingRowsWindow,modelWarmupPositions,&warmupBoardSizes,gzipSgfFiles,maxMegabytesPerSgfFile,
+     &modelsDir,&outputDir,&logger,&cfg,numGameThreads,numGamesPerThread,
      minBoardXSizeUsed,maxBoardXSizeUsed,minBoardYSizeUsed,maxBoardYSizeUsed](const string* lastNetName) -> bool {
 
+    ClockTimer switchTimer;
     string modelName;
     string modelFile;
     string modelDir;
@@ -154,8 +207,8 @@ int MainCmds::selfplay(const vector<string>& args) {
     logger.write("Found new neural net " + modelName);
 
     // * 2 + 16 just in case to have plenty of room
-    const int maxConcurrentEvals = cfg.getInt("numSearchThreads") * numGameThreads * 2 + 16;
-    const int expectedConcurrentEvals = cfg.getInt("numSearchThreads") * numGameThreads;
+    const int maxConcurrentEvals = cfg.getInt("numSearchThreads") * numGameThreads * numGamesPerThread * 2 + 16;
+    const int expectedConcurrentEvals = cfg.getInt("numSearchThreads") * numGameThreads * numGamesPerThread;
     const bool defaultRequireExactNNLen = minBoardXSizeUsed == maxBoardXSizeUsed && minBoardYSizeUsed == maxBoardYSizeUsed;
     const int defaultMaxBatchSize = -1;
     const string expectedSha256 = "";
@@ -167,6 +220,13 @@ int MainCmds::selfplay(const vector<string>& args) {
       Setup::SETUP_FOR_OTHER
     );
     logger.write("Loaded latest neural net " + modelName + " from: " + modelFile);
+    const double loadSeconds = switchTimer.getSeconds();
+
+    //Games keep running on the previous net meanwhile, so they don't pay for the first evals on the new one
+    int numWarmupPositions = 0;
+    if(modelWarmupPositions > 0)
+      numWarmupPositions = PlayUtils::warmUpNNEvaluator(nnEval,warmupBoardSizes,modelWarmupPositions,rand);
+    const double warmupSeconds = switchTimer.getSeconds() - loadSeconds;
 
     string modelOutputDir = outputDir + "/" + modelName;
     string sgfOutputDir = modelOutputDir + "/sgfs";
@@ -217,14 +277,33 @@ int MainCmds::selfplay(const vector<string>& args) {
       tdataOutputDir, inputsVersion, maxRowsPerTrainFile, firstFileRandMinProp, dataBoardLen, dataBoardLen, Global::uint64ToHexString(rand.nextUInt64()));
     TrainingDataWriter* vdataWriter = new TrainingDataWriter(
       vdataOutputDir, inputsVersion, maxRowsPerValFile, firstFileRandMinProp, dataBoardLen, dataBoardLen, Global::uint64ToHexString(rand.nextUInt64()));
-    ofstream* sgfOut = NULL;
+    if(trainingDataFormat == "shard") {
+      tdataWriter->enableShardOutput(shardRowsPerChunk, shardCompression);
+      vdataWriter->enableShardOutput(shardRowsPerChunk, shardCompression);
+    }
+    if(dedupTrainingRows) {
+      tdataWriter->enableRowDedup(dedupTrainingRowsSymmetry, dedupTrainingRowsWindow);
+      vdataWriter->enableRowDedup(dedupTrainingRowsSymmetry, dedupTrainingRowsWindow);
+    }
+    if(numDataWriteThreads > 0) {
+      tdataWriter->enableBackgroundWriting(numDataWriteThreads, maxPendingDataFiles);
+      vdataWriter->enableBackgroundWriting(numDataWriteThreads, maxPendingDataFiles);
+    }
+    SgfStreamWriter* sgfOut = NULL;
     if(sgfOutputDir.length() > 0) {
-      sgfOut = new ofstream();
-      FileUtils::open(*sgfOut, sgfOutputDir + "/" + Global::uint64ToHexString(rand.nextUInt64()) + ".sgfs");
+      const size_t sgfBlockBytes = 256 * 1024;
+      sgfOut = new SgfStreamWriter(sgfOutputDir, gzipSgfFiles, (int64_t)(maxMegabytesPerSgfFile * 1048576.0), sgfBlockBytes);
     }
 
     logger.write("Model loading loop thread loaded new neural net " + nnEval->getModelName());
     manager->loadModelAndStartDataWriting(nnEval, tdataWriter, vdataWriter, sgfOut);
+    string switchMessage = Global::strprintf(
+      "Switched to neural net %s %.3f seconds after finding it (loading %.3f, warm-up of %d positions %.3f)",
+      modelName.c_str(), switchTimer.getSeconds(), loadSeconds, numWarmupPositions, warmupSeconds
+    );
+    if(modelTime > 0)
+      switchMessage += Global::strprintf(", %.0f seconds after it was written", std::difftime(std::time(NULL), modelTime));
+    logger.write(switchMessage);
     return true;
   };
 
@@ -240,13 +319,34 @@ int MainCmds::selfplay(const vector<string>& args) {
 
   //Shared across all game loop threads
   std::atomic<int64_t> numGamesStarted(0);
+  std::atomic<int64_t> numGamesFinished(0);
   ForkData* forkData = new ForkData();
+  const ClockTimer selfplayTimer;
+  const double initialCpuSeconds = ClockTimer::getProcessCpuSeconds();
+  //For comparing throughput and cpu usage across numGameThreads and numGamesPerThread
+  auto logThroughput = [&logger,&selfplayTimer,initialCpuSeconds](int64_t gamesFinished) {
+    double seconds = selfplayTimer.getSeconds();
+    double cpuSeconds = ClockTimer::getProcessCpuSeconds() - initialCpuSeconds;
+    int numCores = std::max(1,(int)std::thread::hardware_concurrency());
+    Play::MoveOverheadStats overhead = Play::getMoveOverheadStats();
+    logger.write(Global::strprintf(
+      "Finished %lld games, %.1f games/hour, cpu utilization %.1f%% of %d cores, "
+      "move overhead outside playouts %.1f us/move cheap (%lld moves) %.1f us/move full (%lld moves)",
+      (long long)gamesFinished, gamesFinished * 3600.0 / std::max(seconds,1e-10),
+      cpuSeconds / std::max(seconds,1e-10) / numCores * 100.0, numCores,
+      overhead.cheapMoveOverheadSeconds * 1e6 / std::max(overhead.numCheapMoves,(int64_t)1), (long long)overhead.numCheapMoves,
+      overhead.fullMoveOverheadSeconds * 1e6 / std::max(overhead.numFullMoves,(int64_t)1), (long long)overhead.numFullMoves
+    ));
+  };
   auto gameLoop = [
     &gameRunner,
     &manager,
     &logger,
     switchNetsMidGame,
     &numGamesStarted,
+    &numGamesFinished,
+    &logThroughput,
+    logGamesEvery,
     &forkData,
     maxGamesTotal,
     &baseParams,
@@ -311,8 +411,12 @@ int MainCmds::selfplay(const vector<string>& args) {
       //Or when we run out of total games.
       bool shouldContinue = gameData != NULL;
       //Note that if we've gotten a newNNEval, we're actually pushing the game as data for the new one, rather than the old one!
-      if(gameData != NULL)
+      if(gameData != NULL) {
         manager->enqueueDataToWrite(nnEval,gameData);
+        int64_t gamesFinished = numGamesFinished.fetch_add(1,std::memory_order_acq_rel) + 1;
+        if(gamesFinished % logGamesEvery == 0)
+          logThroughput(gamesFinished);
+      }
 
       manager->release(nnEval);
 
@@ -325,11 +429,33 @@ int MainCmds::selfplay(const vector<string>& args) {
   auto gameLoopProtected = [&logger,&gameLoop](int threadIdx) {
     Logger::logThreadUncaught("game loop", &logger, [&](){ gameLoop(threadIdx); });
   };
+  //Each thread runs numGamesPerThread game loops as cooperative tasks
+  auto gameThreadLoop = [&gameLoopProtected,numGamesPerThread](int threadIdx) {
+    if(numGamesPerThread <= 1) {
+      gameLoopProtected(threadIdx);
+      return;
+    }
+    vector<std::function<void()>> tasks;
+    for(int i = 0; i<numGamesPerThread; i++) {
+      int gameLoopIdx = threadIdx * numGamesPerThread + i;
+      tasks.push_back([&gameLoopProtected,gameLoopIdx]() {
+        try {
+          gameLoopProtected(gameLoopIdx);
+        }
+        catch(...) {
+          //Wind down the other game loops, so that the error actually propagates
+          shouldStop.store(true);
+          throw;
+        }
+      });
+    }
+    //Same as the usual default thread stack size, only the pages actually used get committed
+    const size_t stackBytesPerTask = 8 * 1024 * 1024;
+    CooperativeScheduler::run(tasks, stackBytesPerTask);
+  };
 
-  //Looping thread for polling for new neural nets and loading them in
-  std::mutex modelLoadMutex;
-  std::condition_variable modelLoadSleepVar;
-  auto modelLoadLoop = [&modelLoadMutex,&modelLoadSleepVar,&logger,&manager,&loadLatestNeuralNetIntoManager]() {
+  //Looping thread for waiting for new neural nets and loading them in
+  auto modelLoadLoop = [&modelsDirWatcher,modelsDirPollSeconds,&logger,&manager,&loadLatestNeuralNetIntoManager]() {
     logger.write("Model loading loop thread starting");
 
     while(true) {
@@ -342,9 +468,8 @@ int MainCmds::selfplay(const vector<string>& args) {
       if(shouldStop.load())
         break;
 
-      //Sleep for a while and then re-poll
-      std::unique_lock<std::mutex> lock(modelLoadMutex);
-      modelLoadSleepVar.wait_for(lock, std::chrono::seconds(20), [](){return shouldStop.load();});
+      //Sleep until something is written to the models dir, or for a while, and then rescan it
+      modelsDirWatcher.waitForChange(modelsDirPollSeconds);
     }
 
     logger.write("Model loading loop thread terminating");
@@ -355,7 +480,7 @@ int MainCmds::selfplay(const vector<string>& args) {
 
   vector<std::thread> threads;
   for(int i = 0; i<numGameThreads; i++) {
-    threads.push_back(std::thread(gameLoopProtected,i));
+    threads.push_back(std::thread(gameThreadLoop,i));
   }
   std::thread modelLoadLoopThread(modelLoadLoopProtected);
 
@@ -363,17 +488,15 @@ int MainCmds::selfplay(const vector<string>& args) {
   for(int i = 0; i<threads.size(); i++)
     threads[i].join();
 
+  if(numGamesFinished.load() % logGamesEvery != 0)
+    logThroughput(numGamesFinished.load());
+
   //If by now somehow shouldStop is not true, set it to be true since all game threads are toast
   shouldStop.store(true);
 
   //Wake up the model loading thread rather than waiting for it to wake up on its own, and
-  //wait for it to die.
-  {
-    //Lock so that we don't race where we notify the loading thread to wake when it's still in
-    //its own critical section but not yet slept, and to ensure the two agree on shouldStop.
-    std::lock_guard<std::mutex> lock(modelLoadMutex);
-    modelLoadSleepVar.notify_all();
-  }
+  //wait for it to die. The interrupt is not lost even if the thread is not waiting yet.
+  modelsDirWatcher.interrupt();
   modelLoadLoopThread.join();
 
   //At this point, nothing else except possibly data write loops are running, within the selfplay manager.
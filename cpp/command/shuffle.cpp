@@ -0,0 +1,437 @@
+#include "../core/global.h"
+#include "../core/makedir.h"
+#include "../core/os.h"
+#include "../core/rand.h"
+#include "../core/timer.h"
+#include "../dataio/files.h"
+#include "../dataio/trainingshard.h"
+#include "../command/commandline.h"
+#include "../main.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#ifdef OS_IS_UNIX_OR_APPLE
+  #include <sys/resource.h>
+#endif
+
+#include <ghc/filesystem.hpp>
+
+using namespace std;
+namespace gfs = ghc::filesystem;
+
+/*
+  Two pass external-memory shuffle of training shards.
+
+  Scatter: the input rows are split into blocks that threads read in parallel. Each row is subsampled according to
+  its row weight, and every copy of it that survives is sent to a uniformly random bucket, which is a temporary shard.
+  To stay within open file limits, only so many buckets are open at once, by default as many as the limit allows.
+  With more buckets than that, the input is read once per range of buckets, with the same random choices each time
+  so that every copy lands in exactly one bucket. Each thread reads one input shard at a time.
+  Gather: threads load one bucket at a time into memory, shuffle it, and write it out as one output shard.
+  Since every row goes to a uniformly random bucket and each bucket is uniformly shuffled, the concatenation of the
+  outputs is a uniform shuffle of the whole input, while memory stays bounded by about numThreads buckets.
+*/
+
+namespace {
+  struct InputShard {
+    string fileName;
+    int64_t numRows;
+    //Rows before this one are outside of the window
+    int64_t firstRow;
+  };
+
+  struct ReadBlock {
+    size_t shardIdx;
+    int64_t firstRow;
+    int64_t numRows;
+  };
+}
+
+static const int ROWS_PER_READ_BLOCK = 4096;
+//Rows per chunk of the temporary bucket shards, buffered per thread per bucket before appending
+static const int ROWS_PER_TMP_CHUNK = 64;
+//Bound on what each thread buffers for all buckets together, using smaller temporary chunks if needed
+static const int64_t MAX_STAGING_BYTES_PER_THREAD = (int64_t)64 << 20;
+
+//Default for -max-open-buckets, as many as the open file limit allows after the readers and some headroom,
+//since every further set of buckets costs another full read of the input. Raises the soft limit as far as possible first.
+static int defaultMaxOpenBuckets(int numThreads) {
+#ifdef OS_IS_UNIX_OR_APPLE
+  struct rlimit limit;
+  if(getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    if(limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur != limit.rlim_max) {
+      struct rlimit raised = limit;
+      raised.rlim_cur = limit.rlim_max;
+      //May fail where the hard limit is unlimited but the kernel caps it lower, then we just keep the soft limit
+      if(setrlimit(RLIMIT_NOFILE, &raised) == 0)
+        limit = raised;
+    }
+    int64_t fileLimit = limit.rlim_cur == RLIM_INFINITY ? (int64_t)1 << 20 : (int64_t)std::min(limit.rlim_cur, (rlim_t)1 << 20);
+    return (int)std::max((int64_t)16, std::min((int64_t)65536, fileLimit - 2 * numThreads - 64));
+  }
+#endif
+  (void)numThreads;
+  return 128;
+}
+
+//Number of copies of a row of weight targetWeight to emit, with the right expectation
+static int numCopiesForWeight(float targetWeight, Rand& rand) {
+  if(!(targetWeight > 0.0f))
+    return 0;
+  double whole = floor(targetWeight);
+  int numCopies = (int)whole;
+  if(rand.nextBool(targetWeight - whole))
+    numCopies += 1;
+  return numCopies;
+}
+
+int MainCmds::shuffle(const vector<string>& args) {
+  vector<string> inputs;
+  string outputDir;
+  int64_t windowRows;
+  int64_t rowsPerShard;
+  int rowsPerChunk;
+  TrainingShard::Compression compression;
+  int numThreads;
+  string seed;
+  bool keepWeights;
+  int maxOpenBuckets;
+  try {
+    KataHexCommandLine cmd("Shuffle training shards into new shards with bounded memory, subsampling rows by weight.");
+    TCLAP::MultiArg<string> inputArg("","input","Shard file or directory of them to shuffle, can be given multiple times",true,"DIR_OR_FILE");
+    TCLAP::ValueArg<string> outputDirArg("","output-dir","Dir to write shuffled shards to",true,string(),"DIR");
+    TCLAP::ValueArg<int64_t> windowRowsArg("","window-rows","Only use the most recent this many input rows, by shard modification time (default all)",false,0,"ROWS");
+    TCLAP::ValueArg<int64_t> rowsPerShardArg("","rows-per-shard","Approximate rows per output shard, each thread holds one shard worth of rows in memory at a time (default 250000)",false,250000,"ROWS");
+    TCLAP::ValueArg<int> rowsPerChunkArg("","rows-per-chunk","Rows per independently compressed chunk of the output (default 256)",false,256,"ROWS");
+    TCLAP::ValueArg<string> compressionArg("","compression","Output chunk compression, none or deflate (default deflate)",false,"deflate","NAME");
+    TCLAP::ValueArg<int> numThreadsArg("","num-threads","Number of threads reading, shuffling, and writing (default 4)",false,4,"THREADS");
+    TCLAP::ValueArg<string> seedArg("","seed","Random seed (default random)",false,string(),"SEED");
+    TCLAP::SwitchArg keepWeightsArg("","keep-weights","Copy rows once each with their weights as they are, instead of subsampling them by weight");
+    TCLAP::ValueArg<int> maxOpenBucketsArg("","max-open-buckets","Max temporary shards to write at once, reading the input again for each further set of them (default as many as the open file limit allows)",false,0,"N");
+    cmd.add(inputArg);
+    cmd.add(outputDirArg);
+    cmd.add(windowRowsArg);
+    cmd.add(rowsPerShardArg);
+    cmd.add(rowsPerChunkArg);
+    cmd.add(compressionArg);
+    cmd.add(numThreadsArg);
+    cmd.add(seedArg);
+    cmd.add(keepWeightsArg);
+    cmd.add(maxOpenBucketsArg);
+    cmd.parseArgs(args);
+    inputs = inputArg.getValue();
+    outputDir = outputDirArg.getValue();
+    windowRows = windowRowsArg.getValue();
+    rowsPerShard = rowsPerShardArg.getValue();
+    rowsPerChunk = rowsPerChunkArg.getValue();
+    compression = TrainingShard::parseCompression(compressionArg.getValue());
+    numThreads = numThreadsArg.getValue();
+    seed = seedArg.getValue();
+    keepWeights = keepWeightsArg.getValue();
+    maxOpenBuckets = maxOpenBucketsArg.getValue();
+    if(windowRows < 0)
+      throw StringError("Invalid -window-rows: " + Global::int64ToString(windowRows));
+    if(rowsPerShard <= 0)
+      throw StringError("Invalid -rows-per-shard: " + Global::int64ToString(rowsPerShard));
+    if(rowsPerChunk <= 0 || rowsPerChunk > 1000000)
+      throw StringError("Invalid -rows-per-chunk: " + Global::intToString(rowsPerChunk));
+    if(numThreads <= 0 || numThreads > 1024)
+      throw StringError("Invalid -num-threads: " + Global::intToString(numThreads));
+    if(maxOpenBuckets < 0 || maxOpenBuckets > 65536)
+      throw StringError("Invalid -max-open-buckets: " + Global::intToString(maxOpenBuckets));
+    if(maxOpenBuckets == 0)
+      maxOpenBuckets = defaultMaxOpenBuckets(numThreads);
+  }
+  catch (TCLAP::ArgException &e) {
+    cerr << "Error: " << e.error() << " for argument " << e.argId() << endl;
+    return 1;
+  }
+  if(seed.size() <= 0)
+    seed = Global::uint64ToHexString(Rand().nextUInt64());
+
+  Logger logger;
+  logger.setLogToStdout(true);
+
+  vector<string> files;
+  FileHelpers::collectTrainingDataFromDirsOrFiles(inputs,files);
+  for(const string& file: files) {
+    if(!Global::isSuffix(file,".khshard"))
+      throw StringError("shuffle only reads .khshard files, convert .npz files with npztoshard first: " + file);
+  }
+  logger.write("Found " + Global::uint64ToString(files.size()) + " shard files");
+  if(files.size() <= 0)
+    return 1;
+
+  //Newest first, so that the window takes the most recent rows.
+  vector<pair<gfs::file_time_type,string>> filesByTime;
+  for(const string& file: files)
+    filesByTime.push_back(std::make_pair(gfs::last_write_time(file),file));
+  std::sort(filesByTime.begin(), filesByTime.end(), std::greater<pair<gfs::file_time_type,string>>());
+
+  vector<InputShard> shards;
+  vector<TrainingShard::Field> fields;
+  int64_t rowBytes = 0;
+  int64_t numInputRows = 0;
+  for(size_t i = 0; i<filesByTime.size(); i++) {
+    if(windowRows > 0 && numInputRows >= windowRows)
+      break;
+    TrainingShardReader reader(filesByTime[i].second);
+    if(i == 0) {
+      fields = reader.getFields();
+      rowBytes = reader.getRowBytes();
+    }
+    else if(reader.getFields() != fields)
+      throw StringError("Shard " + reader.getFileName() + " has different fields than " + filesByTime[0].second);
+    InputShard shard;
+    shard.fileName = reader.getFileName();
+    shard.numRows = reader.getNumRows();
+    shard.firstRow = 0;
+    //Within a shard, later rows are newer
+    if(windowRows > 0 && numInputRows + shard.numRows > windowRows)
+      shard.firstRow = shard.numRows - (windowRows - numInputRows);
+    numInputRows += shard.numRows - shard.firstRow;
+    shards.push_back(shard);
+  }
+  const int64_t weightOffset = TrainingShardReader(shards[0].fileName).getFieldOffset("globalTargetsNC") + 25 * (int64_t)sizeof(float);
+  logger.write(
+    "Shuffling " + Global::int64ToString(numInputRows) + " rows from " + Global::uint64ToString(shards.size()) + " shards" +
+    ", " + Global::int64ToString(rowBytes) + " bytes per row"
+  );
+  if(numInputRows <= 0)
+    return 1;
+
+  //Subsampling by weight keeps the expected number of rows the same if the weights average to 1, which is the usual case
+  const int numBuckets = (int)std::max((int64_t)1, (numInputRows + rowsPerShard - 1) / rowsPerShard);
+  const int numScatterPasses = (numBuckets + maxOpenBuckets - 1) / maxOpenBuckets;
+  const int bucketsPerPass = std::min(numBuckets, maxOpenBuckets);
+  const int64_t rowsPerTmpChunk =
+    std::max((int64_t)1, std::min((int64_t)ROWS_PER_TMP_CHUNK, MAX_STAGING_BYTES_PER_THREAD / ((int64_t)bucketsPerPass * rowBytes)));
+  logger.write(
+    "Using " + Global::intToString(numBuckets) + " output shards in " + Global::intToString(numScatterPasses) +
+    " passes over the input, expect about " +
+    Global::doubleToString((double)std::min(numThreads,numBuckets) * rowsPerShard * rowBytes / 1048576.0) + " MB of memory for shuffling"
+  );
+  if(numScatterPasses > 1)
+    logger.write(
+      "Warning: reading all input " + Global::intToString(numScatterPasses) + " times since only " + Global::intToString(maxOpenBuckets) +
+      " temporary shards can be open at once, raise the open file limit or -rows-per-shard to need fewer passes"
+    );
+
+  MakeDir::make(outputDir);
+  const string tmpDir = outputDir + "/tmp-" + seed;
+  vector<string> bucketFiles;
+  vector<string> outputFiles;
+  for(int i = 0; i<numBuckets; i++) {
+    bucketFiles.push_back(tmpDir + "/bucket" + Global::intToString(i) + ".khshard");
+    outputFiles.push_back(outputDir + "/shuffled-" + seed + "-" + Global::intToString(i) + ".khshard");
+    if(gfs::exists(outputFiles[i]))
+      throw StringError("Output shard already exists: " + outputFiles[i]);
+  }
+  MakeDir::make(tmpDir);
+  //Remove the temporary files however we exit, including on errors.
+  //On success they're gone already, other than the directory itself.
+  struct TmpFileCleanup {
+    const string& tmpDir;
+    const vector<string>& outputFiles;
+    ~TmpFileCleanup() {
+      std::error_code ec;
+      gfs::remove_all(tmpDir, ec);
+      for(const string& outputFile: outputFiles)
+        gfs::remove(outputFile + ".tmp", ec);
+    }
+  };
+  TmpFileCleanup tmpFileCleanup{tmpDir, outputFiles};
+
+  vector<ReadBlock> blocks;
+  for(size_t i = 0; i<shards.size(); i++) {
+    for(int64_t row = shards[i].firstRow; row < shards[i].numRows; row += ROWS_PER_READ_BLOCK) {
+      ReadBlock block;
+      block.shardIdx = i;
+      block.firstRow = row;
+      block.numRows = std::min((int64_t)ROWS_PER_READ_BLOCK, shards[i].numRows - row);
+      blocks.push_back(block);
+    }
+  }
+
+  //Threads record the first error and everyone stops
+  std::mutex errorMutex;
+  string errorMessage;
+  auto recordError = [&](const string& message) {
+    std::lock_guard<std::mutex> lock(errorMutex);
+    if(errorMessage.size() <= 0)
+      errorMessage = message;
+  };
+  auto hasError = [&]() {
+    std::lock_guard<std::mutex> lock(errorMutex);
+    return errorMessage.size() > 0;
+  };
+  auto runThreads = [&](const std::function<void(int)>& f) {
+    vector<std::thread> threads;
+    for(int i = 0; i<numThreads; i++) {
+      threads.push_back(std::thread([&f,&recordError,i]() {
+        try {
+          f(i);
+        }
+        catch(const std::exception& e) {
+          recordError(e.what());
+        }
+      }));
+    }
+    for(size_t i = 0; i<threads.size(); i++)
+      threads[i].join();
+    if(errorMessage.size() > 0)
+      throw StringError(errorMessage);
+  };
+
+  //Scatter, to buckets [bucketBegin,bucketEnd) in each pass
+  ClockTimer timer;
+  int bucketBegin = 0;
+  int bucketEnd = 0;
+  vector<TrainingShardWriter*> bucketWriters(numBuckets, NULL);
+  std::atomic<size_t> nextBlockIdx(0);
+  std::atomic<int64_t> numRowsScattered(0);
+  auto scatterLoop = [&](int threadIdx) {
+    (void)threadIdx;
+    //Each thread's blocks come in increasing order, so by shard, and only the current shard's reader is kept open
+    std::unique_ptr<TrainingShardReader> reader;
+    size_t readerShardIdx = 0;
+    vector<vector<char>> staging(numBuckets);
+    vector<char> buf(ROWS_PER_READ_BLOCK * rowBytes);
+    vector<int64_t> rowIdxs;
+    int64_t numRowsThisThread = 0;
+
+    auto flushStaging = [&](int bucketIdx) {
+      vector<char>& s = staging[bucketIdx];
+      if(s.size() > 0)
+        bucketWriters[bucketIdx]->appendChunk(s.data(), (int64_t)s.size() / rowBytes);
+      s.clear();
+    };
+
+    while(!hasError()) {
+      size_t blockIdx = nextBlockIdx.fetch_add(1);
+      if(blockIdx >= blocks.size())
+        break;
+      const ReadBlock& block = blocks[blockIdx];
+      //Seeded by block rather than by thread, so that every pass makes the same choices for each row
+      Rand rand(seed + ":scatter:" + Global::uint64ToString(blockIdx));
+      if(reader == nullptr || readerShardIdx != block.shardIdx) {
+        reader.reset();
+        reader = std::make_unique<TrainingShardReader>(shards[block.shardIdx].fileName);
+        readerShardIdx = block.shardIdx;
+      }
+      rowIdxs.clear();
+      for(int64_t i = 0; i<block.numRows; i++)
+        rowIdxs.push_back(block.firstRow + i);
+      reader->readRows(rowIdxs, buf.data());
+
+      for(int64_t i = 0; i<block.numRows; i++) {
+        char* row = buf.data() + i * rowBytes;
+        int numCopies = 1;
+        if(!keepWeights) {
+          float targetWeight;
+          std::memcpy(&targetWeight, row + weightOffset, sizeof(float));
+          numCopies = numCopiesForWeight(targetWeight, rand);
+          const float one = 1.0f;
+          std::memcpy(row + weightOffset, &one, sizeof(float));
+        }
+        for(int c = 0; c<numCopies; c++) {
+          int bucketIdx = (int)rand.nextUInt((uint32_t)numBuckets);
+          if(bucketIdx < bucketBegin || bucketIdx >= bucketEnd)
+            continue;
+          vector<char>& s = staging[bucketIdx];
+          s.insert(s.end(), row, row + rowBytes);
+          if((int64_t)s.size() >= rowsPerTmpChunk * rowBytes)
+            flushStaging(bucketIdx);
+          numRowsThisThread += 1;
+        }
+      }
+    }
+    for(int i = bucketBegin; i<bucketEnd; i++)
+      flushStaging(i);
+    numRowsScattered.fetch_add(numRowsThisThread);
+  };
+  for(int pass = 0; pass<numScatterPasses; pass++) {
+    bucketBegin = pass * maxOpenBuckets;
+    bucketEnd = std::min(numBuckets, bucketBegin + maxOpenBuckets);
+    auto deleteWriters = [&]() {
+      for(int i = bucketBegin; i<bucketEnd; i++) {
+        delete bucketWriters[i];
+        bucketWriters[i] = NULL;
+      }
+    };
+    try {
+      for(int i = bucketBegin; i<bucketEnd; i++)
+        bucketWriters[i] = new TrainingShardWriter(bucketFiles[i], fields, TrainingShard::Compression::NONE);
+      nextBlockIdx.store(0);
+      runThreads(scatterLoop);
+    }
+    catch(...) {
+      deleteWriters();
+      throw;
+    }
+    deleteWriters();
+  }
+  double scatterSeconds = timer.getSeconds();
+  logger.write(
+    "Scattered " + Global::int64ToString(numRowsScattered.load()) + " rows after subsampling by weight, took " +
+    Global::doubleToString(scatterSeconds) + "s, " +
+    Global::doubleToString(numScatterPasses * numInputRows * rowBytes / 1048576.0 / std::max(scatterSeconds,1e-10)) + " MB/s read"
+  );
+
+  //Gather
+  timer.reset();
+  std::atomic<int> nextBucketIdx(0);
+  std::atomic<int64_t> numRowsWritten(0);
+  auto gatherLoop = [&](int threadIdx) {
+    (void)threadIdx;
+    vector<char> shuffled;
+    vector<int64_t> rowIdxs;
+    while(!hasError()) {
+      int bucketIdx = nextBucketIdx.fetch_add(1);
+      if(bucketIdx >= numBuckets)
+        break;
+      //Reading the rows in a random order directly does the shuffling, and only needs memory for the output.
+      int64_t numRows;
+      {
+        TrainingShardReader reader(bucketFiles[bucketIdx]);
+        numRows = reader.getNumRows();
+        rowIdxs.resize(numRows);
+        for(int64_t i = 0; i<numRows; i++)
+          rowIdxs[i] = i;
+        Rand rand(seed + ":gather:" + Global::intToString(bucketIdx));
+        for(int64_t i = numRows-1; i > 0; i--) {
+          int64_t j = (int64_t)(rand.nextUInt64() % (uint64_t)(i+1));
+          std::swap(rowIdxs[i],rowIdxs[j]);
+        }
+        shuffled.resize(numRows * rowBytes);
+        reader.readRows(rowIdxs, shuffled.data());
+      }
+
+      //Write under a temporary name so that a crash never leaves a partial output shard that looks complete
+      string tmpOutputFile = outputFiles[bucketIdx] + ".tmp";
+      {
+        TrainingShardWriter writer(tmpOutputFile, fields, compression);
+        for(int64_t i = 0; i<numRows; i += rowsPerChunk)
+          writer.appendChunk(shuffled.data() + i * rowBytes, std::min((int64_t)rowsPerChunk, numRows - i));
+      }
+      gfs::rename(tmpOutputFile, outputFiles[bucketIdx]);
+      gfs::remove(bucketFiles[bucketIdx]);
+      numRowsWritten.fetch_add(numRows);
+    }
+  };
+  runThreads(gatherLoop);
+  gfs::remove(tmpDir);
+  double gatherSeconds = timer.getSeconds();
+
+  logger.write(
+    "Wrote " + Global::int64ToString(numRowsWritten.load()) + " rows to " + Global::intToString(numBuckets) +
+    " shards in " + outputDir + ", took " + Global::doubleToString(gatherSeconds) + "s, " +
+    Global::doubleToString(numRowsWritten.load() * rowBytes / 1048576.0 / std::max(gatherSeconds,1e-10)) + " MB/s"
+  );
+  return 0;
+}
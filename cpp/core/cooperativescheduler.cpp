@@ -0,0 +1,210 @@
+#ifdef __APPLE__
+  //ucontext is deprecated but still present on macOS, and only declared with these, before any other includes
+  #define _XOPEN_SOURCE 600
+  #define _DARWIN_C_SOURCE
+#endif
+
+#include "../core/cooperativescheduler.h"
+#include "../core/os.h"
+
+#ifdef OS_IS_UNIX_OR_APPLE
+  #include <sys/mman.h>
+  #include <ucontext.h>
+  #include <unistd.h>
+#endif
+
+#include <chrono>
+#include <exception>
+
+#include "../core/global.h"
+
+//------------------------
+#include "../core/using.h"
+//------------------------
+
+CooperativeScheduler::Waker::Waker()
+  :mutex(),cv(),signaled(false)
+{}
+
+void CooperativeScheduler::Waker::wake() {
+  std::lock_guard<std::mutex> lock(mutex);
+  signaled = true;
+  cv.notify_all();
+}
+
+#ifdef OS_IS_UNIX_OR_APPLE
+
+namespace {
+  struct Task {
+    const std::function<void()>* func;
+    ucontext_t context;
+    char* stackMemory;
+    size_t stackMemoryBytes;
+    bool finished;
+    //Empty if the task is ready to run
+    std::function<bool()> waitingFor;
+  };
+
+  struct SchedulerState {
+    ucontext_t schedulerContext;
+    vector<Task> tasks;
+    //Index of the task running right now, or -1 if the scheduler itself is running
+    int currentTaskIdx;
+    CooperativeScheduler::Waker waker;
+    std::exception_ptr firstError;
+  };
+
+  thread_local SchedulerState* currentState = NULL;
+}
+
+static void runTaskEntry() {
+  SchedulerState* state = currentState;
+  Task& task = state->tasks[state->currentTaskIdx];
+  try {
+    (*task.func)();
+  }
+  catch(...) {
+    if(state->firstError == nullptr)
+      state->firstError = std::current_exception();
+  }
+  task.finished = true;
+  //Returning resumes the scheduler through uc_link
+}
+
+//Switch from the current task back to the scheduler, which resumes it once waitingFor is true
+static void switchToScheduler(SchedulerState* state) {
+  Task& task = state->tasks[state->currentTaskIdx];
+  swapcontext(&task.context, &state->schedulerContext);
+}
+
+//Switch from the scheduler to a task until it waits or finishes. Kept out of line so that locals of run are never
+//live across the context switch, which the compiler would otherwise warn may be clobbered as with setjmp.
+static void __attribute__((noinline)) switchToTask(SchedulerState* state, int taskIdx) {
+  state->currentTaskIdx = taskIdx;
+  swapcontext(&state->schedulerContext, &state->tasks[taskIdx].context);
+  state->currentTaskIdx = -1;
+}
+
+bool CooperativeScheduler::isSupported() {
+  return true;
+}
+
+void CooperativeScheduler::run(const vector<std::function<void()>>& funcs, size_t stackBytesRequested) {
+  if(currentState != NULL)
+    throw StringError("CooperativeScheduler::run called from within a cooperative task");
+
+  const size_t pageBytes = (size_t)sysconf(_SC_PAGESIZE);
+  const size_t stackBytesPerTask = (stackBytesRequested + pageBytes - 1) / pageBytes * pageBytes;
+
+  SchedulerState state;
+  state.tasks.resize(funcs.size());
+  state.currentTaskIdx = -1;
+  for(size_t i = 0; i<funcs.size(); i++) {
+    Task& task = state.tasks[i];
+    task.func = &funcs[i];
+    task.finished = false;
+    //One extra inaccessible page below the stack, so that overflowing it crashes rather than corrupting memory.
+    //Pages of the stack are only committed by the OS as they get used.
+    task.stackMemoryBytes = stackBytesPerTask + pageBytes;
+    void* mem = mmap(NULL, task.stackMemoryBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if(mem == MAP_FAILED) {
+      for(size_t j = 0; j<i; j++)
+        munmap(state.tasks[j].stackMemory, state.tasks[j].stackMemoryBytes);
+      throw StringError("CooperativeScheduler: could not allocate task stack");
+    }
+    task.stackMemory = (char*)mem;
+    mprotect(task.stackMemory, pageBytes, PROT_NONE);
+
+    getcontext(&task.context);
+    task.context.uc_stack.ss_sp = task.stackMemory + pageBytes;
+    task.context.uc_stack.ss_size = stackBytesPerTask;
+    task.context.uc_link = &state.schedulerContext;
+    makecontext(&task.context, runTaskEntry, 0);
+  }
+
+  currentState = &state;
+  size_t numFinished = 0;
+  while(numFinished < state.tasks.size()) {
+    bool anyRan = false;
+    for(size_t i = 0; i<state.tasks.size(); i++) {
+      Task& task = state.tasks[i];
+      if(task.finished)
+        continue;
+      if(task.waitingFor && !task.waitingFor())
+        continue;
+      task.waitingFor = nullptr;
+      switchToTask(&state, (int)i);
+      anyRan = true;
+      if(task.finished) {
+        numFinished++;
+        munmap(task.stackMemory, task.stackMemoryBytes);
+        task.stackMemory = NULL;
+      }
+    }
+    //Everything is waiting, sleep until someone wakes us.
+    //The timeout is only a backstop for waits whose condition is made true without calling wake.
+    if(!anyRan) {
+      std::unique_lock<std::mutex> lock(state.waker.mutex);
+      if(!state.waker.signaled)
+        state.waker.cv.wait_for(lock, std::chrono::milliseconds(10));
+      state.waker.signaled = false;
+    }
+  }
+  currentState = NULL;
+
+  if(state.firstError != nullptr)
+    std::rethrow_exception(state.firstError);
+}
+
+bool CooperativeScheduler::waitIfCooperative(const std::function<bool()>& isDone) {
+  SchedulerState* state = currentState;
+  if(state == NULL || state->currentTaskIdx < 0)
+    return false;
+  if(isDone())
+    return true;
+  state->tasks[state->currentTaskIdx].waitingFor = isDone;
+  switchToScheduler(state);
+  return true;
+}
+
+bool CooperativeScheduler::yieldIfCooperative() {
+  SchedulerState* state = currentState;
+  if(state == NULL || state->currentTaskIdx < 0)
+    return false;
+  switchToScheduler(state);
+  return true;
+}
+
+CooperativeScheduler::Waker* CooperativeScheduler::getCurrentWaker() {
+  SchedulerState* state = currentState;
+  if(state == NULL || state->currentTaskIdx < 0)
+    return NULL;
+  return &(state->waker);
+}
+
+#else
+
+bool CooperativeScheduler::isSupported() {
+  return false;
+}
+
+void CooperativeScheduler::run(const vector<std::function<void()>>& funcs, size_t stackBytesPerTask) {
+  (void)funcs;
+  (void)stackBytesPerTask;
+  throw StringError("CooperativeScheduler is not supported on this platform");
+}
+
+bool CooperativeScheduler::waitIfCooperative(const std::function<bool()>& isDone) {
+  (void)isDone;
+  return false;
+}
+
+bool CooperativeScheduler::yieldIfCooperative() {
+  return false;
+}
+
+CooperativeScheduler::Waker* CooperativeScheduler::getCurrentWaker() {
+  return NULL;
+}
+
+#endif
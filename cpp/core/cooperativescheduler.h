@@ -0,0 +1,50 @@
+/*
+ * cooperativescheduler.h
+ *
+ * Runs several tasks on one OS thread as stackful coroutines, switching between them only when a task explicitly
+ * waits for something. Each task is written as ordinary blocking code, but whenever it would block on one of the
+ * waits below, the thread moves on to another task instead. This lets a small number of OS threads keep many
+ * independent computations in flight (for example, many selfplay games each with its own single-threaded Search,
+ * all waiting on the same NNEvaluator) without one OS thread per computation.
+ *
+ * Tasks must never block in any other way while holding a lock that another task on the same thread could want.
+ * Only supported on unix-like systems.
+ */
+
+#ifndef CORE_COOPERATIVESCHEDULER_H_
+#define CORE_COOPERATIVESCHEDULER_H_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+class CooperativeScheduler {
+ public:
+  //Whoever makes the condition of a wait true calls wake(), so that a scheduler with nothing to do rechecks its tasks.
+  struct Waker {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool signaled;
+
+    Waker();
+    void wake();
+  };
+
+  static bool isSupported();
+
+  //Run all tasks on the calling thread until every one of them has returned.
+  //If any task throws, the others are still run to completion, then the first exception is rethrown.
+  static void run(const std::vector<std::function<void()>>& tasks, size_t stackBytesPerTask);
+
+  //If the calling thread is running tasks of a scheduler, run other tasks until isDone() returns true, and return true.
+  //Otherwise, return false right away, and the caller should wait for the condition however it normally would.
+  //isDone will be called from the same thread, at arbitrary times, and must not block.
+  static bool waitIfCooperative(const std::function<bool()>& isDone);
+  //If the calling thread is running tasks of a scheduler, give every other task a chance to run, and return true.
+  static bool yieldIfCooperative();
+  //The waker of the scheduler running on the calling thread, or NULL.
+  static Waker* getCurrentWaker();
+};
+
+#endif  // CORE_COOPERATIVESCHEDULER_H_
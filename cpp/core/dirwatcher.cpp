@@ -0,0 +1,189 @@
+#include "../core/dirwatcher.h"
+
+#ifdef __linux__
+  #include <poll.h>
+  #include <sys/eventfd.h>
+  #include <sys/inotify.h>
+  #include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+
+#include "../core/global.h"
+
+//------------------------
+#include "../core/using.h"
+//------------------------
+
+void DirWatcher::sleepUntilInterrupted(double maxSeconds) {
+  std::unique_lock<std::mutex> lock(interruptMutex);
+  interruptVar.wait_for(lock, std::chrono::duration<double>(maxSeconds), [this](){return interrupted;});
+  interrupted = false;
+}
+
+void DirWatcher::interruptSleep() {
+  std::lock_guard<std::mutex> lock(interruptMutex);
+  interrupted = true;
+  interruptVar.notify_all();
+}
+
+#ifdef __linux__
+
+DirWatcher::DirWatcher(const string& d)
+  :dir(d),inotifyFd(-1),interruptFd(-1),watchedDirs(),
+   interruptMutex(),interruptVar(),interrupted(false)
+{
+  inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if(inotifyFd < 0)
+    return;
+  interruptFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if(interruptFd < 0) {
+    close(inotifyFd);
+    inotifyFd = -1;
+    return;
+  }
+  addWatch(dir);
+  if(watchedDirs.size() <= 0) {
+    close(inotifyFd);
+    close(interruptFd);
+    inotifyFd = -1;
+    interruptFd = -1;
+  }
+}
+
+DirWatcher::~DirWatcher() {
+  if(inotifyFd >= 0)
+    close(inotifyFd);
+  if(interruptFd >= 0)
+    close(interruptFd);
+}
+
+bool DirWatcher::isEventDriven() const {
+  return inotifyFd >= 0;
+}
+
+void DirWatcher::addWatch(const string& path) {
+  int wd = inotify_add_watch(inotifyFd, path.c_str(), IN_CREATE | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ONLYDIR);
+  if(wd >= 0)
+    watchedDirs[wd] = path;
+}
+
+//Drain all pending events, returns true if any of them is a change that waitForChange reports
+bool DirWatcher::processEvents() {
+  bool anyChange = false;
+  alignas(struct inotify_event) char buf[16384];
+  while(true) {
+    ssize_t len = read(inotifyFd, buf, sizeof(buf));
+    if(len <= 0)
+      break;
+    for(char* p = buf; p < buf + len; ) {
+      const struct inotify_event* event = (const struct inotify_event*)p;
+      p += sizeof(struct inotify_event) + event->len;
+
+      //Lost events, so the caller should rescan everything
+      if(event->mask & IN_Q_OVERFLOW) {
+        anyChange = true;
+        continue;
+      }
+      if(event->mask & IN_IGNORED) {
+        watchedDirs.erase(event->wd);
+        continue;
+      }
+      auto iter = watchedDirs.find(event->wd);
+      if(iter == watchedDirs.end())
+        continue;
+      bool isTopLevel = iter->second == dir;
+      //A directory was made in place, its contents are probably still to come, so watch it for them.
+      if((event->mask & IN_CREATE) && (event->mask & IN_ISDIR)) {
+        if(isTopLevel && event->len > 0)
+          addWatch(dir + "/" + event->name);
+        continue;
+      }
+      if(event->mask & (IN_MOVED_TO | IN_CLOSE_WRITE))
+        anyChange = true;
+    }
+  }
+  return anyChange;
+}
+
+bool DirWatcher::waitForChange(double maxSeconds) {
+  if(!isEventDriven()) {
+    sleepUntilInterrupted(maxSeconds);
+    return false;
+  }
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+    std::chrono::duration<double>(maxSeconds)
+  );
+  while(true) {
+    double secondsLeft = std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count();
+    if(secondsLeft <= 0)
+      return false;
+    struct pollfd fds[2];
+    fds[0].fd = inotifyFd;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    fds[1].fd = interruptFd;
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+    int ret = poll(fds, 2, (int)std::ceil(std::min(secondsLeft, 3600.0) * 1000.0));
+    if(ret < 0) {
+      if(errno == EINTR)
+        continue;
+      throw StringError("DirWatcher: poll failed on " + dir);
+    }
+    if(fds[1].revents & POLLIN) {
+      uint64_t count;
+      ssize_t len = read(interruptFd, &count, sizeof(count));
+      (void)len;
+      return false;
+    }
+    if((fds[0].revents & POLLIN) && processEvents())
+      return true;
+  }
+}
+
+void DirWatcher::interrupt() {
+  if(!isEventDriven()) {
+    interruptSleep();
+    return;
+  }
+  uint64_t one = 1;
+  ssize_t len = write(interruptFd, &one, sizeof(one));
+  (void)len;
+}
+
+#else
+
+DirWatcher::DirWatcher(const string& d)
+  :dir(d),inotifyFd(-1),interruptFd(-1),watchedDirs(),
+   interruptMutex(),interruptVar(),interrupted(false)
+{}
+
+DirWatcher::~DirWatcher()
+{}
+
+bool DirWatcher::isEventDriven() const {
+  return false;
+}
+
+void DirWatcher::addWatch(const string& path) {
+  (void)path;
+}
+
+bool DirWatcher::processEvents() {
+  return false;
+}
+
+bool DirWatcher::waitForChange(double maxSeconds) {
+  sleepUntilInterrupted(maxSeconds);
+  return false;
+}
+
+void DirWatcher::interrupt() {
+  interruptSleep();
+}
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * dirwatcher.h
+ *
+ * Waits for files to appear in a directory, for processes that would otherwise have to poll it.
+ * On linux this uses inotify. Elsewhere, or if inotify cannot be set up, there are no change notifications and
+ * waiting simply sleeps until the timeout, so callers should always also rescan the directory on a timer.
+ */
+
+#ifndef CORE_DIRWATCHER_H_
+#define CORE_DIRWATCHER_H_
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+
+class DirWatcher {
+ public:
+  //Watches dir itself, and any subdirectory of it created after this point, but nothing deeper.
+  DirWatcher(const std::string& dir);
+  ~DirWatcher();
+
+  DirWatcher(const DirWatcher&) = delete;
+  DirWatcher& operator=(const DirWatcher&) = delete;
+
+  bool isEventDriven() const;
+
+  //Block until a file in the watched directories finishes being written, or a file or directory is moved into one
+  //of them, or until maxSeconds pass, or until interrupt is called. Returns true if there was such a change.
+  //Not threadsafe, only one thread should wait at a time.
+  bool waitForChange(double maxSeconds);
+  //Wake up waitForChange, now or the next time it is called. Threadsafe.
+  void interrupt();
+
+ private:
+  const std::string dir;
+  int inotifyFd;
+  int interruptFd;
+  //Watched directory by inotify watch descriptor
+  std::map<int,std::string> watchedDirs;
+
+  //Only used when not event driven
+  std::mutex interruptMutex;
+  std::condition_variable interruptVar;
+  bool interrupted;
+
+  void addWatch(const std::string& path);
+  bool processEvents();
+  void sleepUntilInterrupted(double maxSeconds);
+  void interruptSleep();
+};
+
+#endif  // CORE_DIRWATCHER_H_
@@ -167,6 +167,21 @@ string FileUtils::readFile(const char* filename)
 {
   ifstream ifs;
   open(ifs,filename);
+  //Read in one go if we can tell the size, which is much faster than going character by character.
+  //In text mode the size is only an upper bound, so trim to what was actually read.
+  ifs.seekg(0,std::ios::end);
+  std::streamoff size = ifs.tellg();
+  if(size >= 0 && ifs.good()) {
+    ifs.seekg(0,std::ios::beg);
+    string str;
+    str.resize((size_t)size);
+    ifs.read(&str[0],size);
+    str.resize((size_t)ifs.gcount());
+    if(!ifs.bad())
+      return str;
+  }
+  ifs.clear();
+  ifs.seekg(0,std::ios::beg);
   string str((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
   return str;
 }
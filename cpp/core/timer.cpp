@@ -38,12 +38,25 @@ int64_t ClockTimer::getPrecisionSystemTime()
   return (int64_t)GetTickCount64();
 }
 
+double ClockTimer::getProcessCpuSeconds()
+{
+  FILETIME creationTime, exitTime, kernelTime, userTime;
+  if(!GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime))
+    return 0.0;
+  //FILETIMEs count 100 nanosecond intervals
+  auto toSeconds = [](const FILETIME& t) {
+    return (double)(((uint64_t)t.dwHighDateTime << 32) | (uint64_t)t.dwLowDateTime) / 10000000.0;
+  };
+  return toSeconds(kernelTime) + toSeconds(userTime);
+}
+
 #endif
 
 //UNIX IMPLEMENTATION------------------------------------------------------------------
 
 #ifdef OS_IS_UNIX_OR_APPLE
 #include <chrono>
+#include <sys/resource.h>
 
 ClockTimer::ClockTimer()
 {
@@ -75,4 +88,14 @@ int64_t ClockTimer::getPrecisionSystemTime()
   return newTime;
 }
 
+double ClockTimer::getProcessCpuSeconds()
+{
+  struct rusage usage;
+  if(getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0.0;
+  return
+    (double)usage.ru_utime.tv_sec + (double)usage.ru_utime.tv_usec / 1000000.0 +
+    (double)usage.ru_stime.tv_sec + (double)usage.ru_stime.tv_usec / 1000000.0;
+}
+
 #endif
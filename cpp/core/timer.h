@@ -28,6 +28,8 @@ class ClockTimer
 
   //Return some integer indicating the current system time (for seeds/hashes), may vary with OS.
   static int64_t getPrecisionSystemTime();
+  //Total user plus system cpu time used so far by all threads of this process, in seconds.
+  static double getProcessCpuSeconds();
 };
 
 
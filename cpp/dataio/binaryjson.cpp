@@ -0,0 +1,101 @@
+#include "../dataio/binaryjson.h"
+
+#include <cstring>
+
+//------------------------
+#include "../core/using.h"
+//------------------------
+
+using json = nlohmann::json;
+
+static bool isFloatArray(const json& j) {
+  if(!j.is_array() || j.size() <= 0)
+    return false;
+  for(const json& elt: j) {
+    if(!elt.is_number_float())
+      return false;
+  }
+  return true;
+}
+
+void BinaryJson::packFloatArrays(json& j) {
+  if(isFloatArray(j)) {
+    std::vector<uint8_t> data(j.size() * 4);
+    size_t pos = 0;
+    for(const json& elt: j) {
+      float f = (float)elt.get<double>();
+      uint32_t bits;
+      std::memcpy(&bits, &f, 4);
+      data[pos] = (uint8_t)bits;
+      data[pos+1] = (uint8_t)(bits >> 8);
+      data[pos+2] = (uint8_t)(bits >> 16);
+      data[pos+3] = (uint8_t)(bits >> 24);
+      pos += 4;
+    }
+    j = json::binary(std::move(data), PACKED_FLOAT_ARRAY_EXT_TYPE);
+  }
+  else if(j.is_array() || j.is_object()) {
+    for(json& elt: j)
+      packFloatArrays(elt);
+  }
+}
+
+void BinaryJson::unpackFloatArrays(json& j) {
+  if(j.is_binary()) {
+    const json::binary_t& data = j.get_binary();
+    if(!data.has_subtype() || data.subtype() != PACKED_FLOAT_ARRAY_EXT_TYPE)
+      return;
+    if(data.size() % 4 != 0)
+      throw IOError("BinaryJson: packed float array length is not a multiple of 4");
+    json arr = json::array();
+    for(size_t pos = 0; pos < data.size(); pos += 4) {
+      uint32_t bits =
+        (uint32_t)data[pos] | ((uint32_t)data[pos+1] << 8) | ((uint32_t)data[pos+2] << 16) | ((uint32_t)data[pos+3] << 24);
+      float f;
+      std::memcpy(&f, &bits, 4);
+      arr.push_back((double)f);
+    }
+    j = std::move(arr);
+  }
+  else if(j.is_array() || j.is_object()) {
+    for(json& elt: j)
+      unpackFloatArrays(elt);
+  }
+}
+
+void BinaryJson::encode(json& j, string& out) {
+  packFloatArrays(j);
+  size_t lenPos = out.size();
+  out.append(4, '\0');
+  json::to_msgpack(j, nlohmann::detail::output_adapter<char>(out));
+  size_t len = out.size() - lenPos - 4;
+  if(len > MAX_MESSAGE_BYTES)
+    throw StringError("BinaryJson: message too large: " + Global::uint64ToString(len));
+  out[lenPos] = (char)(uint8_t)len;
+  out[lenPos+1] = (char)(uint8_t)(len >> 8);
+  out[lenPos+2] = (char)(uint8_t)(len >> 16);
+  out[lenPos+3] = (char)(uint8_t)(len >> 24);
+}
+
+bool BinaryJson::readFrame(std::istream& in, string& frame) {
+  unsigned char header[4];
+  in.read((char*)header, 4);
+  if(in.gcount() == 0)
+    return false;
+  if(in.gcount() != 4)
+    throw IOError("BinaryJson: input ended in the middle of a message length");
+  uint32_t len = (uint32_t)header[0] | ((uint32_t)header[1] << 8) | ((uint32_t)header[2] << 16) | ((uint32_t)header[3] << 24);
+  if(len > MAX_MESSAGE_BYTES)
+    throw IOError("BinaryJson: message too large: " + Global::uint64ToString(len));
+  frame.resize(len);
+  in.read(&frame[0], len);
+  if((uint32_t)in.gcount() != len)
+    throw IOError("BinaryJson: input ended in the middle of a message");
+  return true;
+}
+
+json BinaryJson::decode(const string& frame) {
+  json j = json::from_msgpack(frame.begin(), frame.end());
+  unpackFloatArrays(j);
+  return j;
+}
@@ -0,0 +1,38 @@
+#ifndef DATAIO_BINARYJSON_H_
+#define DATAIO_BINARYJSON_H_
+
+#include <iostream>
+
+#include "../core/global.h"
+
+#include "../external/nlohmann_json/json.hpp"
+
+/*
+  Compact binary framing of json messages, for programs exchanging many of them where text json is a noticeable cost.
+
+  Each message is a 4-byte little-endian unsigned length followed by that many bytes of MessagePack encoding the same
+  json value, with one difference: any non-empty array consisting only of floating point numbers may be sent as a
+  MessagePack extension of type PACKED_FLOAT_ARRAY_EXT_TYPE, whose data is the array as little-endian float32s.
+  Receivers should treat such an extension exactly as the corresponding array of numbers.
+*/
+namespace BinaryJson {
+  constexpr uint8_t PACKED_FLOAT_ARRAY_EXT_TYPE = 1;
+  constexpr uint32_t MAX_MESSAGE_BYTES = (uint32_t)1 << 28;
+
+  //Append the framed message for j to out. Packs float arrays of j in place along the way, so j is left holding
+  //binary values in their place.
+  void encode(nlohmann::json& j, std::string& out);
+
+  //Read the next frame from in into frame, returning false at the end of input before any of it.
+  //Throws IOError if the input ends in the middle of a frame or a frame is too large, after which the stream cannot be resynchronized.
+  bool readFrame(std::istream& in, std::string& frame);
+
+  //Decode a frame read by readFrame, unpacking float arrays. Throws nlohmann::json exceptions if it's not valid MessagePack.
+  nlohmann::json decode(const std::string& frame);
+
+  //Replace float arrays in j with packed ones, or the reverse
+  void packFloatArrays(nlohmann::json& j);
+  void unpackFloatArrays(nlohmann::json& j);
+}
+
+#endif  // DATAIO_BINARYJSON_H_
@@ -60,6 +60,44 @@ void FileHelpers::collectSgfsFromDirsOrFiles(const std::vector<std::string>& dir
   }
 }
 
+static void collectFromDirsOrFiles(
+  const std::vector<std::string>& dirsOrFiles, bool (*filter)(const string&), const string& description, std::vector<std::string>& collected
+) {
+  for(int i = 0; i<dirsOrFiles.size(); i++) {
+    string path = gfs::exists(dirsOrFiles[i]) ? dirsOrFiles[i] : Global::trim(dirsOrFiles[i]);
+    if(path.size() <= 0)
+      continue;
+    try {
+      if(gfs::exists(path) && !gfs::is_directory(path)) {
+        if(!filter(path))
+          throw StringError("Error collecting " + description + ": " + path);
+        collected.push_back(path);
+        continue;
+      }
+    }
+    catch(const gfs::filesystem_error& e) {
+      throw StringError(string("Error recursively collecting files: ") + e.what());
+    }
+    FileUtils::collectFiles(path, filter, collected);
+  }
+}
+
+static bool multiSgfFilter(const string& name) {
+  return Global::isSuffix(name,".sgfs") || Global::isSuffix(name,".sgfs.gz");
+}
+
+void FileHelpers::collectMultiSgfsFromDirsOrFiles(const std::vector<std::string>& dirsOrFiles, std::vector<std::string>& collected) {
+  collectFromDirsOrFiles(dirsOrFiles, &multiSgfFilter, "sgfs files: File does not end in .sgfs or .sgfs.gz", collected);
+}
+
+static bool trainingDataFilter(const string& name) {
+  return Global::isSuffix(name,".npz") || Global::isSuffix(name,".khshard");
+}
+
+void FileHelpers::collectTrainingDataFromDirsOrFiles(const std::vector<std::string>& dirsOrFiles, std::vector<std::string>& collected) {
+  collectFromDirsOrFiles(dirsOrFiles, &trainingDataFilter, "training data files: File does not end in .npz or .khshard", collected);
+}
+
 void FileHelpers::sortNewestToOldest(std::vector<std::string>& files) {
   vector<std::pair<string, gfs::file_time_type>> filesWithTime;
   for(size_t i = 0; i<files.size(); i++)
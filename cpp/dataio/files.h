@@ -10,6 +10,12 @@ namespace FileHelpers {
   void collectSgfsFromDirs(const std::vector<std::string>& dirs, std::vector<std::string>& collected);
   void collectSgfsFromDirsOrFiles(const std::vector<std::string>& dirsOrFiles, std::vector<std::string>& collected);
 
+  //Files of one sgf per line as written by selfplay and match, .sgfs and .sgfs.gz
+  void collectMultiSgfsFromDirsOrFiles(const std::vector<std::string>& dirsOrFiles, std::vector<std::string>& collected);
+
+  //Training data files, .npz and .khshard
+  void collectTrainingDataFromDirsOrFiles(const std::vector<std::string>& dirsOrFiles, std::vector<std::string>& collected);
+
   void sortNewestToOldest(std::vector<std::string>& files);
 }
 
@@ -263,6 +263,13 @@ void ZipFile::close() {
   throwZipError();
 }
 
+string ZipFile::readBuffer(const string& fName, const char* nameWithinZip) {
+  (void)fName;
+  (void)nameWithinZip;
+  throwZipError();
+  return string();
+}
+
 #else
 
 struct ZipError {
@@ -320,6 +327,39 @@ void ZipFile::close() {
     file = NULL;
 }
 
+string ZipFile::readBuffer(const string& fName, const char* nameWithinZip) {
+  int errorCode = 0;
+  zip_t* fileHandle = zip_open(fName.c_str(), ZIP_RDONLY, &errorCode);
+  if(fileHandle == NULL) {
+    ZipError zipError;
+    zip_error_init_with_code(&(zipError.value), errorCode);
+    throw StringError("Could not open zip file " + fName + " due to error " + zip_error_strerror(&(zipError.value)));
+  }
+
+  zip_stat_t stat;
+  zip_stat_init(&stat);
+  if(zip_stat(fileHandle, nameWithinZip, 0, &stat) < 0 || !(stat.valid & ZIP_STAT_SIZE)) {
+    string error = zip_strerror(fileHandle);
+    zip_discard(fileHandle);
+    throw StringError("Could not find " + string(nameWithinZip) + " within zip file " + fName + " due to error " + error);
+  }
+  zip_file_t* entry = zip_fopen(fileHandle, nameWithinZip, 0);
+  if(entry == NULL) {
+    string error = zip_strerror(fileHandle);
+    zip_discard(fileHandle);
+    throw StringError("Could not open " + string(nameWithinZip) + " within zip file " + fName + " due to error " + error);
+  }
+
+  string ret;
+  ret.resize((size_t)stat.size);
+  zip_int64_t numRead = stat.size > 0 ? zip_fread(entry, &ret[0], stat.size) : 0;
+  zip_fclose(entry);
+  zip_discard(fileHandle);
+  if(numRead < 0 || (zip_uint64_t)numRead != stat.size)
+    throw StringError("Could not read " + string(nameWithinZip) + " within zip file " + fName);
+  return ret;
+}
+
 #endif
 
 // void test() {
@@ -44,7 +44,6 @@ private:
 };
 
 //Simple class for writing zip-compressed data.
-//No current support for reading it.
 class ZipFile {
  public:
   ZipFile(const std::string& fileName);
@@ -56,6 +55,9 @@ class ZipFile {
   void writeBuffer(const char* nameWithinZip, void* data, uint64_t numBytes);
   void close();
 
+  //Read back the whole uncompressed contents of a single file within an existing zip file.
+  static std::string readBuffer(const std::string& fileName, const char* nameWithinZip);
+
   private:
   std::string fileName;
   void* file;
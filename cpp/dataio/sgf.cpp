@@ -1,5 +1,9 @@
 #include "../dataio/sgf.h"
 
+#include <condition_variable>
+#include <exception>
+#include <thread>
+
 #include "../core/fileutils.h"
 #include "../core/sha2.h"
 
@@ -604,6 +608,34 @@ void Sgf::iterAllUniquePositions(
   bool flipIfPassOrWFirst,
   Rand* rand,
   std::function<void(PositionSample&,const BoardHistory&,const std::string&)> f
+) const {
+  std::function<bool(const Hash128&)> insertIfUnique = [&uniqueHashes](const Hash128& situationHash) {
+    return uniqueHashes.insert(situationHash).second;
+  };
+  iterAllUniquePositionsImpl(insertIfUnique,hashComments,hashParent,flipIfPassOrWFirst,rand,f);
+}
+
+void Sgf::iterAllUniquePositions(
+  ConcurrentHashSet& uniqueHashes,
+  bool hashComments,
+  bool hashParent,
+  bool flipIfPassOrWFirst,
+  Rand* rand,
+  std::function<void(PositionSample&,const BoardHistory&,const std::string&)> f
+) const {
+  std::function<bool(const Hash128&)> insertIfUnique = [&uniqueHashes](const Hash128& situationHash) {
+    return uniqueHashes.insert(situationHash);
+  };
+  iterAllUniquePositionsImpl(insertIfUnique,hashComments,hashParent,flipIfPassOrWFirst,rand,f);
+}
+
+void Sgf::iterAllUniquePositionsImpl(
+  const std::function<bool(const Hash128&)>& insertIfUnique,
+  bool hashComments,
+  bool hashParent,
+  bool flipIfPassOrWFirst,
+  Rand* rand,
+  const std::function<void(PositionSample&,const BoardHistory&,const std::string&)>& f
 ) const {
   XYSize size = getXYSize();
   int xSize = size.x;
@@ -618,7 +650,7 @@ void Sgf::iterAllUniquePositions(
 
   PositionSample sampleBuf;
   std::vector<std::pair<int64_t,int64_t>> variationTraceNodesBranch;
-  iterAllUniquePositionsHelper(board,hist,nextPla,rules,xSize,ySize,sampleBuf,0,uniqueHashes,hashComments,hashParent,flipIfPassOrWFirst,rand,variationTraceNodesBranch,f);
+  iterAllUniquePositionsHelper(board,hist,nextPla,rules,xSize,ySize,sampleBuf,0,insertIfUnique,hashComments,hashParent,flipIfPassOrWFirst,rand,variationTraceNodesBranch,f);
 }
 
 void Sgf::iterAllUniquePositionsHelper(
@@ -626,13 +658,13 @@ void Sgf::iterAllUniquePositionsHelper(
   const Rules& rules, int xSize, int ySize,
   PositionSample& sampleBuf,
   int initialTurnNumber,
-  std::set<Hash128>& uniqueHashes,
+  const std::function<bool(const Hash128&)>& insertIfUnique,
   bool hashComments,
   bool hashParent,
   bool flipIfPassOrWFirst,
   Rand* rand,
   std::vector<std::pair<int64_t,int64_t>>& variationTraceNodesBranch,
-  std::function<void(PositionSample&,const BoardHistory&,const std::string&)> f
+  const std::function<void(PositionSample&,const BoardHistory&,const std::string&)>& f
 ) const {
   vector<Move> buf;
   for(size_t i = 0; i<nodes.size(); i++) {
@@ -665,7 +697,7 @@ void Sgf::iterAllUniquePositionsHelper(
 
         hist.clear(board,nextPla,rules);
       }
-      samplePositionIfUniqueHelper(board,hist,nextPla,sampleBuf,initialTurnNumber,uniqueHashes,hashComments,hashParent,flipIfPassOrWFirst,comments,f);
+      samplePositionIfUniqueHelper(board,hist,nextPla,sampleBuf,initialTurnNumber,insertIfUnique,hashComments,hashParent,flipIfPassOrWFirst,comments,f);
     }
 
     //Handle actual moves
@@ -690,7 +722,7 @@ void Sgf::iterAllUniquePositionsHelper(
       if(hist.moveHistory.size() > 0x3FFFFFFF)
         throw StringError("too many moves in sgf");
       nextPla = getOpp(buf[j].pla);
-      samplePositionIfUniqueHelper(board,hist,nextPla,sampleBuf,initialTurnNumber,uniqueHashes,hashComments,hashParent,flipIfPassOrWFirst,comments,f);
+      samplePositionIfUniqueHelper(board,hist,nextPla,sampleBuf,initialTurnNumber,insertIfUnique,hashComments,hashParent,flipIfPassOrWFirst,comments,f);
     }
   }
 
@@ -711,7 +743,7 @@ void Sgf::iterAllUniquePositionsHelper(
     std::unique_ptr<BoardHistory> histCopy = std::make_unique<BoardHistory>(hist);
     variationTraceNodesBranch.push_back(std::make_pair((int64_t)nodes.size(),(int64_t)i));
     children[i]->iterAllUniquePositionsHelper(
-      *copy,*histCopy,nextPla,rules,xSize,ySize,sampleBuf,initialTurnNumber,uniqueHashes,hashComments,hashParent,flipIfPassOrWFirst,rand,variationTraceNodesBranch,f
+      *copy,*histCopy,nextPla,rules,xSize,ySize,sampleBuf,initialTurnNumber,insertIfUnique,hashComments,hashParent,flipIfPassOrWFirst,rand,variationTraceNodesBranch,f
     );
     assert(variationTraceNodesBranch.size() > 0);
     variationTraceNodesBranch.erase(variationTraceNodesBranch.begin()+(variationTraceNodesBranch.size()-1));
@@ -722,12 +754,12 @@ void Sgf::samplePositionIfUniqueHelper(
   Board& board, BoardHistory& hist, Player nextPla,
   PositionSample& sampleBuf,
   int initialTurnNumber,
-  std::set<Hash128>& uniqueHashes,
+  const std::function<bool(const Hash128&)>& insertIfUnique,
   bool hashComments,
   bool hashParent,
   bool flipIfPassOrWFirst,
   const std::string& comments,
-  std::function<void(PositionSample&,const BoardHistory&,const std::string&)> f
+  const std::function<void(PositionSample&,const BoardHistory&,const std::string&)>& f
 ) const {
   //If the game is over or there were two consecutive passes, skip
   if(hist.isGameFinished || (
@@ -754,9 +786,8 @@ void Sgf::samplePositionIfUniqueHelper(
     situationHash ^= mixed;
   }
 
-  if(contains(uniqueHashes,situationHash))
+  if(!insertIfUnique(situationHash))
     return;
-  uniqueHashes.insert(situationHash);
 
   //Snap the position 5 turns ago so as to include 5 moves of history.
   assert(BoardHistory::NUM_RECENT_BOARDS > 5);
@@ -792,6 +823,28 @@ void Sgf::samplePositionIfUniqueHelper(
   f(sampleBuf,hist,comments);
 }
 
+Sgf::ConcurrentHashSet::ConcurrentHashSet()
+  :shards()
+{}
+Sgf::ConcurrentHashSet::~ConcurrentHashSet()
+{}
+
+bool Sgf::ConcurrentHashSet::insert(const Hash128& hash) {
+  //hash0 is already well mixed for all hashes we store here
+  Shard& shard = shards[hash.hash0 % NUM_SHARDS];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  return shard.hashes.insert(hash).second;
+}
+
+size_t Sgf::ConcurrentHashSet::size() const {
+  size_t total = 0;
+  for(int i = 0; i<NUM_SHARDS; i++) {
+    std::lock_guard<std::mutex> lock(shards[i].mutex);
+    total += shards[i].hashes.size();
+  }
+  return total;
+}
+
 static uint64_t parseHex64(const string& str) {
   assert(str.length() == 16);
   uint64_t x = 0;
@@ -979,6 +1032,18 @@ static string parseTextValue(const string& str, int& pos) {
   bool escaping = false;
   int newPos;
   while(true) {
+    //Fast path, copy the whole run of characters that need no special handling at once
+    if(!escaping) {
+      int end = pos;
+      while(end < (int)str.length()) {
+        char d = str[end];
+        if(d == ']' || d == '\\' || d == '\n' || d == '\r' || d == '\t' || d == '\v' || d == '\f')
+          break;
+        end++;
+      }
+      acc.append(str, pos, end-pos);
+      pos = end;
+    }
     char c = peekSgfTextChar(str,pos,newPos);
     if(!escaping && c == ']') {
       break;
@@ -1045,8 +1110,7 @@ static bool maybeParseProperty(SgfNode* node, const string& str, int& pos) {
       if(node->props == NULL)
         node->props = new map<string,vector<string>>();
       vector<string>& contents = (*(node->props))[key];
-      string value = parseTextValue(str,pos);
-      contents.push_back(value);
+      contents.push_back(parseTextValue(str,pos));
     }
     if(peekSgfChar(str,pos,newPos) != ']')
       sgfFail("Expected closing bracket",str,pos);
@@ -1136,20 +1200,21 @@ Sgf* Sgf::loadFile(const string& file) {
   return sgf;
 }
 
-vector<Sgf*> Sgf::loadFiles(const vector<string>& files) {
+vector<Sgf*> Sgf::loadFiles(const vector<string>& files, int numThreads) {
   vector<Sgf*> sgfs;
   try {
-    for(int i = 0; i<files.size(); i++) {
+    loadFilesParallel(files, numThreads, [&](size_t i, Sgf* sgf, const StringError* error) {
       if(i % 10000 == 0)
         cout << "Loaded " << i << "/" << files.size() << " files" << endl;
-      try {
-        Sgf* sgf = loadFile(files[i]);
-        sgfs.push_back(sgf);
-      }
-      catch(const IOError& e) {
-        cout << "Skipping sgf file: " << files[i] << ": " << e.message << endl;
+      if(error != NULL) {
+        //f runs inside the handler for error, so this rethrows it with its original type
+        if(dynamic_cast<const IOError*>(error) == NULL)
+          std::rethrow_exception(std::current_exception());
+        cout << "Skipping sgf file: " << files[i] << ": " << error->message << endl;
+        return;
       }
-    }
+      sgfs.push_back(sgf);
+    });
   }
   catch(...) {
     for(int i = 0; i<sgfs.size(); i++) {
@@ -1160,9 +1225,122 @@ vector<Sgf*> Sgf::loadFiles(const vector<string>& files) {
   return sgfs;
 }
 
+void Sgf::loadFilesParallel(
+  const vector<string>& files,
+  int numThreads,
+  const std::function<void(size_t idx, Sgf* sgf, const StringError* error)>& f
+) {
+  if(numThreads <= 0)
+    numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+  if((size_t)numThreads > files.size())
+    numThreads = std::max(1, (int)files.size());
+
+  //Results wait in a ring of slots until f takes them in order
+  struct Slot {
+    bool ready = false;
+    Sgf* sgf = NULL;
+    std::exception_ptr error;
+  };
+  const size_t windowSize = (size_t)numThreads * 16;
+  vector<Slot> slots(windowSize);
+  std::mutex mutex;
+  std::condition_variable slotReadyVar;
+  std::condition_variable slotFreeVar;
+  size_t nextIdxToLoad = 0;
+  size_t nextIdxToConsume = 0;
+  bool aborted = false;
+
+  auto loadLoop = [&]() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true) {
+      while(!aborted && nextIdxToLoad < files.size() && nextIdxToLoad >= nextIdxToConsume + windowSize)
+        slotFreeVar.wait(lock);
+      if(aborted || nextIdxToLoad >= files.size())
+        return;
+      size_t idx = nextIdxToLoad++;
+      lock.unlock();
+
+      Sgf* sgf = NULL;
+      std::exception_ptr error;
+      try {
+        sgf = loadFile(files[idx]);
+      }
+      catch(...) {
+        error = std::current_exception();
+      }
+
+      lock.lock();
+      Slot& slot = slots[idx % windowSize];
+      slot.sgf = sgf;
+      slot.error = error;
+      slot.ready = true;
+      slotReadyVar.notify_all();
+    }
+  };
+
+  vector<std::thread> threads;
+  for(int i = 0; i<numThreads; i++)
+    threads.push_back(std::thread(loadLoop));
+
+  auto cleanup = [&]() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      aborted = true;
+      slotFreeVar.notify_all();
+    }
+    for(size_t i = 0; i<threads.size(); i++)
+      threads[i].join();
+    for(size_t i = 0; i<windowSize; i++) {
+      delete slots[i].sgf;
+      slots[i].sgf = NULL;
+    }
+  };
+
+  try {
+    for(size_t idx = 0; idx<files.size(); idx++) {
+      Sgf* sgf;
+      std::exception_ptr error;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        Slot& slot = slots[idx % windowSize];
+        while(!slot.ready)
+          slotReadyVar.wait(lock);
+        sgf = slot.sgf;
+        error = slot.error;
+        slot = Slot();
+        nextIdxToConsume = idx+1;
+        slotFreeVar.notify_all();
+      }
+      if(error == nullptr) {
+        f(idx, sgf, NULL);
+        continue;
+      }
+      //f is called from within the handler so that it can rethrow the error unsliced via std::current_exception
+      try {
+        std::rethrow_exception(error);
+      }
+      catch(const StringError& e) {
+        f(idx, NULL, &e);
+      }
+    }
+  }
+  catch(...) {
+    cleanup();
+    throw;
+  }
+  cleanup();
+}
+
 vector<Sgf*> Sgf::loadSgfsFile(const string& file) {
   vector<Sgf*> sgfs;
-  vector<string> lines = FileUtils::readFileLines(file,'\n');
+  vector<string> lines;
+  if(Global::isSuffix(file,".gz")) {
+    string contents;
+    FileUtils::uncompressAndLoadFileIntoString(file,"",contents);
+    lines = Global::split(contents,'\n');
+  }
+  else
+    lines = FileUtils::readFileLines(file,'\n');
   try {
     for(size_t i = 0; i<lines.size(); i++) {
       string line = Global::trim(lines[i]);
@@ -1286,20 +1464,23 @@ CompactSgf* CompactSgf::loadFile(const string& file) {
   return compact;
 }
 
-vector<CompactSgf*> CompactSgf::loadFiles(const vector<string>& files) {
+vector<CompactSgf*> CompactSgf::loadFiles(const vector<string>& files, int numThreads) {
   vector<CompactSgf*> sgfs;
   try {
-    for(int i = 0; i<files.size(); i++) {
+    Sgf::loadFilesParallel(files, numThreads, [&](size_t i, Sgf* sgf, const StringError* error) {
       if(i % 10000 == 0)
         cout << "Loaded " << i << "/" << files.size() << " files" << endl;
-      try {
-        CompactSgf* sgf = loadFile(files[i]);
-        sgfs.push_back(sgf);
+      if(error != NULL) {
+        //f runs inside the handler for error, so this rethrows it with its original type
+        if(dynamic_cast<const IOError*>(error) == NULL)
+          std::rethrow_exception(std::current_exception());
+        cout << "Skipping sgf file: " << files[i] << ": " << error->message << endl;
+        return;
       }
-      catch(const IOError& e) {
-        cout << "Skipping sgf file: " << files[i] << ": " << e.message << endl;
-      }
-    }
+      CompactSgf* compact = new CompactSgf(std::move(*sgf));
+      delete sgf;
+      sgfs.push_back(compact);
+    });
   }
   catch(...) {
     for(int i = 0; i<sgfs.size(); i++) {
@@ -1,6 +1,8 @@
 #ifndef DATAIO_SGF_H_
 #define DATAIO_SGF_H_
 
+#include <mutex>
+
 #include "../core/global.h"
 #include "../core/hash.h"
 #include "../core/rand.h"
@@ -53,7 +55,19 @@ struct Sgf {
 
   static Sgf* parse(const std::string& str);
   static Sgf* loadFile(const std::string& file);
-  static std::vector<Sgf*> loadFiles(const std::vector<std::string>& files);
+  //numThreads <= 0 uses one thread per hardware thread
+  static std::vector<Sgf*> loadFiles(const std::vector<std::string>& files, int numThreads = 1);
+  //Reads and parses files on numThreads threads (<= 0 for one per hardware thread), but calls f on the calling thread,
+  //for each file in order. f takes ownership of sgf, which is NULL if reading or parsing failed with error.
+  //Only a bounded number of files past the one being handed to f are loaded ahead of time.
+  //When error is non-NULL, f runs inside its catch handler, so std::current_exception() refers to it and
+  //f can rethrow it with its full type. Errors that are not StringErrors propagate out directly.
+  static void loadFilesParallel(
+    const std::vector<std::string>& files,
+    int numThreads,
+    const std::function<void(size_t idx, Sgf* sgf, const StringError* error)>& f
+  );
+  //One sgf per line, gzipped if the file name ends in .gz
   static std::vector<Sgf*> loadSgfsFile(const std::string& file);
   static std::vector<Sgf*> loadSgfsFiles(const std::vector<std::string>& files);
 
@@ -125,35 +139,74 @@ struct Sgf {
     std::function<void(PositionSample&,const BoardHistory&,const std::string&)> f
   ) const;
 
+  //Threadsafe set of hashes, for iterating the unique positions of many sgfs at once from different threads
+  class ConcurrentHashSet {
+   public:
+    ConcurrentHashSet();
+    ~ConcurrentHashSet();
+    ConcurrentHashSet(const ConcurrentHashSet&) = delete;
+    ConcurrentHashSet& operator=(const ConcurrentHashSet&) = delete;
+
+    //Returns true if hash was not already present
+    bool insert(const Hash128& hash);
+    size_t size() const;
+
+   private:
+    static constexpr int NUM_SHARDS = 64;
+    struct Shard {
+      mutable std::mutex mutex;
+      std::set<Hash128> hashes;
+    };
+    Shard shards[NUM_SHARDS];
+  };
+  //Same as above, but threadsafe with respect to uniqueHashes. f may be called concurrently for different sgfs.
+  void iterAllUniquePositions(
+    ConcurrentHashSet& uniqueHashes,
+    bool hashComments,
+    bool hashParent,
+    bool flipIfPassOrWFirst,
+    Rand* rand,
+    std::function<void(PositionSample&,const BoardHistory&,const std::string&)> f
+  ) const;
+
   static std::set<Hash128> readExcludes(const std::vector<std::string>& files);
 
   private:
   void getMovesHelper(std::vector<Move>& moves, int xSize, int ySize) const;
 
 
+  //insertIfUnique returns true if the hash was not seen before, and records it
+  void iterAllUniquePositionsImpl(
+    const std::function<bool(const Hash128&)>& insertIfUnique,
+    bool hashComments,
+    bool hashParent,
+    bool flipIfPassOrWFirst,
+    Rand* rand,
+    const std::function<void(PositionSample&,const BoardHistory&,const std::string&)>& f
+  ) const;
   void iterAllUniquePositionsHelper(
     Board& board, BoardHistory& hist, Player nextPla,
     const Rules& rules, int xSize, int ySize,
     PositionSample& sampleBuf,
     int initialTurnNumber,
-    std::set<Hash128>& uniqueHashes,
+    const std::function<bool(const Hash128&)>& insertIfUnique,
     bool hashComments,
     bool hashParent,
     bool flipIfPassOrWFirst,
     Rand* rand,
     std::vector<std::pair<int64_t,int64_t>>& variationTraceNodesBranch,
-    std::function<void(PositionSample&,const BoardHistory&,const std::string&)> f
+    const std::function<void(PositionSample&,const BoardHistory&,const std::string&)>& f
   ) const;
   void samplePositionIfUniqueHelper(
     Board& board, BoardHistory& hist, Player nextPla,
     PositionSample& sampleBuf,
     int initialTurnNumber,
-    std::set<Hash128>& uniqueHashes,
+    const std::function<bool(const Hash128&)>& insertIfUnique,
     bool hashComments,
     bool hashParent,
     bool flipIfPassOrWFirst,
     const std::string& comments,
-    std::function<void(PositionSample&,const BoardHistory&,const std::string&)> f
+    const std::function<void(PositionSample&,const BoardHistory&,const std::string&)>& f
   ) const;
 };
 
@@ -178,7 +231,8 @@ struct CompactSgf {
 
   static CompactSgf* parse(const std::string& str);
   static CompactSgf* loadFile(const std::string& file);
-  static std::vector<CompactSgf*> loadFiles(const std::vector<std::string>& files);
+  //numThreads <= 0 uses one thread per hardware thread
+  static std::vector<CompactSgf*> loadFiles(const std::vector<std::string>& files, int numThreads = 1);
 
   bool hasRules() const;
   Rules getRulesOrFail() const;
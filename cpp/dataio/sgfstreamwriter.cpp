@@ -0,0 +1,181 @@
+#include "../dataio/sgfstreamwriter.h"
+
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+
+#include <zlib.h>
+
+#include "../core/fileutils.h"
+#include "../core/rand.h"
+#include "../dataio/sgf.h"
+
+using namespace std;
+
+//Blocks waiting on the io thread before writeGame blocks
+static const size_t MAX_PENDING_BLOCKS = 64;
+
+SgfStreamWriter::SgfStreamWriter(const string& dir, bool gz, int64_t maxBytes, size_t blkBytes)
+  :outputDir(dir),
+   gzip(gz),
+   maxBytesPerFile(maxBytes),
+   blockBytes(blkBytes),
+   buffers(),
+   blockQueue(MAX_PENDING_BLOCKS),
+   ioThread(),
+   isClosed(false),
+   errorMutex(),
+   writeError(),
+   numGamesWritten(0),
+   numFilesStarted(0)
+{
+  ioThread = std::thread(&SgfStreamWriter::runIOLoop, this);
+}
+
+SgfStreamWriter::~SgfStreamWriter() {
+  try {
+    close();
+  }
+  catch(...) {
+  }
+}
+
+void SgfStreamWriter::rethrowWriteError() {
+  std::lock_guard<std::mutex> lock(errorMutex);
+  if(writeError != nullptr)
+    std::rethrow_exception(writeError);
+}
+
+void SgfStreamWriter::writeGame(const FinishedGameData& gameData) {
+  assert(gameData.startHist.moveHistory.size() <= gameData.endHist.moveHistory.size());
+  ostringstream out;
+  WriteSgf::writeSgf(out,gameData.bName,gameData.wName,gameData.endHist,&gameData,false,true);
+  out << "\n";
+
+  Buffer& buffer = buffers[std::hash<std::thread::id>()(std::this_thread::get_id()) % NUM_BUFFERS];
+  string* block = NULL;
+  {
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.text += out.str();
+    if(buffer.text.size() >= blockBytes) {
+      block = new string();
+      block->swap(buffer.text);
+    }
+  }
+  numGamesWritten.fetch_add(1,std::memory_order_relaxed);
+  //Outside of the buffer lock, since this can wait if the io thread is behind
+  if(block != NULL) {
+    blockQueue.waitPush(block);
+    rethrowWriteError();
+  }
+}
+
+void SgfStreamWriter::close() {
+  if(isClosed)
+    return;
+  isClosed = true;
+  for(int i = 0; i<NUM_BUFFERS; i++) {
+    std::lock_guard<std::mutex> lock(buffers[i].mutex);
+    if(buffers[i].text.size() > 0) {
+      string* block = new string();
+      block->swap(buffers[i].text);
+      blockQueue.waitPush(block);
+    }
+  }
+  blockQueue.setReadOnly();
+  ioThread.join();
+  rethrowWriteError();
+}
+
+int64_t SgfStreamWriter::getNumGamesWritten() const {
+  return numGamesWritten.load(std::memory_order_relaxed);
+}
+int64_t SgfStreamWriter::getNumFilesStarted() const {
+  return numFilesStarted.load(std::memory_order_relaxed);
+}
+
+void SgfStreamWriter::runIOLoop() {
+  try {
+    runIOLoopImpl();
+  }
+  catch(...) {
+    {
+      std::lock_guard<std::mutex> lock(errorMutex);
+      writeError = std::current_exception();
+    }
+    //Keep taking blocks so that writers never wait forever on a full queue
+    string* block;
+    while(blockQueue.waitPop(block))
+      delete block;
+  }
+}
+
+void SgfStreamWriter::runIOLoopImpl() {
+  Rand rand;
+  ofstream* out = NULL;
+  gzFile gzOut = NULL;
+  int64_t bytesThisFile = 0;
+
+  auto closeFile = [&]() {
+    if(out != NULL) {
+      out->close();
+      delete out;
+      out = NULL;
+    }
+    if(gzOut != NULL) {
+      gzclose(gzOut);
+      gzOut = NULL;
+    }
+  };
+
+  try {
+    while(true) {
+      string* block;
+      bool suc = blockQueue.waitPop(block);
+      if(!suc)
+        break;
+      std::unique_ptr<string> blockOwner(block);
+
+      if(out == NULL && gzOut == NULL) {
+        string fileName = outputDir + "/" + Global::uint64ToHexString(rand.nextUInt64()) + ".sgfs";
+        if(gzip) {
+          fileName += ".gz";
+          gzOut = gzopen(fileName.c_str(),"wb");
+          if(gzOut == NULL)
+            throw StringError("SgfStreamWriter: could not open " + fileName);
+        }
+        else {
+          out = new ofstream();
+          FileUtils::open(*out,fileName);
+        }
+        bytesThisFile = 0;
+        numFilesStarted.fetch_add(1,std::memory_order_relaxed);
+      }
+
+      if(gzOut != NULL) {
+        //gzwrite takes an unsigned int length, so write in pieces
+        const size_t maxPiece = (size_t)1 << 30;
+        for(size_t pos = 0; pos < block->size(); pos += maxPiece) {
+          unsigned int len = (unsigned int)std::min(maxPiece, block->size() - pos);
+          if(gzwrite(gzOut, block->data() + pos, len) != (int)len)
+            throw StringError("SgfStreamWriter: error writing gzipped sgfs");
+        }
+      }
+      else {
+        out->write(block->data(), block->size());
+        if(!out->good())
+          throw StringError("SgfStreamWriter: error writing sgfs");
+      }
+      bytesThisFile += (int64_t)block->size();
+
+      if(maxBytesPerFile > 0 && bytesThisFile >= maxBytesPerFile)
+        closeFile();
+    }
+  }
+  catch(...) {
+    closeFile();
+    throw;
+  }
+  closeFile();
+}
@@ -0,0 +1,72 @@
+#ifndef DATAIO_SGFSTREAMWRITER_H_
+#define DATAIO_SGFSTREAMWRITER_H_
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include "../core/global.h"
+#include "../core/threadsafequeue.h"
+#include "../dataio/trainingwrite.h"
+
+/*
+  Writes game records as .sgfs files, one sgf per line, for many threads at once without making them take turns.
+
+  writeGame formats the sgf on the calling thread and appends it to one of several text buffers, picked by thread,
+  so threads rarely contend. Only once a buffer holds blockBytes of text is it handed as one block to a dedicated io
+  thread, which appends whole blocks to the current file. So games in a file are only roughly in the order they finished,
+  and up to a block per buffer of the most recent games is lost if the process dies instead of calling close.
+
+  Files are optionally gzipped (.sgfs.gz). If maxBytesPerFile > 0, a new file is started once the current one has that
+  many bytes of sgf text, counted before compression. Files only ever end between blocks, so never split a game.
+*/
+class SgfStreamWriter {
+ public:
+  SgfStreamWriter(const std::string& outputDir, bool gzip, int64_t maxBytesPerFile, size_t blockBytes);
+  ~SgfStreamWriter();
+
+  SgfStreamWriter(const SgfStreamWriter&) = delete;
+  SgfStreamWriter& operator=(const SgfStreamWriter&) = delete;
+
+  //Threadsafe. Throws if the io thread has failed to write anything so far.
+  void writeGame(const FinishedGameData& gameData);
+
+  //Write out everything buffered, wait for the io thread to finish, and close the current file.
+  //No other thread may be in writeGame, and writeGame may not be called afterwards.
+  //Throws if the io thread failed to write anything. Called by the destructor if needed, ignoring errors.
+  void close();
+
+  int64_t getNumGamesWritten() const;
+  int64_t getNumFilesStarted() const;
+
+ private:
+  static constexpr int NUM_BUFFERS = 16;
+  struct Buffer {
+    std::mutex mutex;
+    std::string text;
+  };
+
+  const std::string outputDir;
+  const bool gzip;
+  const int64_t maxBytesPerFile;
+  const size_t blockBytes;
+
+  Buffer buffers[NUM_BUFFERS];
+  ThreadSafeQueue<std::string*> blockQueue;
+  std::thread ioThread;
+  bool isClosed;
+
+  std::mutex errorMutex;
+  //First error of the io thread, after which it discards everything
+  std::exception_ptr writeError;
+
+  std::atomic<int64_t> numGamesWritten;
+  std::atomic<int64_t> numFilesStarted;
+
+  void runIOLoop();
+  void runIOLoopImpl();
+  void rethrowWriteError();
+};
+
+#endif  // DATAIO_SGFSTREAMWRITER_H_
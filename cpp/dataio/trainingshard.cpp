@@ -0,0 +1,613 @@
+#include "../dataio/trainingshard.h"
+
+#include <algorithm>
+#include <cstring>
+#include <zlib.h>
+#include <ghc/filesystem.hpp>
+
+#include "../core/fileutils.h"
+
+namespace gfs = ghc::filesystem;
+
+using namespace std;
+
+static const char SHARD_MAGIC[8] = {'K','H','S','H','A','R','D','\n'};
+static const uint32_t SHARD_FORMAT_VERSION = 1;
+static const uint32_t CHUNK_MAGIC = 0x4B4E4843; //"CHNK"
+static const int64_t CHUNK_HEADER_BYTES = 24;
+//Sanity limits for parsing, so that a corrupt header can't make us allocate absurd amounts of memory
+static const uint32_t MAX_NUM_FIELDS = 64;
+static const uint32_t MAX_STRING_LEN = 1024;
+static const uint32_t MAX_FIELD_RANK = 8;
+
+//All integers in headers are little-endian regardless of platform.
+static void appendU32(string& s, uint32_t x) {
+  for(int i = 0; i<4; i++)
+    s.push_back((char)((x >> (8*i)) & 0xFF));
+}
+static void appendU64(string& s, uint64_t x) {
+  for(int i = 0; i<8; i++)
+    s.push_back((char)((x >> (8*i)) & 0xFF));
+}
+static uint32_t decodeU32(const char* s) {
+  uint32_t x = 0;
+  for(int i = 0; i<4; i++)
+    x |= ((uint32_t)(uint8_t)s[i]) << (8*i);
+  return x;
+}
+static uint64_t decodeU64(const char* s) {
+  uint64_t x = 0;
+  for(int i = 0; i<8; i++)
+    x |= ((uint64_t)(uint8_t)s[i]) << (8*i);
+  return x;
+}
+
+static bool readExactly(istream& in, char* buf, int64_t numBytes) {
+  in.read(buf, numBytes);
+  return in.gcount() == numBytes;
+}
+static uint32_t readU32(istream& in, const string& fileName) {
+  char buf[4];
+  if(!readExactly(in,buf,4))
+    throw StringError("Training shard " + fileName + " has a truncated header");
+  return decodeU32(buf);
+}
+static uint64_t readU64(istream& in, const string& fileName) {
+  char buf[8];
+  if(!readExactly(in,buf,8))
+    throw StringError("Training shard " + fileName + " has a truncated header");
+  return decodeU64(buf);
+}
+static string readString(istream& in, const string& fileName) {
+  uint32_t len = readU32(in,fileName);
+  if(len > MAX_STRING_LEN)
+    throw StringError("Training shard " + fileName + " has a corrupt header");
+  string s(len,'\0');
+  if(len > 0 && !readExactly(in,&s[0],len))
+    throw StringError("Training shard " + fileName + " has a truncated header");
+  return s;
+}
+
+static int64_t getDtypeBytes(const string& dtype) {
+  if(dtype.size() != 3)
+    throw StringError("Training shard: unsupported dtype " + dtype);
+  char c = dtype[2];
+  if(c < '1' || c > '8')
+    throw StringError("Training shard: unsupported dtype " + dtype);
+  return c - '0';
+}
+
+static string serializeHeader(const vector<TrainingShard::Field>& fields) {
+  string s(SHARD_MAGIC,sizeof(SHARD_MAGIC));
+  appendU32(s,SHARD_FORMAT_VERSION);
+  appendU32(s,(uint32_t)fields.size());
+  for(const TrainingShard::Field& field: fields) {
+    appendU32(s,(uint32_t)field.name.size());
+    s += field.name;
+    appendU32(s,(uint32_t)field.dtype.size());
+    s += field.dtype;
+    appendU32(s,(uint32_t)field.rowShape.size());
+    for(int64_t x: field.rowShape)
+      appendU64(s,(uint64_t)x);
+  }
+  return s;
+}
+
+//Reads the header from the start of in, leaving in positioned at the first chunk.
+static vector<TrainingShard::Field> readHeader(istream& in, const string& fileName) {
+  char magic[sizeof(SHARD_MAGIC)];
+  if(!readExactly(in,magic,sizeof(SHARD_MAGIC)) || memcmp(magic,SHARD_MAGIC,sizeof(SHARD_MAGIC)) != 0)
+    throw StringError("File " + fileName + " is not a training shard");
+  uint32_t version = readU32(in,fileName);
+  if(version != SHARD_FORMAT_VERSION)
+    throw StringError("Training shard " + fileName + " has unsupported format version " + Global::uint32ToString(version));
+
+  uint32_t numFields = readU32(in,fileName);
+  if(numFields <= 0 || numFields > MAX_NUM_FIELDS)
+    throw StringError("Training shard " + fileName + " has a corrupt header");
+  vector<TrainingShard::Field> fields;
+  for(uint32_t i = 0; i<numFields; i++) {
+    TrainingShard::Field field;
+    field.name = readString(in,fileName);
+    field.dtype = readString(in,fileName);
+    uint32_t rank = readU32(in,fileName);
+    if(rank > MAX_FIELD_RANK)
+      throw StringError("Training shard " + fileName + " has a corrupt header");
+    field.rowBytes = getDtypeBytes(field.dtype);
+    for(uint32_t j = 0; j<rank; j++) {
+      uint64_t x = readU64(in,fileName);
+      if(x > ((uint64_t)1 << 32))
+        throw StringError("Training shard " + fileName + " has a corrupt header");
+      field.rowShape.push_back((int64_t)x);
+      field.rowBytes *= (int64_t)x;
+    }
+    fields.push_back(field);
+  }
+  return fields;
+}
+
+static int64_t getFileSize(istream& in) {
+  in.clear();
+  in.seekg(0,std::ios::end);
+  return (int64_t)in.tellg();
+}
+
+//Hop over complete chunks starting at offset, calling f on each one. Returns the offset just past the last complete chunk.
+//A chunk that is cut off by the end of the file or that has a corrupt header ends the scan.
+static int64_t scanChunks(
+  istream& in, int64_t offset, int64_t rowBytes,
+  std::function<void(int64_t payloadOffset, int64_t payloadBytes, int64_t numRows, uint32_t crc, TrainingShard::Compression compression)> f
+) {
+  int64_t fileSize = getFileSize(in);
+  while(offset + CHUNK_HEADER_BYTES <= fileSize) {
+    char buf[CHUNK_HEADER_BYTES];
+    in.clear();
+    in.seekg(offset);
+    if(!readExactly(in,buf,CHUNK_HEADER_BYTES))
+      break;
+    uint32_t magic = decodeU32(buf);
+    uint32_t numRows = decodeU32(buf+4);
+    uint8_t compression = (uint8_t)buf[8];
+    uint64_t payloadBytes = decodeU64(buf+12);
+    uint32_t crc = decodeU32(buf+20);
+    if(magic != CHUNK_MAGIC || numRows <= 0)
+      break;
+    if(compression != (uint8_t)TrainingShard::Compression::NONE && compression != (uint8_t)TrainingShard::Compression::DEFLATE)
+      break;
+    if(compression == (uint8_t)TrainingShard::Compression::NONE && (int64_t)payloadBytes != (int64_t)numRows * rowBytes)
+      break;
+    if(payloadBytes > (uint64_t)(fileSize - offset - CHUNK_HEADER_BYTES))
+      break;
+    f(offset + CHUNK_HEADER_BYTES, (int64_t)payloadBytes, numRows, crc, (TrainingShard::Compression)compression);
+    offset += CHUNK_HEADER_BYTES + (int64_t)payloadBytes;
+  }
+  return offset;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+string TrainingShard::compressionToString(Compression compression) {
+  if(compression == Compression::NONE)
+    return "none";
+  if(compression == Compression::DEFLATE)
+    return "deflate";
+  ASSERT_UNREACHABLE;
+  return string();
+}
+
+TrainingShard::Compression TrainingShard::parseCompression(const string& s) {
+  string lower = Global::toLower(Global::trim(s));
+  if(lower == "none")
+    return Compression::NONE;
+  if(lower == "deflate")
+    return Compression::DEFLATE;
+  throw StringError("Unknown training shard compression: " + s + ", should be one of: none, deflate");
+}
+
+bool TrainingShard::Field::operator==(const Field& other) const {
+  return name == other.name && dtype == other.dtype && rowShape == other.rowShape;
+}
+bool TrainingShard::Field::operator!=(const Field& other) const {
+  return !(*this == other);
+}
+
+template <typename T>
+static TrainingShard::Field getField(const string& name, const NumpyBuffer<T>& buffer) {
+  TrainingShard::Field field;
+  field.name = name;
+  field.dtype = buffer.dtype;
+  field.rowBytes = sizeof(T);
+  for(size_t i = 1; i<buffer.shape.size(); i++) {
+    field.rowShape.push_back(buffer.shape[i]);
+    field.rowBytes *= buffer.shape[i];
+  }
+  return field;
+}
+
+vector<TrainingShard::Field> TrainingShard::getFields(const TrainingWriteBuffers& buffers) {
+  vector<Field> fields;
+  fields.push_back(getField("binaryInputNCHWPacked",buffers.binaryInputNCHWPacked));
+  fields.push_back(getField("globalInputNC",buffers.globalInputNC));
+  fields.push_back(getField("policyTargetsNCMove",buffers.policyTargetsNCMove));
+  fields.push_back(getField("globalTargetsNC",buffers.globalTargetsNC));
+  fields.push_back(getField("scoreDistrN",buffers.scoreDistrN));
+  fields.push_back(getField("valueTargetsNCHW",buffers.valueTargetsNCHW));
+  return fields;
+}
+
+//Parse the header of a .npy file, returning the offset of the data.
+static int64_t parseNpyHeader(const string& npy, const string& desc, string& dtype, vector<int64_t>& shape) {
+  if(npy.size() < 10 || (uint8_t)npy[0] != 0x93 || npy.compare(1,5,"NUMPY") != 0)
+    throw StringError(desc + " is not a numpy array");
+  int majorVersion = (uint8_t)npy[6];
+  int64_t headerLen;
+  int64_t dataStart;
+  if(majorVersion == 1) {
+    headerLen = (uint8_t)npy[8] | ((int64_t)(uint8_t)npy[9] << 8);
+    dataStart = 10 + headerLen;
+  }
+  else if(majorVersion == 2 || majorVersion == 3) {
+    if(npy.size() < 12)
+      throw StringError(desc + " has a truncated numpy header");
+    headerLen = (int64_t)decodeU32(npy.data()+8);
+    dataStart = 12 + headerLen;
+  }
+  else
+    throw StringError(desc + " has unsupported numpy format version " + Global::intToString(majorVersion));
+  if((int64_t)npy.size() < dataStart)
+    throw StringError(desc + " has a truncated numpy header");
+  string dict = npy.substr(dataStart - headerLen, headerLen);
+
+  auto findValue = [&](const string& key) {
+    size_t pos = dict.find("'" + key + "'");
+    if(pos == string::npos)
+      throw StringError(desc + " numpy header is missing " + key);
+    pos = dict.find(':',pos);
+    if(pos == string::npos)
+      throw StringError(desc + " numpy header is malformed");
+    return pos+1;
+  };
+
+  size_t descrPos = findValue("descr");
+  size_t descrStart = dict.find('\'',descrPos);
+  size_t descrEnd = descrStart == string::npos ? string::npos : dict.find('\'',descrStart+1);
+  if(descrEnd == string::npos)
+    throw StringError(desc + " numpy header is malformed");
+  dtype = dict.substr(descrStart+1, descrEnd-descrStart-1);
+
+  size_t fortranPos = findValue("fortran_order");
+  if(Global::trim(dict.substr(fortranPos)).compare(0,5,"False") != 0)
+    throw StringError(desc + " is fortran order, not supported");
+
+  size_t shapePos = findValue("shape");
+  size_t shapeStart = dict.find('(',shapePos);
+  size_t shapeEnd = shapeStart == string::npos ? string::npos : dict.find(')',shapeStart);
+  if(shapeEnd == string::npos)
+    throw StringError(desc + " numpy header is malformed");
+  shape.clear();
+  for(const string& piece: Global::split(dict.substr(shapeStart+1, shapeEnd-shapeStart-1),',')) {
+    string trimmed = Global::trim(piece);
+    if(trimmed.size() > 0)
+      shape.push_back(Global::stringToInt64(trimmed));
+  }
+  return dataStart;
+}
+
+static const char* NPZ_ARRAY_NAMES[6] = {
+  "binaryInputNCHWPacked", "globalInputNC", "policyTargetsNCMove", "globalTargetsNC", "scoreDistrN", "valueTargetsNCHW"
+};
+
+vector<TrainingShard::Field> TrainingShard::getFieldsOfNpz(const string& npzFile) {
+  vector<Field> fields;
+  for(const char* name: NPZ_ARRAY_NAMES) {
+    string npy = ZipFile::readBuffer(npzFile, (string(name) + ".npy").c_str());
+    Field field;
+    field.name = name;
+    vector<int64_t> shape;
+    parseNpyHeader(npy, npzFile + " " + name, field.dtype, shape);
+    if(shape.size() <= 0)
+      throw StringError(npzFile + " " + name + " is a scalar, expected an array of rows");
+    field.rowShape.assign(shape.begin()+1, shape.end());
+    field.rowBytes = getDtypeBytes(field.dtype);
+    for(int64_t x: field.rowShape)
+      field.rowBytes *= x;
+    fields.push_back(field);
+  }
+  return fields;
+}
+
+int64_t TrainingShard::appendNpzToShard(const string& npzFile, TrainingShardWriter& writer, int rowsPerChunk) {
+  if(rowsPerChunk <= 0)
+    throw StringError("appendNpzToShard: rowsPerChunk must be positive");
+  const vector<Field>& fields = writer.getFields();
+
+  //Load and validate all arrays, remembering where the data of each starts
+  vector<string> arrays;
+  vector<int64_t> dataStarts;
+  int64_t numRows = -1;
+  for(const Field& field: fields) {
+    string desc = npzFile + " " + field.name;
+    arrays.push_back(ZipFile::readBuffer(npzFile, (field.name + ".npy").c_str()));
+    string dtype;
+    vector<int64_t> shape;
+    int64_t dataStart = parseNpyHeader(arrays.back(), desc, dtype, shape);
+    if(dtype != field.dtype)
+      throw StringError(desc + " has dtype " + dtype + " but shard has " + field.dtype);
+    if(shape.size() != field.rowShape.size() + 1 || !std::equal(field.rowShape.begin(), field.rowShape.end(), shape.begin()+1))
+      throw StringError(desc + " has a different shape than the shard");
+    if(numRows >= 0 && shape[0] != numRows)
+      throw StringError(desc + " has a different number of rows than other arrays");
+    numRows = shape[0];
+    if((int64_t)arrays.back().size() < dataStart + numRows * field.rowBytes)
+      throw StringError(desc + " is truncated");
+    dataStarts.push_back(dataStart);
+  }
+
+  int64_t rowBytes = writer.getRowBytes();
+  vector<char> rowData;
+  for(int64_t chunkStart = 0; chunkStart < numRows; chunkStart += rowsPerChunk) {
+    int64_t chunkRows = std::min((int64_t)rowsPerChunk, numRows - chunkStart);
+    rowData.resize(chunkRows * rowBytes);
+    for(int64_t r = 0; r<chunkRows; r++) {
+      char* dst = rowData.data() + r * rowBytes;
+      for(size_t i = 0; i<fields.size(); i++) {
+        memcpy(dst, arrays[i].data() + dataStarts[i] + (chunkStart + r) * fields[i].rowBytes, fields[i].rowBytes);
+        dst += fields[i].rowBytes;
+      }
+    }
+    writer.appendChunk(rowData.data(), chunkRows);
+  }
+  return std::max(numRows,(int64_t)0);
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+TrainingShardWriter::TrainingShardWriter(
+  const string& fName,
+  const vector<TrainingShard::Field>& flds,
+  TrainingShard::Compression comp
+)
+  :fileName(fName),
+   fields(flds),
+   compression(comp),
+   rowBytes(0),
+   writeMutex(),
+   out(),
+   numRows(0),
+   numChunks(0)
+{
+  if(fields.size() <= 0 || fields.size() > MAX_NUM_FIELDS)
+    throw StringError("TrainingShardWriter: invalid number of fields");
+  for(const TrainingShard::Field& field: fields)
+    rowBytes += field.rowBytes;
+
+  if(FileUtils::exists(fileName)) {
+    int64_t endOfLastChunk;
+    int64_t fileSize;
+    {
+      ifstream in;
+      FileUtils::open(in, fileName, std::ios::in | std::ios::binary);
+      vector<TrainingShard::Field> existingFields = readHeader(in,fileName);
+      if(existingFields != fields)
+        throw StringError("TrainingShardWriter: existing file " + fileName + " has different fields, cannot append to it");
+      int64_t firstChunkOffset = (int64_t)in.tellg();
+      endOfLastChunk = scanChunks(
+        in, firstChunkOffset, rowBytes,
+        [&](int64_t payloadOffset, int64_t payloadBytes, int64_t chunkRows, uint32_t crc, TrainingShard::Compression chunkCompression) {
+          (void)payloadOffset; (void)payloadBytes; (void)crc; (void)chunkCompression;
+          numRows += chunkRows;
+          numChunks += 1;
+        }
+      );
+      fileSize = getFileSize(in);
+    }
+    //Drop any partially written chunk so that new chunks follow the last complete one
+    if(endOfLastChunk < fileSize)
+      gfs::resize_file(gfs::u8path(fileName), (uintmax_t)endOfLastChunk);
+    FileUtils::open(out, fileName, std::ios::out | std::ios::binary | std::ios::app);
+  }
+  else {
+    FileUtils::open(out, fileName, std::ios::out | std::ios::binary | std::ios::trunc);
+    string header = serializeHeader(fields);
+    out.write(header.data(), header.size());
+    out.flush();
+    if(!out.good())
+      throw StringError("TrainingShardWriter: error writing header to " + fileName);
+  }
+}
+
+TrainingShardWriter::~TrainingShardWriter() {
+  out.close();
+}
+
+const string& TrainingShardWriter::getFileName() const {
+  return fileName;
+}
+const vector<TrainingShard::Field>& TrainingShardWriter::getFields() const {
+  return fields;
+}
+int64_t TrainingShardWriter::getRowBytes() const {
+  return rowBytes;
+}
+int64_t TrainingShardWriter::getNumRows() const {
+  std::lock_guard<std::mutex> lock(writeMutex);
+  return numRows;
+}
+int64_t TrainingShardWriter::getNumChunks() const {
+  std::lock_guard<std::mutex> lock(writeMutex);
+  return numChunks;
+}
+
+void TrainingShardWriter::appendChunk(const TrainingWriteBuffers& buffers) {
+  int64_t chunkRows = buffers.curRows;
+  if(chunkRows <= 0)
+    return;
+
+  //Interleave the per-array rows into row records
+  vector<char> rowData(chunkRows * rowBytes);
+  const char* srcs[6] = {
+    (const char*)buffers.binaryInputNCHWPacked.data,
+    (const char*)buffers.globalInputNC.data,
+    (const char*)buffers.policyTargetsNCMove.data,
+    (const char*)buffers.globalTargetsNC.data,
+    (const char*)buffers.scoreDistrN.data,
+    (const char*)buffers.valueTargetsNCHW.data,
+  };
+  if(fields.size() != 6)
+    throw StringError("TrainingShardWriter: fields do not match TrainingWriteBuffers");
+  for(int64_t r = 0; r<chunkRows; r++) {
+    char* dst = rowData.data() + r * rowBytes;
+    for(size_t i = 0; i<fields.size(); i++) {
+      memcpy(dst, srcs[i] + r * fields[i].rowBytes, fields[i].rowBytes);
+      dst += fields[i].rowBytes;
+    }
+  }
+  appendChunk(rowData.data(), chunkRows);
+}
+
+void TrainingShardWriter::appendChunk(const char* rowData, int64_t chunkRows) {
+  if(chunkRows <= 0)
+    return;
+  if(chunkRows > 0xFFFFFFFFLL)
+    throw StringError("TrainingShardWriter: too many rows for one chunk");
+  int64_t uncompressedBytes = chunkRows * rowBytes;
+
+  vector<char> compressed;
+  const char* payload = rowData;
+  int64_t payloadBytes = uncompressedBytes;
+  if(compression == TrainingShard::Compression::DEFLATE) {
+    uLongf compressedLen = compressBound((uLong)uncompressedBytes);
+    compressed.resize(compressedLen);
+    int zret = compress2((Bytef*)compressed.data(), &compressedLen, (const Bytef*)rowData, (uLong)uncompressedBytes, Z_DEFAULT_COMPRESSION);
+    if(zret != Z_OK)
+      throw StringError("TrainingShardWriter: zlib compression failed for " + fileName);
+    payload = compressed.data();
+    payloadBytes = (int64_t)compressedLen;
+  }
+  uint32_t crc = (uint32_t)crc32(crc32(0L,Z_NULL,0), (const Bytef*)payload, (uInt)payloadBytes);
+
+  string header;
+  appendU32(header,CHUNK_MAGIC);
+  appendU32(header,(uint32_t)chunkRows);
+  header.push_back((char)compression);
+  header.append(3,'\0');
+  appendU64(header,(uint64_t)payloadBytes);
+  appendU32(header,crc);
+  assert((int64_t)header.size() == CHUNK_HEADER_BYTES);
+
+  std::lock_guard<std::mutex> lock(writeMutex);
+  out.write(header.data(), header.size());
+  out.write(payload, payloadBytes);
+  out.flush();
+  if(!out.good())
+    throw StringError("TrainingShardWriter: error appending to " + fileName);
+  numRows += chunkRows;
+  numChunks += 1;
+}
+
+//------------------------------------------------------------------------------------------------------------
+
+TrainingShardReader::TrainingShardReader(const string& fName)
+  :fileName(fName),
+   in(),
+   fields(),
+   rowBytes(0),
+   chunks(),
+   numRows(0),
+   nextChunkOffset(0),
+   cachedChunkIdx(-1),
+   cachedChunkData(),
+   compressedBuf()
+{
+  FileUtils::open(in, fileName, std::ios::in | std::ios::binary);
+  fields = readHeader(in,fileName);
+  for(const TrainingShard::Field& field: fields)
+    rowBytes += field.rowBytes;
+  nextChunkOffset = (int64_t)in.tellg();
+  refresh();
+}
+
+TrainingShardReader::~TrainingShardReader() {
+}
+
+const string& TrainingShardReader::getFileName() const {
+  return fileName;
+}
+const vector<TrainingShard::Field>& TrainingShardReader::getFields() const {
+  return fields;
+}
+int64_t TrainingShardReader::getRowBytes() const {
+  return rowBytes;
+}
+int64_t TrainingShardReader::getNumRows() const {
+  return numRows;
+}
+int64_t TrainingShardReader::getNumChunks() const {
+  return (int64_t)chunks.size();
+}
+
+int64_t TrainingShardReader::getFieldOffset(const string& fieldName) const {
+  int64_t offset = 0;
+  for(const TrainingShard::Field& field: fields) {
+    if(field.name == fieldName)
+      return offset;
+    offset += field.rowBytes;
+  }
+  throw StringError("Training shard " + fileName + " has no field " + fieldName);
+}
+
+void TrainingShardReader::refresh() {
+  nextChunkOffset = scanChunks(
+    in, nextChunkOffset, rowBytes,
+    [&](int64_t payloadOffset, int64_t payloadBytes, int64_t chunkRows, uint32_t crc, TrainingShard::Compression compression) {
+      ChunkInfo info;
+      info.payloadOffset = payloadOffset;
+      info.payloadBytes = payloadBytes;
+      info.firstRow = numRows;
+      info.numRows = chunkRows;
+      info.crc = crc;
+      info.compression = compression;
+      chunks.push_back(info);
+      numRows += chunkRows;
+    }
+  );
+}
+
+size_t TrainingShardReader::findChunk(int64_t rowIdx) const {
+  if(rowIdx < 0 || rowIdx >= numRows)
+    throw StringError("Training shard " + fileName + ": row " + Global::int64ToString(rowIdx) + " out of range");
+  //Last chunk whose firstRow <= rowIdx
+  auto it = std::upper_bound(
+    chunks.begin(), chunks.end(), rowIdx,
+    [](int64_t r, const ChunkInfo& chunk) { return r < chunk.firstRow; }
+  );
+  assert(it != chunks.begin());
+  return (size_t)(it - chunks.begin()) - 1;
+}
+
+const char* TrainingShardReader::loadChunk(size_t chunkIdx) {
+  if((int64_t)chunkIdx == cachedChunkIdx)
+    return cachedChunkData.data();
+
+  const ChunkInfo& chunk = chunks[chunkIdx];
+  int64_t uncompressedBytes = chunk.numRows * rowBytes;
+  compressedBuf.resize(chunk.payloadBytes);
+  in.clear();
+  in.seekg(chunk.payloadOffset);
+  if(!readExactly(in, compressedBuf.data(), chunk.payloadBytes))
+    throw StringError("Training shard " + fileName + ": error reading chunk " + Global::int64ToString((int64_t)chunkIdx));
+  uint32_t crc = (uint32_t)crc32(crc32(0L,Z_NULL,0), (const Bytef*)compressedBuf.data(), (uInt)chunk.payloadBytes);
+  if(crc != chunk.crc)
+    throw StringError("Training shard " + fileName + ": checksum mismatch in chunk " + Global::int64ToString((int64_t)chunkIdx));
+
+  cachedChunkIdx = -1;
+  if(chunk.compression == TrainingShard::Compression::NONE) {
+    cachedChunkData.swap(compressedBuf);
+  }
+  else {
+    cachedChunkData.resize(uncompressedBytes);
+    uLongf destLen = (uLongf)uncompressedBytes;
+    int zret = uncompress((Bytef*)cachedChunkData.data(), &destLen, (const Bytef*)compressedBuf.data(), (uLong)chunk.payloadBytes);
+    if(zret != Z_OK || (int64_t)destLen != uncompressedBytes)
+      throw StringError("Training shard " + fileName + ": error decompressing chunk " + Global::int64ToString((int64_t)chunkIdx));
+  }
+  cachedChunkIdx = (int64_t)chunkIdx;
+  return cachedChunkData.data();
+}
+
+void TrainingShardReader::readRow(int64_t rowIdx, char* buf) {
+  size_t chunkIdx = findChunk(rowIdx);
+  const char* chunkData = loadChunk(chunkIdx);
+  memcpy(buf, chunkData + (rowIdx - chunks[chunkIdx].firstRow) * rowBytes, rowBytes);
+}
+
+void TrainingShardReader::readRows(const vector<int64_t>& rowIdxs, char* buf) {
+  //Visit rows grouped by chunk so that each chunk is decompressed at most once
+  vector<std::pair<int64_t,size_t>> order;
+  order.reserve(rowIdxs.size());
+  for(size_t i = 0; i<rowIdxs.size(); i++)
+    order.push_back(std::make_pair(rowIdxs[i],i));
+  std::sort(order.begin(), order.end());
+  for(const std::pair<int64_t,size_t>& p: order)
+    readRow(p.first, buf + p.second * rowBytes);
+}
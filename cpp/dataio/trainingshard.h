@@ -0,0 +1,149 @@
+#ifndef DATAIO_TRAININGSHARD_H_
+#define DATAIO_TRAININGSHARD_H_
+
+#include <fstream>
+#include <mutex>
+
+#include "../core/global.h"
+#include "../dataio/trainingwrite.h"
+
+/*
+  Chunked, append-only alternative to the .npz files written by TrainingWriteBuffers.
+
+  A shard file is a header listing the fields of a row, followed by any number of chunks.
+  Every row is a fixed-size record made of one row of each of binaryInputNCHWPacked, globalInputNC,
+  policyTargetsNCMove, globalTargetsNC, scoreDistrN, valueTargetsNCHW, in that order and with exactly the same
+  dtypes and layouts as the corresponding npz arrays.
+  Each chunk is a small header followed by a run of consecutive rows, compressed independently of all other chunks.
+  So chunks can be appended as games finish, and a reader can index a file by hopping from chunk header to chunk
+  header and then only decompress the chunks containing the rows it actually wants.
+
+  A truncated chunk at the end of the file (a writer that crashed, or is in the middle of appending) is ignored by
+  readers and discarded by the next writer that opens the file.
+  Only one writer at a time may append to a given file.
+*/
+
+class TrainingShardWriter;
+
+namespace TrainingShard {
+  enum class Compression : uint8_t {
+    NONE = 0,
+    DEFLATE = 1,
+  };
+  std::string compressionToString(Compression compression);
+  Compression parseCompression(const std::string& s);
+
+  struct Field {
+    std::string name;
+    //Numpy dtype string, such as "<f4"
+    std::string dtype;
+    //Shape of a single row, i.e. the numpy shape without the leading dimension
+    std::vector<int64_t> rowShape;
+    int64_t rowBytes;
+
+    bool operator==(const Field& other) const;
+    bool operator!=(const Field& other) const;
+  };
+
+  //Fields of a row of data written out of these buffers
+  std::vector<Field> getFields(const TrainingWriteBuffers& buffers);
+
+  //Fields of a row of a .npz file written by TrainingWriteBuffers
+  std::vector<Field> getFieldsOfNpz(const std::string& npzFile);
+  //Append all rows of a .npz file written by TrainingWriteBuffers to writer, rowsPerChunk at a time.
+  //Returns the number of rows appended.
+  int64_t appendNpzToShard(const std::string& npzFile, TrainingShardWriter& writer, int rowsPerChunk);
+}
+
+class TrainingShardWriter {
+ public:
+  //Creates the file if it does not exist. Otherwise appends to it, after checking that it has the same fields.
+  TrainingShardWriter(
+    const std::string& fileName,
+    const std::vector<TrainingShard::Field>& fields,
+    TrainingShard::Compression compression
+  );
+  ~TrainingShardWriter();
+
+  TrainingShardWriter(const TrainingShardWriter&) = delete;
+  TrainingShardWriter& operator=(const TrainingShardWriter&) = delete;
+
+  //Append all current rows of buffers as one chunk. Does nothing if buffers is empty.
+  //Threadsafe, and compression is done outside of any lock so that multiple threads can compress at once.
+  void appendChunk(const TrainingWriteBuffers& buffers);
+  //Append numRows row records that are consecutive in rowData as one chunk.
+  void appendChunk(const char* rowData, int64_t numRows);
+
+  const std::string& getFileName() const;
+  const std::vector<TrainingShard::Field>& getFields() const;
+  int64_t getRowBytes() const;
+  //Including rows that were already in the file when it was opened
+  int64_t getNumRows() const;
+  int64_t getNumChunks() const;
+
+ private:
+  const std::string fileName;
+  const std::vector<TrainingShard::Field> fields;
+  const TrainingShard::Compression compression;
+  int64_t rowBytes;
+
+  mutable std::mutex writeMutex;
+  std::ofstream out;
+  int64_t numRows;
+  int64_t numChunks;
+};
+
+//Not threadsafe, because of the cached chunk. Use one reader per thread.
+class TrainingShardReader {
+ public:
+  TrainingShardReader(const std::string& fileName);
+  ~TrainingShardReader();
+
+  TrainingShardReader(const TrainingShardReader&) = delete;
+  TrainingShardReader& operator=(const TrainingShardReader&) = delete;
+
+  const std::string& getFileName() const;
+  const std::vector<TrainingShard::Field>& getFields() const;
+  int64_t getRowBytes() const;
+  int64_t getNumRows() const;
+  int64_t getNumChunks() const;
+  //Byte offset of the named field within a row record. Throws if there is no such field.
+  int64_t getFieldOffset(const std::string& fieldName) const;
+
+  //Index any chunks appended since the file was opened or last refreshed.
+  void refresh();
+
+  //Copy the getRowBytes() byte record of row rowIdx into buf.
+  //Only the chunk containing the row is read and decompressed, and the most recent chunk is kept around.
+  void readRow(int64_t rowIdx, char* buf);
+  //Copy the records of all of rowIdxs into buf consecutively, in the order given.
+  //Reads and decompresses each chunk involved only once.
+  void readRows(const std::vector<int64_t>& rowIdxs, char* buf);
+
+ private:
+  struct ChunkInfo {
+    int64_t payloadOffset;
+    int64_t payloadBytes;
+    int64_t firstRow;
+    int64_t numRows;
+    uint32_t crc;
+    TrainingShard::Compression compression;
+  };
+
+  const std::string fileName;
+  std::ifstream in;
+  std::vector<TrainingShard::Field> fields;
+  int64_t rowBytes;
+  std::vector<ChunkInfo> chunks;
+  int64_t numRows;
+  int64_t nextChunkOffset;
+
+  int64_t cachedChunkIdx;
+  std::vector<char> cachedChunkData;
+  std::vector<char> compressedBuf;
+
+  size_t findChunk(int64_t rowIdx) const;
+  const char* loadChunk(size_t chunkIdx);
+};
+
+#endif  // DATAIO_TRAININGSHARD_H_
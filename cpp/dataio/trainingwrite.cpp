@@ -1,6 +1,14 @@
 #include "../dataio/trainingwrite.h"
 
+#include <array>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "../core/fileutils.h"
+#include "../core/timer.h"
+#include "../dataio/trainingshard.h"
 #include "../neuralnet/modelversion.h"
 
 using namespace std;
@@ -25,7 +33,7 @@ template<typename T> static void selfTransposeNCHW(T* src, int n, int c, int h,
   }
   std::copy(buf, buf + n * c * h * w, src);
 
-  delete buf;
+  delete[] buf;
 }
 ValueTargets::ValueTargets()
   :win(0),
@@ -234,6 +242,7 @@ TrainingWriteBuffers::TrainingWriteBuffers(int iVersion, int maxRws, int numBCha
    dataYLen(yLen),
    packedBoardArea((xLen*yLen + 7)/8),
    curRows(0),
+   packInputsViaFloats(false),
    binaryInputNCHWUnpacked(NULL),
    binaryInputNCHWPacked({maxRws, numBChannels, packedBoardArea}),
    globalInputNC({maxRws, numFChannels}),
@@ -277,6 +286,78 @@ static void packBits(const float* binaryFloats, int len, uint8_t* bits) {
   }
 }
 
+static std::array<uint8_t,256> makeBitReverseTable() {
+  std::array<uint8_t,256> table;
+  for(int i = 0; i<256; i++) {
+    uint8_t reversed = 0;
+    for(int b = 0; b<8; b++)
+      reversed |= (uint8_t)(((i >> b) & 1) << (7-b));
+    table[i] = reversed;
+  }
+  return table;
+}
+static const std::array<uint8_t,256> BIT_REVERSE_TABLE = makeBitReverseTable();
+
+//Same as packBits, but from bytes that are each either 0 or 0xFF.
+static void packByteMasks(const uint8_t* masks, int len, uint8_t* bits) {
+  int i = 0;
+#ifdef __SSE2__
+  //movemask gathers the high bit of each byte, little-endian-style, so reverse each resulting byte
+  for(; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(masks + i));
+    uint32_t m = (uint32_t)_mm_movemask_epi8(v);
+    bits[i >> 3] = BIT_REVERSE_TABLE[m & 0xFF];
+    bits[(i >> 3) + 1] = BIT_REVERSE_TABLE[(m >> 8) & 0xFF];
+  }
+#endif
+  for(; i < len; i += 8) {
+    uint8_t b = 0;
+    for(int di = 0; di < 8 && i + di < len; di++)
+      b |= (uint8_t)((masks[i + di] >> 7) << (7-di));
+    bits[i >> 3] = b;
+  }
+}
+
+//Write the packed spatial features of NNInputs::fillRowV7, including the transpose for white, straight from the board.
+//Only the on-board and stone features are ever set, so build a byte mask per feature and pack those, instead of
+//filling and transposing NUM_FEATURES_SPATIAL_V7 planes of floats and packing them one float at a time.
+static void fillPackedBinaryInputsV7(
+  const Board& board, Player nextPlayer, int dataXLen, int dataYLen, int packedBoardArea, uint8_t* rowBinPacked
+) {
+  static_assert(NNInputs::NUM_FEATURES_SPATIAL_V7 == 22, "Keep in sync with NNInputs::fillRowV7");
+  static const int MAX_MASK_LEN = (NNPos::MAX_BOARD_AREA + 15) / 16 * 16;
+  assert(dataXLen == dataYLen);
+  assert(board.x_size <= dataXLen && board.y_size <= dataYLen);
+
+  int posArea = dataXLen * dataYLen;
+  uint8_t onBoard[MAX_MASK_LEN];
+  uint8_t plaStones[MAX_MASK_LEN];
+  uint8_t oppStones[MAX_MASK_LEN];
+  std::memset(onBoard, 0, posArea);
+  std::memset(plaStones, 0, posArea);
+  std::memset(oppStones, 0, posArea);
+
+  Player pla = nextPlayer;
+  Player opp = getOpp(pla);
+  bool transpose = nextPlayer == C_WHITE;
+  int xSize = board.x_size;
+  int ySize = board.y_size;
+  for(int y = 0; y<ySize; y++) {
+    for(int x = 0; x<xSize; x++) {
+      int pos = transpose ? NNPos::xyToPos(y,x,dataXLen) : NNPos::xyToPos(x,y,dataXLen);
+      Color stone = board.colors[Location::getLoc(x,y,xSize)];
+      onBoard[pos] = 0xFF;
+      plaStones[pos] = stone == pla ? 0xFF : 0;
+      oppStones[pos] = stone == opp ? 0xFF : 0;
+    }
+  }
+
+  packByteMasks(onBoard, posArea, rowBinPacked + 0 * packedBoardArea);
+  packByteMasks(plaStones, posArea, rowBinPacked + 1 * packedBoardArea);
+  packByteMasks(oppStones, posArea, rowBinPacked + 2 * packedBoardArea);
+  std::memset(rowBinPacked + 3 * packedBoardArea, 0, (NNInputs::NUM_FEATURES_SPATIAL_V7 - 3) * packedBoardArea);
+}
+
 static void zeroPolicyTarget(int policySize, int16_t* target) {
   for(int pos = 0; pos<policySize; pos++)
     target[pos] = 0;
@@ -352,6 +433,15 @@ static void fillValueTDTargets(const vector<ValueTargets>& whiteValueTargetsByTu
   buf[3] = (float)score;
 }
 
+static MiscNNInputParams getNNInputParamsForRow(Player nextPlayer, bool isSidePosition, const FinishedGameData& data) {
+  MiscNNInputParams nnInputParams;
+  nnInputParams.drawEquivalentWinsForWhite = data.drawEquivalentWinsForWhite;
+  //Note: this is coordinated with the fact that selfplay does not use this feature on side positions
+  if(!isSidePosition)
+    nnInputParams.playoutDoublingAdvantage = getOpp(nextPlayer) == data.playoutDoublingAdvantagePla ? -data.playoutDoublingAdvantage : data.playoutDoublingAdvantage;
+  return nnInputParams;
+}
+
 void TrainingWriteBuffers::addRow(
   const Board& board, const BoardHistory& hist, Player nextPlayer,
   int turnIdx,
@@ -381,31 +471,31 @@ void TrainingWriteBuffers::addRow(
   assert(curRows < maxRows);
 
   {
-    MiscNNInputParams nnInputParams;
-    nnInputParams.drawEquivalentWinsForWhite = data.drawEquivalentWinsForWhite;
-    //Note: this is coordinated with the fact that selfplay does not use this feature on side positions
-    if(!isSidePosition)
-      nnInputParams.playoutDoublingAdvantage = getOpp(nextPlayer) == data.playoutDoublingAdvantagePla ? -data.playoutDoublingAdvantage : data.playoutDoublingAdvantage;
+    MiscNNInputParams nnInputParams = getNNInputParamsForRow(nextPlayer, isSidePosition, data);
 
     bool inputsUseNHWC = false;
     float* rowBin = binaryInputNCHWUnpacked;
     float* rowGlobal = globalInputNC.data + curRows * numGlobalChannels;
+    uint8_t* rowBinPacked = binaryInputNCHWPacked.data + curRows * numBinaryChannels * packedBoardArea;
     static_assert(NNModelVersion::latestInputsVersionImplemented == 7, "");
-    
+
     if(inputsVersion == 7) {
       assert(NNInputs::NUM_FEATURES_SPATIAL_V7 == numBinaryChannels);
       assert(NNInputs::NUM_FEATURES_GLOBAL_V7 == numGlobalChannels);
-      NNInputs::fillRowV7(board, hist, nextPlayer, nnInputParams, dataXLen, dataYLen, inputsUseNHWC, rowBin, rowGlobal);
+      if(packInputsViaFloats) {
+        NNInputs::fillRowV7(board, hist, nextPlayer, nnInputParams, dataXLen, dataYLen, inputsUseNHWC, rowBin, rowGlobal);
+        if(nextPlayer==C_WHITE)selfTransposeNCHW(rowBin, 1, numBinaryChannels, dataYLen, dataXLen);
+        //Pack bools bitwise into uint8_t
+        for(int c = 0; c<numBinaryChannels; c++)
+          packBits(rowBin + c * posArea, posArea, rowBinPacked + c * packedBoardArea);
+      }
+      else {
+        NNInputs::fillRowGlobalV7(board, hist, nextPlayer, nnInputParams, rowGlobal);
+        fillPackedBinaryInputsV7(board, nextPlayer, dataXLen, dataYLen, packedBoardArea, rowBinPacked);
+      }
     }
     else
       ASSERT_UNREACHABLE;
-
-    if(nextPlayer==C_WHITE)selfTransposeNCHW(rowBin, 1, numBinaryChannels, dataYLen, dataXLen);
-
-    //Pack bools bitwise into uint8_t
-    uint8_t* rowBinPacked = binaryInputNCHWPacked.data + curRows * numBinaryChannels * packedBoardArea;
-    for(int c = 0; c<numBinaryChannels; c++)
-      packBits(rowBin + c * posArea, posArea, rowBinPacked + c * packedBoardArea);
   }
 
   //Vector for global targets and metadata
@@ -681,6 +771,115 @@ void TrainingWriteBuffers::addRow(
   curRows++;
 }
 
+//Round to one of the two nearest integers, randomized so that the expectation is exactly x.
+static int8_t stochasticRoundToInt8(double x, Rand& rand) {
+  double low = floor(x);
+  double lambda = x - low;
+  if(lambda > 0.0 && rand.nextBool(lambda))
+    low += 1.0;
+  return (int8_t)std::max(-128.0, std::min(127.0, low));
+}
+
+void TrainingWriteBuffers::mergeRowInto(int srcRow, int dstRow, bool rotate180, Rand& rand) {
+  assert(srcRow >= 0 && srcRow < curRows);
+  assert(dstRow >= 0 && dstRow < curRows);
+  assert(srcRow != dstRow);
+  int posArea = dataXLen*dataYLen;
+  int policySize = NNPos::getPolicySize(dataXLen,dataYLen);
+
+  //Position in srcRow of the point that is at pos in dstRow
+  auto srcPos = [&](int pos) {
+    return rotate180 ? posArea-1-pos : pos;
+  };
+
+  float* srcGlobal = globalTargetsNC.data + srcRow * GLOBAL_TARGET_NUM_CHANNELS;
+  float* dstGlobal = globalTargetsNC.data + dstRow * GLOBAL_TARGET_NUM_CHANNELS;
+  double srcWeight = srcGlobal[25];
+  double dstWeight = dstGlobal[25];
+  double totalWeight = srcWeight + dstWeight;
+  if(srcWeight <= 0.0)
+    return;
+
+  //Policy targets, as the visit-weighted average of the two distributions, which is just the sum of the visit counts.
+  //Rescaled down if that would overflow.
+  int16_t* srcPolicy = policyTargetsNCMove.data + srcRow * POLICY_TARGET_NUM_CHANNELS * policySize;
+  int16_t* dstPolicy = policyTargetsNCMove.data + dstRow * POLICY_TARGET_NUM_CHANNELS * policySize;
+  const int policyWeightChannels[POLICY_TARGET_NUM_CHANNELS] = {26, 28};
+  for(int c = 0; c<POLICY_TARGET_NUM_CHANNELS; c++) {
+    int wc = policyWeightChannels[c];
+    if(srcGlobal[wc] <= 0.0f)
+      continue;
+    int16_t* src = srcPolicy + c * policySize;
+    int16_t* dst = dstPolicy + c * policySize;
+    if(dstGlobal[wc] <= 0.0f) {
+      //dst only has a dummy uniform target
+      for(int pos = 0; pos<posArea; pos++)
+        dst[pos] = src[srcPos(pos)];
+      for(int pos = posArea; pos<policySize; pos++)
+        dst[pos] = src[pos];
+      continue;
+    }
+    int32_t maxSum = 0;
+    for(int pos = 0; pos<policySize; pos++) {
+      int32_t sum = (int32_t)dst[pos] + (int32_t)src[pos < posArea ? srcPos(pos) : pos];
+      maxSum = std::max(maxSum,sum);
+    }
+    double scale = maxSum > 32767 ? 32767.0 / maxSum : 1.0;
+    for(int pos = 0; pos<policySize; pos++) {
+      int32_t sum = (int32_t)dst[pos] + (int32_t)src[pos < posArea ? srcPos(pos) : pos];
+      dst[pos] = (int16_t)(scale < 1.0 ? round(sum * scale) : sum);
+    }
+  }
+
+  //Everything else is averaged weighted by row weight times the weight of the specific target.
+  auto averageGlobal = [&](int channel, double srcW, double dstW) {
+    if(srcW + dstW > 0.0)
+      dstGlobal[channel] = (float)((srcGlobal[channel] * srcW + dstGlobal[channel] * dstW) / (srcW + dstW));
+  };
+  for(int i = 0; i<20; i++)
+    averageGlobal(i, srcWeight, dstWeight);
+  averageGlobal(20, srcWeight * srcGlobal[27], dstWeight * dstGlobal[27]);
+  averageGlobal(21, srcWeight * srcGlobal[29], dstWeight * dstGlobal[29]);
+  averageGlobal(22, srcWeight, dstWeight);
+  for(int i = 57; i<=59; i++)
+    averageGlobal(i, srcWeight, dstWeight);
+
+  int8_t* srcValue = valueTargetsNCHW.data + srcRow * VALUE_SPATIAL_TARGET_NUM_CHANNELS * posArea;
+  int8_t* dstValue = valueTargetsNCHW.data + dstRow * VALUE_SPATIAL_TARGET_NUM_CHANNELS * posArea;
+  auto averageSpatial = [&](int channel, double srcW, double dstW) {
+    if(srcW <= 0.0)
+      return;
+    const int8_t* src = srcValue + channel * posArea;
+    int8_t* dst = dstValue + channel * posArea;
+    for(int pos = 0; pos<posArea; pos++)
+      dst[pos] = stochasticRoundToInt8((src[srcPos(pos)] * srcW + dst[pos] * dstW) / (srcW + dstW), rand);
+  };
+  averageSpatial(0, srcWeight * srcGlobal[27], dstWeight * dstGlobal[27]);
+  averageSpatial(1, srcWeight * srcGlobal[27], dstWeight * dstGlobal[27]);
+  averageSpatial(2, srcWeight * srcGlobal[33], dstWeight * dstGlobal[33]);
+  averageSpatial(3, srcWeight * srcGlobal[33], dstWeight * dstGlobal[33]);
+  averageSpatial(4, srcWeight * srcGlobal[34], dstWeight * dstGlobal[34]);
+
+  if(srcGlobal[27] > 0.0f) {
+    int scoreDistrLen = posArea*2 + NNPos::EXTRA_SCORE_DISTR_RADIUS*2;
+    const int8_t* src = scoreDistrN.data + srcRow * scoreDistrLen;
+    int8_t* dst = scoreDistrN.data + dstRow * scoreDistrLen;
+    double srcW = srcWeight * srcGlobal[27];
+    double dstW = dstWeight * dstGlobal[27];
+    for(int i = 0; i<scoreDistrLen; i++)
+      dst[i] = stochasticRoundToInt8((src[i] * srcW + dst[i] * dstW) / (srcW + dstW), rand);
+  }
+
+  //Target weights become the proportion of the merged row weight that had each target
+  const int targetWeightChannels[6] = {26, 27, 28, 29, 33, 34};
+  for(int i = 0; i<6; i++) {
+    int c = targetWeightChannels[i];
+    dstGlobal[c] = (float)((srcGlobal[c] * srcWeight + dstGlobal[c] * dstWeight) / totalWeight);
+  }
+  dstGlobal[25] = (float)totalWeight;
+  dstGlobal[60] = dstGlobal[60] + srcGlobal[60];
+}
+
 void TrainingWriteBuffers::writeToZipFile(const string& fileName) {
   ZipFile zipFile(fileName);
 
@@ -792,7 +991,11 @@ TrainingDataWriter::TrainingDataWriter(ostream* dbgOut, int iVersion, int maxRow
 {}
 
 TrainingDataWriter::TrainingDataWriter(const string& outDir, ostream* dbgOut, int iVersion, int maxRowsPerFile, double firstFileMinRandProp, int dataXLen, int dataYLen, int onlyEvery, const string& randSeed)
-  :outputDir(outDir),inputsVersion(iVersion),rand(randSeed),writeBuffers(NULL),debugOut(dbgOut),debugOnlyWriteEvery(onlyEvery),rowCount(0)
+  :outputDir(outDir),inputsVersion(iVersion),rand(randSeed),writeBuffers(NULL),debugOut(dbgOut),debugOnlyWriteEvery(onlyEvery),rowCount(0),
+   writeThreads(),writeMutex(),pendingWritesAdded(),pendingWriteFinished(),pendingWrites(),freeBuffers(),
+   numWritesInProgress(0),shouldStopWriting(false),writeError(),writeStats(),
+   shardMaxRows(0),shardCompression(TrainingShard::Compression::NONE),shardWriter(),shardRowsHandedOff(0),
+   dedupRows(false),dedupUseSymmetry(false),dedupRowsByHash()
 {
   int numBinaryChannels;
   int numGlobalChannels;
@@ -822,7 +1025,240 @@ TrainingDataWriter::TrainingDataWriter(const string& outDir, ostream* dbgOut, in
 
 TrainingDataWriter::~TrainingDataWriter()
 {
+  //Write threads finish everything still pending before exiting
+  {
+    std::lock_guard<std::mutex> lock(writeMutex);
+    shouldStopWriting = true;
+  }
+  pendingWritesAdded.notify_all();
+  for(size_t i = 0; i<writeThreads.size(); i++)
+    writeThreads[i].join();
+  for(size_t i = 0; i<freeBuffers.size(); i++)
+    delete freeBuffers[i];
+  delete writeBuffers;
+
+  //Normally waitForPendingWrites already threw this, but we can't throw from here, so at least don't lose it silently
+  if(writeError != nullptr) {
+    try {
+      std::rethrow_exception(writeError);
+    }
+    catch(const std::exception& e) {
+      cerr << "TrainingDataWriter: error writing training data to " << outputDir << ": " << e.what() << endl;
+    }
+    catch(...) {
+      cerr << "TrainingDataWriter: unknown error writing training data to " << outputDir << endl;
+    }
+  }
+}
+
+void TrainingDataWriter::enableBackgroundWriting(int numThreads, int maxPendingFiles) {
+  if(debugOut != NULL)
+    throw StringError("TrainingDataWriter: background writing is not supported when writing to a debug stream");
+  if(writeThreads.size() > 0)
+    throw StringError("TrainingDataWriter: background writing already enabled");
+  if(rowCount > 0)
+    throw StringError("TrainingDataWriter: background writing must be enabled before writing any data");
+  if(numThreads <= 0 || maxPendingFiles <= 0)
+    throw StringError("TrainingDataWriter: invalid number of background write threads or pending files");
+
+  for(int i = 0; i<maxPendingFiles; i++) {
+    freeBuffers.push_back(new TrainingWriteBuffers(
+      writeBuffers->inputsVersion, writeBuffers->maxRows, writeBuffers->numBinaryChannels, writeBuffers->numGlobalChannels,
+      writeBuffers->dataXLen, writeBuffers->dataYLen
+    ));
+  }
+  for(int i = 0; i<numThreads; i++)
+    writeThreads.push_back(std::thread(&TrainingDataWriter::runWriteLoop, this));
+}
+
+static int64_t getUncompressedNumBytes(TrainingWriteBuffers* buffers) {
+  int64_t numRows = buffers->curRows;
+  return
+    buffers->binaryInputNCHWPacked.getActualDataLen(numRows) * (int64_t)sizeof(uint8_t) +
+    buffers->globalInputNC.getActualDataLen(numRows) * (int64_t)sizeof(float) +
+    buffers->policyTargetsNCMove.getActualDataLen(numRows) * (int64_t)sizeof(int16_t) +
+    buffers->globalTargetsNC.getActualDataLen(numRows) * (int64_t)sizeof(float) +
+    buffers->scoreDistrN.getActualDataLen(numRows) * (int64_t)sizeof(int8_t) +
+    buffers->valueTargetsNCHW.getActualDataLen(numRows) * (int64_t)sizeof(int8_t);
+}
+
+void TrainingDataWriter::enableShardOutput(int rowsPerChunk, TrainingShard::Compression compression) {
+  if(debugOut != NULL)
+    throw StringError("TrainingDataWriter: shard output is not supported when writing to a debug stream");
+  if(writeThreads.size() > 0)
+    throw StringError("TrainingDataWriter: shard output must be enabled before background writing");
+  if(rowCount > 0)
+    throw StringError("TrainingDataWriter: shard output must be enabled before writing any data");
+  if(rowsPerChunk <= 0)
+    throw StringError("TrainingDataWriter: invalid number of rows per shard chunk");
+
+  //The buffer now only needs to hold one chunk, and the per-file row limit applies to whole shards instead.
+  //Shards are appended to as they go, so there is no point randomizing the size of the first one.
+  shardMaxRows = writeBuffers->maxRows;
+  shardCompression = compression;
+  TrainingWriteBuffers* chunkBuffers = new TrainingWriteBuffers(
+    writeBuffers->inputsVersion, rowsPerChunk, writeBuffers->numBinaryChannels, writeBuffers->numGlobalChannels,
+    writeBuffers->dataXLen, writeBuffers->dataYLen
+  );
   delete writeBuffers;
+  writeBuffers = chunkBuffers;
+  isFirstFile = false;
+}
+
+void TrainingDataWriter::enableRowDedup(bool useSymmetry, int minWindowRows) {
+  if(writeThreads.size() > 0)
+    throw StringError("TrainingDataWriter: row dedup must be enabled before background writing");
+  if(rowCount > 0)
+    throw StringError("TrainingDataWriter: row dedup must be enabled before writing any data");
+  dedupRows = true;
+  dedupUseSymmetry = useSymmetry;
+
+  //For npz output the buffer is already a whole file
+  int64_t chunkRows = std::min((int64_t)minWindowRows, shardMaxRows);
+  if(shardMaxRows > 0 && writeBuffers->maxRows < chunkRows) {
+    TrainingWriteBuffers* chunkBuffers = new TrainingWriteBuffers(
+      writeBuffers->inputsVersion, (int)chunkRows, writeBuffers->numBinaryChannels, writeBuffers->numGlobalChannels,
+      writeBuffers->dataXLen, writeBuffers->dataYLen
+    );
+    delete writeBuffers;
+    writeBuffers = chunkBuffers;
+  }
+}
+
+void TrainingDataWriter::dedupLastRow(
+  const Board& board, const BoardHistory& hist, Player nextPlayer, bool isSidePosition, const FinishedGameData& data
+) {
+  if(!dedupRows)
+    return;
+  MiscNNInputParams nnInputParams = getNNInputParamsForRow(nextPlayer, isSidePosition, data);
+  Hash128 hash = NNInputs::getHash(board, hist, nextPlayer, nnInputParams);
+  bool isRotated = false;
+  //Rows are stored in data coordinates, where rotating is just reversing the order of the points,
+  //as long as the board covers the whole data area.
+  if(dedupUseSymmetry && board.x_size == writeBuffers->dataXLen && board.y_size == writeBuffers->dataYLen) {
+    Board rotated(board.x_size, board.y_size);
+    for(int y = 0; y<board.y_size; y++) {
+      for(int x = 0; x<board.x_size; x++) {
+        Loc loc = Location::getLoc(x,y,board.x_size);
+        if(board.colors[loc] != C_EMPTY)
+          rotated.setStone(Location::getLoc(board.x_size-1-x,board.y_size-1-y,board.x_size), board.colors[loc]);
+      }
+    }
+    Hash128 rotatedHash = NNInputs::getHash(rotated, hist, nextPlayer, nnInputParams);
+    if(rotatedHash < hash) {
+      hash = rotatedHash;
+      isRotated = true;
+    }
+  }
+
+  int row = writeBuffers->curRows-1;
+  auto iter = dedupRowsByHash.find(hash);
+  if(iter == dedupRowsByHash.end()) {
+    DedupEntry entry;
+    entry.row = row;
+    entry.isRotated = isRotated;
+    dedupRowsByHash[hash] = entry;
+    return;
+  }
+  writeBuffers->mergeRowInto(row, iter->second.row, isRotated != iter->second.isRotated, rand);
+  writeBuffers->curRows -= 1;
+  std::lock_guard<std::mutex> lock(writeMutex);
+  writeStats.numRowsDeduped += 1;
+}
+
+void TrainingDataWriter::rethrowWriteErrorAlreadyLocked() {
+  if(writeError != nullptr) {
+    std::exception_ptr e = writeError;
+    writeError = nullptr;
+    std::rethrow_exception(e);
+  }
+}
+
+void TrainingDataWriter::handOffBuffersForWriting(const string& fileName, const std::shared_ptr<TrainingShardWriter>& shard) {
+  std::unique_lock<std::mutex> lock(writeMutex);
+  if(freeBuffers.size() <= 0) {
+    ClockTimer timer;
+    while(freeBuffers.size() <= 0)
+      pendingWriteFinished.wait(lock);
+    writeStats.secondsBlocked += timer.getSeconds();
+  }
+  rethrowWriteErrorAlreadyLocked();
+
+  PendingWrite pendingWrite;
+  pendingWrite.buffers = writeBuffers;
+  pendingWrite.fileName = fileName;
+  pendingWrite.shardWriter = shard;
+  pendingWrites.push_back(pendingWrite);
+  writeBuffers = freeBuffers.back();
+  freeBuffers.pop_back();
+  int64_t numPending = (int64_t)pendingWrites.size() + numWritesInProgress;
+  if(numPending > writeStats.maxNumFilesPending)
+    writeStats.maxNumFilesPending = numPending;
+  lock.unlock();
+  pendingWritesAdded.notify_one();
+}
+
+void TrainingDataWriter::runWriteLoop() {
+  std::unique_lock<std::mutex> lock(writeMutex);
+  while(true) {
+    while(pendingWrites.size() <= 0 && !shouldStopWriting)
+      pendingWritesAdded.wait(lock);
+    if(pendingWrites.size() <= 0)
+      break;
+    PendingWrite pendingWrite = pendingWrites.front();
+    pendingWrites.pop_front();
+    TrainingWriteBuffers* buffers = pendingWrite.buffers;
+    numWritesInProgress += 1;
+    lock.unlock();
+
+    ClockTimer timer;
+    int64_t numBytes = 0;
+    std::exception_ptr error;
+    try {
+      numBytes = getUncompressedNumBytes(buffers);
+      if(pendingWrite.shardWriter != nullptr) {
+        pendingWrite.shardWriter->appendChunk(*buffers);
+      }
+      else {
+        string tmpFilename = pendingWrite.fileName + ".tmp";
+        buffers->writeToZipFile(tmpFilename);
+        FileUtils::rename(tmpFilename,pendingWrite.fileName);
+      }
+    }
+    catch(...) {
+      error = std::current_exception();
+    }
+    buffers->clear();
+    double seconds = timer.getSeconds();
+
+    lock.lock();
+    numWritesInProgress -= 1;
+    freeBuffers.push_back(buffers);
+    if(error != nullptr) {
+      if(writeError == nullptr)
+        writeError = error;
+    }
+    else {
+      writeStats.numFilesWritten += 1;
+      writeStats.numBytesWritten += numBytes;
+    }
+    writeStats.secondsWriting += seconds;
+    pendingWriteFinished.notify_all();
+  }
+}
+
+void TrainingDataWriter::waitForPendingWrites() {
+  std::unique_lock<std::mutex> lock(writeMutex);
+  while(pendingWrites.size() > 0 || numWritesInProgress > 0)
+    pendingWriteFinished.wait(lock);
+  rethrowWriteErrorAlreadyLocked();
+}
+
+TrainingDataWriter::WriteStats TrainingDataWriter::getWriteStats() const {
+  std::lock_guard<std::mutex> lock(writeMutex);
+  WriteStats stats = writeStats;
+  stats.numFilesPending = (int64_t)pendingWrites.size() + numWritesInProgress;
+  return stats;
 }
 
 bool TrainingDataWriter::isEmpty() const {
@@ -841,13 +1277,23 @@ void TrainingDataWriter::writeAndClearIfFull() {
 
 
 void TrainingDataWriter::flushIfNonempty() {
-  string resultingFilename;
-  flushIfNonempty(resultingFilename);
+  if(writeBuffers->curRows <= 0)
+    return;
+  flushIfNonemptyNoWait();
 }
 
 bool TrainingDataWriter::flushIfNonempty(string& resultingFilename) {
   if(writeBuffers->curRows <= 0)
     return false;
+  resultingFilename = flushIfNonemptyNoWait();
+  if(writeThreads.size() > 0)
+    waitForPendingWrites();
+  return true;
+}
+
+string TrainingDataWriter::flushIfNonemptyNoWait() {
+  string resultingFilename;
+  dedupRowsByHash.clear();
 
   isFirstFile = false;
 
@@ -857,13 +1303,43 @@ bool TrainingDataWriter::flushIfNonempty(string& resultingFilename) {
     resultingFilename = "";
   }
   else {
-    resultingFilename = outputDir + "/" + Global::uint64ToHexString(rand.nextUInt64()) + ".npz";
-    string tmpFilename = resultingFilename + ".tmp";
-    writeBuffers->writeToZipFile(tmpFilename);
-    writeBuffers->clear();
-    FileUtils::rename(tmpFilename,resultingFilename);
+    if(shardMaxRows > 0) {
+      //Shards are appended to under their final name from the start, readers ignore a partially appended chunk
+      if(shardWriter == nullptr || shardRowsHandedOff >= shardMaxRows) {
+        string shardFilename = outputDir + "/" + Global::uint64ToHexString(rand.nextUInt64()) + ".khshard";
+        shardWriter = std::make_shared<TrainingShardWriter>(shardFilename, TrainingShard::getFields(*writeBuffers), shardCompression);
+        shardRowsHandedOff = 0;
+      }
+      shardRowsHandedOff += writeBuffers->curRows;
+      resultingFilename = shardWriter->getFileName();
+    }
+    else {
+      resultingFilename = outputDir + "/" + Global::uint64ToHexString(rand.nextUInt64()) + ".npz";
+    }
+
+    if(writeThreads.size() > 0) {
+      handOffBuffersForWriting(resultingFilename, shardWriter);
+    }
+    else {
+      ClockTimer timer;
+      int64_t numBytes = getUncompressedNumBytes(writeBuffers);
+      if(shardWriter != nullptr) {
+        shardWriter->appendChunk(*writeBuffers);
+      }
+      else {
+        string tmpFilename = resultingFilename + ".tmp";
+        writeBuffers->writeToZipFile(tmpFilename);
+        FileUtils::rename(tmpFilename,resultingFilename);
+      }
+      writeBuffers->clear();
+
+      std::lock_guard<std::mutex> lock(writeMutex);
+      writeStats.numFilesWritten += 1;
+      writeStats.numBytesWritten += numBytes;
+      writeStats.secondsWriting += timer.getSeconds();
+    }
   }
-  return true;
+  return resultingFilename;
 }
 
 void TrainingDataWriter::writeGame(const FinishedGameData& data) {
@@ -968,6 +1444,7 @@ void TrainingDataWriter::writeGame(const FinishedGameData& data) {
             data,
             rand
           );
+          dedupLastRow(board,hist,nextPlayer,isSidePosition,data);
           writeAndClearIfFull();
         }
         rowCount++;
@@ -1019,6 +1496,7 @@ void TrainingDataWriter::writeGame(const FinishedGameData& data) {
             data,
             rand
           );
+          dedupLastRow(sp->board,sp->hist,sp->pla,isSidePosition,data);
           writeAndClearIfFull();
         }
         rowCount++;
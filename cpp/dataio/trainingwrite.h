@@ -1,6 +1,14 @@
 #ifndef DATAIO_TRAINING_WRITE_H_
 #define DATAIO_TRAINING_WRITE_H_
 
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
 #include "../dataio/numpywrite.h"
 #include "../neuralnet/nninputs.h"
 #include "../neuralnet/nninterface.h"
@@ -119,6 +127,9 @@ struct TrainingWriteBuffers {
   int packedBoardArea;
 
   int curRows;
+  //Use the original path of filling the spatial inputs as floats via NNInputs and then packing them, rather than
+  //packing them directly from the board. Slower, for testing and benchmarking.
+  bool packInputsViaFloats;
   float* binaryInputNCHWUnpacked;
 
   //Input feature planes that have spatial extent, all of which happen to be binary.
@@ -241,11 +252,22 @@ struct TrainingWriteBuffers {
     Rand& rand
   );
 
+  //Merge row srcRow into row dstRow, which must have the same inputs. The row weights (C25) add up, value-like
+  //targets are averaged weighted by row weight times the weight of each target, and policy targets are averaged
+  //weighted by visits. If rotate180, srcRow is the 180 degree rotation of dstRow and is rotated back first, which
+  //requires the board to fill the whole data area. Does not change srcRow.
+  void mergeRowInto(int srcRow, int dstRow, bool rotate180, Rand& rand);
+
   void writeToZipFile(const std::string& fileName);
   void writeToTextOstream(std::ostream& out);
 
 };
 
+class TrainingShardWriter;
+namespace TrainingShard {
+  enum class Compression : uint8_t;
+}
+
 class TrainingDataWriter {
  public:
   TrainingDataWriter(const std::string& outputDir, int inputsVersion, int maxRowsPerFile, double firstFileMinRandProp, int dataXLen, int dataYLen, const std::string& randSeed);
@@ -253,13 +275,51 @@ class TrainingDataWriter {
   TrainingDataWriter(const std::string& outputDir, std::ostream* debugOut, int inputsVersion, int maxRowsPerFile, double firstFileMinRandProp, int dataXLen, int dataYLen, int onlyWriteEvery, const std::string& randSeed);
   ~TrainingDataWriter();
 
+  //Move compressing and writing files off of the thread calling writeGame. Full buffers are handed to
+  //numThreads background threads, and rows keep getting added to a spare buffer in the meantime. If all
+  //maxPendingFiles spare buffers are waiting to be written, writeGame blocks until one is done.
+  //Must be called before any data is written. Not supported when writing to debugOut.
+  void enableBackgroundWriting(int numThreads, int maxPendingFiles);
+  //Append rows to chunked training shard files (see trainingshard.h) instead of writing separate .npz files.
+  //Rows are appended rowsPerChunk at a time, and a new shard is started once the current one has maxRowsPerFile rows.
+  //Must be called before enableBackgroundWriting and before any data is written. Not supported when writing to debugOut.
+  void enableShardOutput(int rowsPerChunk, TrainingShard::Compression compression);
+  //Merge each row into any earlier row in the same file (or with shard output, the same chunk) for the same position,
+  //side to move, and rules, instead of writing it separately. See TrainingWriteBuffers::mergeRowInto.
+  //Rows can only be merged while still buffered, so with shard output, chunks are made at least minWindowRows rows
+  //(but no more than a whole shard) so that duplicates aren't missed just because they straddle a small chunk.
+  //If useSymmetry, a position also matches its 180 degree rotation, the only symmetry of hex.
+  //Must be called after enableShardOutput if using it, before enableBackgroundWriting, and before any data is written.
+  void enableRowDedup(bool useSymmetry, int minWindowRows);
+
   void writeGame(const FinishedGameData& data);
+  //With background writing, hands off the buffer and returns without waiting for it to be written.
   void flushIfNonempty();
+  //Always waits until the resulting file is completely written, so that the caller can use it.
   bool flushIfNonempty(std::string& resultingFilename);
+  //Block until all files handed off so far are written.
+  void waitForPendingWrites();
 
   bool isEmpty() const;
   int64_t numRowsInBuffer() const;
 
+  //With shard output, "files" below are chunks of shards.
+  struct WriteStats {
+    int64_t numFilesWritten;
+    //Files handed off but not yet completely written, including ones being written right now.
+    int64_t numFilesPending;
+    int64_t maxNumFilesPending;
+    //Size of the uncompressed data that went into the written files.
+    int64_t numBytesWritten;
+    //Total across all background threads of time spent compressing and writing.
+    double secondsWriting;
+    //Time writeGame and flushes spent waiting for a free buffer.
+    double secondsBlocked;
+    //Rows that were merged into an earlier row rather than written, with row dedup.
+    int64_t numRowsDeduped;
+  };
+  WriteStats getWriteStats() const;
+
  private:
   std::string outputDir;
   int inputsVersion;
@@ -273,7 +333,46 @@ class TrainingDataWriter {
   bool isFirstFile;
   int firstFileMaxRows;
 
+  std::vector<std::thread> writeThreads;
+  mutable std::mutex writeMutex;
+  std::condition_variable pendingWritesAdded;
+  std::condition_variable pendingWriteFinished;
+  struct PendingWrite {
+    TrainingWriteBuffers* buffers;
+    std::string fileName;
+    //Non-null if appending to a shard rather than writing fileName
+    std::shared_ptr<TrainingShardWriter> shardWriter;
+  };
+  std::deque<PendingWrite> pendingWrites;
+  std::vector<TrainingWriteBuffers*> freeBuffers;
+  int numWritesInProgress;
+  bool shouldStopWriting;
+  std::exception_ptr writeError;
+  WriteStats writeStats;
+
+  //Rows per shard, or 0 if writing .npz files
+  int64_t shardMaxRows;
+  TrainingShard::Compression shardCompression;
+  std::shared_ptr<TrainingShardWriter> shardWriter;
+  int64_t shardRowsHandedOff;
+
+  bool dedupRows;
+  bool dedupUseSymmetry;
+  struct DedupEntry {
+    int row;
+    //Whether the key was computed from the 180 degree rotation of the row as stored
+    bool isRotated;
+  };
+  std::map<Hash128,DedupEntry> dedupRowsByHash;
+
+  //Merge the last row added into an earlier one, if dedup is enabled and there is one for the same position.
+  void dedupLastRow(const Board& board, const BoardHistory& hist, Player nextPlayer, bool isSidePosition, const FinishedGameData& data);
+
   void writeAndClearIfFull();
+  std::string flushIfNonemptyNoWait();
+  void handOffBuffersForWriting(const std::string& fileName, const std::shared_ptr<TrainingShardWriter>& shardWriter);
+  void runWriteLoop();
+  void rethrowWriteErrorAlreadyLocked();
 
 };
 
@@ -14,6 +14,10 @@ namespace GraphHash {
 
   //Compute graph hash from scratch by replaying the whole history.
   Hash128 getGraphHashFromScratch(const BoardHistory& hist, Player nextPlayer, int repBound, double drawEquivalentWinsForWhite);
+
+  //Whether the graph of game states under these rules is guaranteed to contain no cycles, such that a search
+  //transposing positions by graph hash can never revisit a node along a single playout path.
+  bool isGraphAcyclic(const Rules& rules);
 }
 
 #endif
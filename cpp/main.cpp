@@ -42,9 +42,16 @@ tuner : (OpenCL only) Run tuning to find and optimize parameters that work on yo
 
 selfplay : Play selfplay games and generate training data.
 gatekeeper : Poll directory for new nets and match them against the latest net so far.
+npztoshard : Convert .npz training data files into a chunked training shard file.
+shuffle : Shuffle training shards into new shards with bounded memory, subsampling rows by weight.
 
 ---Testing/debugging subcommands-------------
 evalsgf : Utility/debug tool, analyze a single position of a game from an SGF file.
+benchmarktrainwrite : Benchmark and cross-check writing rows of training data.
+benchmarkanalysisprotocol : Benchmark analysis engine responses in the json and msgpack protocols.
+benchmarktimecontrols : Compare ways of budgeting time over a game, on a simulated clock.
+benchmarkponder : Measure how much of the pondered tree is kept after the opponent moves, with and without ponderingReplyFocus.
+analysisloadtest : Send an analysis engine requests of mixed priorities and report latency percentiles per priority.
 
 runtests : Test important board algorithms and datastructures
 runnnlayertests : Test a few subcomponents of the current neural net backend
@@ -93,6 +100,10 @@ static int handleSubcommand(const string& subcommand, const vector<string>& args
     return MainCmds::dataminesgfs(subArgs);
   else if(subcommand == "genbook")
     return MainCmds::genbook(subArgs);
+  else if(subcommand == "npztoshard")
+    return MainCmds::npztoshard(subArgs);
+  else if(subcommand == "shuffle")
+    return MainCmds::shuffle(subArgs);
   else if(subcommand == "trystartposes")
     return MainCmds::trystartposes(subArgs);
   else if(subcommand == "viewstartposes")
@@ -103,6 +114,16 @@ static int handleSubcommand(const string& subcommand, const vector<string>& args
     return MainCmds::sampleinitializations(subArgs);
   else if(subcommand == "printclockinfo")
     return MainCmds::printclockinfo(subArgs);
+  else if(subcommand == "benchmarktrainwrite")
+    return MainCmds::benchmarktrainwrite(subArgs);
+  else if(subcommand == "benchmarkanalysisprotocol")
+    return MainCmds::benchmarkanalysisprotocol(subArgs);
+  else if(subcommand == "benchmarktimecontrols")
+    return MainCmds::benchmarktimecontrols(subArgs);
+  else if(subcommand == "benchmarkponder")
+    return MainCmds::benchmarkponder(subArgs);
+  else if(subcommand == "analysisloadtest")
+    return MainCmds::analysisloadtest(subArgs,args[0]);
   else if(subcommand == "sandbox")
     return MainCmds::sandbox();
   else if(subcommand == "version") {
@@ -17,12 +17,19 @@ namespace MainCmds {
   int samplesgfs(const std::vector<std::string>& args);
   int dataminesgfs(const std::vector<std::string>& args);
   int genbook(const std::vector<std::string>& args);
+  int npztoshard(const std::vector<std::string>& args);
+  int shuffle(const std::vector<std::string>& args);
 
   int trystartposes(const std::vector<std::string>& args);
   int viewstartposes(const std::vector<std::string>& args);
 
   int demoplay(const std::vector<std::string>& args);
   int printclockinfo(const std::vector<std::string>& args);
+  int benchmarktrainwrite(const std::vector<std::string>& args);
+  int benchmarkanalysisprotocol(const std::vector<std::string>& args);
+  int benchmarktimecontrols(const std::vector<std::string>& args);
+  int benchmarkponder(const std::vector<std::string>& args);
+  int analysisloadtest(const std::vector<std::string>& args, const std::string& firstCommand);
   int sampleinitializations(const std::vector<std::string>& args);
 
   int sandbox();
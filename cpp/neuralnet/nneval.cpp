@@ -19,7 +19,8 @@ NNResultBuf::NNResultBuf()
     result(nullptr),
     errorLogLockout(false),
     // If no symmetry is specified, it will use default or random based on config.
-    symmetry(NNInputs::SYMMETRY_NOTSPECIFIED)
+    symmetry(NNInputs::SYMMETRY_NOTSPECIFIED),
+    resultWaker(NULL)
 {}
 
 NNResultBuf::~NNResultBuf() {
@@ -31,6 +32,23 @@ NNResultBuf::~NNResultBuf() {
 
 //-------------------------------------------------------------------------------------
 
+struct NNEvaluator::InFlightEval {
+  std::mutex mutex;
+  std::condition_variable finishedVar;
+  bool finished;
+  const bool includeOwnerMap;
+  //nullptr if the caller evaluating it failed, in which case those waiting evaluate for themselves
+  std::shared_ptr<NNOutput> result;
+  //Cooperative tasks waiting on this, woken along with finishedVar
+  vector<CooperativeScheduler::Waker*> wakers;
+
+  InFlightEval(bool includeOwner)
+    :mutex(),finishedVar(),finished(false),includeOwnerMap(includeOwner),result(nullptr),wakers()
+  {}
+};
+
+//-------------------------------------------------------------------------------------
+
 NNServerBuf::NNServerBuf(const NNEvaluator& nnEval, const LoadedModel* model)
   :inputBuffers(NULL),
    resultBufs(NULL)
@@ -95,6 +113,7 @@ NNEvaluator::NNEvaluator(
    computeContext(NULL),
    loadedModel(NULL),
    nnCacheTable(NULL),
+   positionStore(NULL),
    logger(lg),
    numServerThreadsEverSpawned(0),
    serverThreads(),
@@ -103,6 +122,9 @@ NNEvaluator::NNEvaluator(
    numResultBufssMask(),
    m_numRowsProcessed(0),
    m_numBatchesProcessed(0),
+   m_numCoalescedEvals(0),
+   inFlightMutex(),
+   inFlightEvals(),
    serverWaitingForBatchStart(),
    bufferMutex(),
    isKilled(false),
@@ -112,6 +134,8 @@ NNEvaluator::NNEvaluator(
    numWaitingEvals(0),
    numEvalsToAwaken(0),
    waitingForFinish(),
+   numEvalsFinished(0),
+   finishWakers(),
    currentDoRandomize(doRandomize),
    currentDefaultSymmetry(defaultSymmetry),
    m_resultBufss(NULL),
@@ -198,6 +222,17 @@ NNEvaluator::~NNEvaluator() {
   loadedModel = NULL;
 
   delete nnCacheTable;
+
+  if(positionStore != NULL && logger != NULL && positionStore->numLookups() > 0) {
+    logger->write(
+      "nnPositionStore " + positionStore->getFileName() +
+      " lookups " + Global::uint64ToString(positionStore->numLookups()) +
+      " hits " + Global::uint64ToString(positionStore->numHits()) +
+      " writes " + Global::uint64ToString(positionStore->numWrites()) +
+      " evictions " + Global::uint64ToString(positionStore->numEvictions())
+    );
+  }
+  delete positionStore;
 }
 
 string NNEvaluator::getModelName() const {
@@ -298,10 +333,14 @@ uint64_t NNEvaluator::numBatchesProcessed() const {
 double NNEvaluator::averageProcessedBatchSize() const {
   return (double)numRowsProcessed() / (double)numBatchesProcessed();
 }
+uint64_t NNEvaluator::numCoalescedEvals() const {
+  return m_numCoalescedEvals.load(std::memory_order_relaxed);
+}
 
 void NNEvaluator::clearStats() {
   m_numRowsProcessed.store(0);
   m_numBatchesProcessed.store(0);
+  m_numCoalescedEvals.store(0);
 }
 
 void NNEvaluator::clearCache() {
@@ -309,6 +348,16 @@ void NNEvaluator::clearCache() {
     nnCacheTable->clear();
 }
 
+void NNEvaluator::openPositionStore(const string& fileName, int sizePowerOfTwo, bool readOnly) {
+  if(positionStore != NULL)
+    throw StringError("NNEvaluator: position store was already opened");
+  positionStore = new NNPositionStore(fileName, sizePowerOfTwo, readOnly, getInternalModelName(), nnXLen, nnYLen, logger);
+}
+
+NNPositionStore* NNEvaluator::getPositionStore() {
+  return positionStore;
+}
+
 static void serveEvals(
   string randSeedThisThread,
   NNEvaluator* nnEval, const LoadedModel* loadedModel,
@@ -355,6 +404,7 @@ void NNEvaluator::spawnServerThreads() {
 void NNEvaluator::killServerThreads() {
   unique_lock<std::mutex> lock(bufferMutex);
   isKilled = true;
+  wakeFinishWaitersAlreadyLocked();
   lock.unlock();
   serverWaitingForBatchStart.notify_all();
   waitingForFinish.notify_all();
@@ -496,6 +546,8 @@ void NNEvaluator::serve(
         resultBuf->result->shorttermScoreError = 0.0f;
         resultBuf->hasResult = true;
         resultBuf->clientWaitingForResult.notify_all();
+        if(resultBuf->resultWaker != NULL)
+          resultBuf->resultWaker->wake();
         resultLock.unlock();
       }
     }
@@ -545,6 +597,8 @@ void NNEvaluator::serve(
         resultBuf->result = std::shared_ptr<NNOutput>(outputBuf[row]);
         resultBuf->hasResult = true;
         resultBuf->clientWaitingForResult.notify_all();
+        if(resultBuf->resultWaker != NULL)
+          resultBuf->resultWaker->wake();
         resultLock.unlock();
       }
     }
@@ -552,6 +606,7 @@ void NNEvaluator::serve(
     //Lock and update stats before looping again
     lock.lock();
     numOngoingEvals -= 1;
+    wakeFinishWaitersAlreadyLocked();
 
     if(numWaitingEvals > 0) {
       numEvalsToAwaken += numWaitingEvals;
@@ -571,7 +626,37 @@ void NNEvaluator::serve(
   }
 }
 
+void NNEvaluator::wakeFinishWaitersAlreadyLocked() {
+  numEvalsFinished += 1;
+  for(CooperativeScheduler::Waker* waker: finishWakers)
+    waker->wake();
+  finishWakers.clear();
+}
+
 void NNEvaluator::waitForNextNNEvalIfAny() {
+  //Cooperative tasks would block every other task on their thread, so park the task instead, letting the others run
+  CooperativeScheduler::Waker* waker = CooperativeScheduler::getCurrentWaker();
+  if(waker != NULL) {
+    int64_t numEvalsFinishedBefore;
+    bool anyOngoing;
+    {
+      lock_guard<std::mutex> lock(bufferMutex);
+      anyOngoing = numOngoingEvals > 0;
+      numEvalsFinishedBefore = numEvalsFinished;
+      if(anyOngoing)
+        finishWakers.push_back(waker);
+    }
+    //Nothing to wait for, but other tasks might be about to queue rows, so let them
+    if(!anyOngoing) {
+      CooperativeScheduler::yieldIfCooperative();
+      return;
+    }
+    CooperativeScheduler::waitIfCooperative([this,numEvalsFinishedBefore]() {
+      lock_guard<std::mutex> lock(bufferMutex);
+      return numEvalsFinished != numEvalsFinishedBefore;
+    });
+    return;
+  }
   unique_lock<std::mutex> lock(bufferMutex);
   if(numOngoingEvals <= 0)
     return;
@@ -583,6 +668,56 @@ void NNEvaluator::waitForNextNNEvalIfAny() {
 }
 
 
+//Returns the eval in progress for nnHash if there is a usable one, else registers and returns a new one for the caller
+//to compute and finish, setting isStarter. Returns nullptr if there is one but it lacks the ownermap we need.
+std::shared_ptr<NNEvaluator::InFlightEval> NNEvaluator::joinOrStartInFlightEval(Hash128 nnHash, bool includeOwnerMap, bool& isStarter) {
+  lock_guard<std::mutex> lock(inFlightMutex);
+  auto iter = inFlightEvals.find(nnHash);
+  if(iter != inFlightEvals.end()) {
+    isStarter = false;
+    if(includeOwnerMap && !iter->second->includeOwnerMap)
+      return nullptr;
+    return iter->second;
+  }
+  isStarter = true;
+  std::shared_ptr<InFlightEval> eval = std::make_shared<InFlightEval>(includeOwnerMap);
+  inFlightEvals[nnHash] = eval;
+  return eval;
+}
+
+std::shared_ptr<NNOutput> NNEvaluator::waitForInFlightEval(const std::shared_ptr<InFlightEval>& eval) {
+  CooperativeScheduler::Waker* waker = CooperativeScheduler::getCurrentWaker();
+  if(waker != NULL) {
+    lock_guard<std::mutex> lock(eval->mutex);
+    if(!eval->finished)
+      eval->wakers.push_back(waker);
+  }
+  bool waitedCooperatively = CooperativeScheduler::waitIfCooperative([&eval]() {
+    lock_guard<std::mutex> lock(eval->mutex);
+    return eval->finished;
+  });
+  unique_lock<std::mutex> lock(eval->mutex);
+  if(!waitedCooperatively) {
+    while(!eval->finished)
+      eval->finishedVar.wait(lock);
+  }
+  return eval->result;
+}
+
+void NNEvaluator::finishInFlightEval(Hash128 nnHash, const std::shared_ptr<InFlightEval>& eval, const std::shared_ptr<NNOutput>& result) {
+  {
+    lock_guard<std::mutex> lock(inFlightMutex);
+    inFlightEvals.erase(nnHash);
+  }
+  //Wake while holding the mutex, else a waiting task could see that it's finished and its scheduler exit before we wake it
+  lock_guard<std::mutex> lock(eval->mutex);
+  eval->result = result;
+  eval->finished = true;
+  eval->finishedVar.notify_all();
+  for(CooperativeScheduler::Waker* waker: eval->wakers)
+    waker->wake();
+}
+
 static double softPlus(double x) {
   //Avoid blowup
   if(x > 40.0)
@@ -631,6 +766,44 @@ void NNEvaluator::evaluate(
       buf.result = nullptr;
     }
   }
+  //Fall back to the persistent store, and warm the in-memory cache with whatever we find there.
+  //Not if we already have the policy and values cached though, for the same reason as the ownermap hack below.
+  if(positionStore != NULL && !skipCache && !hadResultWithoutOwnerMap && positionStore->get(nnHash,includeOwnerMap,buf.result)) {
+    if(nnCacheTable != NULL)
+      nnCacheTable->set(buf.result);
+    buf.hasResult = true;
+    return;
+  }
+
+  //Same as a late cache hit, if someone else is evaluating this position right now, wait for their result.
+  //Else let anyone else who wants this position wait for ours.
+  std::shared_ptr<InFlightEval> inFlightEval = nullptr;
+  if(nnCacheTable != NULL && !skipCache) {
+    bool isStarter;
+    inFlightEval = joinOrStartInFlightEval(nnHash,includeOwnerMap,isStarter);
+    if(inFlightEval != nullptr && !isStarter) {
+      buf.result = waitForInFlightEval(inFlightEval);
+      inFlightEval = nullptr;
+      if(buf.result != nullptr) {
+        m_numCoalescedEvals.fetch_add(1,std::memory_order_relaxed);
+        buf.hasResult = true;
+        return;
+      }
+    }
+  }
+  //Release anyone waiting on us however we leave this function
+  struct InFlightEvalFinisher {
+    NNEvaluator* nnEval;
+    Hash128 nnHash;
+    std::shared_ptr<InFlightEval> eval;
+    std::shared_ptr<NNOutput> result;
+    ~InFlightEvalFinisher() {
+      if(eval != nullptr)
+        nnEval->finishInFlightEval(nnHash,eval,result);
+    }
+  };
+  InFlightEvalFinisher inFlightEvalFinisher = {this, nnHash, inFlightEval, nullptr};
+
   buf.includeOwnerMap = includeOwnerMap;
 
   buf.boardXSizeForServer = board.x_size;
@@ -664,6 +837,7 @@ void NNEvaluator::evaluate(
   }
 
   buf.symmetry = nnInputParams.symmetry;
+  buf.resultWaker = CooperativeScheduler::getCurrentWaker();
 
   unique_lock<std::mutex> lock(bufferMutex);
 
@@ -685,10 +859,17 @@ void NNEvaluator::evaluate(
   assert(!overlooped);
   (void)overlooped; //Avoid unused variable when asserts disabled
 
-  unique_lock<std::mutex> resultLock(buf.resultMutex);
-  while(!buf.hasResult)
-    buf.clientWaitingForResult.wait(resultLock);
-  resultLock.unlock();
+  //Cooperative tasks let other tasks on their thread run meanwhile, possibly adding more rows to this same batch
+  bool waitedCooperatively = CooperativeScheduler::waitIfCooperative([&buf]() {
+    std::lock_guard<std::mutex> resultLock(buf.resultMutex);
+    return buf.hasResult;
+  });
+  if(!waitedCooperatively) {
+    unique_lock<std::mutex> resultLock(buf.resultMutex);
+    while(!buf.hasResult)
+      buf.clientWaitingForResult.wait(resultLock);
+    resultLock.unlock();
+  }
 
   //Perform postprocessing on the result - turn the nn output into probabilities
   //As a hack though, if the only thing we were missing was the ownermap, just grab the old policy and values
@@ -916,6 +1097,9 @@ void NNEvaluator::evaluate(
   buf.result->nnHash = nnHash;
   if(nnCacheTable != NULL)
     nnCacheTable->set(buf.result);
+  if(positionStore != NULL)
+    positionStore->put(*buf.result);
+  inFlightEvalFinisher.result = buf.result;
 
 }
 
@@ -1,16 +1,19 @@
 #ifndef NEURALNET_NNEVAL_H_
 #define NEURALNET_NNEVAL_H_
 
+#include <map>
 #include <memory>
 
 #include "../core/global.h"
 #include "../core/commontypes.h"
+#include "../core/cooperativescheduler.h"
 #include "../core/logger.h"
 #include "../core/multithread.h"
 #include "../game/board.h"
 #include "../game/boardhistory.h"
 #include "../neuralnet/nninputs.h"
 #include "../neuralnet/nninterface.h"
+#include "../neuralnet/nnpositionstore.h"
 #include "../search/mutexpool.h"
 
 class NNEvaluator;
@@ -56,6 +59,7 @@ struct NNResultBuf {
   std::shared_ptr<NNOutput> result;
   bool errorLogLockout; //error flag to restrict log to 1 error to prevent spam
   int symmetry; //The symmetry to use for this eval
+  CooperativeScheduler::Waker* resultWaker; //If the client is a cooperative task, woken along with clientWaitingForResult
 
   NNResultBuf();
   ~NNResultBuf();
@@ -130,9 +134,17 @@ class NNEvaluator {
   //Clear all entires cached in the table
   void clearCache();
 
+  //Back this evaluator with a persistent on-disk store of evaluations, consulted on a miss in the in-memory cache.
+  //Should be called before any evals are made.
+  void openPositionStore(const std::string& fileName, int sizePowerOfTwo, bool readOnly);
+  //NULL if no store was opened
+  NNPositionStore* getPositionStore();
+
   //Queue a position for the next neural net batch evaluation and wait for it. Upon evaluation, result
   //will be supplied in NNResultBuf& buf, the shared_ptr there can grabbed via std::move if desired.
   //logStream is for some error logging, can be NULL.
+  //Unless skipCache, if another caller is already evaluating the same position, waits for and shares its result
+  //instead of queueing a duplicate row.
   //This function is threadsafe.
   void evaluate(
     Board& board,
@@ -172,6 +184,8 @@ class NNEvaluator {
   uint64_t numRowsProcessed() const;
   uint64_t numBatchesProcessed() const;
   double averageProcessedBatchSize() const;
+  //Number of evaluate calls that shared the result of an identical eval already in progress
+  uint64_t numCoalescedEvals() const;
 
   void clearStats();
 
@@ -193,6 +207,7 @@ class NNEvaluator {
   ComputeContext* computeContext;
   LoadedModel* loadedModel;
   NNCacheTable* nnCacheTable;
+  NNPositionStore* positionStore;
   Logger* logger;
 
   int modelVersion;
@@ -209,6 +224,18 @@ class NNEvaluator {
   //Counters for statistics
   std::atomic<uint64_t> m_numRowsProcessed;
   std::atomic<uint64_t> m_numBatchesProcessed;
+  std::atomic<uint64_t> m_numCoalescedEvals;
+
+  //Evals that some caller of evaluate is computing right now, by nnHash, for other callers to wait on
+  struct InFlightEval;
+  std::mutex inFlightMutex;
+  std::map<Hash128,std::shared_ptr<InFlightEval>> inFlightEvals;
+
+  std::shared_ptr<InFlightEval> joinOrStartInFlightEval(Hash128 nnHash, bool includeOwnerMap, bool& isStarter);
+  std::shared_ptr<NNOutput> waitForInFlightEval(const std::shared_ptr<InFlightEval>& eval);
+  //Call with bufferMutex held when an ongoing eval finishes
+  void wakeFinishWaitersAlreadyLocked();
+  void finishInFlightEval(Hash128 nnHash, const std::shared_ptr<InFlightEval>& eval, const std::shared_ptr<NNOutput>& result);
 
   std::condition_variable serverWaitingForBatchStart;
   mutable std::mutex bufferMutex;
@@ -223,6 +250,8 @@ class NNEvaluator {
   int numWaitingEvals; //Current number of things waiting for finish.
   int numEvalsToAwaken; //Current number of things waitingForFinish that should be woken up. Used to avoid spurious wakeups.
   std::condition_variable waitingForFinish; //Condvar for waiting for at least one ongoing eval to finish.
+  int64_t numEvalsFinished; //Counts up whenever an ongoing eval finishes, or server threads are killed
+  std::vector<CooperativeScheduler::Waker*> finishWakers; //Cooperative tasks waiting for numEvalsFinished to change
 
   //Randomization settings for symmetries
   bool currentDoRandomize;
@@ -562,7 +562,6 @@ void NNInputs::fillRowV7(
   assert(board.x_size <= nnXLen);
   assert(board.y_size <= nnYLen);
   std::fill(rowBin,rowBin+NUM_FEATURES_SPATIAL_V7*nnXLen*nnYLen,false);
-  std::fill(rowGlobal,rowGlobal+NUM_FEATURES_GLOBAL_V7,0.0f);
 
   Player pla = nextPlayer;
   Player opp = getOpp(pla);
@@ -600,9 +599,16 @@ void NNInputs::fillRowV7(
     }
   }
 
-  
-
+  fillRowGlobalV7(board,hist,nextPlayer,nnInputParams,rowGlobal);
+}
 
+void NNInputs::fillRowGlobalV7(
+  const Board& board, const BoardHistory& hist, Player nextPlayer,
+  const MiscNNInputParams& nnInputParams, float* rowGlobal
+) {
+  std::fill(rowGlobal,rowGlobal+NUM_FEATURES_GLOBAL_V7,0.0f);
+  int xSize = board.x_size;
+  int ySize = board.y_size;
 
   //Global features.
   
@@ -0,0 +1,450 @@
+#include "../neuralnet/nnpositionstore.h"
+
+#include "../core/os.h"
+
+#ifdef OS_IS_UNIX_OR_APPLE
+  #include <cerrno>
+  #include <cstring>
+  #include <fcntl.h>
+  #include <sys/file.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+//------------------------
+#include "../core/using.h"
+//------------------------
+
+static constexpr char STORE_MAGIC[8] = {'k','h','p','o','s','s','t','r'};
+static constexpr uint32_t STORE_VERSION = 2;
+static constexpr int SLOTS_PER_BUCKET = 4;
+static constexpr size_t HEADER_BYTES = 4096;
+static constexpr int MODEL_NAME_BYTES = 256;
+
+struct NNPositionStore::Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t sizePowerOfTwo;
+  uint32_t slotsPerBucket;
+  uint32_t slotBytes;
+  char modelName[MODEL_NAME_BYTES];
+  //Logical clock for LRU eviction, advanced on every write and every hit.
+  std::atomic<uint32_t> clock;
+};
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "");
+
+//Everything about a slot other than its sequence number and last used time, copied in and out as a unit.
+struct NNPositionStore::SlotData {
+  uint64_t hash0;
+  uint64_t hash1;
+  uint8_t hasOwnerMap;
+  uint8_t unused;
+  //The policy and ownership layout depends on the nn size, so entries only match evaluators with the same size.
+  uint8_t nnXLen;
+  uint8_t nnYLen;
+
+  float whiteWinProb;
+  float whiteLossProb;
+  float whiteNoResultProb;
+  float whiteScoreMean;
+  float whiteScoreMeanSq;
+  float whiteLead;
+  float varTimeLeft;
+  float shorttermWinlossError;
+  float shorttermScoreError;
+
+  //0 for illegal, otherwise the square root of the probability scaled to [1,65535].
+  uint16_t policy[NNPos::MAX_NN_POLICY_SIZE];
+  //Scaled by 127
+  int8_t ownerMap[NNPos::MAX_BOARD_AREA];
+};
+
+struct NNPositionStore::Slot {
+  //Odd while a write is in progress.
+  std::atomic<uint32_t> seq;
+  std::atomic<uint32_t> lastUsed;
+  SlotData data;
+};
+
+static inline bool isEmptyHash(uint64_t hash0, uint64_t hash1) {
+  return hash0 == 0 && hash1 == 0;
+}
+
+static inline uint16_t quantizePolicy(float prob) {
+  if(prob < 0.0f)
+    return 0;
+  double scaled = sqrt(std::min((double)prob,1.0)) * 65534.0;
+  return (uint16_t)(1 + (int)round(scaled));
+}
+static inline float unquantizePolicy(uint16_t code) {
+  if(code == 0)
+    return -1.0f;
+  double x = (code - 1) / 65534.0;
+  return (float)(x * x);
+}
+
+NNPositionStore::NNPositionStore(
+  const string& fName,
+  int sizePowerOfTwo,
+  bool rOnly,
+  const string& internalModelName,
+  int xLen,
+  int yLen,
+  Logger* lg
+)
+  :fileName(fName),
+   readOnly(rOnly),
+   nnXLen(xLen),
+   nnYLen(yLen),
+   logger(lg),
+   fd(-1),
+   mappedSize(0),
+   mapped(NULL),
+   header(NULL),
+   slots(NULL),
+   bucketMask(0),
+   disabled(false),
+   mutexPool(NULL),
+   mutexPoolMask(0),
+   m_numLookups(0),
+   m_numHits(0),
+   m_numWrites(0),
+   m_numEvictions(0)
+{
+  if(sizePowerOfTwo < 2 || sizePowerOfTwo > 32)
+    throw StringError("NNPositionStore: Invalid sizePowerOfTwo: " + Global::intToString(sizePowerOfTwo));
+  if(nnXLen > NNPos::MAX_BOARD_LEN || nnYLen > NNPos::MAX_BOARD_LEN)
+    throw StringError("NNPositionStore: Invalid nnXLen or nnYLen");
+
+  uint64_t numBuckets = ((uint64_t)1 << sizePowerOfTwo) / SLOTS_PER_BUCKET;
+  bucketMask = numBuckets - 1;
+  size_t expectedSize = HEADER_BYTES + (size_t)(numBuckets * SLOTS_PER_BUCKET) * sizeof(Slot);
+
+#ifdef OS_IS_WINDOWS
+  (void)internalModelName;
+  (void)expectedSize;
+  throw StringError("NNPositionStore: nnPositionStoreFile is not supported on Windows");
+#endif
+
+#ifdef OS_IS_UNIX_OR_APPLE
+  fd = open(fileName.c_str(), readOnly ? O_RDONLY : (O_RDWR | O_CREAT), 0644);
+  if(fd < 0 && readOnly && errno == ENOENT) {
+    if(logger != NULL)
+      logger->write("WARNING: nnPositionStoreFile " + fileName + " does not exist and nnPositionStoreReadOnly is set, so it will not be used");
+    disabled = true;
+    return;
+  }
+  if(fd < 0)
+    throw StringError("NNPositionStore: could not open " + fileName + ": " + strerror(errno));
+
+  if(!readOnly && flock(fd, LOCK_EX | LOCK_NB) != 0) {
+    close(fd);
+    throw StringError(
+      "NNPositionStore: " + fileName + " is already open for writing by another process, "
+      "use nnPositionStoreReadOnly = true to share it"
+    );
+  }
+
+  struct stat st;
+  if(fstat(fd, &st) != 0) {
+    close(fd);
+    throw StringError("NNPositionStore: could not stat " + fileName + ": " + strerror(errno));
+  }
+
+  //Check that the existing contents are compatible.
+  //A file larger than we need is fine, we never shrink a store file since other processes may have it mapped
+  //and would crash on touching pages past the new end.
+  bool compatible = false;
+  if((size_t)st.st_size >= expectedSize) {
+    Header existing;
+    if(pread(fd, &existing, sizeof(Header), 0) == (ssize_t)sizeof(Header)) {
+      compatible =
+        std::equal(STORE_MAGIC, STORE_MAGIC + 8, existing.magic) &&
+        existing.version == STORE_VERSION &&
+        existing.sizePowerOfTwo == (uint32_t)sizePowerOfTwo &&
+        existing.slotsPerBucket == (uint32_t)SLOTS_PER_BUCKET &&
+        existing.slotBytes == (uint32_t)sizeof(Slot) &&
+        strncmp(existing.modelName, internalModelName.c_str(), MODEL_NAME_BYTES) == 0;
+    }
+  }
+
+  if(!compatible && readOnly) {
+    if(logger != NULL)
+      logger->write(
+        "WARNING: nnPositionStoreFile " + fileName + " has a different size or was built with a different model, "
+        "and nnPositionStoreReadOnly is set, so it will not be used"
+      );
+    disabled = true;
+    close(fd);
+    fd = -1;
+    return;
+  }
+  if(!compatible) {
+    if(st.st_size != 0 && logger != NULL)
+      logger->write("nnPositionStoreFile " + fileName + " was built with a different model or configuration, clearing it");
+    //Only ever grow the file. Newly added space reads as zero, and an all-zero slot is an empty slot.
+    if((size_t)st.st_size < expectedSize && ftruncate(fd, (off_t)expectedSize) != 0) {
+      close(fd);
+      throw StringError("NNPositionStore: could not resize " + fileName + ": " + strerror(errno));
+    }
+  }
+
+  mappedSize = expectedSize;
+  mapped = mmap(NULL, mappedSize, readOnly ? PROT_READ : (PROT_READ | PROT_WRITE), MAP_SHARED, fd, 0);
+  if(mapped == MAP_FAILED) {
+    mapped = NULL;
+    close(fd);
+    throw StringError("NNPositionStore: could not mmap " + fileName + ": " + strerror(errno));
+  }
+  header = (Header*)mapped;
+  slots = (Slot*)((char*)mapped + HEADER_BYTES);
+
+  if(!compatible) {
+    //Old contents are cleared in place through the usual per-slot sequence numbers, so that readers that still
+    //have this file mapped from before just see misses rather than torn or stale entries.
+    if(st.st_size != 0) {
+      std::fill(header->magic, header->magic + 8, '\0');
+      SlotData empty;
+      memset(&empty, 0, sizeof(SlotData));
+      for(uint64_t i = 0; i<numBuckets * SLOTS_PER_BUCKET; i++) {
+        writeSlot(slots+i, empty);
+        slots[i].lastUsed.store(0, std::memory_order_relaxed);
+      }
+    }
+    std::copy(STORE_MAGIC, STORE_MAGIC + 8, header->magic);
+    header->version = STORE_VERSION;
+    header->sizePowerOfTwo = (uint32_t)sizePowerOfTwo;
+    header->slotsPerBucket = (uint32_t)SLOTS_PER_BUCKET;
+    header->slotBytes = (uint32_t)sizeof(Slot);
+    std::fill(header->modelName, header->modelName + MODEL_NAME_BYTES, '\0');
+    strncpy(header->modelName, internalModelName.c_str(), MODEL_NAME_BYTES-1);
+    header->clock.store(1, std::memory_order_relaxed);
+  }
+
+  if(!readOnly) {
+    uint32_t mutexPoolSize = (uint32_t)std::min(numBuckets, (uint64_t)1 << 14);
+    mutexPoolMask = mutexPoolSize - 1;
+    mutexPool = new MutexPool(mutexPoolSize);
+  }
+
+  if(logger != NULL)
+    logger->write(
+      "Opened nnPositionStoreFile " + fileName + (readOnly ? " read-only" : "") +
+      " capacity " + Global::int64ToString(getCapacity()) + " positions"
+    );
+#endif
+}
+
+NNPositionStore::~NNPositionStore() {
+#ifdef OS_IS_UNIX_OR_APPLE
+  if(mapped != NULL)
+    munmap(mapped, mappedSize);
+  if(fd >= 0)
+    close(fd);
+#endif
+  delete mutexPool;
+}
+
+bool NNPositionStore::isReadOnly() const {
+  return readOnly;
+}
+string NNPositionStore::getFileName() const {
+  return fileName;
+}
+int64_t NNPositionStore::getCapacity() const {
+  return disabled ? 0 : (int64_t)((bucketMask + 1) * SLOTS_PER_BUCKET);
+}
+
+uint64_t NNPositionStore::numLookups() const {
+  return m_numLookups.load(std::memory_order_relaxed);
+}
+uint64_t NNPositionStore::numHits() const {
+  return m_numHits.load(std::memory_order_relaxed);
+}
+uint64_t NNPositionStore::numWrites() const {
+  return m_numWrites.load(std::memory_order_relaxed);
+}
+uint64_t NNPositionStore::numEvictions() const {
+  return m_numEvictions.load(std::memory_order_relaxed);
+}
+
+NNPositionStore::Slot* NNPositionStore::getBucket(Hash128 nnHash) const {
+  //Use hash1 so that we aren't correlated with the in-memory NNCacheTable, which indexes by hash0
+  return slots + (nnHash.hash1 & bucketMask) * SLOTS_PER_BUCKET;
+}
+
+bool NNPositionStore::readSlot(const Slot* slot, Hash128 nnHash, SlotData& ret) const {
+  //Cheap rejection before copying the whole slot
+  if(slot->data.hash0 != nnHash.hash0 || slot->data.hash1 != nnHash.hash1)
+    return false;
+  //Retry a few times if a writer got in the way, then just give up and treat it as a miss
+  for(int attempt = 0; attempt < 4; attempt++) {
+    uint32_t seq0 = slot->seq.load(std::memory_order_acquire);
+    if(seq0 & 1)
+      continue;
+    memcpy(&ret, &(slot->data), sizeof(SlotData));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint32_t seq1 = slot->seq.load(std::memory_order_relaxed);
+    if(seq0 == seq1)
+      return ret.hash0 == nnHash.hash0 && ret.hash1 == nnHash.hash1;
+  }
+  return false;
+}
+
+void NNPositionStore::writeSlot(Slot* slot, const SlotData& data) {
+  //Round down in case a process died mid-write and left this odd
+  uint32_t seq = slot->seq.load(std::memory_order_relaxed) & ~(uint32_t)1;
+  slot->seq.store(seq+1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(&(slot->data), &data, sizeof(SlotData));
+  slot->seq.store(seq+2, std::memory_order_release);
+}
+
+void NNPositionStore::touch(Slot* slot) {
+  //Read-only processes don't get a say in what gets evicted
+  if(readOnly)
+    return;
+  uint32_t now = header->clock.fetch_add(1, std::memory_order_relaxed);
+  slot->lastUsed.store(now, std::memory_order_relaxed);
+}
+
+bool NNPositionStore::get(Hash128 nnHash, bool requireOwnerMap, std::shared_ptr<NNOutput>& ret) {
+  if(disabled)
+    return false;
+  m_numLookups.fetch_add(1, std::memory_order_relaxed);
+
+  Slot* bucket = getBucket(nnHash);
+  SlotData data;
+  int slotIdx = -1;
+  for(int i = 0; i<SLOTS_PER_BUCKET; i++) {
+    if(readSlot(bucket+i, nnHash, data)) {
+      slotIdx = i;
+      break;
+    }
+  }
+  if(slotIdx < 0)
+    return false;
+  if(data.nnXLen != nnXLen || data.nnYLen != nnYLen)
+    return false;
+  if(requireOwnerMap && !data.hasOwnerMap)
+    return false;
+
+  NNOutput* output = new NNOutput();
+  output->nnHash = nnHash;
+  output->whiteWinProb = data.whiteWinProb;
+  output->whiteLossProb = data.whiteLossProb;
+  output->whiteNoResultProb = data.whiteNoResultProb;
+  output->whiteScoreMean = data.whiteScoreMean;
+  output->whiteScoreMeanSq = data.whiteScoreMeanSq;
+  output->whiteLead = data.whiteLead;
+  output->varTimeLeft = data.varTimeLeft;
+  output->shorttermWinlossError = data.shorttermWinlossError;
+  output->shorttermScoreError = data.shorttermScoreError;
+  output->nnXLen = nnXLen;
+  output->nnYLen = nnYLen;
+  output->noisedPolicyProbs = NULL;
+
+  //Renormalize so that quantization doesn't leave the policy summing to something other than 1
+  double policySum = 0.0;
+  for(int i = 0; i<NNPos::MAX_NN_POLICY_SIZE; i++) {
+    float prob = unquantizePolicy(data.policy[i]);
+    output->policyProbs[i] = prob;
+    if(prob > 0.0f)
+      policySum += prob;
+  }
+  if(policySum > 0.0) {
+    for(int i = 0; i<NNPos::MAX_NN_POLICY_SIZE; i++) {
+      if(output->policyProbs[i] > 0.0f)
+        output->policyProbs[i] = (float)(output->policyProbs[i] / policySum);
+    }
+  }
+
+  if(data.hasOwnerMap) {
+    output->whiteOwnerMap = new float[nnXLen*nnYLen];
+    for(int i = 0; i<nnXLen*nnYLen; i++)
+      output->whiteOwnerMap[i] = data.ownerMap[i] / 127.0f;
+  }
+  else
+    output->whiteOwnerMap = NULL;
+
+  touch(bucket+slotIdx);
+  m_numHits.fetch_add(1, std::memory_order_relaxed);
+  ret = std::shared_ptr<NNOutput>(output);
+  return true;
+}
+
+void NNPositionStore::put(const NNOutput& nnOutput) {
+  if(disabled || readOnly)
+    return;
+  assert(nnOutput.nnXLen == nnXLen && nnOutput.nnYLen == nnYLen);
+
+  SlotData data;
+  data.hash0 = nnOutput.nnHash.hash0;
+  data.hash1 = nnOutput.nnHash.hash1;
+  if(isEmptyHash(data.hash0,data.hash1))
+    return;
+  data.hasOwnerMap = nnOutput.whiteOwnerMap != NULL ? 1 : 0;
+  data.unused = 0;
+  data.nnXLen = (uint8_t)nnXLen;
+  data.nnYLen = (uint8_t)nnYLen;
+  data.whiteWinProb = nnOutput.whiteWinProb;
+  data.whiteLossProb = nnOutput.whiteLossProb;
+  data.whiteNoResultProb = nnOutput.whiteNoResultProb;
+  data.whiteScoreMean = nnOutput.whiteScoreMean;
+  data.whiteScoreMeanSq = nnOutput.whiteScoreMeanSq;
+  data.whiteLead = nnOutput.whiteLead;
+  data.varTimeLeft = nnOutput.varTimeLeft;
+  data.shorttermWinlossError = nnOutput.shorttermWinlossError;
+  data.shorttermScoreError = nnOutput.shorttermScoreError;
+  for(int i = 0; i<NNPos::MAX_NN_POLICY_SIZE; i++)
+    data.policy[i] = quantizePolicy(nnOutput.policyProbs[i]);
+  std::fill(data.ownerMap, data.ownerMap + NNPos::MAX_BOARD_AREA, (int8_t)0);
+  if(nnOutput.whiteOwnerMap != NULL) {
+    for(int i = 0; i<nnXLen*nnYLen; i++) {
+      float owner = std::max(-1.0f, std::min(1.0f, nnOutput.whiteOwnerMap[i]));
+      data.ownerMap[i] = (int8_t)round(owner * 127.0f);
+    }
+  }
+
+  Slot* bucket = getBucket(nnOutput.nnHash);
+  std::mutex& mutex = mutexPool->getMutex((uint32_t)(nnOutput.nnHash.hash1 & bucketMask) & mutexPoolMask);
+  std::lock_guard<std::mutex> lock(mutex);
+
+  //Prefer the slot already holding this position, then an empty slot, then the least recently used one.
+  //Comparing ages rather than raw stamps keeps this right when the clock wraps.
+  uint32_t now = header->clock.load(std::memory_order_relaxed);
+  int bestIdx = -1;
+  bool bestIsEvict = true;
+  uint32_t bestAge = 0;
+  for(int i = 0; i<SLOTS_PER_BUCKET; i++) {
+    const SlotData& existing = bucket[i].data;
+    if(existing.hash0 == data.hash0 && existing.hash1 == data.hash1) {
+      //Don't lose an ownership map by overwriting with less
+      if(existing.hasOwnerMap && !data.hasOwnerMap && existing.nnXLen == data.nnXLen && existing.nnYLen == data.nnYLen)
+        return;
+      bestIdx = i;
+      bestIsEvict = false;
+      break;
+    }
+    if(isEmptyHash(existing.hash0,existing.hash1)) {
+      if(bestIsEvict) {
+        bestIdx = i;
+        bestIsEvict = false;
+      }
+      continue;
+    }
+    uint32_t age = now - bucket[i].lastUsed.load(std::memory_order_relaxed);
+    if(bestIsEvict && (bestIdx < 0 || age > bestAge)) {
+      bestIdx = i;
+      bestAge = age;
+    }
+  }
+  assert(bestIdx >= 0);
+  if(bestIsEvict)
+    m_numEvictions.fetch_add(1, std::memory_order_relaxed);
+
+  writeSlot(bucket+bestIdx, data);
+  touch(bucket+bestIdx);
+  m_numWrites.fetch_add(1, std::memory_order_relaxed);
+}
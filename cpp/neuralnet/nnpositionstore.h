@@ -0,0 +1,92 @@
+#ifndef NEURALNET_NNPOSITIONSTORE_H_
+#define NEURALNET_NNPOSITIONSTORE_H_
+
+#include <memory>
+
+#include "../core/global.h"
+#include "../core/hash.h"
+#include "../core/logger.h"
+#include "../neuralnet/nninputs.h"
+#include "../search/mutexpool.h"
+
+//On-disk, memory-mapped table of neural net evaluations keyed by NNInputs::getHash, so that positions evaluated
+//by one run (openings, common analysis positions) don't need to be evaluated again by the next run or by other
+//processes running at the same time.
+//
+//Each entry holds a quantized NNOutput (policy in 16 bits, ownership in 8 bits, values as floats).
+//Entries live in small fixed-size buckets. When a bucket is full, the least recently used entry is evicted, so the
+//total size on disk is fixed at creation time by sizePowerOfTwo.
+//
+//A store file may be opened writable by only one process at a time, but any number of other processes may open it
+//read-only at the same time. Readers never block writers - each entry carries a sequence number that readers use
+//to detect and discard entries that changed while they were being copied.
+//The file also records the model it was built with. A writable open of a file built with a different model discards
+//the old contents, a read-only open of such a file results in a store that never finds anything.
+class NNPositionStore {
+ public:
+  NNPositionStore(
+    const std::string& fileName,
+    int sizePowerOfTwo,
+    bool readOnly,
+    const std::string& internalModelName,
+    int nnXLen,
+    int nnYLen,
+    Logger* logger
+  );
+  ~NNPositionStore();
+
+  NNPositionStore(const NNPositionStore& other) = delete;
+  NNPositionStore& operator=(const NNPositionStore& other) = delete;
+
+  bool isReadOnly() const;
+  std::string getFileName() const;
+  //Maximum number of entries that can be held at once.
+  int64_t getCapacity() const;
+
+  //Returns true and fills ret if there is an entry for this hash, which includes an ownership map if requireOwnerMap.
+  //The returned NNOutput has no noisedPolicyProbs.
+  bool get(Hash128 nnHash, bool requireOwnerMap, std::shared_ptr<NNOutput>& ret);
+
+  //No-ops if the store is read-only.
+  void put(const NNOutput& nnOutput);
+
+  uint64_t numLookups() const;
+  uint64_t numHits() const;
+  uint64_t numWrites() const;
+  uint64_t numEvictions() const;
+
+ private:
+  struct Header;
+  struct Slot;
+  struct SlotData;
+
+  const std::string fileName;
+  const bool readOnly;
+  const int nnXLen;
+  const int nnYLen;
+  Logger* logger;
+
+  int fd;
+  size_t mappedSize;
+  void* mapped;
+  Header* header;
+  Slot* slots;
+  uint64_t bucketMask;
+  //Set if the file was built with a different model or board size and we can't reset it because we're read-only.
+  bool disabled;
+
+  MutexPool* mutexPool;
+  uint32_t mutexPoolMask;
+
+  std::atomic<uint64_t> m_numLookups;
+  std::atomic<uint64_t> m_numHits;
+  std::atomic<uint64_t> m_numWrites;
+  std::atomic<uint64_t> m_numEvictions;
+
+  Slot* getBucket(Hash128 nnHash) const;
+  bool readSlot(const Slot* slot, Hash128 nnHash, SlotData& ret) const;
+  void touch(Slot* slot);
+  static void writeSlot(Slot* slot, const SlotData& data);
+};
+
+#endif  // NEURALNET_NNPOSITIONSTORE_H_
@@ -177,10 +177,13 @@ void GameInitializer::initShared(ConfigParser& cfg, Logger& logger) {
         startPoses.push_back(posSample);
     };
     int64_t numExcluded = 0;
-    for(size_t i = 0; i<files.size(); i++) {
-      Sgf* sgf = NULL;
+    const int numLoadThreads = 0;
+    Sgf::loadFilesParallel(files, numLoadThreads, [&](size_t i, Sgf* sgf, const StringError* loadError) {
+      if(loadError != NULL) {
+        logger.write("Invalid SGF " + files[i] + ": " + loadError->what());
+        return;
+      }
       try {
-        sgf = Sgf::loadFile(files[i]);
         if(contains(excludeHashes,sgf->hash))
           numExcluded += 1;
         else {
@@ -193,9 +196,8 @@ void GameInitializer::initShared(ConfigParser& cfg, Logger& logger) {
       catch(const StringError& e) {
         logger.write("Invalid SGF " + files[i] + ": " + e.what());
       }
-      if(sgf != NULL)
-        delete sgf;
-    }
+      delete sgf;
+    });
     logger.write("Kept " + Global::uint64ToString(startPoses.size()) + " start positions");
     logger.write("Excluded " + Global::int64ToString(numExcluded) + "/" + Global::uint64ToString(files.size()) + " sgf files");
 
@@ -877,9 +879,7 @@ static void recordTreePositionsRec(
   int64_t bestChildVisits = 0;
   for(int i = 1; i<numChildren; i++) {
     const SearchNode* child = children[i].getIfAllocated();
-    while(child->statsLock.test_and_set(std::memory_order_acquire));
-    int64_t numVisits = child->stats.visits;
-    child->statsLock.clear(std::memory_order_release);
+    int64_t numVisits = child->stats.visits.load(std::memory_order_acquire);
     if(numVisits > bestChildVisits) {
       bestChildVisits = numVisits;
       bestChildIdx = i;
@@ -956,6 +956,7 @@ struct SearchLimitsThisMove {
   int64_t numAlterPlayouts;
   bool clearBotBeforeSearchThisMove;
   bool removeRootNoise;
+  bool isCheapSearch;
   float targetWeight;
 
   //Note: these two behave slightly differently than the ones in searchParams - derived from OtherGameProperties
@@ -977,6 +978,7 @@ static SearchLimitsThisMove getSearchLimitsThisMove(
   int64_t numAlterPlayouts = toMoveBot->searchParams.maxPlayouts;
   bool clearBotBeforeSearchThisMove = clearBotBeforeSearch;
   bool removeRootNoise = false;
+  bool isCheapSearch = false;
   float targetWeight = 1.0f;
   double playoutDoublingAdvantage = 0.0;
   Player playoutDoublingAdvantagePla = C_EMPTY;
@@ -1008,6 +1010,7 @@ static SearchLimitsThisMove getSearchLimitsThisMove(
       throw StringError("playSettings.cheapSearchVisits > maxVisits and/or maxPlayouts");
 
     doAlterVisitsPlayouts = true;
+    isCheapSearch = true;
     numAlterVisits = std::min(numAlterVisits,(int64_t)playSettings.cheapSearchVisits);
     numAlterPlayouts = std::min(numAlterPlayouts,(int64_t)playSettings.cheapSearchVisits);
     targetWeight *= playSettings.cheapSearchTargetWeight;
@@ -1087,6 +1090,7 @@ static SearchLimitsThisMove getSearchLimitsThisMove(
   limits.numAlterPlayouts = numAlterPlayouts;
   limits.clearBotBeforeSearchThisMove = clearBotBeforeSearchThisMove;
   limits.removeRootNoise = removeRootNoise;
+  limits.isCheapSearch = isCheapSearch;
   limits.targetWeight = targetWeight;
   limits.playoutDoublingAdvantage = playoutDoublingAdvantage;
   limits.playoutDoublingAdvantagePla = playoutDoublingAdvantagePla;
@@ -1094,6 +1098,33 @@ static SearchLimitsThisMove getSearchLimitsThisMove(
   return limits;
 }
 
+//Totals over all games in this process of the time spent on each move outside of search playouts
+static std::atomic<int64_t> numCheapMovesTotal(0);
+static std::atomic<int64_t> cheapMoveOverheadNanosTotal(0);
+static std::atomic<int64_t> numFullMovesTotal(0);
+static std::atomic<int64_t> fullMoveOverheadNanosTotal(0);
+
+static void recordMoveOverhead(bool isCheapSearch, double overheadSeconds) {
+  int64_t nanos = (int64_t)(std::max(overheadSeconds,0.0) * 1e9);
+  if(isCheapSearch) {
+    numCheapMovesTotal.fetch_add(1,std::memory_order_relaxed);
+    cheapMoveOverheadNanosTotal.fetch_add(nanos,std::memory_order_relaxed);
+  }
+  else {
+    numFullMovesTotal.fetch_add(1,std::memory_order_relaxed);
+    fullMoveOverheadNanosTotal.fetch_add(nanos,std::memory_order_relaxed);
+  }
+}
+
+Play::MoveOverheadStats Play::getMoveOverheadStats() {
+  MoveOverheadStats stats;
+  stats.numCheapMoves = numCheapMovesTotal.load(std::memory_order_relaxed);
+  stats.cheapMoveOverheadSeconds = cheapMoveOverheadNanosTotal.load(std::memory_order_relaxed) * 1e-9;
+  stats.numFullMoves = numFullMovesTotal.load(std::memory_order_relaxed);
+  stats.fullMoveOverheadSeconds = fullMoveOverheadNanosTotal.load(std::memory_order_relaxed) * 1e-9;
+  return stats;
+}
+
 //Returns the move chosen
 static Loc runBotWithLimits(
   Search* toMoveBot, Player pla, const PlaySettings& playSettings,
@@ -1441,6 +1472,7 @@ FinishedGameData* Play::runGame(
       break;
 
     Search* toMoveBot = pla == P_BLACK ? botB : botW;
+    const double moveStartTime = timer.getSeconds();
 
     SearchLimitsThisMove limits = getSearchLimitsThisMove(
       toMoveBot, pla, playSettings, gameRand, historicalMctsWinLossValues, clearBotBeforeSearch, otherGameProps
@@ -1485,7 +1517,13 @@ FinishedGameData* Play::runGame(
       int64_t unreducedNumVisits = toMoveBot->getRootVisits();
       extractPolicyTarget(*policyTarget, toMoveBot, toMoveBot->rootNode, locsBuf, playSelectionValuesBuf);
       gameData->policyTargetsByTurn.push_back(PolicyTarget(policyTarget,unreducedNumVisits));
-      gameData->nnRawStatsByTurn.push_back(computeNNRawStats(toMoveBot, board, hist, pla));
+      //A cheap search with no weight is never written out, unless policy surprise weighting later gives it some weight.
+      //If it can't, skip the extra nn query for its raw stats.
+      //The policy target is still needed, as the next move target of the previous turn.
+      if(limits.isCheapSearch && limits.targetWeight <= 0.0f && playSettings.policySurpriseDataWeight <= 0.0)
+        gameData->nnRawStatsByTurn.push_back(NNRawStats());
+      else
+        gameData->nnRawStatsByTurn.push_back(computeNNRawStats(toMoveBot, board, hist, pla));
 
       gameData->targetWeightByTurn.push_back(limits.targetWeight);
       policySurpriseByTurn.push_back(toMoveBot->getPolicySurprise());
@@ -1549,6 +1587,8 @@ FinishedGameData* Play::runGame(
     assert(hist.isLegal(board,loc,pla));
     hist.makeBoardMoveAssumeLegal(board,loc,pla);
 
+    recordMoveOverhead(limits.isCheapSearch, timer.getSeconds() - moveStartTime - toMoveBot->lastSearchPlayoutSeconds);
+
     //Check for resignation
     if(playSettings.allowResignation && historicalMctsWinLossValues.size() >= playSettings.resignConsecTurns) {
       //Play at least some moves no matter what
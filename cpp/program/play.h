@@ -286,6 +286,17 @@ namespace Play {
     const OtherGameProperties& otherGameProps
   );
 
+  //Time spent by runGame on each move outside of the search playouts themselves - choosing the search limits,
+  //setting up the search, extracting training targets, moving the bots down the tree.
+  //Totals over all games run in this process so far, with cheap searches and full searches counted separately.
+  struct MoveOverheadStats {
+    int64_t numCheapMoves;
+    double cheapMoveOverheadSeconds;
+    int64_t numFullMoves;
+    double fullMoveOverheadSeconds;
+  };
+  MoveOverheadStats getMoveOverheadStats();
+
 }
 
 
@@ -358,6 +358,64 @@ vector<double> PlayUtils::computeOwnership(
   return ownerships;
 }
 
+int PlayUtils::warmUpNNEvaluator(
+  NNEvaluator* nnEval,
+  const vector<std::pair<int,int>>& boardSizes,
+  int numPositionsPerSize,
+  Rand& rand
+) {
+  struct Position {
+    Board board;
+    BoardHistory hist;
+    Player pla;
+  };
+  vector<Position> positions;
+  for(const std::pair<int,int>& size: boardSizes) {
+    Board board(size.first,size.second);
+    Player pla = P_BLACK;
+    BoardHistory hist(board,pla,Rules());
+    for(int i = 0; i<numPositionsPerSize && !hist.isGameFinished; i++) {
+      positions.push_back(Position{board,hist,pla});
+      Loc loc = chooseRandomLegalMove(board,hist,pla,rand,Board::NULL_LOC);
+      if(loc == Board::NULL_LOC)
+        break;
+      hist.makeBoardMoveAssumeLegal(board,loc,pla);
+      pla = getOpp(pla);
+    }
+  }
+
+  const int numThreads = std::max(1,std::min(nnEval->getMaxBatchSize(),(int)positions.size()));
+  std::atomic<size_t> nextIdx(0);
+  vector<std::exception_ptr> errors(numThreads);
+  auto evalLoop = [&](int threadIdx) {
+    try {
+      NNResultBuf buf;
+      MiscNNInputParams nnInputParams;
+      const bool skipCache = false;
+      const bool includeOwnerMap = true;
+      while(true) {
+        size_t idx = nextIdx.fetch_add(1);
+        if(idx >= positions.size())
+          break;
+        Position& pos = positions[idx];
+        nnEval->evaluate(pos.board,pos.hist,pos.pla,nnInputParams,buf,skipCache,includeOwnerMap);
+      }
+    }
+    catch(...) {
+      errors[threadIdx] = std::current_exception();
+    }
+  };
+  vector<std::thread> threads;
+  for(int i = 0; i<numThreads; i++)
+    threads.push_back(std::thread(evalLoop,i));
+  for(size_t i = 0; i<threads.size(); i++)
+    threads[i].join();
+  for(size_t i = 0; i<errors.size(); i++) {
+    if(errors[i] != nullptr)
+      std::rethrow_exception(errors[i]);
+  }
+  return (int)positions.size();
+}
 
 string PlayUtils::BenchmarkResults::toStringNotDone() const {
   ostringstream out;
@@ -548,8 +606,18 @@ void PlayUtils::printGenmoveLog(ostream& out, const AsyncBot* bot, const NNEvalu
   out << bot->getRootHist().rules << "\n";
   if(!std::isnan(timeTaken))
     out << "Time taken: " << timeTaken << "\n";
+  out << "Tree transition time before search: " << search->lastTreeTransitionSeconds << "\n";
   out << "Root visits: " << search->getRootVisits() << "\n";
+  out << "Visits carried over: " << search->lastSearchStartingVisits << "\n";
   out << "New playouts: " << search->lastSearchNumPlayouts << "\n";
+  if(search->searchParams.earlyStopIfDecided) {
+    out << "Stopped early: " << (search->lastSearchStoppedEarly ? "yes" : "no")
+        << ", saved " << Global::strprintf("%.2f", search->lastSearchSecondsSavedByEarlyStop) << "s; "
+        << search->numSearchesStoppedEarly << "/" << search->numSearchesCheckedForEarlyStop << " moves stopped early, "
+        << Global::strprintf("%.2f", search->totalSecondsSavedByEarlyStop) << "s saved in total\n";
+  }
+  out << "Node stats write contention: " << search->lastSearchStatsWriteSpins.load(std::memory_order_relaxed)
+      << " spins (root " << search->lastSearchRootStatsWriteSpins.load(std::memory_order_relaxed) << ")\n";
   out << "NN rows: " << nnEval->numRowsProcessed() << endl;
   out << "NN batches: " << nnEval->numBatchesProcessed() << endl;
   out << "NN avg batch size: " << nnEval->averageProcessedBatchSize() << endl;
@@ -80,6 +80,17 @@ namespace PlayUtils {
     int64_t numVisits
   );
 
+  //Evaluate the empty board and a few positions a few random moves into the game, for each of boardSizes, several
+  //at a time so that batches bigger than one get run too. Meant for a freshly loaded nnEval before switching to it,
+  //so that any lazy backend initialization is done and the cache already holds the opening positions.
+  //Returns the number of positions evaluated.
+  int warmUpNNEvaluator(
+    NNEvaluator* nnEval,
+    const std::vector<std::pair<int,int>>& boardSizes,
+    int numPositionsPerSize,
+    Rand& rand
+  );
+
 
   struct BenchmarkResults {
     int numThreads = 0;
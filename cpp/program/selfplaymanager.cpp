@@ -4,7 +4,7 @@ using namespace std;
 
 SelfplayManager::ModelData::ModelData(
   const string& name, NNEvaluator* neval, int maxDQueueSize,
-  TrainingDataWriter* tdWriter, TrainingDataWriter* vdWriter, ofstream* sOut,
+  TrainingDataWriter* tdWriter, TrainingDataWriter* vdWriter, SgfStreamWriter* sOut,
   double initialTime,
   bool hasDataLoop
 ):
@@ -140,7 +140,7 @@ void SelfplayManager::loadModelAndStartDataWriting(
   NNEvaluator* nnEval,
   TrainingDataWriter* tdataWriter,
   TrainingDataWriter* vdataWriter,
-  ofstream* sgfOut
+  SgfStreamWriter* sgfOut
 ) {
   string modelName = nnEval->getModelName();
   std::lock_guard<std::mutex> lock(managerMutex);
@@ -165,7 +165,7 @@ void SelfplayManager::loadModelNoDataWritingLoop(
   NNEvaluator* nnEval,
   TrainingDataWriter* tdataWriter,
   TrainingDataWriter* vdataWriter,
-  ofstream* sgfOut
+  SgfStreamWriter* sgfOut
 ) {
   string modelName = nnEval->getModelName();
   std::lock_guard<std::mutex> lock(managerMutex);
@@ -317,6 +317,9 @@ void SelfplayManager::enqueueDataToWrite(const string& modelName, FinishedGameDa
   //In case it takes a while to push the game on, drop the lock. We're guaranteed as a precondition that
   //the caller has acquired the model as well, so it won't be cleaned up underneath us.
   lock.unlock();
+  //The sgf is written from the calling thread, so that formatting it doesn't hold up writing training data
+  if(foundData->sgfOut != NULL)
+    foundData->sgfOut->writeGame(*gameData);
   foundData->finishedGameQueue.waitPush(gameData);
 }
 
@@ -335,6 +338,9 @@ void SelfplayManager::enqueueDataToWrite(NNEvaluator* nnEval, FinishedGameData*
   //In case it takes a while to push the game on, drop the lock. We're guaranteed as a precondition that
   //the caller has acquired the model as well, so it won't be cleaned up underneath us.
   lock.unlock();
+  //The sgf is written from the calling thread, so that formatting it doesn't hold up writing training data
+  if(foundData->sgfOut != NULL)
+    foundData->sgfOut->writeGame(*gameData);
   foundData->finishedGameQueue.waitPush(gameData);
 }
 
@@ -346,6 +352,22 @@ void SelfplayManager::runDataWriteLoopImpl(ModelData* modelData) {
   if(logger != NULL)
     logger->write("Data write loop starting for neural net: " + modelData->modelName);
 
+  //Log training data writing throughput and backlog whenever a new file finishes
+  int64_t lastLoggedNumFilesWritten = 0;
+  auto maybeLogWriteStats = [&](bool force) {
+    if(logger == NULL)
+      return;
+    TrainingDataWriter::WriteStats stats = modelData->tdataWriter->getWriteStats();
+    if(!force && stats.numFilesWritten == lastLoggedNumFilesWritten)
+      return;
+    lastLoggedNumFilesWritten = stats.numFilesWritten;
+    logger->write(Global::strprintf(
+      "Training data files written %lld, pending %lld (max %lld), compressing %.2f MB/s, data write loop blocked %.3fs total",
+      (long long)stats.numFilesWritten, (long long)stats.numFilesPending, (long long)stats.maxNumFilesPending,
+      stats.numBytesWritten / 1048576.0 / std::max(stats.secondsWriting,1e-10), stats.secondsBlocked
+    ) + (stats.numRowsDeduped > 0 ? Global::strprintf(", rows deduped %lld", (long long)stats.numRowsDeduped) : string()));
+  };
+
   Rand rand;
   while(true) {
     size_t size = modelData->finishedGameQueue.size();
@@ -364,17 +386,17 @@ void SelfplayManager::runDataWriteLoopImpl(ModelData* modelData) {
     else
       modelData->tdataWriter->writeGame(*gameData);
 
-    if(modelData->sgfOut != NULL) {
-      assert(gameData->startHist.moveHistory.size() <= gameData->endHist.moveHistory.size());
-      WriteSgf::writeSgf(*modelData->sgfOut,gameData->bName,gameData->wName,gameData->endHist,gameData,false,true);
-      (*modelData->sgfOut) << endl;
-    }
     delete gameData;
+    maybeLogWriteStats(false);
   }
 
   modelData->tdataWriter->flushIfNonempty();
-  if(modelData->vdataWriter != NULL)
+  modelData->tdataWriter->waitForPendingWrites();
+  if(modelData->vdataWriter != NULL) {
     modelData->vdataWriter->flushIfNonempty();
+    modelData->vdataWriter->waitForPendingWrites();
+  }
+  maybeLogWriteStats(true);
   if(modelData->sgfOut != NULL)
     modelData->sgfOut->close();
 
@@ -425,7 +447,7 @@ void SelfplayManager::runDataWriteLoopImpl(ModelData* modelData) {
 
 void SelfplayManager::withDataWriters(
   NNEvaluator* nnEval,
-  std::function<void(TrainingDataWriter* tdataWriter, TrainingDataWriter* vdataWriter, std::ofstream* sgfOut)> f
+  std::function<void(TrainingDataWriter* tdataWriter, TrainingDataWriter* vdataWriter, SgfStreamWriter* sgfOut)> f
 ) {
   std::lock_guard<std::mutex> lock(managerMutex);
   ModelData* foundData = NULL;
@@ -4,6 +4,7 @@
 #include "../core/threadsafequeue.h"
 #include "../core/timer.h"
 #include "../dataio/sgf.h"
+#include "../dataio/sgfstreamwriter.h"
 #include "../dataio/trainingwrite.h"
 #include "../neuralnet/nneval.h"
 
@@ -26,18 +27,19 @@ class SelfplayManager {
   //All below functions are internally synchronized and thread-safe.
 
   //SelfplayManager takes responsibility for deleting the data writers and closing and deleting sgfOut.
+  //With the data writing loop, games are written to sgfOut by the threads that enqueue them.
   //loadModelNoDataWritingLoop is for the manual writing interface
   void loadModelAndStartDataWriting(
     NNEvaluator* nnEval,
     TrainingDataWriter* tdataWriter,
     TrainingDataWriter* vdataWriter,
-    std::ofstream* sgfOut
+    SgfStreamWriter* sgfOut
   );
   void loadModelNoDataWritingLoop(
     NNEvaluator* nnEval,
     TrainingDataWriter* tdataWriter,
     TrainingDataWriter* vdataWriter,
-    std::ofstream* sgfOut
+    SgfStreamWriter* sgfOut
   );
 
   //NN queries summed across all the models managed by this manager over all time.
@@ -78,7 +80,7 @@ class SelfplayManager {
   //Use these if loadModelNoDataWritingLoop was used to start the model.
   void withDataWriters(
     NNEvaluator* nnEval,
-    std::function<void(TrainingDataWriter* tdataWriter, TrainingDataWriter* vdataWriter, std::ofstream* sgfOut)> f
+    std::function<void(TrainingDataWriter* tdataWriter, TrainingDataWriter* vdataWriter, SgfStreamWriter* sgfOut)> f
   );
 
   //====================================================================================
@@ -96,11 +98,11 @@ class SelfplayManager {
 
     TrainingDataWriter* tdataWriter;
     TrainingDataWriter* vdataWriter;
-    std::ofstream* sgfOut;
+    SgfStreamWriter* sgfOut;
 
     ModelData(
       const std::string& name, NNEvaluator* neval, int maxDataQueueSize,
-      TrainingDataWriter* tdWriter, TrainingDataWriter* vdWriter, std::ofstream* sOut,
+      TrainingDataWriter* tdWriter, TrainingDataWriter* vdWriter, SgfStreamWriter* sOut,
       double initialLastReleaseTime,
       bool hasDataWriteLoop
     );
@@ -318,6 +318,21 @@ vector<NNEvaluator*> Setup::initializeNNEvaluators(
       defaultSymmetry
     );
 
+    if(setupFor != SETUP_FOR_DISTRIBUTED) {
+      string nnPositionStoreFile;
+      if(cfg.contains("nnPositionStoreFile" + idxStr))
+        nnPositionStoreFile = cfg.getString("nnPositionStoreFile" + idxStr);
+      else if(cfg.contains("nnPositionStoreFile"))
+        nnPositionStoreFile = cfg.getString("nnPositionStoreFile");
+      if(nnPositionStoreFile != "") {
+        int nnPositionStoreSizePowerOfTwo =
+          cfg.contains("nnPositionStoreSizePowerOfTwo") ? cfg.getInt("nnPositionStoreSizePowerOfTwo", 2, 32) : 20;
+        bool nnPositionStoreReadOnly =
+          cfg.contains("nnPositionStoreReadOnly") ? cfg.getBool("nnPositionStoreReadOnly") : false;
+        nnEval->openPositionStore(nnPositionStoreFile, nnPositionStoreSizePowerOfTwo, nnPositionStoreReadOnly);
+      }
+    }
+
     nnEval->spawnServerThreads();
 
     nnEvals.push_back(nnEval);
@@ -384,6 +399,12 @@ vector<SearchParams> Setup::loadParams(
     if(cfg.contains("maxTimePondering"+idxStr)) params.maxTimePondering = cfg.getDouble("maxTimePondering"+idxStr, 0.0, 1.0e20);
     else if(cfg.contains("maxTimePondering"))   params.maxTimePondering = cfg.getDouble("maxTimePondering",        0.0, 1.0e20);
     else                                        params.maxTimePondering = 1.0e20;
+    if(cfg.contains("ponderingReplyFocus"+idxStr)) params.ponderingReplyFocus = cfg.getDouble("ponderingReplyFocus"+idxStr, 0.0, 1.0);
+    else if(cfg.contains("ponderingReplyFocus"))   params.ponderingReplyFocus = cfg.getDouble("ponderingReplyFocus",        0.0, 1.0);
+    else                                           params.ponderingReplyFocus = 0.0;
+    if(cfg.contains("ponderingReplyFocusExponent"+idxStr)) params.ponderingReplyFocusExponent = cfg.getDouble("ponderingReplyFocusExponent"+idxStr, 0.0, 16.0);
+    else if(cfg.contains("ponderingReplyFocusExponent"))   params.ponderingReplyFocusExponent = cfg.getDouble("ponderingReplyFocusExponent",        0.0, 16.0);
+    else                                                   params.ponderingReplyFocusExponent = 2.0;
 
     if(cfg.contains("lagBuffer"+idxStr)) params.lagBuffer = cfg.getDouble("lagBuffer"+idxStr, 0.0, 3600.0);
     else if(cfg.contains("lagBuffer"))   params.lagBuffer = cfg.getDouble("lagBuffer",        0.0, 3600.0);
@@ -639,6 +660,9 @@ vector<SearchParams> Setup::loadParams(
     if(cfg.contains("endgameTurnTimeDecay"+idxStr)) params.endgameTurnTimeDecay = cfg.getDouble("endgameTurnTimeDecay"+idxStr,0.0,1000.0);
     else if(cfg.contains("endgameTurnTimeDecay"))   params.endgameTurnTimeDecay = cfg.getDouble("endgameTurnTimeDecay",0.0,1000.0);
     else                                            params.endgameTurnTimeDecay = 100.0;
+    if(cfg.contains("estimateTurnsLeftFromPosition"+idxStr)) params.estimateTurnsLeftFromPosition = cfg.getBool("estimateTurnsLeftFromPosition"+idxStr);
+    else if(cfg.contains("estimateTurnsLeftFromPosition"))   params.estimateTurnsLeftFromPosition = cfg.getBool("estimateTurnsLeftFromPosition");
+    else                                                     params.estimateTurnsLeftFromPosition = false;
     if(cfg.contains("obviousMovesTimeFactor"+idxStr)) params.obviousMovesTimeFactor = cfg.getDouble("obviousMovesTimeFactor"+idxStr,0.01,1.0);
     else if(cfg.contains("obviousMovesTimeFactor"))   params.obviousMovesTimeFactor = cfg.getDouble("obviousMovesTimeFactor",0.01,1.0);
     else                                              params.obviousMovesTimeFactor = 1.0;
@@ -651,6 +675,9 @@ vector<SearchParams> Setup::loadParams(
     if(cfg.contains("futileVisitsThreshold"+idxStr)) params.futileVisitsThreshold = cfg.getDouble("futileVisitsThreshold"+idxStr,0.01,1.0);
     else if(cfg.contains("futileVisitsThreshold"))   params.futileVisitsThreshold = cfg.getDouble("futileVisitsThreshold",0.01,1.0);
     else                                             params.futileVisitsThreshold = 0.0;
+    if(cfg.contains("earlyStopIfDecided"+idxStr)) params.earlyStopIfDecided = cfg.getBool("earlyStopIfDecided"+idxStr);
+    else if(cfg.contains("earlyStopIfDecided"))   params.earlyStopIfDecided = cfg.getBool("earlyStopIfDecided");
+    else                                          params.earlyStopIfDecided = false;
 
 
     paramss.push_back(params);
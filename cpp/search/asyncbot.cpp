@@ -95,6 +95,10 @@ void AsyncBot::setAlwaysIncludeOwnerMap(bool b) {
   stopAndWait();
   search->setAlwaysIncludeOwnerMap(b);
 }
+void AsyncBot::setSharedThreadPool(SearchThreadPool* pool, int64_t priority) {
+  stopAndWait();
+  search->setSharedThreadPool(pool,priority);
+}
 void AsyncBot::setParams(SearchParams params) {
   stopAndWait();
   search->setParams(params);
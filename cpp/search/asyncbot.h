@@ -39,6 +39,7 @@ class AsyncBot {
   void setParamsNoClearing(SearchParams params);
   void setExternalPatternBonusTable(std::unique_ptr<PatternBonusTable>&& table);
   void setCopyOfExternalPatternBonusTable(const std::unique_ptr<PatternBonusTable>& table);
+  void setSharedThreadPool(SearchThreadPool* pool, int64_t priority);
   void clearSearch();
 
   //Updates position and preserves the relevant subtree of search
@@ -152,17 +152,18 @@ void PatternBonusTable::avoidRepeatedSgfMoves(
   FileHelpers::collectSgfsFromDirsOrFiles(sgfsDirsOrFiles,sgfFiles);
   FileHelpers::sortNewestToOldest(sgfFiles);
 
+  if(sgfFiles.size() > maxFiles)
+    sgfFiles.resize(maxFiles);
+
   double factor = 1.0;
-  for(size_t i = 0; i<sgfFiles.size() && i < maxFiles; i++) {
+  const int numLoadThreads = 0;
+  Sgf::loadFilesParallel(sgfFiles, numLoadThreads, [&](size_t i, Sgf* sgf, const StringError* loadError) {
     const string& fileName = sgfFiles[i];
-    Sgf* sgf = NULL;
-    try {
-      sgf = Sgf::loadFile(fileName);
-    }
-    catch(const StringError& e) {
-      logger.write("Invalid SGF " + fileName + ": " + e.what());
-      continue;
+    if(loadError != NULL) {
+      logger.write("Invalid SGF " + fileName + ": " + loadError->what());
+      return;
     }
+    std::unique_ptr<Sgf> sgfOwner(sgf);
 
     bool blackOkay = allowedPlayerNames.size() <= 0 || contains(allowedPlayerNames, sgf->getPlayerName(P_BLACK));
     bool whiteOkay = allowedPlayerNames.size() <= 0 || contains(allowedPlayerNames, sgf->getPlayerName(P_WHITE));
@@ -205,7 +206,6 @@ void PatternBonusTable::avoidRepeatedSgfMoves(
     sgf->iterAllUniquePositions(uniqueHashes, hashComments, hashParent, false, NULL, posHandler);
     logger.write("Added " + Global::uint64ToString(hashesThisGame.size()) + " shapes to penalize repeats for " + logSource + " from " + fileName);
 
-    delete sgf;
     factor *= decayOlderFilesLambda;
-  }
+  });
 }
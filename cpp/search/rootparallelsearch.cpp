@@ -0,0 +1,312 @@
+#include "../search/rootparallelsearch.h"
+
+#include <map>
+
+using namespace std;
+
+SearchParams RootParallelSearch::getSubSearchParams(const SearchParams& params, int numSubSearches) {
+  SearchParams subParams = params;
+  subParams.numThreads = std::max(1, params.numThreads / numSubSearches);
+  //Round up, and leave "unlimited" values alone
+  auto split = [numSubSearches](int64_t x) {
+    if(x >= ((int64_t)1 << 50))
+      return x;
+    return (x + numSubSearches - 1) / numSubSearches;
+  };
+  subParams.maxVisits = split(params.maxVisits);
+  subParams.maxPlayouts = split(params.maxPlayouts);
+  subParams.maxVisitsPondering = split(params.maxVisitsPondering);
+  subParams.maxPlayoutsPondering = split(params.maxPlayoutsPondering);
+  return subParams;
+}
+
+RootParallelSearch::RootParallelSearch(
+  SearchParams params, int numSubSearches, NNEvaluator* nnEval, Logger* logger, const string& randSeed
+)
+  :subSearches()
+{
+  if(numSubSearches <= 0)
+    throw StringError("RootParallelSearch: numSubSearches must be positive");
+  SearchParams subParams = getSubSearchParams(params, numSubSearches);
+  for(int i = 0; i<numSubSearches; i++)
+    subSearches.push_back(new Search(subParams, nnEval, logger, randSeed + "|rootparallel" + Global::intToString(i)));
+}
+
+RootParallelSearch::~RootParallelSearch() {
+  for(Search* search: subSearches)
+    delete search;
+}
+
+int RootParallelSearch::getNumSubSearches() const {
+  return (int)subSearches.size();
+}
+const Search* RootParallelSearch::getSubSearch(int idx) const {
+  return subSearches[idx];
+}
+
+const Board& RootParallelSearch::getRootBoard() const {
+  return subSearches[0]->getRootBoard();
+}
+const BoardHistory& RootParallelSearch::getRootHist() const {
+  return subSearches[0]->getRootHist();
+}
+Player RootParallelSearch::getRootPla() const {
+  return subSearches[0]->getRootPla();
+}
+
+void RootParallelSearch::setPosition(Player pla, const Board& board, const BoardHistory& history) {
+  for(Search* search: subSearches)
+    search->setPosition(pla, board, history);
+}
+
+void RootParallelSearch::setParams(SearchParams params) {
+  SearchParams subParams = getSubSearchParams(params, (int)subSearches.size());
+  for(Search* search: subSearches)
+    search->setParams(subParams);
+}
+
+void RootParallelSearch::clearSearch() {
+  for(Search* search: subSearches)
+    search->clearSearch();
+}
+
+bool RootParallelSearch::makeMove(Loc moveLoc, Player movePla) {
+  //All sub-searches share the same root, so legality is the same for all of them
+  if(!subSearches[0]->isLegalTolerant(moveLoc, movePla))
+    return false;
+  for(Search* search: subSearches) {
+    bool suc = search->makeMove(moveLoc, movePla);
+    assert(suc);
+    (void)suc;
+  }
+  return true;
+}
+
+void RootParallelSearch::runWholeSearch(Player movePla, std::atomic<bool>& shouldStopNow) {
+  for(Search* search: subSearches) {
+    if(movePla != search->getRootPla())
+      search->setPlayerAndClearHistory(movePla);
+  }
+
+  const int numSubSearches = (int)subSearches.size();
+  std::mutex mutex;
+  std::condition_variable stateChanged;
+  int numDone = 0;
+
+  //Each sub-search gets its own stop flag, since a search sets its flag when it hits its own limits and we don't
+  //want one sub-search finishing first to cut off the others.
+  std::vector<std::atomic<bool>*> subShouldStops;
+  for(int i = 0; i<numSubSearches; i++)
+    subShouldStops.push_back(new std::atomic<bool>(false));
+
+  std::vector<std::thread> threads;
+  std::vector<std::exception_ptr> exceptions(numSubSearches);
+  for(int i = 0; i<numSubSearches; i++) {
+    threads.push_back(std::thread([&,i]() {
+      try {
+        subSearches[i]->runWholeSearch(*(subShouldStops[i]), NULL, false, TimeControls(), 1.0);
+      }
+      catch(...) {
+        exceptions[i] = std::current_exception();
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      numDone += 1;
+      stateChanged.notify_all();
+    }));
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while(numDone < numSubSearches) {
+      if(shouldStopNow.load(std::memory_order_acquire)) {
+        for(int i = 0; i<numSubSearches; i++)
+          subShouldStops[i]->store(true, std::memory_order_release);
+      }
+      stateChanged.wait_for(lock, std::chrono::duration<double>(0.05));
+    }
+  }
+
+  for(std::thread& thread: threads)
+    thread.join();
+  for(int i = 0; i<numSubSearches; i++)
+    delete subShouldStops[i];
+  for(int i = 0; i<numSubSearches; i++) {
+    if(exceptions[i])
+      std::rethrow_exception(exceptions[i]);
+  }
+}
+
+void RootParallelSearch::runWholeSearch(Player movePla) {
+  std::atomic<bool> shouldStopNow(false);
+  runWholeSearch(movePla, shouldStopNow);
+}
+
+Loc RootParallelSearch::runWholeSearchAndGetMove(Player movePla) {
+  runWholeSearch(movePla);
+  return getChosenMoveLoc();
+}
+
+Loc RootParallelSearch::getChosenMoveLoc() const {
+  std::map<Loc,double> totalPlaySelectionValues;
+  vector<Loc> locs;
+  vector<double> playSelectionValues;
+  for(const Search* search: subSearches) {
+    locs.clear();
+    playSelectionValues.clear();
+    if(!search->getPlaySelectionValues(locs, playSelectionValues, 0.0))
+      continue;
+    for(size_t i = 0; i<locs.size(); i++)
+      totalPlaySelectionValues[locs[i]] += playSelectionValues[i];
+  }
+
+  Loc bestLoc = Board::NULL_LOC;
+  double bestValue = -1.0;
+  for(auto it = totalPlaySelectionValues.begin(); it != totalPlaySelectionValues.end(); ++it) {
+    if(it->second > bestValue) {
+      bestValue = it->second;
+      bestLoc = it->first;
+    }
+  }
+  return bestLoc;
+}
+
+bool RootParallelSearch::getRootValues(ReportedSearchValues& values) const {
+  double weightSum = 0.0;
+  int64_t visits = 0;
+  double winValue = 0.0;
+  double lossValue = 0.0;
+  double noResultValue = 0.0;
+  double expectedScore = 0.0;
+  double expectedScoreSq = 0.0;
+  double lead = 0.0;
+  double winLossValue = 0.0;
+  double utility = 0.0;
+  for(const Search* search: subSearches) {
+    ReportedSearchValues subValues;
+    if(!search->getRootValues(subValues) || subValues.weight <= 0.0)
+      continue;
+    double w = subValues.weight;
+    weightSum += w;
+    visits += subValues.visits;
+    winValue += w * subValues.winValue;
+    lossValue += w * subValues.lossValue;
+    noResultValue += w * subValues.noResultValue;
+    expectedScore += w * subValues.expectedScore;
+    expectedScoreSq += w * (subValues.expectedScore * subValues.expectedScore + subValues.expectedScoreStdev * subValues.expectedScoreStdev);
+    lead += w * subValues.lead;
+    winLossValue += w * subValues.winLossValue;
+    utility += w * subValues.utility;
+  }
+  if(weightSum <= 0.0)
+    return false;
+
+  values.winValue = winValue / weightSum;
+  values.lossValue = lossValue / weightSum;
+  values.noResultValue = noResultValue / weightSum;
+  values.expectedScore = expectedScore / weightSum;
+  values.expectedScoreStdev = sqrt(std::max(0.0, expectedScoreSq / weightSum - values.expectedScore * values.expectedScore));
+  values.lead = lead / weightSum;
+  values.winLossValue = winLossValue / weightSum;
+  values.utility = utility / weightSum;
+  values.weight = weightSum;
+  values.visits = visits;
+  return true;
+}
+
+int64_t RootParallelSearch::getRootVisits() const {
+  int64_t visits = 0;
+  for(const Search* search: subSearches)
+    visits += search->getRootVisits();
+  return visits;
+}
+
+int64_t RootParallelSearch::getLastSearchNumPlayouts() const {
+  int64_t numPlayouts = 0;
+  for(const Search* search: subSearches)
+    numPlayouts += search->lastSearchNumPlayouts;
+  return numPlayouts;
+}
+
+void RootParallelSearch::getAnalysisData(vector<AnalysisData>& buf, int minMovesToTryToGet, int maxPVDepth) const {
+  buf.clear();
+
+  struct Merged {
+    AnalysisData data;
+    int64_t bestSubVisits = -1;
+    int count = 0;
+    double valueWeight = 0.0;
+  };
+  std::map<Loc,Merged> mergedByMove;
+
+  vector<AnalysisData> subBuf;
+  for(const Search* search: subSearches) {
+    search->getAnalysisData(subBuf, minMovesToTryToGet, false, maxPVDepth, false);
+    for(const AnalysisData& d: subBuf) {
+      Merged& m = mergedByMove[d.move];
+      //Moves with no weight in a sub-search only have fpu values, so give them a token weight so that they only
+      //matter if no sub-search has searched them.
+      double w = d.weightSum > 0.0 ? d.weightSum : 1e-10;
+      if(m.count == 0) {
+        m.data = d;
+        m.data.numVisits = 0;
+        m.data.playSelectionValue = 0.0;
+        m.data.utility = 0.0;
+        m.data.resultUtility = 0.0;
+        m.data.scoreUtility = 0.0;
+        m.data.winLossValue = 0.0;
+        m.data.policyPrior = 0.0;
+        m.data.scoreMean = 0.0;
+        m.data.lead = 0.0;
+        m.data.weightSum = 0.0;
+        m.data.weightSqSum = 0.0;
+        m.data.utilitySqAvg = 0.0;
+        m.data.scoreMeanSqAvg = 0.0;
+        //Nodes belong to the individual sub-searches
+        m.data.node = NULL;
+      }
+      m.count += 1;
+      m.valueWeight += w;
+      m.data.numVisits += d.numVisits;
+      m.data.playSelectionValue += d.playSelectionValue;
+      m.data.utility += w * d.utility;
+      m.data.resultUtility += w * d.resultUtility;
+      m.data.scoreUtility += w * d.scoreUtility;
+      m.data.winLossValue += w * d.winLossValue;
+      m.data.policyPrior += d.policyPrior;
+      m.data.scoreMean += w * d.scoreMean;
+      m.data.lead += w * d.lead;
+      m.data.weightSum += d.weightSum;
+      m.data.weightSqSum += d.weightSqSum;
+      m.data.utilitySqAvg += w * d.utilitySqAvg;
+      m.data.scoreMeanSqAvg += w * d.scoreMeanSqAvg;
+      if(d.numVisits > m.bestSubVisits) {
+        m.bestSubVisits = d.numVisits;
+        m.data.pv = d.pv;
+        m.data.pvVisits = d.pvVisits;
+        m.data.lcb = d.lcb;
+        m.data.radius = d.radius;
+      }
+    }
+  }
+
+  for(auto it = mergedByMove.begin(); it != mergedByMove.end(); ++it) {
+    Merged& m = it->second;
+    AnalysisData& data = m.data;
+    data.utility /= m.valueWeight;
+    data.resultUtility /= m.valueWeight;
+    data.scoreUtility /= m.valueWeight;
+    data.winLossValue /= m.valueWeight;
+    data.policyPrior /= m.count;
+    data.scoreMean /= m.valueWeight;
+    data.lead /= m.valueWeight;
+    data.utilitySqAvg /= m.valueWeight;
+    data.scoreMeanSqAvg /= m.valueWeight;
+    data.scoreStdev = ScoreValue::getScoreStdev(data.scoreMean, data.scoreMeanSqAvg);
+    data.ess = data.weightSqSum > 0.0 ? data.weightSum * data.weightSum / data.weightSqSum : 0.0;
+    buf.push_back(std::move(data));
+  }
+
+  std::stable_sort(buf.begin(), buf.end());
+  for(int i = 0; i<(int)buf.size(); i++)
+    buf[i].order = i;
+}
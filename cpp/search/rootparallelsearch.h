@@ -0,0 +1,61 @@
+#ifndef SEARCH_ROOTPARALLELSEARCH_H_
+#define SEARCH_ROOTPARALLELSEARCH_H_
+
+#include "../search/search.h"
+
+//Root-parallel alternative to a single shared-tree Search for machines with many cores.
+//
+//Runs several independent Searches from the same root, each with its own tree and its own share of the threads,
+//all sharing one NNEvaluator and therefore one NN cache. The trees never touch each other, so there is no contention
+//on the nodes near the root, at the cost of each tree being shallower and of duplicate work between trees.
+//Root child stats are merged across trees only for reporting and for choosing a move once the search is done. Nothing
+//merged is fed back into the sub-searches.
+//
+//Like Search, NOT threadsafe.
+//
+//Currently only used by the benchmark command (-rootparallel), for comparing against shared-tree search.
+//GTP and AsyncBot always use a single shared-tree Search.
+class RootParallelSearch {
+ public:
+  //params.numThreads, maxVisits, and maxPlayouts are totals, and are divided evenly among the sub-searches.
+  RootParallelSearch(SearchParams params, int numSubSearches, NNEvaluator* nnEval, Logger* logger, const std::string& randSeed);
+  ~RootParallelSearch();
+
+  RootParallelSearch(const RootParallelSearch&) = delete;
+  RootParallelSearch& operator=(const RootParallelSearch&) = delete;
+
+  int getNumSubSearches() const;
+  const Search* getSubSearch(int idx) const;
+
+  const Board& getRootBoard() const;
+  const BoardHistory& getRootHist() const;
+  Player getRootPla() const;
+
+  void setPosition(Player pla, const Board& board, const BoardHistory& history);
+  void setParams(SearchParams params);
+  void clearSearch();
+  //Preserves the relevant subtree of every sub-search. Returns false and does nothing if illegal.
+  bool makeMove(Loc moveLoc, Player movePla);
+
+  //Run all sub-searches to completion in parallel. Setting shouldStopNow stops all sub-searches.
+  void runWholeSearch(Player movePla, std::atomic<bool>& shouldStopNow);
+  void runWholeSearch(Player movePla);
+  Loc runWholeSearchAndGetMove(Player movePla);
+
+  //Results, merged across all sub-searches.
+  //The move with the greatest total play selection value. Does not apply chosenMoveTemperature.
+  Loc getChosenMoveLoc() const;
+  bool getRootValues(ReportedSearchValues& values) const;
+  int64_t getRootVisits() const;
+  int64_t getLastSearchNumPlayouts() const;
+  //Per move, visits, weights and play selection values are summed and values are averaged by weight.
+  //The PV is the one from whichever sub-search visited that move the most.
+  void getAnalysisData(std::vector<AnalysisData>& buf, int minMovesToTryToGet, int maxPVDepth) const;
+
+ private:
+  std::vector<Search*> subSearches;
+
+  static SearchParams getSubSearchParams(const SearchParams& params, int numSubSearches);
+};
+
+#endif  // SEARCH_ROOTPARALLELSEARCH_H_
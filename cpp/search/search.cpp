@@ -14,7 +14,9 @@
 #include "../search/distributiontable.h"
 #include "../search/patternbonustable.h"
 #include "../search/searchnode.h"
+#include "../search/searchnodereclaimer.h"
 #include "../search/searchnodetable.h"
+#include "../search/searchthreadpool.h"
 #include "../search/subtreevaluebiastable.h"
 
 using namespace std;
@@ -70,6 +72,7 @@ Search::Search(SearchParams params, NNEvaluator* nnEval, Logger* lg, const strin
    rootHistory(),
    rootGraphHash(),
    rootHintLoc(Board::NULL_LOC),
+   graphSearchMayHaveCycles(false),
    avoidMoveUntilByLocBlack(),avoidMoveUntilByLocWhite(),
    rootSymmetries(),
    rootPruneOnlySymmetries(),
@@ -80,7 +83,19 @@ Search::Search(SearchParams params, NNEvaluator* nnEval, Logger* lg, const strin
    searchParams(params),numSearchesBegun(0),searchNodeAge(0),
    plaThatSearchIsFor(C_EMPTY),plaThatSearchIsForLastSearch(C_EMPTY),
    lastSearchNumPlayouts(0),
+   lastSearchStartingVisits(0),
+   searchIsPondering(false),
+   lastSearchPlayoutSeconds(0.0),
+   recentPlayoutsSum(0.0),
+   recentPlayoutSecondsSum(0.0),
+   lastSearchStatsWriteSpins(0),
+   lastSearchRootStatsWriteSpins(0),
    effectiveSearchTimeCarriedOver(0.0),
+   lastSearchStoppedEarly(false),
+   lastSearchSecondsSavedByEarlyStop(0.0),
+   numSearchesCheckedForEarlyStop(0),
+   numSearchesStoppedEarly(0),
+   totalSecondsSavedByEarlyStop(0.0),
    randSeed(rSeed),
    valueWeightDistribution(NULL),
    normToTApproxZ(0.0),
@@ -97,10 +112,15 @@ Search::Search(SearchParams params, NNEvaluator* nnEval, Logger* lg, const strin
    nodeTable(NULL),
    mutexPool(NULL),
    subtreeValueBiasTable(NULL),
+   nodeReclaimer(NULL),
+   lastTreeTransitionSeconds(0.0),
+   numUnsweptDiscardedNodes(0),
    numThreadsSpawned(0),
    threads(NULL),
    threadTasks(NULL),
    threadTasksRemaining(NULL),
+   sharedThreadPool(NULL),
+   sharedThreadPoolPriority(0),
    oldNNOutputsToCleanUpMutex(),
    oldNNOutputsToCleanUp()
 {
@@ -123,12 +143,15 @@ Search::Search(SearchParams params, NNEvaluator* nnEval, Logger* lg, const strin
   rootNode = NULL;
   nodeTable = new SearchNodeTable(params.nodeTableShardsPowerOfTwo);
   mutexPool = new MutexPool(nodeTable->mutexPool->getNumMutexes());
+  nodeReclaimer = new SearchNodeReclaimer();
 
   rootHistory.clear(rootBoard,rootPla,Rules());
 }
 
 Search::~Search() {
   clearSearch();
+  //Waits for any nodes still being freed in the background
+  delete nodeReclaimer;
 
   delete valueWeightDistribution;
 
@@ -224,6 +247,9 @@ void Search::setRootSymmetryPruningOnly(const std::vector<int>& v) {
 void Search::setParams(SearchParams params) {
   clearSearch();
   searchParams = params;
+  //Different params, such as numThreads, can search at a quite different rate
+  recentPlayoutsSum = 0.0;
+  recentPlayoutSecondsSum = 0.0;
 }
 
 void Search::setParamsNoClearing(SearchParams params) {
@@ -246,6 +272,8 @@ void Search::setCopyOfExternalPatternBonusTable(const std::unique_ptr<PatternBon
 void Search::setNNEval(NNEvaluator* nnEval) {
   clearSearch();
   nnEvaluator = nnEval;
+  recentPlayoutsSum = 0.0;
+  recentPlayoutSecondsSum = 0.0;
   nnXLen = nnEval->getNNXLen();
   nnYLen = nnEval->getNNYLen();
   assert(nnXLen > 0 && nnXLen <= NNPos::MAX_BOARD_LEN);
@@ -256,12 +284,14 @@ void Search::setNNEval(NNEvaluator* nnEval) {
 void Search::clearSearch() {
   effectiveSearchTimeCarriedOver = 0.0;
   if(rootNode != NULL) {
+    ClockTimer timer;
     deleteAllTableNodesMulithreaded();
     //Root is not stored in node table
     if(rootNode != NULL) {
-      delete rootNode;
+      nodeReclaimer->reclaim({rootNode});
       rootNode = NULL;
     }
+    lastTreeTransitionSeconds = timer.getSeconds();
   }
   clearOldNNOutputs();
   searchNodeAge = 0;
@@ -321,13 +351,14 @@ bool Search::makeMove(Loc moveLoc, Player movePla) {
     }
 
     if(foundChild) {
+      ClockTimer timer;
       SearchNode* child = children[foundChildIdx].getIfAllocated();
       assert(child != NULL);
 
       //Account for time carried over
+      int64_t rootVisits = rootNode->stats.visits.load(std::memory_order_acquire);
+      int64_t childVisits = child->stats.visits.load(std::memory_order_acquire);
       {
-        int64_t rootVisits = rootNode->stats.visits.load(std::memory_order_acquire);
-        int64_t childVisits = child->stats.visits.load(std::memory_order_acquire);
         double visitProportion = (double)childVisits / (double)rootVisits;
         if(visitProportion > 1)
           visitProportion = 1;
@@ -337,12 +368,23 @@ bool Search::makeMove(Loc moveLoc, Player movePla) {
       //Okay, this is now our new root! Create a copy so as to keep the root out of the node table.
       const bool copySubtreeValueBias = false;
       const bool forceNonTerminal = true;
+      SearchNode* oldRootNode = rootNode;
       rootNode = new SearchNode(*child, forceNonTerminal, copySubtreeValueBias);
-      //Sweep over the new root marking it as good (calling NULL function), and then delete anything unmarked.
-      //This will include the old root node and the old copy of the child that we promoted to root.
-      applyRecursivelyAnyOrderMulithreaded({rootNode}, NULL);
-      bool old = true;
-      deleteAllOldOrAllNewTableNodesAndSubtreeValueBiasMulithreaded(old);
+      //Every visit creates at most one node, so this bounds how many nodes we just discarded.
+      numUnsweptDiscardedNodes += std::max(rootVisits - childVisits, (int64_t)1);
+      //Sweeping the table costs time proportional to its number of shards, no matter how little was discarded.
+      //So after a tiny search, such as a cheap selfplay move, leave the few discarded nodes for a later sweep.
+      //Until then they are still valid nodes, only unreachable unless a playout transposes back into them.
+      if(numUnsweptDiscardedNodes * 16 >= (int64_t)nodeTable->entries.size()) {
+        //Sweep over the new root marking it as good (calling NULL function), and then delete anything unmarked.
+        //This will include the old copy of the child that we promoted to root.
+        applyRecursivelyAnyOrderMulithreaded({rootNode}, NULL);
+        bool old = true;
+        deleteAllOldOrAllNewTableNodesAndSubtreeValueBiasMulithreaded(old);
+      }
+      //The old root is not in the node table, so it isn't covered by the sweep above.
+      nodeReclaimer->reclaim({oldRootNode});
+      lastTreeTransitionSeconds = timer.getSeconds();
     }
     else {
       clearSearch();
@@ -413,6 +455,10 @@ void Search::runWholeSearch(
   if(searchBegun != NULL)
     (*searchBegun)();
   const int64_t numNonPlayoutVisits = getRootVisits();
+  lastSearchStartingVisits = numNonPlayoutVisits;
+  searchIsPondering = pondering;
+  lastSearchStatsWriteSpins.store(0,std::memory_order_relaxed);
+  lastSearchRootStatsWriteSpins.store(0,std::memory_order_relaxed);
 
   //Compute caps on search
   int64_t maxVisits = pondering ? searchParams.maxVisitsPondering : searchParams.maxVisits;
@@ -453,9 +499,14 @@ void Search::runWholeSearch(
     upperBoundVisitsLeftDueToTime.store(upperBoundVisits, std::memory_order_release);
   }
 
+  //Written only by thread 0, and read after the threads are joined
+  const bool checkEarlyStop = searchParams.earlyStopIfDecided && !pondering;
+  bool stoppedEarly = false;
+  double secondsSavedByEarlyStop = 0.0;
+
   std::function<void(int)> searchLoop = [
     this,&timer,&numPlayoutsShared,numNonPlayoutVisits,&tcMaxTime,&upperBoundVisitsLeftDueToTime,&tc,
-    &hasMaxTime,&hasTc,
+    &hasMaxTime,&hasTc,&checkEarlyStop,&stoppedEarly,&secondsSavedByEarlyStop,
     &shouldStopNow,maxVisits,maxPlayouts,maxTime,pondering,searchFactor
   ](int threadIdx) {
     SearchThread* stbuf = new SearchThread(threadIdx,*this);
@@ -463,6 +514,7 @@ void Search::runWholeSearch(
     int64_t numPlayouts = numPlayoutsShared.load(std::memory_order_relaxed);
     try {
       double lastTimeUsedRecomputingTcLimit = 0.0;
+      int64_t numPlayoutsAtLastEarlyStopCheck = 0;
       while(true) {
         double timeUsed = 0.0;
         if(hasTc || hasMaxTime)
@@ -485,6 +537,9 @@ void Search::runWholeSearch(
           shouldStopNow.store(true,std::memory_order_relaxed);
           break;
         }
+        //A borrowed thread that a higher priority search wants leaves without stopping the rest of the search
+        if(threadIdx != 0 && sharedThreadPool != NULL && SearchThreadPool::shouldCurrentThreadReturn())
+          break;
 
         //Thread 0 alone is responsible for recomputing time limits every once in a while
         //Cap of 10 times per second.
@@ -505,6 +560,30 @@ void Search::runWholeSearch(
         upperBoundVisitsLeft = std::min(upperBoundVisitsLeft, (double)maxPlayouts - numPlayouts);
         upperBoundVisitsLeft = std::min(upperBoundVisitsLeft, (double)maxVisits - numPlayouts - numNonPlayoutVisits);
 
+        //Thread 0 alone checks whether the best move is already decided, every few playouts since it walks the root's children
+        if(checkEarlyStop && threadIdx == 0 && numPlayouts >= 2 && numPlayouts >= numPlayoutsAtLastEarlyStopCheck + 16) {
+          numPlayoutsAtLastEarlyStopCheck = numPlayouts;
+          //Unlike futile visits pruning, also go by maxTime alone
+          double upperBoundVisitsLeftForEarlyStop = upperBoundVisitsLeft;
+          if(hasMaxTime)
+            upperBoundVisitsLeftForEarlyStop = std::min(upperBoundVisitsLeftForEarlyStop, upperBoundVisitsLeftDueToTime.load(std::memory_order_acquire));
+          if(isBestRootMoveDecided(upperBoundVisitsLeftForEarlyStop)) {
+            //Estimate time saved from whichever limit would have stopped us first
+            double now = timer.getSeconds();
+            double secondsLeft = 1e30;
+            if(hasTc)
+              secondsLeft = std::min(secondsLeft, tcMaxTime.load(std::memory_order_acquire) - now);
+            if(hasMaxTime)
+              secondsLeft = std::min(secondsLeft, maxTime - now);
+            double playoutsCapLeft = std::min((double)maxPlayouts - numPlayouts, (double)maxVisits - numPlayouts - numNonPlayoutVisits);
+            secondsLeft = std::min(secondsLeft, playoutsCapLeft * now / numPlayouts);
+            stoppedEarly = true;
+            secondsSavedByEarlyStop = std::max(0.0, secondsLeft);
+            shouldStopNow.store(true,std::memory_order_relaxed);
+            break;
+          }
+        }
+
         bool finishedPlayout = runSinglePlayout(*stbuf, upperBoundVisitsLeft);
         if(finishedPlayout) {
           numPlayouts = numPlayoutsShared.fetch_add((int64_t)1, std::memory_order_relaxed);
@@ -528,11 +607,27 @@ void Search::runWholeSearch(
   };
 
   double actualSearchStartTime = timer.getSeconds();
-  performTaskWithThreads(&searchLoop);
+  performTaskWithThreads(&searchLoop,false);
 
   //Relaxed load is fine since numPlayoutsShared should be synchronized already due to the joins
   lastSearchNumPlayouts = numPlayoutsShared.load(std::memory_order_relaxed);
-  effectiveSearchTimeCarriedOver += timer.getSeconds() - actualSearchStartTime;
+  lastSearchPlayoutSeconds = timer.getSeconds() - actualSearchStartTime;
+  effectiveSearchTimeCarriedOver += lastSearchPlayoutSeconds;
+  lastSearchStoppedEarly = stoppedEarly;
+  lastSearchSecondsSavedByEarlyStop = secondsSavedByEarlyStop;
+  if(checkEarlyStop) {
+    numSearchesCheckedForEarlyStop += 1;
+    if(stoppedEarly)
+      numSearchesStoppedEarly += 1;
+    totalSecondsSavedByEarlyStop += secondsSavedByEarlyStop;
+  }
+  //Searches stopped almost immediately say more about overhead than about the playout rate, and ponders are often
+  //stopped quickly by the opponent's move, or run in parallel with other work
+  if(!pondering && lastSearchPlayoutSeconds >= 0.01 && lastSearchNumPlayouts > 0) {
+    recentPlayoutsSum = recentPlayoutsSum * 0.75 + lastSearchNumPlayouts;
+    recentPlayoutSecondsSum = recentPlayoutSecondsSum * 0.75 + lastSearchPlayoutSeconds;
+  }
+
 }
 
 //If we're being asked to search from a position where the game is over, this is fine. Just keep going, the boardhistory
@@ -699,9 +794,9 @@ void Search::beginSearch(bool pondering) {
         newNumVisits += 1;
 
         //Set the visits in place
-        while(node.statsLock.test_and_set(std::memory_order_acquire));
+        beginNodeStatsWrite(node);
         node.stats.visits.store(newNumVisits,std::memory_order_release);
-        node.statsLock.clear(std::memory_order_release);
+        node.stats.endWrite();
 
         //Update all other stats
         recomputeNodeStats(node, dummyThread, 0, true);
@@ -831,10 +926,16 @@ void Search::removeSubtreeValueBias(SearchNode* node) {
 
 //Delete ALL nodes where nodeAge < searchNodeAge if old is true, else all nodes where nodeAge >= searchNodeAge
 //Also clears subtreevaluebias for deleted nodes.
+//Nodes are unlinked from the table here but actually freed by the nodeReclaimer, possibly in the background.
 void Search::deleteAllOldOrAllNewTableNodesAndSubtreeValueBiasMulithreaded(bool old) {
+  //Everything unreachable is about to be deleted, including anything makeMove left behind
+  if(old)
+    numUnsweptDiscardedNodes = 0;
   int numAdditionalThreads = numAdditionalThreadsToUseForTasks();
   assert(numAdditionalThreads >= 0);
+  std::vector<std::vector<SearchNode*>> nodesToDeleteByThread(numAdditionalThreads+1);
   std::function<void(int)> g = [&](int threadIdx) {
+    std::vector<SearchNode*>& nodesToDelete = nodesToDeleteByThread[threadIdx];
     size_t idx0 = (size_t)((uint64_t)(threadIdx) * nodeTable->entries.size() / (numAdditionalThreads+1));
     size_t idx1 = (size_t)((uint64_t)(threadIdx+1) * nodeTable->entries.size() / (numAdditionalThreads+1));
     for(size_t i = idx0; i<idx1; i++) {
@@ -843,7 +944,7 @@ void Search::deleteAllOldOrAllNewTableNodesAndSubtreeValueBiasMulithreaded(bool
         SearchNode* node = it->second;
         if(old == (node->nodeAge.load(std::memory_order_acquire) < searchNodeAge)) {
           removeSubtreeValueBias(node);
-          delete node;
+          nodesToDelete.push_back(node);
           it = nodeMap.erase(it);
         }
         else
@@ -852,25 +953,21 @@ void Search::deleteAllOldOrAllNewTableNodesAndSubtreeValueBiasMulithreaded(bool
     }
   };
   performTaskWithThreads(&g);
+
+  std::vector<SearchNode*> nodesToDelete = std::move(nodesToDeleteByThread[0]);
+  for(size_t i = 1; i<nodesToDeleteByThread.size(); i++)
+    nodesToDelete.insert(nodesToDelete.end(), nodesToDeleteByThread[i].begin(), nodesToDeleteByThread[i].end());
+  nodeReclaimer->reclaim(std::move(nodesToDelete));
 }
 
 //Delete ALL nodes. More efficient than deleteAllOldOrAllNewTableNodesAndSubtreeValueBiasMulithreaded if deleting everything.
 //Doesn't clear subtree value bias.
+//The whole table is swapped out for an empty one and handed to the nodeReclaimer, so this is cheap regardless of tree size.
 void Search::deleteAllTableNodesMulithreaded() {
-  int numAdditionalThreads = numAdditionalThreadsToUseForTasks();
-  assert(numAdditionalThreads >= 0);
-  std::function<void(int)> g = [&](int threadIdx) {
-    size_t idx0 = (size_t)((uint64_t)(threadIdx) * nodeTable->entries.size() / (numAdditionalThreads+1));
-    size_t idx1 = (size_t)((uint64_t)(threadIdx+1) * nodeTable->entries.size() / (numAdditionalThreads+1));
-    for(size_t i = idx0; i<idx1; i++) {
-      std::map<Hash128,SearchNode*>& nodeMap = nodeTable->entries[i];
-      for(auto it = nodeMap.cbegin(); it != nodeMap.cend(); ++it) {
-        delete it->second;
-      }
-      nodeMap.clear();
-    }
-  };
-  performTaskWithThreads(&g);
+  numUnsweptDiscardedNodes = 0;
+  std::vector<std::map<Hash128,SearchNode*>> oldEntries(nodeTable->entries.size());
+  oldEntries.swap(nodeTable->entries);
+  nodeReclaimer->reclaim(std::move(oldEntries));
 }
 
 //This function should NOT ever be called concurrently with any other threads modifying the search tree.
@@ -941,10 +1038,10 @@ void Search::recursivelyRecomputeStats(SearchNode& n) {
         newUtilityAvg += getPatternBonus(node->patternBonusHash,getOpp(node->nextPla));
         double newUtilitySqAvg = newUtilityAvg * newUtilityAvg;
 
-        while(node->statsLock.test_and_set(std::memory_order_acquire));
+        beginNodeStatsWrite(*node);
         node->stats.utilityAvg.store(newUtilityAvg,std::memory_order_release);
         node->stats.utilitySqAvg.store(newUtilitySqAvg,std::memory_order_release);
-        node->statsLock.clear(std::memory_order_release);
+        node->stats.endWrite();
       }
     }
     else {
@@ -969,6 +1066,8 @@ void Search::computeRootValues() {
     rootGraphHash = GraphHash::getGraphHashFromScratch(rootHistory, rootPla, searchParams.graphSearchRepBound, searchParams.drawEquivalentWinsForWhite);
   else
     rootGraphHash = Hash128();
+  //Without graph search every node is freshly allocated under a randomized hash, so there are no transpositions and no cycles.
+  graphSearchMayHaveCycles = searchParams.useGraphSearch && !GraphHash::isGraphAcyclic(rootHistory.rules);
 
   Player opponentWasMirroringPla = mirroringPla;
   //Update mirroringPla, mirrorAdvantage, mirrorCenterSymmetryError
@@ -1219,10 +1318,9 @@ bool Search::playoutDescend(
   //If somehow we find ourselves in a cycle, increment edge visits and terminate the playout.
   //Basically if the search likes a cycle... just reinforce playing around the cycle and hope we return something
   //reasonable in the end of the search.
-  {
-    std::pair<std::unordered_set<SearchNode*>::iterator,bool> result = thread.graphPath.insert(child);
-    //No insertion, child was already there
-    if(!result.second) {
+  if(graphSearchMayHaveCycles) {
+    //Child was already on the path
+    if(std::find(thread.graphPath.begin(), thread.graphPath.end(), child) != thread.graphPath.end()) {
       int childrenCapacity;
       SearchChildPointer* children = node.getChildren(nodeState,childrenCapacity);
       children[bestChildIdx].addEdgeVisits(1);
@@ -1230,6 +1328,7 @@ bool Search::playoutDescend(
       child->virtualLosses.fetch_add(-1,std::memory_order_release);
       return true;
     }
+    thread.graphPath.push_back(child);
   }
 
   //Recurse!
@@ -34,6 +34,8 @@ struct ReportedSearchValues;
 struct SearchChildPointer;
 struct SubtreeValueBiasTable;
 struct SearchNodeTable;
+struct SearchNodeReclaimer;
+struct SearchThreadPool;
 
 //Per-thread state
 struct SearchThread {
@@ -43,8 +45,9 @@ struct SearchThread {
   Board board;
   BoardHistory history;
   Hash128 graphHash;
-  //The path we trace down the graph as we do a playout
-  std::unordered_set<SearchNode*> graphPath;
+  //The path we trace down the graph as we do a playout, only tracked if the search graph may have cycles.
+  //Playouts are at most a few hundred nodes deep, so a flat array with a linear scan beats hashing.
+  std::vector<SearchNode*> graphPath;
 
   Rand rand;
 
@@ -78,6 +81,8 @@ struct Search {
   BoardHistory rootHistory;
   Hash128 rootGraphHash;
   Loc rootHintLoc;
+  //True if playouts must track graphPath to detect cycles. Only possible with graph search under rules that allow cycles.
+  bool graphSearchMayHaveCycles;
 
   //External user-specified moves that are illegal or that should be nontrivially searched, and the number of turns for which they should
   //be excluded. Empty if not active, else of length MAX_ARR_SIZE and nonzero anywhere a move should be banned, for the number of ply
@@ -105,7 +110,27 @@ struct Search {
   Player plaThatSearchIsFor;
   Player plaThatSearchIsForLastSearch;
   int64_t lastSearchNumPlayouts;
+  //Visits already at the root when the last search began, carried over from pondering or earlier searches by tree reuse
+  int64_t lastSearchStartingVisits;
+  //Whether the search running now, or else the last one, is a ponder
+  bool searchIsPondering;
+  //Wall time the last search spent running playouts, excluding setting up the search beforehand
+  double lastSearchPlayoutSeconds;
+  //Decaying sums over recent searches of playouts and of the wall time spent running them, for measuring the playout rate
+  double recentPlayoutsSum;
+  double recentPlayoutSecondsSum;
+  //Number of times during the last search that a thread waited on another thread writing the same node's stats,
+  //over all nodes and at the root alone.
+  std::atomic<int64_t> lastSearchStatsWriteSpins;
+  std::atomic<int64_t> lastSearchRootStatsWriteSpins;
   double effectiveSearchTimeCarriedOver; //Effective search time carried over from previous moves due to ponder/tree reuse
+  //Whether the last search was stopped by earlyStopIfDecided, and roughly how much of its planned time it didn't need
+  bool lastSearchStoppedEarly;
+  double lastSearchSecondsSavedByEarlyStop;
+  //Totals over the non-pondering searches that earlyStopIfDecided applied to
+  int64_t numSearchesCheckedForEarlyStop;
+  int64_t numSearchesStoppedEarly;
+  double totalSecondsSavedByEarlyStop;
 
   std::string randSeed;
 
@@ -142,12 +167,24 @@ struct Search {
   SearchNodeTable* nodeTable;
   MutexPool* mutexPool;
   SubtreeValueBiasTable* subtreeValueBiasTable;
+  //Frees nodes dropped by tree reuse or clearing in the background
+  SearchNodeReclaimer* nodeReclaimer;
+
+  //Wall time spent by the most recent makeMove or clearSearch that had a tree to discard, in seconds.
+  //This is the gap between searches that tree teardown adds, so it's worth watching on large trees.
+  double lastTreeTransitionSeconds;
+  //Upper bound on the number of nodes left in nodeTable that are no longer reachable from the root, because
+  //makeMove skipped sweeping the table for them.
+  int64_t numUnsweptDiscardedNodes;
 
   //Thread pool
   int numThreadsSpawned;
   std::thread* threads;
   ThreadSafeQueue<std::function<void(int)>*>* threadTasks;
   ThreadSafeCounter* threadTasksRemaining;
+  //If not NULL, threads are borrowed from here instead, and the above are unused. Not owned.
+  SearchThreadPool* sharedThreadPool;
+  int64_t sharedThreadPoolPriority;
 
   //Occasionally we may need to swap out an NNOutput from a node mid-search.
   //However, to prevent access-after-delete races, this vector collects them after a thread exits, and is cleaned up
@@ -201,6 +238,10 @@ struct Search {
   void setExternalPatternBonusTable(std::unique_ptr<PatternBonusTable>&& table);
   void setCopyOfExternalPatternBonusTable(const std::unique_ptr<PatternBonusTable>& table);
   void setNNEval(NNEvaluator* nnEval);
+  //Borrow threads from pool rather than spawning our own, competing with other searches using it at the given priority.
+  //searchParams.numThreads is then the most threads to use at once. pool must outlive this search, or be unset by passing NULL.
+  //searchmultithreadhelpers.cpp
+  void setSharedThreadPool(SearchThreadPool* pool, int64_t priority);
 
   //If the number of threads is reduced, this can free up some excess threads in the thread pool.
   //Calling this is never necessary, it may just reduce some resource use.
@@ -427,7 +468,8 @@ private:
   int numAdditionalThreadsToUseForTasks() const;
   void spawnThreadsIfNeeded();
   void killThreads();
-  void performTaskWithThreads(std::function<void(int)>* task);
+  //If !allThreadIdxsRequired, threadIdxs other than 0 may be skipped, or may stop early when borrowing from a shared pool.
+  void performTaskWithThreads(std::function<void(int)>* task, bool allThreadIdxsRequired = true);
 
   void applyRecursivelyPostOrderMulithreaded(const std::vector<SearchNode*>& nodes, std::function<void(SearchNode*,int)>* f);
   void applyRecursivelyPostOrderMulithreadedHelper(
@@ -451,6 +493,15 @@ private:
     int64_t rootVisits, double timeUsed, double plannedTimeLimit
   );
   double recomputeSearchTimeLimit(const TimeControls& tc, double timeUsed, double searchFactor, int64_t rootVisits);
+  //True if no root child other than the one with the most visits could catch up to it with this many more visits,
+  //and with useLcbForSelection, if that child is also sure to stay the one selected by LCB. Never true with move temperature.
+  bool isBestRootMoveDecided(double upperBoundVisitsLeft) const;
+public:
+  //Playouts per second over recent searches, weighted towards the latest ones, or 0 if none have been measured yet.
+  double getMeasuredPlayoutsPerSecond() const;
+  //Turns left in the game by both players to plan time controls on, or -1 to go by the time controls' own crude estimate.
+  double estimateGameTurnsLeftForTime() const;
+private:
 
   //----------------------------------------------------------------------------------------
   // Neural net queries
@@ -531,6 +582,7 @@ private:
 
   void updateStatsAfterPlayout(SearchNode& node, SearchThread& thread, bool isRoot);
   void recomputeNodeStats(SearchNode& node, SearchThread& thread, int32_t numVisitsToAdd, bool isRoot);
+  void beginNodeStatsWrite(SearchNode& node);
 
   void downweightBadChildrenAndNormalizeWeight(
     int numChildren,
@@ -93,16 +93,13 @@ double Search::getExploreSelectionValueOfChild(
   float nnPolicyProb = parentPolicyProbs[movePos];
 
   int32_t childVirtualLosses = child->virtualLosses.load(std::memory_order_acquire);
-  int64_t childVisits = child->stats.visits.load(std::memory_order_acquire);
-  double utilityAvg = child->stats.utilityAvg.load(std::memory_order_acquire);
-  double scoreMeanAvg = child->stats.scoreMeanAvg.load(std::memory_order_acquire);
-  double scoreMeanSqAvg = child->stats.scoreMeanSqAvg.load(std::memory_order_acquire);
-  double childWeight = child->stats.getChildWeight(childEdgeVisits,childVisits);
+  const NodeStats childStats(child->stats);
+  int64_t childVisits = childStats.visits;
+  double utilityAvg = childStats.utilityAvg;
+  double childWeight = NodeStats::childWeight(childEdgeVisits,childVisits,childStats.weightSum);
 
   //It's possible that childVisits is actually 0 here with multithreading because we're visiting this node while a child has
   //been expanded but its thread not yet finished its first visit.
-  //It's also possible that we observe childWeight <= 0 even though childVisits >= due to multithreading, the two could
-  //be out of sync briefly since they are separate atomics.
   double childUtility;
   if(childVisits <= 0 || childWeight <= 0.0)
     childUtility = fpuValue;
@@ -207,14 +204,12 @@ double Search::getReducedPlaySelectionWeight(
   int movePos = getPos(moveLoc);
   float nnPolicyProb = parentPolicyProbs[movePos];
 
-  int64_t childVisits = child->stats.visits.load(std::memory_order_acquire);
-  double scoreMeanAvg = child->stats.scoreMeanAvg.load(std::memory_order_acquire);
-  double scoreMeanSqAvg = child->stats.scoreMeanSqAvg.load(std::memory_order_acquire);
-  double utilityAvg = child->stats.utilityAvg.load(std::memory_order_acquire);
-  double childWeight = child->stats.getChildWeight(childEdgeVisits,childVisits);
+  const NodeStats childStats(child->stats);
+  int64_t childVisits = childStats.visits;
+  double utilityAvg = childStats.utilityAvg;
+  double childWeight = NodeStats::childWeight(childEdgeVisits,childVisits,childStats.weightSum);
 
   //Child visits may be 0 if this function is called in a multithreaded context, such as during live analysis
-  //Child weight may also be 0 if it's out of sync.
   if(childVisits <= 0 || childWeight <= 0.0)
     return 0;
 
@@ -232,10 +227,11 @@ double Search::getFpuValueForChildrenAssumeVisited(
   const SearchNode& node, Player pla, bool isRoot, double policyProbMassVisited,
   double& parentUtility, double& parentWeightPerVisit, double& parentUtilityStdevFactor
 ) const {
-  int64_t visits = node.stats.visits.load(std::memory_order_acquire);
-  double weightSum = node.stats.weightSum.load(std::memory_order_acquire);
-  double utilityAvg = node.stats.utilityAvg.load(std::memory_order_acquire);
-  double utilitySqAvg = node.stats.utilitySqAvg.load(std::memory_order_acquire);
+  const NodeStats nodeStats(node.stats);
+  int64_t visits = nodeStats.visits;
+  double weightSum = nodeStats.weightSum;
+  double utilityAvg = nodeStats.utilityAvg;
+  double utilitySqAvg = nodeStats.utilitySqAvg;
 
   assert(visits > 0);
   assert(weightSum > 0.0);
@@ -340,6 +336,14 @@ void Search::selectBestChildToDescend(
   std::fill(posesWithChildBuf,posesWithChildBuf+NNPos::MAX_NN_POLICY_SIZE,false);
   bool antiMirror = searchParams.antiMirror && mirroringPla != C_EMPTY && isMirroringSinceSearchStart(thread.history,0);
 
+  //When pondering, sometimes pick among the opponent's replies in proportion to a power of their visits instead, as an
+  //estimate of how likely each is to be played, sharpened toward the likeliest ones. Sampled in one pass over the children
+  //as we go, among those not illegal or futile-pruned.
+  bool sampleByVisits = isRoot && searchIsPondering && searchParams.ponderingReplyFocus > 0 && thread.rand.nextBool(searchParams.ponderingReplyFocus);
+  double sampledWeightTotal = 0.0;
+  int sampledChildIdx = -1;
+  Loc sampledChildMoveLoc = Board::NULL_LOC;
+
   //Try all existing children
   //Also count how many children we actually find
   numChildrenFound = 0;
@@ -370,9 +374,23 @@ void Search::selectBestChildToDescend(
       bestChildIdx = i;
       bestChildMoveLoc = moveLoc;
     }
+    if(sampleByVisits && childEdgeVisits > 0 && selectionValue > FUTILE_VISITS_PRUNE_VALUE) {
+      double weight = pow((double)childEdgeVisits, searchParams.ponderingReplyFocusExponent);
+      sampledWeightTotal += weight;
+      if(thread.rand.nextDouble() * sampledWeightTotal < weight) {
+        sampledChildIdx = i;
+        sampledChildMoveLoc = moveLoc;
+      }
+    }
 
     posesWithChildBuf[getPos(moveLoc)] = true;
   }
+  //Children forced by the root hacks in getExploreSelectionValueOfChild (1e20) still take priority over the sample
+  if(sampledChildIdx >= 0 && maxSelectionValue < 1e20) {
+    bestChildIdx = sampledChildIdx;
+    bestChildMoveLoc = sampledChildMoveLoc;
+    return;
+  }
 
   const std::vector<int>& avoidMoveUntilByLoc = thread.pla == P_BLACK ? avoidMoveUntilByLocBlack : avoidMoveUntilByLocWhite;
 
@@ -269,13 +269,14 @@ double Search::getNormToTApproxForLCB(int64_t numVisits) const {
 }
 
 void Search::getSelfUtilityLCBAndRadius(const SearchNode& parent, const SearchNode* child, int64_t edgeVisits, Loc moveLoc, double& lcbBuf, double& radiusBuf) const {
-  int64_t childVisits = child->stats.visits.load(std::memory_order_acquire);
-  double scoreMeanAvg = child->stats.scoreMeanAvg.load(std::memory_order_acquire);
-  double scoreMeanSqAvg = child->stats.scoreMeanSqAvg.load(std::memory_order_acquire);
-  double utilityAvg = child->stats.utilityAvg.load(std::memory_order_acquire);
-  double utilitySqAvg = child->stats.utilitySqAvg.load(std::memory_order_acquire);
-  double weightSum = child->stats.getChildWeight(edgeVisits,childVisits);
-  double weightSqSum = child->stats.getChildWeightSq(edgeVisits,childVisits);
+  const NodeStats childStats(child->stats);
+  int64_t childVisits = childStats.visits;
+  double scoreMeanAvg = childStats.scoreMeanAvg;
+  double scoreMeanSqAvg = childStats.scoreMeanSqAvg;
+  double utilityAvg = childStats.utilityAvg;
+  double utilitySqAvg = childStats.utilitySqAvg;
+  double weightSum = NodeStats::childWeight(edgeVisits,childVisits,childStats.weightSum);
+  double weightSqSum = NodeStats::childWeightSq(edgeVisits,childVisits,childStats.weightSqSum);
 
   radiusBuf = 2.0 * (searchParams.winLossUtilityFactor + searchParams.staticScoreUtilityFactor + searchParams.dynamicScoreUtilityFactor);
   lcbBuf = -radiusBuf;
@@ -1,6 +1,7 @@
 #include "../search/search.h"
 
 #include "../search/searchnode.h"
+#include "../search/searchthreadpool.h"
 
 //------------------------
 #include "../core/using.h"
@@ -40,7 +41,16 @@ int Search::numAdditionalThreadsToUseForTasks() const {
   return searchParams.numThreads-1;
 }
 
+void Search::setSharedThreadPool(SearchThreadPool* pool, int64_t priority) {
+  sharedThreadPool = pool;
+  sharedThreadPoolPriority = priority;
+  if(sharedThreadPool != NULL)
+    killThreads();
+}
+
 void Search::spawnThreadsIfNeeded() {
+  if(sharedThreadPool != NULL)
+    return;
   int desiredNumAdditionalThreads = numAdditionalThreadsToUseForTasks();
   if(numThreadsSpawned >= desiredNumAdditionalThreads)
     return;
@@ -74,7 +84,11 @@ void Search::respawnThreads() {
   spawnThreadsIfNeeded();
 }
 
-void Search::performTaskWithThreads(std::function<void(int)>* task) {
+void Search::performTaskWithThreads(std::function<void(int)>* task, bool allThreadIdxsRequired) {
+  if(sharedThreadPool != NULL) {
+    sharedThreadPool->runTask(task, numAdditionalThreadsToUseForTasks()+1, allThreadIdxsRequired, sharedThreadPoolPriority);
+    return;
+  }
   spawnThreadsIfNeeded();
   int numAdditionalThreadsToUse = numAdditionalThreadsToUseForTasks();
   if(numAdditionalThreadsToUse <= 0) {
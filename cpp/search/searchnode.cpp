@@ -3,7 +3,8 @@
 #include "../search/search.h"
 
 NodeStatsAtomic::NodeStatsAtomic()
-  :visits(0),
+  :version(0),
+   visits(0),
    winLossValueAvg(0.0),
    noResultValueAvg(0.0),
    scoreMeanAvg(0.0),
@@ -15,17 +16,21 @@ NodeStatsAtomic::NodeStatsAtomic()
    weightSqSum(0.0)
 {}
 NodeStatsAtomic::NodeStatsAtomic(const NodeStatsAtomic& other)
-  :visits(other.visits.load(std::memory_order_acquire)),
-   winLossValueAvg(other.winLossValueAvg.load(std::memory_order_acquire)),
-   noResultValueAvg(other.noResultValueAvg.load(std::memory_order_acquire)),
-   scoreMeanAvg(other.scoreMeanAvg.load(std::memory_order_acquire)),
-   scoreMeanSqAvg(other.scoreMeanSqAvg.load(std::memory_order_acquire)),
-   leadAvg(other.leadAvg.load(std::memory_order_acquire)),
-   utilityAvg(other.utilityAvg.load(std::memory_order_acquire)),
-   utilitySqAvg(other.utilitySqAvg.load(std::memory_order_acquire)),
-   weightSum(other.weightSum.load(std::memory_order_acquire)),
-   weightSqSum(other.weightSqSum.load(std::memory_order_acquire))
-{}
+  :NodeStatsAtomic()
+{
+  NodeStats snapshot(other);
+  visits.store(snapshot.visits,std::memory_order_relaxed);
+  winLossValueAvg.store(snapshot.winLossValueAvg,std::memory_order_relaxed);
+  noResultValueAvg.store(snapshot.noResultValueAvg,std::memory_order_relaxed);
+  scoreMeanAvg.store(snapshot.scoreMeanAvg,std::memory_order_relaxed);
+  scoreMeanSqAvg.store(snapshot.scoreMeanSqAvg,std::memory_order_relaxed);
+  leadAvg.store(snapshot.leadAvg,std::memory_order_relaxed);
+  utilityAvg.store(snapshot.utilityAvg,std::memory_order_relaxed);
+  utilitySqAvg.store(snapshot.utilitySqAvg,std::memory_order_relaxed);
+  weightSum.store(snapshot.weightSum,std::memory_order_relaxed);
+  weightSqSum.store(snapshot.weightSqSum,std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
 NodeStatsAtomic::~NodeStatsAtomic()
 {}
 
@@ -41,18 +46,26 @@ NodeStats::NodeStats()
    weightSum(0.0),
    weightSqSum(0.0)
 {}
-NodeStats::NodeStats(const NodeStatsAtomic& other)
-  :visits(other.visits.load(std::memory_order_acquire)),
-   winLossValueAvg(other.winLossValueAvg.load(std::memory_order_acquire)),
-   noResultValueAvg(other.noResultValueAvg.load(std::memory_order_acquire)),
-   scoreMeanAvg(other.scoreMeanAvg.load(std::memory_order_acquire)),
-   scoreMeanSqAvg(other.scoreMeanSqAvg.load(std::memory_order_acquire)),
-   leadAvg(other.leadAvg.load(std::memory_order_acquire)),
-   utilityAvg(other.utilityAvg.load(std::memory_order_acquire)),
-   utilitySqAvg(other.utilitySqAvg.load(std::memory_order_acquire)),
-   weightSum(other.weightSum.load(std::memory_order_acquire)),
-   weightSqSum(other.weightSqSum.load(std::memory_order_acquire))
-{}
+NodeStats::NodeStats(const NodeStatsAtomic& other) {
+  //Retry until we read all the fields without a write happening in between.
+  while(true) {
+    uint32_t version0 = other.version.load(std::memory_order_acquire);
+    visits = other.visits.load(std::memory_order_relaxed);
+    winLossValueAvg = other.winLossValueAvg.load(std::memory_order_relaxed);
+    noResultValueAvg = other.noResultValueAvg.load(std::memory_order_relaxed);
+    scoreMeanAvg = other.scoreMeanAvg.load(std::memory_order_relaxed);
+    scoreMeanSqAvg = other.scoreMeanSqAvg.load(std::memory_order_relaxed);
+    leadAvg = other.leadAvg.load(std::memory_order_relaxed);
+    utilityAvg = other.utilityAvg.load(std::memory_order_relaxed);
+    utilitySqAvg = other.utilitySqAvg.load(std::memory_order_relaxed);
+    weightSum = other.weightSum.load(std::memory_order_relaxed);
+    weightSqSum = other.weightSqSum.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint32_t version1 = other.version.load(std::memory_order_relaxed);
+    if((version0 & 1) == 0 && version0 == version1)
+      break;
+  }
+}
 NodeStats::~NodeStats()
 {}
 
@@ -11,7 +11,11 @@
 struct SearchNode;
 struct SearchThread;
 
+//Versioned like a seqlock. The version is odd while a write is in progress, so a reader that sees the same even
+//version before and after loading the fields got a consistent snapshot of all of them. Individual fields are still
+//atomics so that callers that only need one field can load it directly without consulting the version.
 struct NodeStatsAtomic {
+  std::atomic<uint32_t> version;
   std::atomic<int64_t> visits;
   std::atomic<double> winLossValueAvg;
   std::atomic<double> noResultValueAvg;
@@ -35,6 +39,12 @@ struct NodeStatsAtomic {
   double getChildWeight(int64_t edgeVisits, int64_t childVisits) const;
   double getChildWeightSq(int64_t edgeVisits) const;
   double getChildWeightSq(int64_t edgeVisits, int64_t childVisits) const;
+
+  //Writes must be bracketed by these. Concurrent writers to the same node are rare since only the thread that
+  //claims a node's dirtyCounter recomputes its stats, but they are still excluded from each other.
+  //Returns the number of times we had to wait on another writer.
+  int64_t beginWrite();
+  void endWrite();
 };
 
 struct NodeStats {
@@ -82,6 +92,22 @@ inline double NodeStatsAtomic::getChildWeightSq(int64_t edgeVisits, int64_t chil
   return NodeStats::childWeightSq(edgeVisits, childVisits, weightSqSum.load(std::memory_order_acquire));
 }
 
+inline int64_t NodeStatsAtomic::beginWrite() {
+  int64_t numSpins = 0;
+  uint32_t v = version.load(std::memory_order_relaxed);
+  while(true) {
+    if((v & 1) == 0 && version.compare_exchange_weak(v, v+1, std::memory_order_acquire, std::memory_order_relaxed))
+      break;
+    numSpins += 1;
+    v = version.load(std::memory_order_relaxed);
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+  return numSpins;
+}
+inline void NodeStatsAtomic::endWrite() {
+  version.fetch_add(1, std::memory_order_release);
+}
+
 
 struct MoreNodeStats {
   NodeStats stats;
@@ -135,9 +161,6 @@ public:
 };
 
 struct SearchNode {
-  //Locks------------------------------------------------------------------------------
-  mutable std::atomic_flag statsLock = ATOMIC_FLAG_INIT;
-
   //Constant during search--------------------------------------------------------------
   const Player nextPla;
   const bool forceNonTerminal;
@@ -178,7 +201,7 @@ struct SearchNode {
   static constexpr int CHILDREN2SIZE = NNPos::MAX_NN_POLICY_SIZE;
 
   //Lightweight mutable---------------------------------------------------------------
-  //Protected under statsLock for writing
+  //Written between stats.beginWrite() and stats.endWrite()
   NodeStatsAtomic stats;
   std::atomic<int32_t> virtualLosses;
 
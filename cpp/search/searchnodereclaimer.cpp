@@ -0,0 +1,124 @@
+#include "../search/searchnodereclaimer.h"
+
+#include "../search/searchnode.h"
+
+using namespace std;
+
+SearchNodeReclaimer::SearchNodeReclaimer()
+  :mutex(),
+   batchAddedCondVar(),
+   batchDoneCondVar(),
+   batches(),
+   thread(),
+   threadSpawned(false),
+   shouldStop(false),
+   lastEpochStarted(0),
+   lastEpochReclaimed(0),
+   nodesPending(0)
+{}
+
+SearchNodeReclaimer::~SearchNodeReclaimer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    shouldStop = true;
+    batchAddedCondVar.notify_all();
+  }
+  //The loop drains all remaining batches before exiting
+  if(threadSpawned)
+    thread.join();
+  assert(batches.size() == 0);
+}
+
+void SearchNodeReclaimer::deleteBatch(Batch* batch) {
+  for(SearchNode* node: batch->nodes)
+    delete node;
+  for(std::map<Hash128,SearchNode*>& nodeMap: batch->tableEntries) {
+    for(auto it = nodeMap.cbegin(); it != nodeMap.cend(); ++it)
+      delete it->second;
+  }
+  delete batch;
+}
+
+uint64_t SearchNodeReclaimer::enqueue(Batch* batch, int64_t numNodes) {
+  std::lock_guard<std::mutex> lock(mutex);
+  lastEpochStarted += 1;
+  batch->epoch = lastEpochStarted;
+  uint64_t epoch = batch->epoch;
+  if(numNodes < (int64_t)MIN_NODES_TO_RECLAIM_ASYNC && lastEpochReclaimed + 1 == epoch) {
+    //Not worth handing off, and nothing earlier is outstanding so epochs still complete in order.
+    //Small enough that it's fine to hold the lock while freeing.
+    deleteBatch(batch);
+    lastEpochReclaimed = epoch;
+    batchDoneCondVar.notify_all();
+    return epoch;
+  }
+
+  if(!threadSpawned) {
+    thread = std::thread(&SearchNodeReclaimer::runLoop, this);
+    threadSpawned = true;
+  }
+  nodesPending += numNodes;
+  batches.push_back(batch);
+  batchAddedCondVar.notify_all();
+  return epoch;
+}
+
+uint64_t SearchNodeReclaimer::reclaim(std::vector<SearchNode*>&& nodes) {
+  Batch* batch = new Batch();
+  batch->nodes = std::move(nodes);
+  return enqueue(batch, (int64_t)batch->nodes.size());
+}
+
+uint64_t SearchNodeReclaimer::reclaim(std::vector<std::map<Hash128,SearchNode*>>&& tableEntries) {
+  Batch* batch = new Batch();
+  batch->tableEntries = std::move(tableEntries);
+  int64_t numNodes = 0;
+  for(const std::map<Hash128,SearchNode*>& nodeMap: batch->tableEntries)
+    numNodes += (int64_t)nodeMap.size();
+  return enqueue(batch, numNodes);
+}
+
+void SearchNodeReclaimer::waitUntilReclaimed(uint64_t epoch) {
+  std::unique_lock<std::mutex> lock(mutex);
+  while(lastEpochReclaimed < epoch)
+    batchDoneCondVar.wait(lock);
+}
+
+void SearchNodeReclaimer::waitUntilAllReclaimed() {
+  uint64_t epoch;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    epoch = lastEpochStarted;
+  }
+  waitUntilReclaimed(epoch);
+}
+
+int64_t SearchNodeReclaimer::numNodesPending() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return nodesPending;
+}
+
+void SearchNodeReclaimer::runLoop() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while(true) {
+    while(batches.size() == 0 && !shouldStop)
+      batchAddedCondVar.wait(lock);
+    if(batches.size() == 0)
+      return;
+
+    Batch* batch = batches.front();
+    batches.pop_front();
+    uint64_t epoch = batch->epoch;
+    int64_t numNodes = (int64_t)batch->nodes.size();
+    for(const std::map<Hash128,SearchNode*>& nodeMap: batch->tableEntries)
+      numNodes += (int64_t)nodeMap.size();
+
+    lock.unlock();
+    deleteBatch(batch);
+    lock.lock();
+
+    nodesPending -= numNodes;
+    lastEpochReclaimed = epoch;
+    batchDoneCondVar.notify_all();
+  }
+}
@@ -0,0 +1,64 @@
+#ifndef SEARCH_SEARCHNODERECLAIMER_H_
+#define SEARCH_SEARCHNODERECLAIMER_H_
+
+#include <deque>
+
+#include "../core/global.h"
+#include "../core/hash.h"
+#include "../core/multithread.h"
+
+struct SearchNode;
+
+//Deletes search nodes that are no longer part of the search on a background thread, so that tree reuse and
+//search clearing only need to unlink the old nodes before the next search can begin.
+//
+//Callers must only hand off nodes that are already unreachable - removed from the SearchNodeTable, and not the child
+//of any node still in the search, so that no table lookup or tree walk can return them again. Each handoff is assigned
+//an increasing epoch, and waitUntilReclaimed can be used to wait until everything up to some epoch has been freed.
+//Handoffs too small to be worth a thread switch are freed synchronously.
+struct SearchNodeReclaimer {
+  static constexpr size_t MIN_NODES_TO_RECLAIM_ASYNC = 4096;
+
+  SearchNodeReclaimer();
+  //Blocks until all nodes handed off have been freed.
+  ~SearchNodeReclaimer();
+
+  SearchNodeReclaimer(const SearchNodeReclaimer&) = delete;
+  SearchNodeReclaimer& operator=(const SearchNodeReclaimer&) = delete;
+
+  //Take ownership of and delete the specified nodes. Returns the epoch of this handoff.
+  uint64_t reclaim(std::vector<SearchNode*>&& nodes);
+  //Take ownership of and delete every node in the specified node table entries. Returns the epoch of this handoff.
+  uint64_t reclaim(std::vector<std::map<Hash128,SearchNode*>>&& tableEntries);
+
+  void waitUntilReclaimed(uint64_t epoch);
+  void waitUntilAllReclaimed();
+
+  //Number of nodes handed off so far but not freed yet.
+  int64_t numNodesPending();
+
+private:
+  struct Batch {
+    uint64_t epoch;
+    std::vector<SearchNode*> nodes;
+    std::vector<std::map<Hash128,SearchNode*>> tableEntries;
+  };
+
+  std::mutex mutex;
+  std::condition_variable batchAddedCondVar;
+  std::condition_variable batchDoneCondVar;
+  std::deque<Batch*> batches;
+  std::thread thread;
+  bool threadSpawned;
+  bool shouldStop;
+  uint64_t lastEpochStarted;
+  uint64_t lastEpochReclaimed;
+  int64_t nodesPending;
+
+  uint64_t enqueue(Batch* batch, int64_t numNodes);
+  void runLoop();
+
+  static void deleteBatch(Batch* batch);
+};
+
+#endif  // SEARCH_SEARCHNODERECLAIMER_H_
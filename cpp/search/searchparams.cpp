@@ -76,6 +76,8 @@ SearchParams::SearchParams()
    maxVisitsPondering(((int64_t)1) << 50),
    maxPlayoutsPondering(((int64_t)1) << 50),
    maxTimePondering(1.0e20),
+   ponderingReplyFocus(0.0),
+   ponderingReplyFocusExponent(2.0),
    lagBuffer(0.0),
    searchFactorAfterOnePass(1.0),
    searchFactorAfterTwoPass(1.0),
@@ -84,10 +86,12 @@ SearchParams::SearchParams()
    midgameTimeFactor(1.0),
    midgameTurnPeakTime(130.0),
    endgameTurnTimeDecay(100.0),
+   estimateTurnsLeftFromPosition(false),
    obviousMovesTimeFactor(1.0),
    obviousMovesPolicyEntropyTolerance(0.30),
    obviousMovesPolicySurpriseTolerance(0.15),
-   futileVisitsThreshold(0.0)
+   futileVisitsThreshold(0.0),
+   earlyStopIfDecided(false)
 {}
 
 SearchParams::~SearchParams()
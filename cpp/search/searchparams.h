@@ -106,6 +106,12 @@ struct SearchParams {
   int64_t maxVisitsPondering;
   int64_t maxPlayoutsPondering;
   double maxTimePondering;
+  //When pondering, the proportion of playouts that descend into the opponent's replies in proportion to their visits so far
+  //rather than by the usual selection, so that more of the tree is kept for the replies the opponent is likely to play
+  double ponderingReplyFocus;
+  //Those playouts pick replies in proportion to visits to this power. Visits alone just reproduce the usual selection,
+  //so this should be greater than 1 to concentrate on the most likely replies.
+  double ponderingReplyFocusExponent;
 
   //Amount of time to reserve for lag when using a time control
   double lagBuffer;
@@ -120,11 +126,13 @@ struct SearchParams {
   double midgameTimeFactor; //Think this factor longer in the midgame, proportional to midgame weight
   double midgameTurnPeakTime; //The turn considered to have midgame weight 1.0, rising up from 0.0 in the opening, for 19x19
   double endgameTurnTimeDecay; //The scale of exponential decay of midgame weight back to 1.0, for 19x19
+  bool estimateTurnsLeftFromPosition; //Plan time on the game lasting as long as hex games do from the root's emptiness and net's varTimeLeft. Also bounds early visits left by the recent playout rate, for futile pruning
   double obviousMovesTimeFactor; //Think up to this factor longer on obvious moves, weighted by obviousness
   double obviousMovesPolicyEntropyTolerance; //What entropy does the policy need to be at most to be (1/e) obvious?
   double obviousMovesPolicySurpriseTolerance; //What logits of surprise does the search result need to be at most to be (1/e) obvious?
 
   double futileVisitsThreshold; //If a move would not be able to match this proportion of the max visits move in the time or visit or playout cap remaining, prune it.
+  bool earlyStopIfDecided; //Stop searching once no other move can catch up in visits (or LCB, with useLcbForSelection) with the most visited one in the time or visit or playout cap remaining.
 
 
   SearchParams();
@@ -340,14 +340,15 @@ bool Search::getNodeRawNNValues(const SearchNode& node, ReportedSearchValues& va
 bool Search::getNodeValues(const SearchNode* node, ReportedSearchValues& values) const {
   if(node == NULL)
     return false;
-  int64_t visits = node->stats.visits.load(std::memory_order_acquire);
-  double weightSum = node->stats.weightSum.load(std::memory_order_acquire);
-  double winLossValueAvg = node->stats.winLossValueAvg.load(std::memory_order_acquire);
-  double noResultValueAvg = node->stats.noResultValueAvg.load(std::memory_order_acquire);
-  double scoreMeanAvg = node->stats.scoreMeanAvg.load(std::memory_order_acquire);
-  double scoreMeanSqAvg = node->stats.scoreMeanSqAvg.load(std::memory_order_acquire);
-  double leadAvg = node->stats.leadAvg.load(std::memory_order_acquire);
-  double utilityAvg = node->stats.utilityAvg.load(std::memory_order_acquire);
+  const NodeStats nodeStats(node->stats);
+  int64_t visits = nodeStats.visits;
+  double weightSum = nodeStats.weightSum;
+  double winLossValueAvg = nodeStats.winLossValueAvg;
+  double noResultValueAvg = nodeStats.noResultValueAvg;
+  double scoreMeanAvg = nodeStats.scoreMeanAvg;
+  double scoreMeanSqAvg = nodeStats.scoreMeanSqAvg;
+  double leadAvg = nodeStats.leadAvg;
+  double utilityAvg = nodeStats.utilityAvg;
 
   if(weightSum <= 0.0)
     return false;
@@ -643,16 +644,17 @@ AnalysisData Search::getAnalysisDataOfSingleChild(
   double weightSqSum = 0.0;
 
   if(child != NULL) {
-    childVisits = child->stats.visits.load(std::memory_order_acquire);
-    winLossValueAvg = child->stats.winLossValueAvg.load(std::memory_order_acquire);
-    noResultValueAvg = child->stats.noResultValueAvg.load(std::memory_order_acquire);
-    scoreMeanAvg = child->stats.scoreMeanAvg.load(std::memory_order_acquire);
-    scoreMeanSqAvg = child->stats.scoreMeanSqAvg.load(std::memory_order_acquire);
-    leadAvg = child->stats.leadAvg.load(std::memory_order_acquire);
-    utilityAvg = child->stats.utilityAvg.load(std::memory_order_acquire);
-    utilitySqAvg = child->stats.utilitySqAvg.load(std::memory_order_acquire);
-    weightSum = child->stats.getChildWeight(edgeVisits,childVisits);
-    weightSqSum = child->stats.getChildWeightSq(edgeVisits,childVisits);
+    const NodeStats childStats(child->stats);
+    childVisits = childStats.visits;
+    winLossValueAvg = childStats.winLossValueAvg;
+    noResultValueAvg = childStats.noResultValueAvg;
+    scoreMeanAvg = childStats.scoreMeanAvg;
+    scoreMeanSqAvg = childStats.scoreMeanSqAvg;
+    leadAvg = childStats.leadAvg;
+    utilityAvg = childStats.utilityAvg;
+    utilitySqAvg = childStats.utilitySqAvg;
+    weightSum = NodeStats::childWeight(edgeVisits,childVisits,childStats.weightSum);
+    weightSqSum = NodeStats::childWeightSq(edgeVisits,childVisits,childStats.weightSqSum);
   }
 
   AnalysisData data;
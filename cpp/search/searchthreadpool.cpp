@@ -0,0 +1,229 @@
+#include "../search/searchthreadpool.h"
+
+#include <algorithm>
+
+//------------------------
+#include "../core/using.h"
+//------------------------
+
+//The pool and job that the current thread is lent to, if it's a pool thread in a task
+static thread_local SearchThreadPool* currentThreadPool = NULL;
+static thread_local void* currentThreadJob = NULL;
+static thread_local bool currentThreadReturning = false;
+
+SearchThreadPool::SearchThreadPool(int maxTotal)
+  :maxTotalThreads(maxTotal),
+   threads(),
+   mutex(),
+   workAvailableCondVar(),
+   poolThreadLeftCondVar(),
+   shouldStop(false),
+   jobs(),
+   numThreadsReturned(0)
+{
+  if(maxTotalThreads <= 0)
+    throw StringError("SearchThreadPool: maxTotalThreads must be positive: " + Global::intToString(maxTotalThreads));
+  //Every task has its caller, so at most this many can be lent at once
+  for(int i = 0; i<maxTotalThreads-1; i++)
+    threads.push_back(std::thread(&SearchThreadPool::runLoop, this));
+}
+
+SearchThreadPool::~SearchThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    assert(jobs.size() == 0);
+    shouldStop = true;
+  }
+  workAvailableCondVar.notify_all();
+  for(size_t i = 0; i<threads.size(); i++)
+    threads[i].join();
+}
+
+int SearchThreadPool::getMaxTotalThreads() const {
+  return maxTotalThreads;
+}
+
+int64_t SearchThreadPool::getNumThreadsReturned() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return numThreadsReturned;
+}
+
+//Recompute how many pool threads each job should have. Call with mutex held whenever jobs are added or removed,
+//or the number of threads a job could use changes.
+void SearchThreadPool::rebalance() {
+  int budget = std::min((int)threads.size(), maxTotalThreads - (int)jobs.size());
+  for(Job* job: jobs)
+    job->targetNumPoolThreads = 0;
+
+  //Jobs of each priority in turn from the highest, giving one thread at a time to each job of that priority
+  //that can still use one, until we run out.
+  size_t start = 0;
+  while(start < jobs.size() && budget > 0) {
+    size_t end = start;
+    while(end < jobs.size() && jobs[end]->priority == jobs[start]->priority)
+      end++;
+    while(budget > 0) {
+      bool anyGiven = false;
+      for(size_t i = start; i<end && budget > 0; i++) {
+        Job* job = jobs[i];
+        int maxUsable = std::min(job->numThreadIdxs - 1, job->numPoolThreadsLent + (int)job->unstartedThreadIdxs.size());
+        if(job->targetNumPoolThreads < maxUsable) {
+          job->targetNumPoolThreads += 1;
+          budget -= 1;
+          anyGiven = true;
+        }
+      }
+      if(!anyGiven)
+        break;
+    }
+    start = end;
+  }
+
+  for(Job* job: jobs)
+    job->numExcessThreads.store(std::max(0, job->numPoolThreadsLent - job->targetNumPoolThreads), std::memory_order_release);
+}
+
+SearchThreadPool::Job* SearchThreadPool::findJobWantingThread() {
+  for(Job* job: jobs) {
+    if(job->numPoolThreadsLent < job->targetNumPoolThreads && job->unstartedThreadIdxs.size() > 0)
+      return job;
+  }
+  return NULL;
+}
+
+void SearchThreadPool::runLoop() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while(true) {
+    if(shouldStop)
+      break;
+    Job* job = findJobWantingThread();
+    if(job == NULL) {
+      workAvailableCondVar.wait(lock);
+      continue;
+    }
+    int threadIdx = job->unstartedThreadIdxs.back();
+    job->unstartedThreadIdxs.pop_back();
+    job->numPoolThreadsLent += 1;
+    job->numPoolThreadsInTask += 1;
+    lock.unlock();
+
+    currentThreadPool = this;
+    currentThreadJob = job;
+    currentThreadReturning = false;
+    std::exception_ptr error = nullptr;
+    try {
+      (*job->task)(threadIdx);
+    }
+    catch(...) {
+      error = std::current_exception();
+    }
+    const bool returned = currentThreadReturning;
+    currentThreadPool = NULL;
+    currentThreadJob = NULL;
+    currentThreadReturning = false;
+
+    lock.lock();
+    if(error != nullptr && job->firstError == nullptr)
+      job->firstError = error;
+    //A thread that was taken back no longer counted towards the job already.
+    //Let another thread pick up where it left off, if the job gets more threads again. Threads are only taken back
+    //from jobs that don't require every threadIdx, so it's fine whether the threadIdx runs again or not.
+    if(!returned)
+      job->numPoolThreadsLent -= 1;
+    else if(!job->isClosed)
+      job->unstartedThreadIdxs.push_back(threadIdx);
+    job->numPoolThreadsInTask -= 1;
+    if(!job->isClosed)
+      rebalance();
+    poolThreadLeftCondVar.notify_all();
+    workAvailableCondVar.notify_all();
+  }
+}
+
+bool SearchThreadPool::shouldReturn(Job* job) {
+  if(job->numExcessThreads.load(std::memory_order_acquire) <= 0)
+    return false;
+  std::lock_guard<std::mutex> lock(mutex);
+  if(job->numPoolThreadsLent <= job->targetNumPoolThreads)
+    return false;
+  job->numPoolThreadsLent -= 1;
+  job->numExcessThreads.store(std::max(0, job->numPoolThreadsLent - job->targetNumPoolThreads), std::memory_order_release);
+  numThreadsReturned += 1;
+  workAvailableCondVar.notify_all();
+  return true;
+}
+
+bool SearchThreadPool::shouldCurrentThreadReturn() {
+  if(currentThreadPool == NULL)
+    return false;
+  if(currentThreadReturning)
+    return true;
+  currentThreadReturning = currentThreadPool->shouldReturn((Job*)currentThreadJob);
+  return currentThreadReturning;
+}
+
+void SearchThreadPool::runTask(std::function<void(int)>* task, int numThreadIdxs, bool allThreadIdxsRequired, int64_t priority) {
+  if(numThreadIdxs <= 1 || threads.size() <= 0) {
+    int numToRun = allThreadIdxsRequired ? numThreadIdxs : std::min(numThreadIdxs,1);
+    for(int threadIdx = 0; threadIdx<numToRun; threadIdx++)
+      (*task)(threadIdx);
+    return;
+  }
+
+  Job job;
+  job.task = task;
+  job.numThreadIdxs = numThreadIdxs;
+  job.priority = priority;
+  for(int threadIdx = numThreadIdxs-1; threadIdx >= 1; threadIdx--)
+    job.unstartedThreadIdxs.push_back(threadIdx);
+  job.isClosed = false;
+  job.numPoolThreadsInTask = 0;
+  job.numPoolThreadsLent = 0;
+  job.targetNumPoolThreads = 0;
+  job.numExcessThreads.store(0, std::memory_order_release);
+  job.firstError = nullptr;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto pos = std::find_if(jobs.begin(), jobs.end(), [&job](const Job* other) { return other->priority < job.priority; });
+    jobs.insert(pos, &job);
+    rebalance();
+  }
+  workAvailableCondVar.notify_all();
+
+  std::exception_ptr callerError = nullptr;
+  try {
+    (*task)(0);
+    //Run whatever no pool thread has taken
+    while(allThreadIdxsRequired) {
+      int threadIdx;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(job.unstartedThreadIdxs.size() <= 0)
+          break;
+        threadIdx = job.unstartedThreadIdxs.back();
+        job.unstartedThreadIdxs.pop_back();
+      }
+      (*task)(threadIdx);
+    }
+  }
+  catch(...) {
+    callerError = std::current_exception();
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    job.isClosed = true;
+    job.unstartedThreadIdxs.clear();
+    jobs.erase(std::find(jobs.begin(), jobs.end(), &job));
+    rebalance();
+    workAvailableCondVar.notify_all();
+    while(job.numPoolThreadsInTask > 0)
+      poolThreadLeftCondVar.wait(lock);
+  }
+
+  if(callerError != nullptr)
+    std::rethrow_exception(callerError);
+  if(job.firstError != nullptr)
+    std::rethrow_exception(job.firstError);
+}
@@ -0,0 +1,80 @@
+#ifndef SEARCH_SEARCHTHREADPOOL_H_
+#define SEARCH_SEARCHTHREADPOOL_H_
+
+#include <exception>
+#include <functional>
+#include <vector>
+
+#include "../core/global.h"
+#include "../core/multithread.h"
+
+//A set of search threads shared by many Searches, lent out by priority, instead of each Search spawning its own.
+//
+//A caller runs a task as a set of threadIdxs, running threadIdx 0 itself while pool threads that are lent to it run the
+//others. Lending is bounded so that callers plus lent threads never number more than maxTotalThreads. Among the tasks
+//currently running, threads are lent to the highest priority first, split as evenly as possible between tasks of equal
+//priority. Since every caller is a thread too, each running task always has at least one.
+//
+//Tasks run this way must be correct however many of their threadIdxs actually run concurrently, including all of them
+//one after another on the caller. Tasks that don't need every threadIdx to run (namely, search loops, where any thread
+//may do any playout) can also grow and shrink mid-task: threads freed by other tasks finishing join in, and threads
+//wanted by a higher priority task that has just started leave once shouldCurrentThreadReturn says so.
+struct SearchThreadPool {
+  SearchThreadPool(int maxTotalThreads);
+  ~SearchThreadPool();
+
+  SearchThreadPool(const SearchThreadPool&) = delete;
+  SearchThreadPool& operator=(const SearchThreadPool&) = delete;
+
+  int getMaxTotalThreads() const;
+
+  //Call (*task)(threadIdx) for threadIdx in [0,numThreadIdxs), and return once they are done. Threadsafe.
+  //If allThreadIdxsRequired, every threadIdx is run, with the caller running whatever no pool thread got to.
+  //Else threadIdxs that no pool thread has started by the time the caller finishes threadIdx 0 are skipped.
+  //Rethrows the first exception from any thread, after all threads have left the task.
+  void runTask(std::function<void(int)>* task, int numThreadIdxs, bool allThreadIdxsRequired, int64_t priority);
+
+  //For a task that doesn't require all threadIdxs to run. True if the current thread is one lent by a pool to that task
+  //and the pool now wants it back, in which case the task should return soon. Once this returns true for a thread,
+  //it will keep doing so until the thread leaves the task.
+  static bool shouldCurrentThreadReturn();
+
+  //Number of times pool threads were taken back from a task before it finished
+  int64_t getNumThreadsReturned() const;
+
+ private:
+  struct Job {
+    std::function<void(int)>* task;
+    int numThreadIdxs;
+    int64_t priority;
+    //Everything below is protected by the pool mutex, other than numExcessThreads which may be read without it
+    //Popped from the back, so lowest threadIdx first
+    std::vector<int> unstartedThreadIdxs;
+    bool isClosed;
+    //Pool threads in the task, counting those asked to leave that haven't yet
+    int numPoolThreadsInTask;
+    //Pool threads in the task that count towards what it is lent
+    int numPoolThreadsLent;
+    int targetNumPoolThreads;
+    std::atomic<int> numExcessThreads;
+    std::exception_ptr firstError;
+  };
+
+  const int maxTotalThreads;
+  std::vector<std::thread> threads;
+
+  mutable std::mutex mutex;
+  std::condition_variable workAvailableCondVar;
+  std::condition_variable poolThreadLeftCondVar;
+  bool shouldStop;
+  //Running jobs, highest priority first, earliest first among equal priority
+  std::vector<Job*> jobs;
+  int64_t numThreadsReturned;
+
+  void rebalance();
+  Job* findJobWantingThread();
+  void runLoop();
+  bool shouldReturn(Job* job);
+};
+
+#endif  // SEARCH_SEARCHTHREADPOOL_H_
@@ -26,21 +26,107 @@ double Search::computeUpperBoundVisitsLeftDueToTime(
     return 1e30;
   double timeThoughtSoFar = effectiveSearchTimeCarriedOver + timeUsed;
   double timeLeftPlanned = plannedTimeLimit - timeUsed;
-  //Require at least a tenth of a second of search to begin to trust an estimate of visits/time.
-  if(timeThoughtSoFar < 0.1)
-    return 1e30;
+  //Require at least a tenth of a second of search to begin to trust an estimate of visits/time from this search.
+  //Before that, go by the rate measured over recent searches, if any and if using the hex time model.
+  if(timeThoughtSoFar < 0.1) {
+    if(!searchParams.estimateTurnsLeftFromPosition)
+      return 1e30;
+    double playoutsPerSecond = getMeasuredPlayoutsPerSecond();
+    if(playoutsPerSecond <= 0)
+      return 1e30;
+    return ceil(playoutsPerSecond * std::max(0.0, timeLeftPlanned) + searchParams.numThreads-1);
+  }
 
   double proportionOfTimeThoughtLeft = timeLeftPlanned / timeThoughtSoFar;
   return ceil(proportionOfTimeThoughtLeft * rootVisits + searchParams.numThreads-1);
 }
 
+bool Search::isBestRootMoveDecided(double upperBoundVisitsLeft) const {
+  if(rootNode == NULL || upperBoundVisitsLeft >= 1e29)
+    return false;
+  //With temperature, the move is sampled from the whole visit distribution, which more visits still change
+  double chosenMoveTemperature = interpolateEarly(
+    searchParams.chosenMoveTemperatureHalflife, searchParams.chosenMoveTemperatureEarly, searchParams.chosenMoveTemperature
+  );
+  if(chosenMoveTemperature > 0.0)
+    return false;
+
+  int childrenCapacity;
+  const SearchChildPointer* children = rootNode->getChildren(childrenCapacity);
+  int bestIdx = -1;
+  int64_t bestVisits = 0;
+  int64_t secondBestVisits = 0;
+  int numChildren = 0;
+  for(int i = 0; i<childrenCapacity; i++) {
+    const SearchNode* child = children[i].getIfAllocated();
+    if(child == NULL)
+      break;
+    numChildren++;
+    int64_t edgeVisits = children[i].getEdgeVisits();
+    if(edgeVisits > bestVisits) {
+      secondBestVisits = bestVisits;
+      bestVisits = edgeVisits;
+      bestIdx = i;
+    }
+    else if(edgeVisits > secondBestVisits)
+      secondBestVisits = edgeVisits;
+  }
+  if(bestIdx < 0 || secondBestVisits + upperBoundVisitsLeft >= bestVisits)
+    return false;
+  if(!searchParams.useLcbForSelection)
+    return true;
+
+  //The move played is the one with the best LCB among children with enough visits, so also require that to be the visit
+  //leader, and that no other child that could get enough visits in time has a confidence interval reaching up to its LCB.
+  //Visits stand in for weights here, as in the visit check above.
+  const SearchNode* bestChild = children[bestIdx].getIfAllocated();
+  double bestLcb;
+  double bestRadius;
+  getSelfUtilityLCBAndRadius(*rootNode,bestChild,bestVisits,children[bestIdx].getMoveLocRelaxed(),bestLcb,bestRadius);
+  double minVisitsForLcb = std::max((double)MIN_VISITS_FOR_LCB, searchParams.minVisitPropForLCB * bestVisits);
+  for(int i = 0; i<numChildren; i++) {
+    if(i == bestIdx)
+      continue;
+    const SearchNode* child = children[i].getIfAllocated();
+    int64_t edgeVisits = children[i].getEdgeVisits();
+    if(edgeVisits + upperBoundVisitsLeft < minVisitsForLcb)
+      continue;
+    if(edgeVisits <= 0)
+      return false;
+    double lcb;
+    double radius;
+    getSelfUtilityLCBAndRadius(*rootNode,child,edgeVisits,children[i].getMoveLocRelaxed(),lcb,radius);
+    if(lcb + 2.0 * radius >= bestLcb)
+      return false;
+  }
+  return true;
+}
+
+double Search::getMeasuredPlayoutsPerSecond() const {
+  if(recentPlayoutSecondsSum <= 0)
+    return 0.0;
+  return recentPlayoutsSum / recentPlayoutSecondsSum;
+}
+
+double Search::estimateGameTurnsLeftForTime() const {
+  if(!searchParams.estimateTurnsLeftFromPosition)
+    return -1.0;
+  double nnVarTimeLeft = -1.0;
+  if(rootNode != NULL) {
+    const NNOutput* nnOutput = rootNode->getNNOutput();
+    if(nnOutput != NULL)
+      nnVarTimeLeft = nnOutput->varTimeLeft;
+  }
+  return TimeControls::estimateHexTurnsLeft(rootBoard,nnVarTimeLeft);
+}
+
 double Search::recomputeSearchTimeLimit(
   const TimeControls& tc, double timeUsed, double searchFactor, int64_t rootVisits
 ) {
   double tcMin;
   double tcRec;
   double tcMax;
-  tc.getTime(rootBoard,rootHistory,searchParams.lagBuffer,tcMin,tcRec,tcMax);
+  tc.getTime(rootBoard,rootHistory,searchParams.lagBuffer,estimateGameTurnsLeftForTime(),tcMin,tcRec,tcMax);
 
   tcRec *= searchParams.overallocateTimeFactor;
 
@@ -42,7 +42,7 @@ void Search::addLeafValue(
   double weightSq = weight * weight;
 
   if(assumeNoExistingWeight) {
-    while(node.statsLock.test_and_set(std::memory_order_acquire));
+    beginNodeStatsWrite(node);
     node.stats.winLossValueAvg.store(winLossValue,std::memory_order_release);
     node.stats.noResultValueAvg.store(noResultValue,std::memory_order_release);
     node.stats.scoreMeanAvg.store(scoreMean,std::memory_order_release);
@@ -53,7 +53,7 @@ void Search::addLeafValue(
     node.stats.weightSqSum.store(weightSq,std::memory_order_release);
     node.stats.weightSum.store(weight,std::memory_order_release);
     int64_t oldVisits = node.stats.visits.fetch_add(1,std::memory_order_release);
-    node.statsLock.clear(std::memory_order_release);
+    node.stats.endWrite();
     // This should only be possible in the extremely rare case that we transpose to a terminal node from a non-terminal node probably due to
     // a hash collision, or that we have a graph history interaction that somehow changes whether a particular path ends the game or not, despite
     // our simpleRepetitionBoundGt logic... such that the node managed to get visits as a terminal node despite not having an nn eval. There's
@@ -63,7 +63,7 @@ void Search::addLeafValue(
     }
   }
   else {
-    while(node.statsLock.test_and_set(std::memory_order_acquire));
+    beginNodeStatsWrite(node);
     double oldWeightSum = node.stats.weightSum.load(std::memory_order_relaxed);
     double newWeightSum = oldWeightSum + weight;
 
@@ -77,7 +77,7 @@ void Search::addLeafValue(
     node.stats.weightSqSum.store(node.stats.weightSqSum.load(std::memory_order_relaxed) + weightSq,std::memory_order_release);
     node.stats.weightSum.store(newWeightSum,std::memory_order_release);
     node.stats.visits.fetch_add(1,std::memory_order_release);
-    node.statsLock.clear(std::memory_order_release);
+    node.stats.endWrite();
   }
 }
 
@@ -312,8 +312,7 @@ void Search::recomputeNodeStats(SearchNode& node, SearchThread& thread, int numV
   utilityAvg += getPatternBonus(node.patternBonusHash,getOpp(node.nextPla));
   utilitySqAvg = utilitySqAvg + (utilityAvg * utilityAvg - oldUtilityAvg * oldUtilityAvg);
 
-  //TODO statslock may be unnecessary now with the dirtyCounter mechanism?
-  while(node.statsLock.test_and_set(std::memory_order_acquire));
+  beginNodeStatsWrite(node);
   node.stats.winLossValueAvg.store(winLossValueAvg,std::memory_order_release);
   node.stats.noResultValueAvg.store(noResultValueAvg,std::memory_order_release);
   node.stats.scoreMeanAvg.store(scoreMeanAvg,std::memory_order_release);
@@ -324,7 +323,16 @@ void Search::recomputeNodeStats(SearchNode& node, SearchThread& thread, int numV
   node.stats.weightSqSum.store(weightSqSum,std::memory_order_release);
   node.stats.weightSum.store(weightSum,std::memory_order_release);
   node.stats.visits.fetch_add(numVisitsToAdd,std::memory_order_release);
-  node.statsLock.clear(std::memory_order_release);
+  node.stats.endWrite();
+}
+
+void Search::beginNodeStatsWrite(SearchNode& node) {
+  int64_t numSpins = node.stats.beginWrite();
+  if(numSpins > 0) {
+    lastSearchStatsWriteSpins.fetch_add(numSpins,std::memory_order_relaxed);
+    if(&node == rootNode)
+      lastSearchRootStatsWriteSpins.fetch_add(numSpins,std::memory_order_relaxed);
+  }
 }
 
 void Search::downweightBadChildrenAndNormalizeWeight(
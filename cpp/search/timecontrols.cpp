@@ -104,6 +104,10 @@ TimeControls TimeControls::canadianOrByoYomiTime(
 }
 
 std::string TimeControls::toDebugString(const Board& board, const BoardHistory& hist, double lagBuffer) const {
+  return toDebugString(board,hist,lagBuffer,-1.0);
+}
+
+std::string TimeControls::toDebugString(const Board& board, const BoardHistory& hist, double lagBuffer, double approxGameTurnsLeft) const {
   std::ostringstream out;
   out << "originalMainTime " << originalMainTime;
   if(increment != 0)
@@ -131,7 +135,9 @@ std::string TimeControls::toDebugString(const Board& board, const BoardHistory&
   double minTime;
   double recommendedTime;
   double maxTime;
-  getTime(board,hist,lagBuffer,minTime,recommendedTime,maxTime);
+  getTime(board,hist,lagBuffer,approxGameTurnsLeft,minTime,recommendedTime,maxTime);
+  if(approxGameTurnsLeft > 0)
+    out << " approxGameTurnsLeft " << approxGameTurnsLeft;
   out << " minRecMax " << minTime << " " << recommendedTime << " " << maxTime;
 
   //Rounded time limit recommendation at the start of search
@@ -181,17 +187,52 @@ static double applyLagBuffer(double time, double lagBuffer) {
     return time - lagBuffer;
 }
 
+double TimeControls::estimateHexTurnsLeft(const Board& board, double nnVarTimeLeft) {
+  int boardArea = board.x_size * board.y_size;
+  int numStonesOnBoard = board.numStonesOnBoard();
+  double numEmpty = std::max(1, boardArea - numStonesOnBoard);
+
+  //Hex games between strong players are usually decided with somewhat under half the board filled, and once past that,
+  //the rest tends to be a fight over the last few open areas, so assume a fraction of the empty cells.
+  double typicalGameLength = HEX_TYPICAL_GAME_LENGTH_FRACTION * boardArea;
+  double turnsLeft = std::max(typicalGameLength - numStonesOnBoard, 0.15 * numEmpty + 4.0);
+  //The net knows much better than the stone count whether this particular game is nearly decided.
+  //Split the difference rather than trusting it outright, since it's noisy from one position to the next.
+  if(nnVarTimeLeft > 0)
+    turnsLeft = sqrt(turnsLeft * std::min((double)nnVarTimeLeft, numEmpty));
+  return std::max(1.0, std::min(turnsLeft, numEmpty));
+}
+
 void TimeControls::getTime(const Board& board, const BoardHistory& hist, double lagBuffer, double& minTime, double& recommendedTime, double& maxTime) const {
+  getTime(board,hist,lagBuffer,-1.0,minTime,recommendedTime,maxTime);
+}
+
+void TimeControls::getTime(
+  const Board& board, const BoardHistory& hist, double lagBuffer, double approxGameTurnsLeft,
+  double& minTime, double& recommendedTime, double& maxTime
+) const {
   (void)hist;
 
   int boardArea = board.x_size * board.y_size;
   int numStonesOnBoard = board.numStonesOnBoard();
 
-  //Very crude way to estimate game progress
   double approxTurnsLeftAbsolute;
   double approxTurnsLeftIncrement; //Turns left in which we plan to spend our main time
   double approxTurnsLeftByoYomi;   //Turns left in which we plan to spend our main time
-  {
+  if(approxGameTurnsLeft > 0) {
+    //Allow for the game running longer than expected, by more the worse it is to run short of time,
+    //in the same proportions as the crude estimate below.
+    approxTurnsLeftAbsolute = std::max(1.9 * approxGameTurnsLeft, 8.0);
+    approxTurnsLeftIncrement = std::max(1.5 * approxGameTurnsLeft, 6.0);
+    approxTurnsLeftByoYomi = std::max(approxGameTurnsLeft, 2.0);
+
+    //Multiply by 0.5 since we only make half the moves
+    approxTurnsLeftAbsolute *= 0.5;
+    approxTurnsLeftIncrement *= 0.5;
+    approxTurnsLeftByoYomi *= 0.5;
+  }
+  //Very crude way to estimate game progress
+  else {
     double typicalGameLengthToAllowForAbsolute = 0.95 * boardArea + 20.0;
     double typicalGameLengthToAllowForIncrement = 0.75 * boardArea + 15.0;
     double typicalGameLengthToAllowForByoYomi = 0.50 * boardArea + 10.0;
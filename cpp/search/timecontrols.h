@@ -59,6 +59,20 @@ struct TimeControls {
   //recommendedTime - recommended mean time to search
   //maxTime - very bad to go over this time, possibly immediately losing
   void getTime(const Board& board, const BoardHistory& hist, double lagBuffer, double& minTime, double& recommendedTime, double& maxTime) const;
+  //Same, but planning on the game lasting about approxGameTurnsLeft more turns by both players, if positive,
+  //instead of going by a crude estimate from the number of stones on the board.
+  void getTime(
+    const Board& board, const BoardHistory& hist, double lagBuffer, double approxGameTurnsLeft,
+    double& minTime, double& recommendedTime, double& maxTime
+  ) const;
+
+  //Estimate of the number of turns by both players left in a game of hex, which ends once a side connects rather than
+  //when the board fills up. Goes by the number of empty cells, and also by the neural net's varTimeLeft for the position
+  //if it's positive.
+  static double estimateHexTurnsLeft(const Board& board, double nnVarTimeLeft);
+  //Fraction of the board assumed filled when a game is decided, absent anything better. benchmarktimecontrols -sgfs
+  //reports what it actually is for a set of games.
+  static constexpr double HEX_TYPICAL_GAME_LENGTH_FRACTION = 0.45;
 
   //If we'd think for a given time limit and actually it would lose time to stop at this limit, then bump the limit up
   //This is used for not partial-wasting byo yomi periods.
@@ -66,6 +80,7 @@ struct TimeControls {
 
   std::string toDebugString() const;
   std::string toDebugString(const Board& board, const BoardHistory& hist, double lagBuffer) const;
+  std::string toDebugString(const Board& board, const BoardHistory& hist, double lagBuffer, double approxGameTurnsLeft) const;
 };
 
 #endif  // SEARCH_TIMECONTROLS_H_